@@ -0,0 +1,24 @@
+source ./conf.sh
+
+# compare the throughput and p99 of set/get with executor-store-affinity
+# off and on, usage: affinity_bench.sh [clients] [requests] [pipeline]
+clientnum=${1:-100}
+reqnum=${2:-2000000}
+pipeline=${3:-1}
+cli=$bin_dir/redis-cli
+log="affinity_bench.log"
+
+for mode in no yes
+do
+    $cli -h $benchip -p $benchport $cli_pw config set executor-store-affinity $mode
+    for t in set get
+    do
+        ./redis-benchmark -h $benchip -p $benchport -c $clientnum -n $reqnum \
+            -r 100000000 -d 128 -P $pipeline -t $t $bench_pw > $log
+        qps=`grep "requests per second" $log | awk '{print $1}'`
+        # the first bucket of the latency distribution reaching 99%
+        p99=`grep "% <=" $log | awk '{sub("%", "", $1); if ($1 >= 99) {print $3; exit}}'`
+        echo affinity:$mode test:$t qps:$qps p99_ms:$p99
+    done
+done
+$cli -h $benchip -p $benchport $cli_pw info stats | grep executor_switches
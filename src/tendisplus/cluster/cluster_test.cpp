@@ -2153,12 +2153,13 @@ TEST(Cluster, ConvergenceRate) {
   servers.clear();
 }
 
-TEST(Cluster, MigrateTTLIndex) {
+void testMigrateTTLIndex(bool bySst, bool byFrame = false) {
   uint32_t nodeNum = 2;
   uint32_t migrateSlot = 8373;
   uint32_t startPort = 19000;
 
-  LOG(INFO) << "MigrateTTLIndex begin.";
+  LOG(INFO) << "MigrateTTLIndex begin, bySst:" << bySst
+            << " byFrame:" << byFrame;
   std::vector<std::string> dirs;
   for (uint32_t i = 0; i < nodeNum; ++i) {
     dirs.push_back("node" + to_string(i));
@@ -2178,6 +2179,10 @@ TEST(Cluster, MigrateTTLIndex) {
     uint32_t nodePort = startPort + index++;
     servers.emplace_back(std::move(makeClusterNode(dir, nodePort, storeCnt)));
   }
+  // the receiver asks for the sst files
+  servers[1]->getParams()->migrateBySst = bySst;
+  servers[1]->getParams()->migrateBatchFrame = byFrame;
+  servers[1]->getParams()->migrateFrameCompress = byFrame;
 
   auto ctx1 = std::make_shared<asio::io_context>();
   auto sess1 = makeSession(servers[0], ctx1);
@@ -2255,6 +2260,18 @@ TEST(Cluster, MigrateTTLIndex) {
   servers.clear();
 }
 
+TEST(Cluster, MigrateTTLIndex) {
+  testMigrateTTLIndex(false);
+}
+
+TEST(Cluster, MigrateTTLIndexBySst) {
+  testMigrateTTLIndex(true);
+}
+
+TEST(Cluster, MigrateTTLIndexByFrame) {
+  testMigrateTTLIndex(false, true);
+}
+
 TEST(Cluster, ChangeMaster) {
   uint32_t nodeNum = 3;
   uint32_t startPort = 15200;
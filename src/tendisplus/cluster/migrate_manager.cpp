@@ -440,6 +440,24 @@ bool MigrateManager::slotsInTask(const SlotsBitmap& bitMap) {
   return false;
 }
 
+// the records and bytes per second of a snapshot, till now if it is not over
+static std::string snapshotRate(uint64_t records,
+                                uint64_t bytes,
+                                uint64_t startMs,
+                                uint64_t endMs) {
+  std::stringstream ss;
+  if (startMs == 0) {
+    ss << "records/s:0 bytes/s:0";
+    return ss.str();
+  }
+  if (endMs < startMs) {
+    endMs = msSinceEpoch();
+  }
+  uint64_t ms = std::max(endMs - startMs, uint64_t(1));
+  ss << "records/s:" << records * 1000 / ms << " bytes/s:" << bytes * 1000 / ms;
+  return ss.str();
+}
+
 std::string MigrateSendTask::toString() {
   std::lock_guard<std::mutex> lk(_mutex);
   std::stringstream ss;
@@ -500,6 +518,12 @@ std::string MigrateSendTask::toString() {
       << "beginTime: " << beginTime << "\n"
       << "runTime: " << taskTime << "ms \n"
       << "snapShotTime: " << snapshotTime << "ms \n"
+      << "snapShotRate: "
+      << snapshotRate(_sender->getSnapshotNum(),
+                      _sender->getSnapshotBytes(),
+                      snapStart,
+                      snapshotEnd)
+      << "\n"
       << "binlogTime: " << binlogTime << "ms \n"
       << "lockTime: " << lockTime << "ms \n"
       << "binlogDelay: " << _sender->getBinlogDelay() << "ms \n"
@@ -551,6 +575,12 @@ std::string MigrateReceiveTask::toString() {
       << "beginTime: " + beginTime << "\n"
       << "runTime: " << taskTime << "ms \n"
       << "snapShotTime: " << snapshotTime << "ms \n"
+      << "snapShotRate: "
+      << snapshotRate(_receiver->getSnapshotNum(),
+                      _receiver->getSnapshotBytes(),
+                      snapStart,
+                      snapshotEnd)
+      << "\n"
       << "binlogTime: " << binlogTime << "ms \n"
       << "State: " << taskState << "\n"
       << "RunningState: " << runningState << "\n"
@@ -991,7 +1021,8 @@ void MigrateManager::dstReadyMigrate(asio::ip::tcp::socket sock,
                                      const std::string& slotsArg,
                                      const std::string& StoreidArg,
                                      const std::string& nodeidArg,
-                                     const std::string& taskidArg) {
+                                     const std::string& taskidArg,
+                                     const std::string& modeArg) {
   std::shared_ptr<BlockingTcpClient> client =
     std::move(_svr->getNetwork()->createBlockingClient(std::move(sock),
                                                        64 * 1024 * 1024));
@@ -1022,6 +1053,7 @@ void MigrateManager::dstReadyMigrate(asio::ip::tcp::socket sock,
     _migrateSendTaskMap[taskidArg]->_sender->setClient(client);
     _migrateSendTaskMap[taskidArg]->_sender->setDstNode(nodeidArg);
     _migrateSendTaskMap[taskidArg]->_sender->setDstStoreid(dstStoreid);
+    _migrateSendTaskMap[taskidArg]->_sender->setMode(modeArg);
     _migrateSendTaskMap[taskidArg]->_sender->start();
     _migrateSendTaskMap[taskidArg]->_state = MigrateSendState::START;
     LOG(INFO) << "sender task marked start on taskid:" << taskidArg;
@@ -1549,6 +1581,15 @@ Expected<std::string> MigrateManager::getMigrateInfo() {
 
     std::string taskSizeInfo =
       "running sender task num:" + std::to_string(_migrateSendTaskMap.size());
+    for (auto& iter : _migrateSendTaskMap) {
+      auto& sender = iter.second->_sender;
+      taskSizeInfo += " [" + iter.first + " " +
+        snapshotRate(sender->getSnapshotNum(),
+                     sender->getSnapshotBytes(),
+                     sender->getSnapShotStartTime(),
+                     sender->getSnapShotEndTime()) +
+        "]";
+    }
     std::string succcInfo =
       "success sender task num:" + std::to_string(_succSenderTask.size());
     std::string failInfo =
@@ -1582,6 +1623,15 @@ Expected<std::string> MigrateManager::getMigrateInfo() {
 
     std::string taskSizeInfo2 = "running receiver task num:" +
       std::to_string(_migrateReceiveTaskMap.size());
+    for (auto& iter : _migrateReceiveTaskMap) {
+      auto& receiver = iter.second->_receiver;
+      taskSizeInfo2 += " [" + iter.first + " " +
+        snapshotRate(receiver->getSnapshotNum(),
+                     receiver->getSnapshotBytes(),
+                     receiver->getSnapShotStartTime(),
+                     receiver->getSnapShotEndTime()) +
+        "]";
+    }
     std::string succcInfo2 =
       "success receiver task num:" + std::to_string(_succReceTask.size());
     std::string failInfo2 =
@@ -186,11 +186,14 @@ class MigrateManager {
                    const std::string& taskid,
                    const std::shared_ptr<pTask> task);
 
+  // modeArg is the way the receiver asks for the snapshot, see
+  // ChunkMigrateSender::setMode()
   void dstReadyMigrate(asio::ip::tcp::socket sock,
                        const std::string& chunkidArg,
                        const std::string& StoreidArg,
                        const std::string& nodeidArg,
-                       const std::string& taskidArg);
+                       const std::string& taskidArg,
+                       const std::string& modeArg = "");
 
   void dstPrepareMigrate(asio::ip::tcp::socket sock,
                          const std::string& chunkidArg,
@@ -2,9 +2,17 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
+#include <fstream>
 #include "glog/logging.h"
+#include "snappy.h"
 #include "tendisplus/cluster/migrate_receiver.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/replication/repl_manager.h"
+#include "tendisplus/server/index_manager.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
 
@@ -21,6 +29,7 @@ ChunkMigrateReceiver::ChunkMigrateReceiver(
     _taskid(taskid),
     _slots(slots),
     _snapshotKeyNum(0),
+    _snapshotBytes(0),
     _snapshotStartTime(0),
     _snapshotEndTime(0),
     _binlogEndTime(0),
@@ -37,6 +46,20 @@ Status ChunkMigrateReceiver::receiveSnapshot() {
   std::string bitmapStr = _slots.to_string();
   ss << "readymigrate " << bitmapStr << " " << _storeid << " " << nodename
      << " " << _taskid;
+  // the ingested files have no binlog, which the slaves need, so no slave
+  // can attach the store till the files are ingested
+  auto replMgr = _svr->getReplManager();
+  bool bySst = _cfg->migrateBySst && replMgr->beginSstIngest(_storeid);
+  auto ingestGuard = MakeGuard([bySst, replMgr, this] {
+    if (bySst) {
+      replMgr->endSstIngest(_storeid);
+    }
+  });
+  if (bySst) {
+    ss << " sst";
+  } else if (_cfg->migrateBatchFrame) {
+    ss << (_cfg->migrateFrameCompress ? " frame,snappy" : " frame");
+  }
   Status s = _client->writeLine(ss.str());
   if (!s.ok()) {
     LOG(ERROR) << "readymigrate srcDb failed:" << s.toString();
@@ -59,11 +82,33 @@ Status ChunkMigrateReceiver::receiveSnapshot() {
   setStartTime(timePointRepr(SCLOCK::now()));
   uint32_t timeoutSec = 5;
   uint32_t readNum = 0;
+  std::string frame;
+  const std::string sstDir = _dbWithLock->store->dbPath() + "/" +
+    _dbWithLock->store->dbId() + "_migrate_in_" + _taskid;
+  std::vector<std::string> sstFiles;
+  // the metas with ttl of the files, whose ttl indexes are written after
+  // the files are ingested
+  std::vector<std::pair<std::string, std::string>> ttlMetas;
+  if (bySst) {
+    try {
+      filesystem::remove_all(sstDir);
+      filesystem::create_directories(sstDir);
+    } catch (const std::exception& ex) {
+      return {ErrorCodes::ERR_INTERNAL, ex.what()};
+    }
+  }
+  auto guard = MakeGuard([bySst, &sstDir] {
+    if (bySst) {
+      std::error_code ec;
+      filesystem::remove_all(sstDir, ec);
+    }
+  });
   while (true) {
     if (!isRunning()) {
       LOG(ERROR) << "stop receiver task on taskid:" << _taskid;
       return {ErrorCodes::ERR_INTERNAL, "stop running"};
     }
+    _snapshotKeyNum.store(readNum, std::memory_order_relaxed);
 
     SyncReadData(exptData, 1, timeoutSec);
     if (!exptData.ok()) {
@@ -96,22 +141,130 @@ Status ChunkMigrateReceiver::receiveSnapshot() {
         return s;
       }
       readNum++;
+      _snapshotBytes.fetch_add(1 + 2 * sizeof(uint32_t) + keylen + valuelen,
+                               std::memory_order_relaxed);
     } else if (exptData.value()[0] == '1') {
       SyncWriteData("+OK")
     } else if (exptData.value()[0] == '2') {
       SyncWriteData("+OK")
     } else if (exptData.value()[0] == '3') {
+      if (!sstFiles.empty()) {
+        auto s = _dbWithLock->store->ingestExternalFiles(sstFiles);
+        if (!s.ok()) {
+          return s;
+        }
+        LOG(INFO) << "migrate ingest sst files:" << sstFiles.size()
+                  << " taskid:" << _taskid;
+      }
+      for (const auto& meta : ttlMetas) {
+        auto s = supplySetKV(meta.first, meta.second, true);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       SyncWriteData("+OK") break;
+    } else if (exptData.value()[0] == '4' && bySst) {
+      std::string file =
+        sstDir + "/" + std::to_string(sstFiles.size()) + ".sst";
+      auto keys = receiveSstFile(file);
+      if (!keys.ok()) {
+        LOG(ERROR) << "receive sst file:" << file
+                   << " failed:" << keys.status().toString();
+        return keys.status();
+      }
+      sstFiles.push_back(file);
+      readNum += keys.value();
+      SyncWriteData("+OK")
+    } else if (exptData.value()[0] == '5' && bySst) {
+      SyncReadData(keylenData, 4, timeoutSec);
+      uint32_t keylen =
+        *reinterpret_cast<const uint32_t*>(keylenData.value().c_str());
+      SyncReadData(keyData, keylen, timeoutSec);
+      SyncReadData(valuelenData, 4, timeoutSec);
+      uint32_t valuelen =
+        *reinterpret_cast<const uint32_t*>(valuelenData.value().c_str());
+      SyncReadData(valueData, valuelen, timeoutSec);
+      ttlMetas.emplace_back(keyData.value(), valueData.value());
+      _snapshotBytes.fetch_add(1 + 2 * sizeof(uint32_t) + keylen + valuelen,
+                               std::memory_order_relaxed);
+    } else if (exptData.value()[0] == '6') {
+      // compressed + records + length, see ChunkMigrateSender::sendFrame()
+      SyncReadData(hdrData, 9, timeoutSec);
+      const char* hdr = hdrData.value().c_str();
+      uint32_t records = *reinterpret_cast<const uint32_t*>(hdr + 1);
+      uint32_t len = *reinterpret_cast<const uint32_t*>(hdr + 5);
+      SyncReadData(frameData, len, timeoutSec);
+      const std::string* data = &frameData.value();
+      if (hdr[0]) {
+        if (!snappy::Uncompress(frameData.value().data(), len, &frame)) {
+          LOG(ERROR) << "uncompress frame failed, taskid:" << _taskid;
+          return {ErrorCodes::ERR_INTERNAL, "uncompress frame failed"};
+        }
+        data = &frame;
+      }
+      auto s = supplyFrame(*data, records);
+      if (!s.ok()) {
+        LOG(ERROR) << "supply frame failed:" << s.toString();
+        return s;
+      }
+      readNum += records;
+      _snapshotBytes.fetch_add(10 + len, std::memory_order_relaxed);
+      SyncWriteData("+OK")
+    } else {
+      LOG(ERROR) << "migrate snapshot invalid data type:"
+                 << exptData.value()[0] << " taskid:" << _taskid;
+      return {ErrorCodes::ERR_INTERNAL, "invalid data type"};
     }
   }
-  LOG(INFO) << "migrate snapshot transfer done, readnum:" << readNum;
+  LOG(INFO) << "migrate snapshot transfer done, readnum:" << readNum
+            << " bySst:" << bySst;
   _snapshotKeyNum.store(readNum, std::memory_order_relaxed);
   setSnapShotEndTime(msSinceEpoch());
   return {ErrorCodes::ERR_OK, ""};
 }
 
+// keys + size + the content of file + crc64 of the content, see
+// ChunkMigrateSender::sendSstFile(). It returns the number of keys.
+Expected<uint64_t> ChunkMigrateReceiver::receiveSstFile(
+  const std::string& file) {
+  uint32_t timeoutSec = _cfg->timeoutSecBinlogWaitRsp;
+  SyncReadData(keysData, sizeof(uint64_t), timeoutSec);
+  uint64_t keys = *reinterpret_cast<const uint64_t*>(keysData.value().c_str());
+  SyncReadData(sizeData, sizeof(uint64_t), timeoutSec);
+  uint64_t size = *reinterpret_cast<const uint64_t*>(sizeData.value().c_str());
+  uint64_t remain = size;
+
+  auto myfile = std::ofstream(file, std::ios::out | std::ios::binary);
+  if (!myfile.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open file failed:" + file};
+  }
+  uint64_t crc = 0;
+  while (remain) {
+    uint64_t batchSize = std::min(remain, uint64_t(4 * 1024 * 1024));
+    SyncReadData(exptData, batchSize, timeoutSec);
+    crc = redis_port::crc64(
+      crc,
+      reinterpret_cast<const unsigned char*>(exptData.value().data()),
+      exptData.value().size());
+    myfile.write(exptData.value().data(), exptData.value().size());
+    if (myfile.bad()) {
+      return {ErrorCodes::ERR_INTERNAL,
+              "write file:" + file + " failed:" + strerror(errno)};
+    }
+    remain -= batchSize;
+  }
+  myfile.close();
+  _snapshotBytes.fetch_add(size, std::memory_order_relaxed);
+  SyncReadData(crcData, sizeof(uint64_t), timeoutSec);
+  if (*reinterpret_cast<const uint64_t*>(crcData.value().c_str()) != crc) {
+    return {ErrorCodes::ERR_INTERNAL, "crc mismatch of file:" + file};
+  }
+  return keys;
+}
+
 Status ChunkMigrateReceiver::supplySetKV(const string& key,
-                                         const string& value) {
+                                         const string& value,
+                                         bool ingested) {
   Expected<RecordKey> expRk = RecordKey::decode(key);
   if (!expRk.ok()) {
     return expRk.status();
@@ -136,37 +289,133 @@ Status ChunkMigrateReceiver::supplySetKV(const string& key,
   }
   std::unique_ptr<Transaction> txn = std::move(eTxn.value());
 
-  Status s = kvstore->setKV(expRk.value(), expRv.value(), txn.get());
+  Status s;
+  if (!ingested) {
+    s = kvstore->setKV(expRk.value(), expRv.value(), txn.get());
+    if (!s.ok()) {
+      LOG(ERROR) << "setKV failed:" << s.toString();
+      return s;
+    }
+  }
+  std::vector<TTLIndex> indexes;
+  s = supplyTTLIndex(expRk.value(), expRv.value(), txn.get(), &indexes);
+  if (!s.ok()) {
+    return s;
+  }
 
+  auto commitStatus = txn->commit();
+  if (!commitStatus.ok()) {
+    return commitStatus.status();
+  }
+  for (const auto& index : indexes) {
+    if (_svr->getIndexMgr()) {
+      _svr->getIndexMgr()->addExpire(_storeid, index);
+    }
+  }
+
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// NOTE(takenliu) TTLIndex's chunkid is different from key's chunkid,
+// so need to recover TTLIndex.
+// only RT_*_META need recover, it's saved as RT_DATA_META in RecordKey
+// if RecordValue's type is RT_KV need ignore recovering.
+Status ChunkMigrateReceiver::supplyTTLIndex(const RecordKey& rk,
+                                            const RecordValue& rv,
+                                            Transaction* txn,
+                                            std::vector<TTLIndex>* indexes) {
+  if (rk.getRecordType() != RecordType::RT_DATA_META ||
+      Command::noExpire() || rv.getTtl() == 0 ||
+      rv.getRecordType() == RecordType::RT_KV) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  // add new index entry
+  TTLIndex n_ictx(
+    rk.getPrimaryKey(), rv.getRecordType(), rk.getDbId(), rv.getTtl());
+  auto s =
+    txn->setKV(n_ictx.encode(), RecordValue(RecordType::RT_TTL_INDEX).encode());
   if (!s.ok()) {
-    LOG(ERROR) << "setKV failed:" << s.toString();
     return s;
   }
-  // NOTE(takenliu) TTLIndex's chunkid is different from key's chunkid,
-  // so need to recover TTLIndex.
-  // only RT_*_META need recover, it's saved as RT_DATA_META in RecordKey
-  // if RecordValue's type is RT_KV need ignore recovering.
-  if (expRk.value().getRecordType() == RecordType::RT_DATA_META) {
-    if (!Command::noExpire() && expRv.value().getTtl() > 0 &&
-        expRv.value().getRecordType() != RecordType::RT_KV) {
-      // add new index entry
-      TTLIndex n_ictx(expRk.value().getPrimaryKey(),
-                      expRv.value().getRecordType(),
-                      expRk.value().getDbId(),
-                      expRv.value().getTtl());
-      s = txn->setKV(n_ictx.encode(),
-                     RecordValue(RecordType::RT_TTL_INDEX).encode());
+  indexes->push_back(n_ictx);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// the records of a frame are written as they are in one transaction, only the
+// metas with ttl are decoded for their ttl indexes
+Status ChunkMigrateReceiver::supplyFrame(const std::string& frame,
+                                         uint32_t records) {
+  PStore kvstore = _dbWithLock->store;
+  auto eTxn = kvstore->createTransaction(nullptr);
+  if (!eTxn.ok()) {
+    LOG(ERROR) << "createTransaction failed:" << eTxn.status().toString();
+    return eTxn.status();
+  }
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+
+  std::vector<TTLIndex> indexes;
+  std::string key;
+  std::string value;
+  size_t offset = 0;
+  auto readField = [&frame, &offset](std::string* field) {
+    uint32_t len = 0;
+    if (frame.size() - offset < sizeof(uint32_t)) {
+      return false;
+    }
+    memcpy(&len, frame.data() + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    if (frame.size() - offset < len) {
+      return false;
+    }
+    field->assign(frame.data() + offset, len);
+    offset += len;
+    return true;
+  };
+  for (uint32_t i = 0; i < records; i++) {
+    if (!readField(&key) || !readField(&value) ||
+        key.size() <= RecordKey::getHdrSize() ||
+        value.size() < RecordValue::minSize()) {
+      return {ErrorCodes::ERR_DECODE, "invalid migrate frame"};
+    }
+    uint32_t slotid = RecordKey::decodeChunkId(key);
+    if (slotid >= CLUSTER_SLOTS || !_slots.test(slotid)) {
+      LOG(ERROR) << "slotid:" << slotid << " is not a member in bitmap";
+      return {ErrorCodes::ERR_INTERNAL, "slotid not match"};
+    }
+    auto s = kvstore->setKV(key, value, txn.get());
+    if (!s.ok()) {
+      LOG(ERROR) << "setKV failed:" << s.toString();
+      return s;
+    }
+    if (RecordKey::decodeType(key) == RecordType::RT_DATA_META &&
+        RecordValue::decodeTtl(value.data(), value.size()) > 0) {
+      auto expRk = RecordKey::decode(key);
+      if (!expRk.ok()) {
+        return expRk.status();
+      }
+      auto expRv = RecordValue::decode(value);
+      if (!expRv.ok()) {
+        return expRv.status();
+      }
+      s = supplyTTLIndex(expRk.value(), expRv.value(), txn.get(), &indexes);
       if (!s.ok()) {
         return s;
       }
     }
   }
+  if (offset != frame.size()) {
+    return {ErrorCodes::ERR_DECODE, "invalid migrate frame"};
+  }
 
   auto commitStatus = txn->commit();
   if (!commitStatus.ok()) {
     return commitStatus.status();
   }
-
+  for (const auto& index : indexes) {
+    if (_svr->getIndexMgr()) {
+      _svr->getIndexMgr()->addExpire(_storeid, index);
+    }
+  }
   return {ErrorCodes::ERR_OK, ""};
 }
 
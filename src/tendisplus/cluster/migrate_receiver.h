@@ -8,6 +8,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/cluster/migrate_manager.h"
 #include "tendisplus/network/blocking_tcp_client.h"
@@ -63,6 +64,10 @@ class ChunkMigrateReceiver {
     return _snapshotKeyNum.load(std::memory_order_relaxed);
   }
 
+  uint64_t getSnapshotBytes() const {
+    return _snapshotBytes.load(std::memory_order_relaxed);
+  }
+
   uint64_t getSnapShotStartTime() const {
     return _snapshotStartTime.load(std::memory_order_relaxed);
   }
@@ -91,7 +96,16 @@ class ChunkMigrateReceiver {
   bool isRunning();
 
  private:
-  Status supplySetKV(const string& key, const string& value);
+  // only the ttl index of the key is written if ingested, see receiveSstFile
+  Status supplySetKV(const string& key,
+                     const string& value,
+                     bool ingested = false);
+  Expected<uint64_t> receiveSstFile(const std::string& file);
+  Status supplyFrame(const std::string& frame, uint32_t records);
+  Status supplyTTLIndex(const RecordKey& rk,
+                        const RecordValue& rv,
+                        Transaction* txn,
+                        std::vector<TTLIndex>* indexes);
   mutable std::mutex _mutex;
   std::shared_ptr<ServerEntry> _svr;
   const std::shared_ptr<ServerParams> _cfg;
@@ -102,6 +116,7 @@ class ChunkMigrateReceiver {
   std::string _taskid;
   std::bitset<CLUSTER_SLOTS> _slots;
   std::atomic<uint64_t> _snapshotKeyNum;
+  std::atomic<uint64_t> _snapshotBytes;
   std::atomic<uint64_t> _snapshotStartTime;
   std::atomic<uint64_t> _snapshotEndTime;
   std::atomic<uint64_t> _binlogEndTime;
@@ -2,17 +2,30 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
+#include <fstream>
 #include <utility>
 #include <vector>
 #include "glog/logging.h"
+#include "snappy.h"
 #include "tendisplus/cluster/migrate_sender.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/replication/repl_util.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/time.h"
 namespace tendisplus {
 
+// the sst files of the snapshot are rolled at the size of a file of the
+// store, and sent in batches of the rate limiter
+static constexpr uint64_t MIGRATE_SST_FILE_SIZE = 64 * 1024 * 1024;
+static constexpr uint64_t MIGRATE_SST_BATCH_SIZE = 4 * 1024 * 1024;
+// '6' + compressed + records + length, see sendFrame()
+static constexpr size_t MIGRATE_FRAME_HDR_SIZE = 10;
+static constexpr size_t MIGRATE_FRAME_SIZE = 1024 * 1024;
+
 ChunkMigrateSender::ChunkMigrateSender(const std::bitset<CLUSTER_SLOTS>& slots,
                                        const std::string& taskid,
                                        std::shared_ptr<ServerEntry> svr,
@@ -42,7 +55,13 @@ ChunkMigrateSender::ChunkMigrateSender(const std::bitset<CLUSTER_SLOTS>& slots,
     _dstIp(""),
     _dstPort(0),
     _dstStoreid(0),
-    _dstNode(nullptr) {}
+    _dstNode(nullptr),
+    _bySst(false),
+    _byFrame(false),
+    _frameCompress(false),
+    _frameRecords(0),
+    _framesInFlight(0),
+    _snapshotBytes(0) {}
 
 Status ChunkMigrateSender::sendChunk() {
   LOG(INFO) << "sendChunk begin on store:" << _storeid
@@ -157,6 +176,22 @@ void ChunkMigrateSender::setDstNode(const std::string nodeid) {
   _dstNode = _clusterState->clusterLookupNode(_nodeid);
 }
 
+void ChunkMigrateSender::setMode(const std::string& mode) {
+  std::stringstream ss(mode);
+  std::string m;
+  while (std::getline(ss, m, ',')) {
+    if (m == "sst") {
+      _bySst = true;
+    } else if (m == "frame") {
+      _byFrame = true;
+    } else if (m == "snappy") {
+      _frameCompress = true;
+    } else if (!m.empty()) {
+      LOG(WARNING) << "unknown migrate mode:" << m << " taskid:" << _taskid;
+    }
+  }
+}
+
 void ChunkMigrateSender::setSenderStatus(MigrateSenderStatus s) {
   _sendstate = s;
 }
@@ -239,7 +274,8 @@ Expected<uint64_t> ChunkMigrateSender::sendRange(Transaction* txn,
     totalWriteNum++;
     uint64_t sendBytes =
       1 + sizeof(uint32_t) + keylen + sizeof(uint32_t) + valuelen;
-    curWriteNum += sendBytes;
+    curWriteLen += sendBytes;
+    _snapshotBytes.fetch_add(sendBytes, std::memory_order_relaxed);
 
     /* *
      * rate limit for migration
@@ -272,6 +308,249 @@ Expected<uint64_t> ChunkMigrateSender::sendRange(Transaction* txn,
   return totalWriteNum;
 }
 
+// the records of the slots are packed into frames as they are stored, without
+// decoding them. The frames may span slots, see sendSnapshot().
+Expected<uint64_t> ChunkMigrateSender::sendRangeByFrame(Transaction* txn,
+                                                        uint32_t begin,
+                                                        uint32_t end) {
+  auto cursor = txn->createSlotsCursor(begin, end);
+  uint64_t totalWriteNum = 0;
+  std::string key;
+  std::string value;
+  while (true) {
+    auto s = cursor->nextRaw(&key, &value);
+    if (s.code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!isRunning()) {
+      LOG(ERROR) << "stop sender send snapshot on taskid:" << _taskid;
+      return {ErrorCodes::ERR_INTERNAL, "stop running"};
+    }
+    if (!s.ok()) {
+      LOG(ERROR) << "snapshot sendRangeByFrame failed storeid:" << _storeid
+                 << " err:" << s.toString();
+      return s;
+    }
+    if (_frameRecords == 0) {
+      _frame.resize(MIGRATE_FRAME_HDR_SIZE);
+    }
+    uint32_t keylen = key.size();
+    uint32_t valuelen = value.size();
+    _frame.append(reinterpret_cast<char*>(&keylen), sizeof(uint32_t));
+    _frame.append(key);
+    _frame.append(reinterpret_cast<char*>(&valuelen), sizeof(uint32_t));
+    _frame.append(value);
+    _frameRecords++;
+    totalWriteNum++;
+    if (_frame.size() >= MIGRATE_FRAME_SIZE) {
+      s = sendFrame();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return totalWriteNum;
+}
+
+// '6' + compressed + records + length + the records, each of them is
+// keylen + key + valuelen + value. The receiver replies +OK when the records
+// are written, and the oldest ack is waited when migrateFrameWindow frames
+// are in flight.
+Status ChunkMigrateSender::sendFrame() {
+  std::string* frame = &_frame;
+  char compressed = 0;
+  if (_frameCompress) {
+    const char* raw = _frame.data() + MIGRATE_FRAME_HDR_SIZE;
+    size_t rawLen = _frame.size() - MIGRATE_FRAME_HDR_SIZE;
+    _compressedFrame.resize(MIGRATE_FRAME_HDR_SIZE +
+                            snappy::MaxCompressedLength(rawLen));
+    size_t len = 0;
+    snappy::RawCompress(
+      raw, rawLen, &_compressedFrame[MIGRATE_FRAME_HDR_SIZE], &len);
+    // the frames not compressible are sent as they are
+    if (len < rawLen) {
+      _compressedFrame.resize(MIGRATE_FRAME_HDR_SIZE + len);
+      frame = &_compressedFrame;
+      compressed = 1;
+    }
+  }
+  uint32_t len = frame->size() - MIGRATE_FRAME_HDR_SIZE;
+  (*frame)[0] = '6';
+  (*frame)[1] = compressed;
+  memcpy(&(*frame)[2], &_frameRecords, sizeof(uint32_t));
+  memcpy(&(*frame)[6], &len, sizeof(uint32_t));
+
+  _svr->getMigrateManager()->requestRateLimit(frame->size());
+  Status s;
+  SyncWriteData(*frame);
+  _snapshotBytes.fetch_add(frame->size(), std::memory_order_relaxed);
+  _frameRecords = 0;
+  if (++_framesInFlight >= std::max(_cfg->migrateFrameWindow, 1U)) {
+    return readFrameAck();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status ChunkMigrateSender::readFrameAck() {
+  SyncReadData(exptData, _OKSTR.length(), _cfg->timeoutSecBinlogWaitRsp);
+  if (exptData.value() != _OKSTR) {
+    LOG(ERROR) << "read receiver data is not +OK of frame, data:"
+               << exptData.value();
+    return {ErrorCodes::ERR_INTERNAL, "read +OK failed"};
+  }
+  _framesInFlight--;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// build the sst files of the slots from the snapshot, in the order of keys,
+// and send them one by one. The collection metas with ttl are sent as '5'
+// for the receiver to write their ttl indexes, which are in other chunks.
+// It returns the number of keys sent.
+Expected<uint64_t> ChunkMigrateSender::sendSstFiles(Transaction* txn) {
+  auto kvstore = _dbWithLock->store;
+  const std::string dir =
+    kvstore->dbPath() + "/" + kvstore->dbId() + "_migrate_out_" + _taskid;
+  try {
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+  } catch (const std::exception& ex) {
+    return {ErrorCodes::ERR_INTERNAL, ex.what()};
+  }
+  auto guard = MakeGuard([&dir] {
+    std::error_code ec;
+    filesystem::remove_all(dir, ec);
+  });
+
+  auto builder = kvstore->createSstFileBuilder();
+  std::string file;
+  uint32_t fileNum = 0;
+  uint64_t fileKeys = 0;
+  uint64_t totalWriteNum = 0;
+  std::string key;
+  std::string value;
+  Status s;
+  for (size_t i = 0; i < CLUSTER_SLOTS; i++) {
+    if (!_slots.test(i)) {
+      continue;
+    }
+    auto cursor = txn->createSlotsCursor(i, i + 1);
+    while (true) {
+      s = cursor->nextRaw(&key, &value);
+      if (s.code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      }
+      if (!isRunning()) {
+        LOG(ERROR) << "stop sender send snapshot on taskid:" << _taskid;
+        return {ErrorCodes::ERR_INTERNAL, "stop running"};
+      }
+      if (!s.ok()) {
+        LOG(ERROR) << "snapshot sendSstFiles failed storeid:" << _storeid
+                   << " err:" << s.toString();
+        return s;
+      }
+      if (fileKeys == 0) {
+        file = dir + "/" + std::to_string(fileNum++) + ".sst";
+        s = builder->open(file);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      s = builder->put(key, value);
+      if (!s.ok()) {
+        return s;
+      }
+      fileKeys++;
+      totalWriteNum++;
+
+      if (RecordKey::decodeType(key) == RecordType::RT_DATA_META &&
+          RecordValue::decodeTtl(value.data(), value.size()) > 0 &&
+          RecordValue::decodeType(value.data(), value.size()) !=
+            RecordType::RT_KV) {
+        uint32_t keylen = key.size();
+        uint32_t valuelen = value.size();
+        SyncWriteData("5");
+        SyncWriteData(
+          string(reinterpret_cast<char*>(&keylen), sizeof(uint32_t)));
+        SyncWriteData(key);
+        SyncWriteData(
+          string(reinterpret_cast<char*>(&valuelen), sizeof(uint32_t)));
+        SyncWriteData(value);
+        _snapshotBytes.fetch_add(1 + 2 * sizeof(uint32_t) + keylen + valuelen,
+                                 std::memory_order_relaxed);
+      }
+
+      if (builder->fileSize() >= MIGRATE_SST_FILE_SIZE) {
+        s = builder->finish();
+        if (!s.ok()) {
+          return s;
+        }
+        s = sendSstFile(file, fileKeys);
+        if (!s.ok()) {
+          return s;
+        }
+        fileKeys = 0;
+      }
+    }
+  }
+  if (fileKeys > 0) {
+    s = builder->finish();
+    if (!s.ok()) {
+      return s;
+    }
+    s = sendSstFile(file, fileKeys);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return totalWriteNum;
+}
+
+// '4' + keys + size + the content of file + crc64 of the content, the
+// receiver replies +OK when the file is saved
+Status ChunkMigrateSender::sendSstFile(const std::string& file, uint64_t keys) {
+  FileSource myfile(file);
+  Status s = myfile.open();
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t size = myfile.size();
+
+  SyncWriteData("4");
+  SyncWriteData(string(reinterpret_cast<char*>(&keys), sizeof(uint64_t)));
+  SyncWriteData(string(reinterpret_cast<char*>(&size), sizeof(uint64_t)));
+  auto timeout = std::chrono::seconds(_cfg->timeoutSecBinlogWaitRsp);
+  uint64_t crc = 0;
+  uint64_t offset = 0;
+  while (offset < size) {
+    uint64_t batchSize = std::min(size - offset, MIGRATE_SST_BATCH_SIZE);
+    _svr->getMigrateManager()->requestRateLimit(batchSize);
+    auto data = myfile.next(batchSize);
+    if (!data.ok()) {
+      return data.status();
+    }
+    // the batch is checksummed from the mapped file and sent from the
+    // same pages by sendfile()
+    crc = redis_port::crc64(
+      crc, reinterpret_cast<const unsigned char*>(data.value()), batchSize);
+    s = _client->sendFile(&myfile, timeout);
+    if (!s.ok()) {
+      LOG(ERROR) << "send file:" << file << " failed:" << s.toString();
+      return s;
+    }
+    offset += batchSize;
+  }
+  SyncWriteData(string(reinterpret_cast<char*>(&crc), sizeof(uint64_t)));
+  _snapshotBytes.fetch_add(size, std::memory_order_relaxed);
+  SyncReadData(exptData, _OKSTR.length(), _cfg->timeoutSecBinlogWaitRsp);
+  if (exptData.value() != _OKSTR) {
+    LOG(ERROR) << "read receiver data is not +OK on file:" << file;
+    return {ErrorCodes::ERR_INTERNAL, "read +OK failed"};
+  }
+  LOG(INFO) << "migrate send sst file:" << file << " keys:" << keys
+            << " size:" << size << " taskid:" << _taskid;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 // deal with slots that is not continuous
 Status ChunkMigrateSender::sendSnapshot() {
   Status s;
@@ -296,11 +575,25 @@ Status ChunkMigrateSender::sendSnapshot() {
   uint32_t timeoutSec = 10;
   uint32_t sendSlotNum = 0;
   setSnapShotStartTime(msSinceEpoch());
-
-  for (size_t i = 0; i < CLUSTER_SLOTS; i++) {
+  _frameRecords = 0;
+  _framesInFlight = 0;
+
+  if (_bySst) {
+    auto ret = sendSstFiles(eTxn.value().get());
+    if (!ret.ok()) {
+      LOG(ERROR) << "sendSstFiles failed:" << ret.status().toString();
+      return ret.status();
+    }
+    _snapshotKeyNum.fetch_add(ret.value(), std::memory_order_relaxed);
+    sendSlotNum = _slots.count();
+    // the receiver ingests the files before the reply
+    timeoutSec = _cfg->timeoutSecBinlogWaitRsp;
+  }
+  for (size_t i = 0; i < CLUSTER_SLOTS && !_bySst; i++) {
     if (_slots.test(i)) {
       sendSlotNum++;
-      auto ret = sendRange(eTxn.value().get(), i, i + 1);
+      auto ret = _byFrame ? sendRangeByFrame(eTxn.value().get(), i, i + 1)
+                          : sendRange(eTxn.value().get(), i, i + 1);
       if (!ret.ok()) {
         LOG(ERROR) << "sendRange failed, slot:" << i << "-" << i + 1;
         return ret.status();
@@ -308,6 +601,20 @@ Status ChunkMigrateSender::sendSnapshot() {
       _snapshotKeyNum.fetch_add(ret.value(), std::memory_order_relaxed);
     }
   }
+  if (_byFrame) {
+    if (_frameRecords > 0) {
+      s = sendFrame();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    while (_framesInFlight > 0) {
+      s = readFrameAck();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
   SyncWriteData("3");  // send over of all
   SyncReadData(exptData, _OKSTR.length(), timeoutSec);
   if (exptData.value() != _OKSTR) {
@@ -318,7 +625,11 @@ Status ChunkMigrateSender::sendSnapshot() {
   LOG(INFO) << "sendSnapshot finished, storeid:" << _storeid
             << " sendSlotNum:" << sendSlotNum
             << " totalWriteNum:" << getSnapshotNum()
+            << " bySst:" << _bySst << " byFrame:" << _byFrame
+            << " bytes:" << getSnapshotBytes()
             << " useTime:" << endTime - startTime
+            << " keysPerSec:"
+            << getSnapshotNum() / std::max(endTime - startTime, 1U)
             << " slots:" << bitsetStrEncode(_slots);
   return {ErrorCodes::ERR_OK, ""};
 }
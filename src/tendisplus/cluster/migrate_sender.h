@@ -76,6 +76,9 @@ class ChunkMigrateSender {
     _dstStoreid = dstStoreid;
   }
   void setDstNode(const std::string nodeid);
+  // the modes the receiver asks for, separated by ',': "sst" for sst
+  // files, "frame" for frames and "snappy" for compressed frames
+  void setMode(const std::string& mode);
 
   uint32_t getStoreid() const {
     return _storeid;
@@ -83,6 +86,9 @@ class ChunkMigrateSender {
   uint64_t getSnapshotNum() const {
     return _snapshotKeyNum.load(std::memory_order_relaxed);
   }
+  uint64_t getSnapshotBytes() const {
+    return _snapshotBytes.load(std::memory_order_relaxed);
+  }
 
   uint64_t getSnapShotStartTime() const {
     return _snapshotStartTime.load(std::memory_order_relaxed);
@@ -154,6 +160,13 @@ class ChunkMigrateSender {
   Status sendBinlog();
   Expected<uint64_t> sendRange(Transaction* txn, uint32_t begin, uint32_t end);
   Status sendSnapshot();
+  Expected<uint64_t> sendRangeByFrame(Transaction* txn,
+                                      uint32_t begin,
+                                      uint32_t end);
+  Status sendFrame();
+  Status readFrameAck();
+  Expected<uint64_t> sendSstFiles(Transaction* txn);
+  Status sendSstFile(const std::string& file, uint64_t keys);
   Status sendLastBinlog();
   Status catchupBinlog(uint64_t end);
 
@@ -192,6 +205,16 @@ class ChunkMigrateSender {
   uint16_t _dstPort;
   uint32_t _dstStoreid;
   std::shared_ptr<ClusterNode> _dstNode;
+  bool _bySst;
+  bool _byFrame;
+  bool _frameCompress;
+  // the header and records of the frame being built, and its compressed
+  // one, they are reused by all the frames
+  std::string _frame;
+  std::string _compressedFrame;
+  uint32_t _frameRecords;
+  uint32_t _framesInFlight;
+  std::atomic<uint64_t> _snapshotBytes;
   uint64_t getMaxBinLog(Transaction* ptxn) const;
   std::list<std::unique_ptr<ChunkLock>> _slotsLockList;
   std::string _OKSTR = "+OK";
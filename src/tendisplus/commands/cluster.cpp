@@ -946,8 +946,9 @@ class ReadymigrateCommand : public Command {
  public:
   ReadymigrateCommand() : Command("readymigrate", "a") {}
 
+  // readymigrate bitmap storeid nodename taskid [sst]
   ssize_t arity() const {
-    return 5;
+    return -5;
   }
 
   int32_t firstkey() const {
@@ -12,9 +12,11 @@
 #include <unordered_set>
 #include "glog/logging.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/server/index_manager.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/latency_stats.h"
 #include "tendisplus/lock/lock.h"
 #include "tendisplus/storage/record.h"
 #include "tendisplus/utils/sync_point.h"
@@ -32,8 +34,20 @@ std::map<std::string, Command*>& commandMap() {
   return map;
 }
 
+namespace {
+// the commands are all constructed at startup, in one thread
+uint32_t nextLatencyId() {
+  static uint32_t id = 0;
+  INVARIANT(id < LatencyStats::MAX_IDS);
+  return id++;
+}
+}  // namespace
+
 Command::Command(const std::string& name, const char* sflags)
-  : _name(name), _sflags(sflags), _flags(redis_port::getCommandFlags(sflags)) {
+  : _name(name),
+    _sflags(sflags),
+    _flags(redis_port::getCommandFlags(sflags)),
+    _latencyId(nextLatencyId()) {
   commandMap()[name] = this;
 }
 
@@ -74,6 +88,10 @@ bool Command::isAdmin() const {
   return (_flags & CMD_ADMIN) != 0;
 }
 
+bool Command::isNoScript() const {
+  return (_flags & CMD_NOSCRIPT) != 0;
+}
+
 bool Command::noExpire() {
   return _noexpire;
 }
@@ -256,9 +274,37 @@ Expected<Command*> Command::precheck(Session* sess) {
   return it->second;
 }
 
+// append the reply of run() to the writer
+Status Command::runWriter(Session* sess, RespWriter* writer) {
+  auto v = run(sess);
+  if (!v.ok()) {
+    return v.status();
+  }
+  writer->appendRaw(std::move(v.value()));
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<std::string> Command::runByWriter(Session* sess) {
+  RespWriter writer;
+  auto s = runWriter(sess, &writer);
+  if (!s.ok()) {
+    return s;
+  }
+  return writer.str();
+}
+
 // NOTE(deyukong): call precheck before call runSessionCmd
 // this function does no necessary checks
 Expected<std::string> Command::runSessionCmd(Session* sess) {
+  RespWriter writer;
+  auto s = runSessionCmd(sess, &writer);
+  if (!s.ok()) {
+    return s;
+  }
+  return writer.str();
+}
+
+Status Command::runSessionCmd(Session* sess, RespWriter* writer) {
   const auto& args = sess->getArgs();
   std::string commandName = toLower(args[0]);
   auto it = commandMap().find(commandName);
@@ -269,33 +315,45 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
   // TODO(vinchen): here there is a copy, it is a waste.
   sess->getCtx()->setArgsBrief(sess->getArgs());
   it->second->incrCallTimes();
+  bool tracking = sess->getServerEntry()->getParams()->latencyTracking;
+  LatencyStats::Mark mark = {};
+  if (tracking) {
+    mark = LatencyStats::startCommand();
+  }
   auto now = nsSinceEpoch();
-  auto guard = MakeGuard([it, now, sess] {
+  auto guard = MakeGuard([it, now, sess, tracking, &mark] {
     sess->getCtx()->clearRequestCtx();
     auto duration = nsSinceEpoch() - now;
     it->second->incrNanos(duration);
+    if (tracking) {
+      auto id = it->second->getLatencyId();
+      LatencyStats::endCommand(id, duration, mark);
+      // the reply queued next is of this command
+      sess->getCtx()->setLatencyId(id);
+    }
     sess->getServerEntry()->slowlogPushEntryIfNeeded(
       now / 1000, duration / 1000, sess);
   });
-  auto v = it->second->run(sess);
+  auto v = it->second->runWriter(sess, writer);
   if (v.ok()) {
     if (sess->getCtx()->isEp()) {
       sess->getServerEntry()->setTsEp(sess->getCtx()->getTsEP());
     }
   } else {
+    writer->clear();
     if (sess->getCtx()->isReplOnly()) {
       // NOTE(vinchen): If it's a slave, the connection should be closed
       // when there is an error. And the error should be log
-      ServerEntry::logError(v.status().toString(), sess);
+      ServerEntry::logError(v.toString(), sess);
 
       auto vv = dynamic_cast<NetSession*>(sess);
       if (vv) {
           vv->setCloseAfterRsp();
       }
-    } else if (v.status().code() == ErrorCodes::ERR_INTERNAL ||
-               v.status().code() == ErrorCodes::ERR_DECODE ||
-               v.status().code() == ErrorCodes::ERR_LOCK_TIMEOUT) {
-      ServerEntry::logError(v.status().toString(), sess);
+    } else if (v.code() == ErrorCodes::ERR_INTERNAL ||
+               v.code() == ErrorCodes::ERR_DECODE ||
+               v.code() == ErrorCodes::ERR_LOCK_TIMEOUT) {
+      ServerEntry::logError(v.toString(), sess);
     }
   }
   return v;
@@ -314,14 +372,162 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
 // }
 
 // requirement: intentionlock held
+// prefixes of all the sub keys of a collection
+std::vector<std::string> getSubKeyPrefixes(const RecordKey& mk,
+                                           RecordType valueType) {
+  std::vector<std::string> prefixes;
+  if (valueType == RecordType::RT_HASH_META) {
+    RecordKey fakeEle(mk.getChunkId(),
+                      mk.getDbId(),
+                      RecordType::RT_HASH_ELE,
+                      mk.getPrimaryKey(),
+                      "");
+    prefixes.push_back(fakeEle.prefixPk());
+  } else if (valueType == RecordType::RT_LIST_META) {
+    RecordKey fakeEle(mk.getChunkId(),
+                      mk.getDbId(),
+                      RecordType::RT_LIST_ELE,
+                      mk.getPrimaryKey(),
+                      "");
+    prefixes.push_back(fakeEle.prefixPk());
+  } else if (valueType == RecordType::RT_SET_META) {
+    RecordKey fakeEle(mk.getChunkId(),
+                      mk.getDbId(),
+                      RecordType::RT_SET_ELE,
+                      mk.getPrimaryKey(),
+                      "");
+    prefixes.push_back(fakeEle.prefixPk());
+  } else if (valueType == RecordType::RT_ZSET_META) {
+    RecordKey fakeEle(mk.getChunkId(),
+                      mk.getDbId(),
+                      RecordType::RT_ZSET_S_ELE,
+                      mk.getPrimaryKey(),
+                      "");
+    prefixes.push_back(fakeEle.prefixPk());
+    RecordKey fakeEle1(mk.getChunkId(),
+                       mk.getDbId(),
+                       RecordType::RT_ZSET_H_ELE,
+                       mk.getPrimaryKey(),
+                       "");
+    prefixes.push_back(fakeEle1.prefixPk());
+  } else {
+    INVARIANT_D(0);
+  }
+  return prefixes;
+}
+
+// the smallest key greater than all the keys beginning with prefix
+std::string prefixSuccessor(const std::string& prefix) {
+  std::string end = prefix;
+  while (!end.empty()) {
+    uint8_t c = static_cast<uint8_t>(end.back());
+    if (c != 0xff) {
+      end.back() = static_cast<char>(c + 1);
+      break;
+    }
+    end.pop_back();
+  }
+  return end;
+}
+
+// keys like pk + "\0" + X share the sub key prefix with pk, see
+// RecordKey::encodePrefixPk(), so the sub keys of pk can only be deleted
+// by range if there is no such key. They have the same chunkid with pk
+// only if a hash tag is used, so it is almost always one seek.
+Expected<bool> hasPrefixSibling(Transaction* txn, const RecordKey& mk) {
+  std::string prefix = mk.prefixPk();
+  // strip the version, keep the padding zero
+  prefix.pop_back();
+  auto cursor = txn->createDataCursor();
+  cursor->seek(prefix);
+  while (true) {
+    auto expKey = cursor->key();
+    if (expKey.status().code() == ErrorCodes::ERR_EXHAUST) {
+      return false;
+    }
+    RET_IF_ERR_EXPECTED(expKey);
+    if (expKey.value().compare(0, prefix.size(), prefix) != 0) {
+      return false;
+    }
+    auto expRcd = cursor->next();
+    RET_IF_ERR_EXPECTED(expRcd);
+    if (expRcd.value().getRecordKey().getPrimaryKey() != mk.getPrimaryKey()) {
+      return true;
+    }
+  }
+}
+
+// requirement: X lock of the key held
+Expected<bool> Command::delKeyByRangeInLock(Session* sess,
+                                            uint32_t storeId,
+                                            const RecordKey& mk,
+                                            RecordType valueType,
+                                            const TTLIndex* ictx) {
+  auto server = sess->getServerEntry();
+  auto expdb =
+    server->getSegmentMgr()->getDb(sess, storeId, mgl::LockMode::LOCK_NONE);
+  RET_IF_ERR_EXPECTED(expdb);
+  PStore kvstore = expdb.value().store;
+
+  for (uint32_t i = 0; i < RETRY_CNT; ++i) {
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    auto sibling = hasPrefixSibling(txn.get(), mk);
+    RET_IF_ERR_EXPECTED(sibling);
+    if (sibling.value()) {
+      return false;
+    }
+    // the sub keys, the meta and the ttl index are deleted in one batch,
+    // and replicated by one binlog. The range tombstones are dropped by
+    // compaction together with the sub keys.
+    for (const auto& prefix : getSubKeyPrefixes(mk, valueType)) {
+      Status s =
+        txn->deleteRange(prefix, prefixSuccessor(prefix), mk.getChunkId());
+      RET_IF_ERR(s);
+    }
+    Status s = kvstore->delKV(mk, txn.get());
+    RET_IF_ERR(s);
+    if (ictx && ictx->getType() != RecordType::RT_KV) {
+      s = txn->delKV(ictx->encode());
+      RET_IF_ERR(s);
+    }
+    auto commitStatus = txn->commit();
+    if (commitStatus.status().code() == ErrorCodes::ERR_COMMIT_RETRY &&
+        i != RETRY_CNT - 1) {
+      continue;
+    }
+    RET_IF_ERR_EXPECTED(commitStatus);
+    return true;
+  }
+  // should never reach here
+  INVARIANT_D(0);
+  return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+}
+
 Status Command::delKeyPessimisticInLock(Session* sess,
                                         uint32_t storeId,
                                         const RecordKey& mk,
                                         RecordType valueType,
+                                        uint64_t subCount,
                                         const TTLIndex* ictx) {
   std::string keyEnc = mk.encode();
   auto server = sess->getServerEntry();
 
+  uint32_t rangeThreshold = server->getParams()->bigKeyDelRangeThreshold;
+  // a range deletion can't be rolled back to a savepoint of a shared txn
+  if (rangeThreshold > 0 && subCount >= rangeThreshold &&
+      !sess->getCtx()->isTxnShared()) {
+    auto deleted = delKeyByRangeInLock(sess, storeId, mk, valueType, ictx);
+    RET_IF_ERR_EXPECTED(deleted);
+    if (deleted.value()) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    LOG(INFO) << "bigkey delete by range skipped, prefix sibling exists:"
+              << hexlify(mk.getPrimaryKey());
+  }
+
   DLOG(INFO) << "begin delKeyPessimistic key:" << hexlify(mk.getPrimaryKey());
 
   auto expdb =
@@ -469,44 +675,7 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
 
     return 1;
   }
-  std::vector<std::string> prefixes;
-  if (valueType == RecordType::RT_HASH_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_HASH_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_LIST_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_SET_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_SET_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_ZSET_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_ZSET_S_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-    RecordKey fakeEle1(mk.getChunkId(),
-                       mk.getDbId(),
-                       RecordType::RT_ZSET_H_ELE,
-                       mk.getPrimaryKey(),
-                       "");
-    prefixes.push_back(fakeEle1.prefixPk());
-  } else {
-    INVARIANT_D(0);
-  }
+  std::vector<std::string> prefixes = getSubKeyPrefixes(mk, valueType);
 
   std::list<RecordKey> pendingDelete;
   for (const auto& prefix : prefixes) {
@@ -598,6 +767,15 @@ Status Command::delKeyAndTTL(Session* sess,
   return s;
 }
 
+void Command::addExpire(Session* sess,
+                        uint32_t storeId,
+                        const TTLIndex& index) {
+  auto indexMgr = sess->getServerEntry()->getIndexMgr();
+  if (indexMgr) {
+    indexMgr->addExpire(storeId, index);
+  }
+}
+
 Status Command::delKey(Session* sess, const std::string& key, RecordType tp) {
   auto server = sess->getServerEntry();
   INVARIANT(server != nullptr);
@@ -638,8 +816,13 @@ Status Command::delKey(Session* sess, const std::string& key, RecordType tp) {
                 << ",rcdType:" << rt2Char(valueType) << ",size:" << cnt.value();
       // reset txn, it is no longer used
       txn.reset();
-      return Command::delKeyPessimisticInLock(
-        sess, storeId, mk, valueType, ictx.getTTL() > 0 ? &ictx : nullptr);
+      return Command::delKeyPessimisticInLock(sess,
+                                              storeId,
+                                              mk,
+                                              valueType,
+                                              cnt.value(),
+                                              ictx.getTTL() > 0 ? &ictx
+                                                                : nullptr);
     } else {
       Status s =
         Command::delKeyOptimismInLock(sess,
@@ -717,8 +900,8 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
                 << ",rcdType:" << rt2Char(valueType) << ",size:" << cnt.value();
       // reset txn, it is no longer used
       txn.reset();
-      Status s =
-        Command::delKeyPessimisticInLock(sess, storeId, mk, valueType, &ictx);
+      Status s = Command::delKeyPessimisticInLock(
+        sess, storeId, mk, valueType, cnt.value(), &ictx);
       if (s.ok()) {
         return {ErrorCodes::ERR_EXPIRED, ""};
       } else {
@@ -742,6 +925,89 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
   return {ErrorCodes::ERR_INTERNAL, "not reachable"};
 }
 
+std::vector<Expected<RecordValue>> Command::expireKeysIfNeeded(
+  Session* sess,
+  const std::vector<std::string>& keys,
+  RecordType tp,
+  bool hasVersion) {
+  auto server = sess->getServerEntry();
+  INVARIANT(server != nullptr);
+  auto pCtx = sess->getCtx();
+  INVARIANT(pCtx != nullptr);
+
+  std::vector<Expected<RecordValue>> result(keys.size(),
+                                            {ErrorCodes::ERR_NOTFOUND, ""});
+  struct StoreKeys {
+    PStore store;
+    std::vector<size_t> index;
+    std::vector<RecordKey> metaKeys;
+  };
+  // group the keys by kvstore, keys in one kvstore are read by one MultiGet
+  std::map<uint32_t, StoreKeys> groups;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, keys[i]);
+    if (!expdb.ok()) {
+      result[i] = expdb.status();
+      continue;
+    }
+    auto& group = groups[expdb.value().dbId];
+    group.store = expdb.value().store;
+    group.index.push_back(i);
+    group.metaKeys.emplace_back(
+      expdb.value().chunkId, pCtx->getDbId(), tp, keys[i], "");
+  }
+
+  std::vector<size_t> expired;
+  for (auto& kv : groups) {
+    auto& group = kv.second;
+    auto ptxn = group.store->createTransaction(sess);
+    if (!ptxn.ok()) {
+      for (auto i : group.index) {
+        result[i] = ptxn.status();
+      }
+      continue;
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto values = group.store->getKVs(group.metaKeys, txn.get());
+    // TODO(vinchen) : Should it use store->getCurrentTime() instead?
+    uint64_t currentTs = msSinceEpoch();
+    for (size_t j = 0; j < values.size(); ++j) {
+      size_t i = group.index[j];
+      auto& eValue = values[j];
+      if (!eValue.ok()) {
+        ++server->getServerStat().keyspaceMisses;
+        result[i] = eValue.status();
+        continue;
+      }
+      uint64_t targetTtl = eValue.value().getTtl();
+      RecordType valueType = eValue.value().getRecordType();
+      if (_noexpire || targetTtl == 0 || currentTs < targetTtl) {
+        if (valueType != tp && tp != RecordType::RT_DATA_META) {
+          result[i] = {ErrorCodes::ERR_WRONG_TYPE, ""};
+          continue;
+        }
+        if (hasVersion && !pCtx->verifyVersion(eValue.value().getVersionEP())) {
+          ++server->getServerStat().keyspaceIncorrectEp;
+          result[i] = {ErrorCodes::ERR_WRONG_VERSION_EP, ""};
+          continue;
+        }
+        ++server->getServerStat().keyspaceHits;
+        result[i] = std::move(eValue.value());
+      } else if (txn->isReplOnly()) {
+        result[i] = {ErrorCodes::ERR_EXPIRED, ""};
+      } else {
+        expired.push_back(i);
+      }
+    }
+  }
+
+  // expired keys are rare, delete them one by one
+  for (auto i : expired) {
+    result[i] = expireKeyIfNeeded(sess, keys[i], tp, hasVersion);
+  }
+  return result;
+}
+
 std::string Command::fmtErr(const std::string& s) {
   if (s.size() != 0 && s[0] == '-') {
     return s;
@@ -755,6 +1021,10 @@ std::string Command::fmtNull() {
   return "$-1\r\n";
 }
 
+std::string Command::fmtNullArray() {
+  return "*-1\r\n";
+}
+
 std::string Command::fmtOK() {
   return "+OK\r\n";
 }
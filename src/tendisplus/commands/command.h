@@ -26,6 +26,10 @@ class Command {
   explicit Command(const std::string& name, const char* sflags);
   virtual ~Command() = default;
   virtual Expected<std::string> run(Session* sess) = 0;
+  // write the reply into a chunked writer. The default implementation
+  // adopts the string returned by run() without copying it. Commands with
+  // big replies override it and implement run() with runByWriter().
+  virtual Status runWriter(Session* sess, RespWriter* writer);
 
   // if arity() > 0, it means the arguments count must equal to arity();
   // else, it means the arguments count must bigger than -arity();
@@ -46,11 +50,17 @@ class Command {
   void incrNanos(uint64_t);
   uint64_t getCallTimes() const;
   uint64_t getNanos() const;
+  // the id of the command in LatencyStats
+  uint32_t getLatencyId() const {
+    return _latencyId;
+  }
   void resetStatInfo();
   bool isReadOnly() const;
   bool isMultiKey() const;
   bool isWriteable() const;
   bool isAdmin() const;
+  // not allowed in the scripts, see script.cpp
+  bool isNoScript() const;
   static bool noExpire();
   // will be LOCK_S when _noexpire set true.
   // should use lock upgrade in the future.
@@ -64,6 +74,8 @@ class Command {
   // precheck returns command name
   static Expected<Command*> precheck(Session* sess);
   static Expected<std::string> runSessionCmd(Session* sess);
+  // on error, nothing is left in the writer
+  static Status runSessionCmd(Session* sess, RespWriter* writer);
   static bool isAdminCmd(const std::string& cmd);
   // static bool isKeyLocked(Session *sess,
   //                         uint32_t storeId,
@@ -76,6 +88,13 @@ class Command {
                                                  const std::string& key,
                                                  RecordType tp,
                                                  bool hasVersion = true);
+  // batched version of expireKeyIfNeeded, all the keys must have been
+  // locked by the session. results are in the same order as keys.
+  static std::vector<Expected<RecordValue>> expireKeysIfNeeded(
+    Session* sess,
+    const std::vector<std::string>& keys,
+    RecordType tp,
+    bool hasVersion = true);
 
   static Expected<std::pair<std::string, std::list<Record>>> scan(
     const std::string& pk,
@@ -88,6 +107,10 @@ class Command {
                              const RecordValue& val,
                              Transaction* txn);
   static Status delKey(Session* sess, const std::string& key, RecordType tp);
+  // schedule the expiry of the ttl index committed in the store
+  static void addExpire(Session* sess,
+                        uint32_t storeId,
+                        const TTLIndex& index);
 
   // return true if exists and delete succ
   // return false if not exists
@@ -98,6 +121,7 @@ class Command {
 
   static std::string fmtErr(const std::string& s);
   static std::string fmtNull();
+  static std::string fmtNullArray();
   static std::string fmtOK();
   static std::string fmtOne();
   static std::string fmtZero();
@@ -118,6 +142,9 @@ class Command {
   static constexpr int32_t RETRY_CNT = 3;
 
  protected:
+  // run() of the commands which override runWriter()
+  Expected<std::string> runByWriter(Session* sess);
+
   static std::mutex _mutex;
   // protected by mutex
   static const uint32_t _maxUnseenCmdNum = 10000;
@@ -131,8 +158,16 @@ class Command {
                                         uint32_t storeId,
                                         const RecordKey& rk,
                                         RecordType valueType,
+                                        uint64_t subCount,
                                         const TTLIndex* ictx = nullptr);
 
+  // return false if the key can not be deleted by range
+  static Expected<bool> delKeyByRangeInLock(Session* sess,
+                                            uint32_t storeId,
+                                            const RecordKey& rk,
+                                            RecordType valueType,
+                                            const TTLIndex* ictx = nullptr);
+
   static Status delKeyOptimismInLock(Session* sess,
                                      uint32_t storeId,
                                      const RecordKey& rk,
@@ -159,6 +194,7 @@ class Command {
 
   std::atomic<uint64_t> _callTimes;
   std::atomic<uint64_t> _totalNanoSecs;
+  const uint32_t _latencyId;
 };
 
 std::map<std::string, Command*>& commandMap();
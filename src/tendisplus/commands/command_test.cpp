@@ -562,6 +562,55 @@ void testScan(std::shared_ptr<ServerEntry> svr) {
     Command::fmtBulk(ss, tmp);
   }
   EXPECT_EQ(ss.str(), expect.value());
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "scankey_" + std::to_string(i);
+    if (i % 2 == 0) {
+      sess.setArgs({"set", key, "v"});
+    } else {
+      sess.setArgs({"hset", key, "f", "v"});
+    }
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+    keys.emplace_back(key);
+  }
+
+  // iterate the whole keyspace, every key should be returned once
+  std::string replies;
+  cursor = "0";
+  uint32_t round = 0;
+  do {
+    sess.setArgs({"scan", cursor, "match", "scankey_*", "count", "7"});
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    cursor = getBulkValue(expect.value(), 0);
+    replies.append(expect.value());
+    round++;
+  } while (cursor != "0" && round < 10000);
+  EXPECT_EQ(cursor, "0");
+  for (const auto& key : keys) {
+    EXPECT_NE(replies.find(Command::fmtBulk(key)), std::string::npos) << key;
+  }
+  EXPECT_EQ(replies.find(Command::fmtBulk("scanset")), std::string::npos);
+
+  replies.clear();
+  cursor = "0";
+  do {
+    sess.setArgs({"scan", cursor, "type", "hash", "count", "1000"});
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    cursor = getBulkValue(expect.value(), 0);
+    replies.append(expect.value());
+  } while (cursor != "0");
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(replies.find(Command::fmtBulk(keys[i])) != std::string::npos,
+              i % 2 == 1);
+  }
+
+  sess.setArgs({"scan", "xyz"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
 }
 
 void testMulti(std::shared_ptr<ServerEntry> svr) {
@@ -928,6 +977,7 @@ TEST(Command, common) {
   testHash1(server);
   testHash2(server);
   testSet(server);
+  testSetAlgebra(server);
   // zadd/zrem/zrank/zscore
   testZset(server);
   // zcount
@@ -1148,6 +1198,422 @@ TEST(Command, testObject) {
 #endif
 }
 
+void testPackedHash(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.ok() ? expect.value() : "";
+  };
+
+  EXPECT_EQ(runCmd({"hset", "ph", "b", "2", "a", "1", "c", "3"}),
+            Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"object", "encoding", "ph"}), Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd({"hsetnx", "ph", "a", "x"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"hincrby", "ph", "a", "10"}), Command::fmtLongLong(11));
+  EXPECT_EQ(runCmd({"hget", "ph", "a"}), Command::fmtBulk("11"));
+  EXPECT_EQ(runCmd({"hstrlen", "ph", "a"}), Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"hexists", "ph", "d"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"hlen", "ph"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"hmget", "ph", "c", "d"}),
+            "*2\r\n$1\r\n3\r\n$-1\r\n");
+  std::string all = runCmd({"hgetall", "ph"});
+  EXPECT_EQ(all,
+            "*6\r\n$1\r\na\r\n$2\r\n11\r\n$1\r\nb\r\n$1\r\n2\r\n"
+            "$1\r\nc\r\n$1\r\n3\r\n");
+
+  // the first page of hscan, the cursor points to "c"
+  std::string page = runCmd({"hscan", "ph", "0", "count", "2"});
+  size_t begin = page.find("\r\n", 5) + 2;
+  std::string cursor = page.substr(begin, page.find("\r\n", begin) - begin);
+  EXPECT_NE(cursor, "0");
+  EXPECT_NE(page.find("$1\r\nb\r\n$1\r\n2\r\n"), std::string::npos);
+
+  EXPECT_EQ(runCmd({"hdel", "ph", "b", "d"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"object", "encoding", "ph"}), Command::fmtBulk("listpack"));
+
+  // a long value expands the hash, the cursor is still valid
+  std::string longVal(svr->getParams()->hashMaxPackedValue + 1, 'v');
+  EXPECT_EQ(runCmd({"hset", "ph", "c", longVal}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"object", "encoding", "ph"}),
+            Command::fmtBulk("hashtable"));
+  EXPECT_EQ(runCmd({"hlen", "ph"}), Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"hget", "ph", "a"}), Command::fmtBulk("11"));
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "0");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "c");
+  Command::fmtBulk(ss, longVal);
+  EXPECT_EQ(runCmd({"hscan", "ph", cursor, "count", "2"}), ss.str());
+
+  // too many fields
+  std::vector<std::string> args = {"hmset", "ph2"};
+  for (uint32_t i = 0; i <= svr->getParams()->hashMaxPackedEntries; i++) {
+    args.push_back("f" + std::to_string(i));
+    args.push_back(std::to_string(i));
+  }
+  runCmd({"hset", "ph2", "f0", "0"});
+  EXPECT_EQ(runCmd({"object", "encoding", "ph2"}),
+            Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd(args), Command::fmtOK());
+  EXPECT_EQ(runCmd({"object", "encoding", "ph2"}),
+            Command::fmtBulk("hashtable"));
+  EXPECT_EQ(runCmd({"hlen", "ph2"}),
+            Command::fmtLongLong(svr->getParams()->hashMaxPackedEntries + 1));
+  EXPECT_EQ(runCmd({"hget", "ph2", "f1"}), Command::fmtBulk("1"));
+
+  // deleting the last field removes the key
+  runCmd({"hset", "ph3", "a", "1"});
+  EXPECT_EQ(runCmd({"hdel", "ph3", "a"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"exists", "ph3"}), Command::fmtZero());
+}
+
+TEST(Command, packedHash) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->hashMaxPackedEntries = 8;
+  auto server = makeServerEntry(cfg);
+
+  testPackedHash(server);
+  // the packed hashes grow into the expanded ones
+  testHash1(server);
+  testHash2(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testPackedSet(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.ok() ? expect.value() : "";
+  };
+
+  EXPECT_EQ(runCmd({"sadd", "ps", "b", "a", "c", "a"}),
+            Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"object", "encoding", "ps"}), Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd({"sismember", "ps", "a"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"sismember", "ps", "d"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"scard", "ps"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"smembers", "ps"}),
+            "*3\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n");
+
+  // the first page of sscan, the cursor points to "c"
+  std::string page = runCmd({"sscan", "ps", "0", "count", "2"});
+  size_t begin = page.find("\r\n", 5) + 2;
+  std::string cursor = page.substr(begin, page.find("\r\n", begin) - begin);
+  EXPECT_NE(cursor, "0");
+  EXPECT_NE(page.find("$1\r\nb\r\n"), std::string::npos);
+
+  EXPECT_EQ(runCmd({"srem", "ps", "b", "d"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"object", "encoding", "ps"}), Command::fmtBulk("listpack"));
+
+  // a long member expands the set, the cursor is still valid
+  std::string longMember(svr->getParams()->setMaxPackedValue + 1, 'm');
+  EXPECT_EQ(runCmd({"sadd", "ps", longMember}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"object", "encoding", "ps"}),
+            Command::fmtBulk("hashtable"));
+  EXPECT_EQ(runCmd({"scard", "ps"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"sismember", "ps", "a"}), Command::fmtOne());
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "0");
+  Command::fmtMultiBulkLen(ss, 2);
+  Command::fmtBulk(ss, "c");
+  Command::fmtBulk(ss, longMember);
+  EXPECT_EQ(runCmd({"sscan", "ps", cursor, "count", "2"}), ss.str());
+
+  // too many members
+  std::vector<std::string> args = {"sadd", "ps2"};
+  for (uint32_t i = 0; i <= svr->getParams()->setMaxPackedEntries; i++) {
+    args.push_back("m" + std::to_string(i));
+  }
+  runCmd({"sadd", "ps2", "m0"});
+  EXPECT_EQ(runCmd({"object", "encoding", "ps2"}),
+            Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd(args),
+            Command::fmtLongLong(svr->getParams()->setMaxPackedEntries));
+  EXPECT_EQ(runCmd({"object", "encoding", "ps2"}),
+            Command::fmtBulk("hashtable"));
+  EXPECT_EQ(runCmd({"scard", "ps2"}),
+            Command::fmtLongLong(svr->getParams()->setMaxPackedEntries + 1));
+  EXPECT_EQ(runCmd({"sismember", "ps2", "m1"}), Command::fmtOne());
+
+  // deleting the last member removes the key
+  runCmd({"sadd", "ps3", "a"});
+  EXPECT_EQ(runCmd({"srem", "ps3", "a"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"exists", "ps3"}), Command::fmtZero());
+}
+
+TEST(Command, packedSet) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->setMaxPackedEntries = 8;
+  auto server = makeServerEntry(cfg);
+
+  testPackedSet(server);
+  // the packed sets grow into the expanded ones
+  testSet(server);
+  testSetAlgebra(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testPackedZset(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.ok() ? expect.value() : "";
+  };
+
+  EXPECT_EQ(runCmd({"zadd", "pz", "2", "b", "1", "a", "3", "c"}),
+            Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"object", "encoding", "pz"}), Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd({"zscore", "pz", "b"}), Command::fmtBulk("2"));
+  EXPECT_EQ(runCmd({"zrank", "pz", "c"}), Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"zrevrank", "pz", "c"}), Command::fmtLongLong(0));
+  EXPECT_EQ(runCmd({"zcard", "pz"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"zrange", "pz", "0", "-1"}),
+            "*3\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n");
+  EXPECT_EQ(runCmd({"zrangebyscore", "pz", "(1", "+inf"}),
+            "*2\r\n$1\r\nb\r\n$1\r\nc\r\n");
+  EXPECT_EQ(runCmd({"zcount", "pz", "2", "3"}), Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"zincrby", "pz", "10", "a"}), Command::fmtBulk("11"));
+  EXPECT_EQ(runCmd({"zrange", "pz", "0", "0"}), "*1\r\n$1\r\nb\r\n");
+  EXPECT_EQ(runCmd({"zscan", "pz", "0", "match", "a"}),
+            "*2\r\n$1\r\n0\r\n*2\r\n$1\r\na\r\n$2\r\n11\r\n");
+
+  EXPECT_EQ(runCmd({"zrem", "pz", "b", "d"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"object", "encoding", "pz"}), Command::fmtBulk("listpack"));
+
+  // a long member expands the zset
+  std::string longMember(svr->getParams()->zsetMaxPackedValue + 1, 'm');
+  EXPECT_EQ(runCmd({"zadd", "pz", "0", longMember}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"object", "encoding", "pz"}),
+            Command::fmtBulk("skiplist"));
+  EXPECT_EQ(runCmd({"zcard", "pz"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"zscore", "pz", "a"}), Command::fmtBulk("11"));
+  EXPECT_EQ(runCmd({"zrank", "pz", longMember}), Command::fmtLongLong(0));
+  EXPECT_EQ(runCmd({"zrange", "pz", "1", "-1"}),
+            "*2\r\n$1\r\nc\r\n$1\r\na\r\n");
+
+  // too many members
+  std::vector<std::string> args = {"zadd", "pz2"};
+  for (uint32_t i = 0; i <= svr->getParams()->zsetMaxPackedEntries; i++) {
+    args.push_back(std::to_string(i));
+    args.push_back("m" + std::to_string(i));
+  }
+  runCmd({"zadd", "pz2", "0", "m0"});
+  EXPECT_EQ(runCmd({"object", "encoding", "pz2"}),
+            Command::fmtBulk("listpack"));
+  EXPECT_EQ(runCmd(args),
+            Command::fmtLongLong(svr->getParams()->zsetMaxPackedEntries));
+  EXPECT_EQ(runCmd({"object", "encoding", "pz2"}),
+            Command::fmtBulk("skiplist"));
+  EXPECT_EQ(runCmd({"zcard", "pz2"}),
+            Command::fmtLongLong(svr->getParams()->zsetMaxPackedEntries + 1));
+  EXPECT_EQ(runCmd({"zrank", "pz2", "m1"}), Command::fmtLongLong(1));
+
+  // deleting the last member removes the key
+  runCmd({"zadd", "pz3", "1", "a"});
+  EXPECT_EQ(runCmd({"zrem", "pz3", "a"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"exists", "pz3"}), Command::fmtZero());
+}
+
+TEST(Command, packedZset) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->zsetMaxPackedEntries = 8;
+  auto server = makeServerEntry(cfg);
+
+  testPackedZset(server);
+  // the packed zsets grow into the expanded ones
+  testZset(server);
+  testZset2(server);
+  testZset3(server);
+  testZset4(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testSegmentedList(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.ok() ? expect.value() : "";
+  };
+  auto multiBulk = [](const std::vector<std::string>& eles) {
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, eles.size());
+    for (const auto& ele : eles) {
+      Command::fmtBulk(ss, ele);
+    }
+    return ss.str();
+  };
+
+  // 4 entries per segment, 10 elements take 3 segments
+  uint32_t entries = svr->getParams()->listMaxSegmentEntries;
+  EXPECT_EQ(entries, 4u);
+  std::vector<std::string> args = {"rpush", "sl"};
+  std::vector<std::string> expected;
+  for (uint32_t i = 0; i < 10; i++) {
+    args.push_back(std::to_string(i));
+    expected.push_back(std::to_string(i));
+  }
+  EXPECT_EQ(runCmd(args), Command::fmtLongLong(10));
+  EXPECT_EQ(runCmd({"object", "encoding", "sl"}),
+            Command::fmtBulk("quicklist"));
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+  EXPECT_EQ(runCmd({"lrange", "sl", "3", "5"}),
+            multiBulk({"3", "4", "5"}));
+
+  EXPECT_EQ(runCmd({"lpush", "sl", "a", "b"}), Command::fmtLongLong(12));
+  expected.insert(expected.begin(), {"b", "a"});
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+  EXPECT_EQ(runCmd({"lindex", "sl", "5"}), Command::fmtBulk("3"));
+  EXPECT_EQ(runCmd({"lindex", "sl", "-1"}), Command::fmtBulk("9"));
+  EXPECT_EQ(runCmd({"lindex", "sl", "12"}), Command::fmtNull());
+
+  EXPECT_EQ(runCmd({"lset", "sl", "6", "x"}), Command::fmtOK());
+  expected[6] = "x";
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+
+  // splits the segment holding the pivot
+  for (uint32_t i = 0; i < entries; i++) {
+    EXPECT_EQ(runCmd({"linsert", "sl", "before", "x", "y"}),
+              Command::fmtLongLong(13 + i));
+    expected.insert(expected.begin() + 6, "y");
+  }
+  EXPECT_EQ(runCmd({"linsert", "sl", "after", "z", "y"}),
+            Command::fmtLongLong(-1));
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+
+  EXPECT_EQ(runCmd({"lrem", "sl", "-2", "y"}), Command::fmtLongLong(2));
+  expected.erase(expected.begin() + 8, expected.begin() + 10);
+  EXPECT_EQ(runCmd({"lrem", "sl", "0", "y"}), Command::fmtLongLong(2));
+  expected.erase(expected.begin() + 6, expected.begin() + 8);
+  EXPECT_EQ(runCmd({"lrem", "sl", "0", "y"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+
+  EXPECT_EQ(runCmd({"ltrim", "sl", "1", "-2"}), Command::fmtOK());
+  expected.erase(expected.begin());
+  expected.pop_back();
+  EXPECT_EQ(runCmd({"llen", "sl"}), Command::fmtLongLong(expected.size()));
+  EXPECT_EQ(runCmd({"lrange", "sl", "0", "-1"}), multiBulk(expected));
+
+  EXPECT_EQ(runCmd({"lpop", "sl"}), Command::fmtBulk(expected.front()));
+  EXPECT_EQ(runCmd({"rpop", "sl"}), Command::fmtBulk(expected.back()));
+  EXPECT_EQ(runCmd({"ltrim", "sl", "5", "1"}), Command::fmtOK());
+  EXPECT_EQ(runCmd({"exists", "sl"}), Command::fmtZero());
+
+  // enough segments for the tree of them to have inner nodes
+  expected.clear();
+  for (uint32_t i = 0; i < 1000; i++) {
+    expected.push_back(std::to_string(i));
+    EXPECT_EQ(runCmd({"rpush", "ll", expected.back()}),
+              Command::fmtLongLong(i + 1));
+  }
+  for (uint32_t i = 0; i < 1000; i += 111) {
+    EXPECT_EQ(runCmd({"lindex", "ll", std::to_string(i)}),
+              Command::fmtBulk(expected[i]));
+  }
+  EXPECT_EQ(runCmd({"linsert", "ll", "after", "500", "y"}),
+            Command::fmtLongLong(1001));
+  expected.insert(expected.begin() + 501, "y");
+  EXPECT_EQ(runCmd({"lrange", "ll", "498", "503"}),
+            multiBulk({"498", "499", "500", "y", "501", "502"}));
+  EXPECT_EQ(runCmd({"ltrim", "ll", "100", "-100"}), Command::fmtOK());
+  expected.erase(expected.end() - 99, expected.end());
+  expected.erase(expected.begin(), expected.begin() + 100);
+  EXPECT_EQ(runCmd({"lrange", "ll", "0", "-1"}), multiBulk(expected));
+  EXPECT_EQ(runCmd({"del", "ll"}), Command::fmtOne());
+
+  // a plain list is converted on linsert
+  svr->getParams()->listMaxSegmentEntries = 0;
+  EXPECT_EQ(runCmd({"rpush", "pl", "a", "b", "c"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"object", "encoding", "pl"}),
+            Command::fmtBulk("linkedlist"));
+  svr->getParams()->listMaxSegmentEntries = entries;
+  EXPECT_EQ(runCmd({"linsert", "pl", "after", "b", "d"}),
+            Command::fmtLongLong(4));
+  EXPECT_EQ(runCmd({"object", "encoding", "pl"}),
+            Command::fmtBulk("quicklist"));
+  EXPECT_EQ(runCmd({"lrange", "pl", "0", "-1"}),
+            multiBulk({"a", "b", "d", "c"}));
+}
+
+TEST(Command, segmentedList) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->listMaxSegmentEntries = 4;
+  auto server = makeServerEntry(cfg);
+
+  testSegmentedList(server);
+  testList(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+TEST(Command, zsetScoreKeys) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  // small blocks to split and merge them often
+  cfg->zsetScoreBlockEntries = 2;
+  auto server = makeServerEntry(cfg);
+
+  testZset(server);
+  testZset2(server);
+  testZset3(server);
+  testZset4(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
 void testRenameCommand(std::shared_ptr<ServerEntry> svr) {
   asio::io_context ioContext;
   asio::ip::tcp::socket socket(ioContext), socket1(ioContext);
@@ -1514,6 +1980,308 @@ TEST(Command, DelTTLIndex) {
 #endif
 }
 
+void testBlockingList(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    return expect.ok() ? expect.value() : expect.status().toString();
+  };
+
+  EXPECT_EQ(runCmd({"rpush", "bl2", "a", "b", "c"}), Command::fmtLongLong(3));
+  EXPECT_EQ(runCmd({"blpop", "bl1", "bl2", "0"}),
+            "*2\r\n$3\r\nbl2\r\n$1\r\na\r\n");
+  EXPECT_EQ(runCmd({"brpop", "bl1", "bl2", "0.5"}),
+            "*2\r\n$3\r\nbl2\r\n$1\r\nc\r\n");
+  EXPECT_EQ(runCmd({"brpoplpush", "bl2", "bl1", "1"}), Command::fmtBulk("b"));
+  EXPECT_EQ(runCmd({"exists", "bl2"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"lrange", "bl1", "0", "-1"}), "*1\r\n$1\r\nb\r\n");
+
+  // a session not driven by the network can not block, it times out
+  EXPECT_EQ(runCmd({"blpop", "bl2", "bl3", "0"}), Command::fmtNullArray());
+  EXPECT_EQ(runCmd({"brpoplpush", "bl2", "bl1", "0"}), Command::fmtNull());
+  EXPECT_EQ(svr->getBlockingMgr()->getBlockedCount(), 0U);
+
+  EXPECT_EQ(runCmd({"blpop", "bl1", "-1"}),
+            "-ERR timeout is negative\r\n");
+  EXPECT_EQ(runCmd({"blpop", "bl1", "x"}),
+            "-ERR timeout is not a float or out of range\r\n");
+  EXPECT_EQ(runCmd({"set", "bs", "v"}), Command::fmtOK());
+  EXPECT_EQ(runCmd({"blpop", "bs", "0"}),
+            Status(ErrorCodes::ERR_WRONG_TYPE, "").toString());
+}
+
+TEST(Command, blockingList) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testBlockingList(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testDelBigKeyByRange(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.ok() ? expect.value() : "";
+  };
+  // big enough to be deleted by delKeyPessimisticInLock()
+  uint32_t n = svr->getParams()->bigKeyDelRangeThreshold + 100;
+  auto fill = [&runCmd, n](const std::string& cmd,
+                           const std::string& key,
+                           bool withScore) {
+    std::vector<std::string> args{cmd, key};
+    for (uint32_t i = 0; i < n; i++) {
+      if (withScore) {
+        args.emplace_back(std::to_string(i));
+      }
+      args.emplace_back(std::to_string(i));
+      if (cmd == "hset") {
+        args.emplace_back(std::to_string(i));
+      }
+    }
+    runCmd(args);
+  };
+
+  fill("hset", "rh", false);
+  fill("sadd", "rs", false);
+  fill("zadd", "rz", true);
+  fill("rpush", "rl", false);
+  EXPECT_EQ(runCmd({"expire", "rz", "100"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"del", "rh", "rs", "rz", "rl"}), Command::fmtLongLong(4));
+  EXPECT_EQ(runCmd({"exists", "rh", "rs", "rz", "rl"}), Command::fmtZero());
+
+  // no stale sub keys are seen by the new keys
+  EXPECT_EQ(runCmd({"hset", "rh", "x", "1"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"hgetall", "rh"}), "*2\r\n$1\r\nx\r\n$1\r\n1\r\n");
+  EXPECT_EQ(runCmd({"zadd", "rz", "1", "x"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"zrange", "rz", "0", "-1"}), "*1\r\n$1\r\nx\r\n");
+  EXPECT_EQ(runCmd({"scard", "rs"}), Command::fmtZero());
+  EXPECT_EQ(runCmd({"llen", "rl"}), Command::fmtZero());
+
+  // the sub keys of {t}big\0x are in the range of {t}big, so it falls
+  // back to delete the sub keys one by one
+  std::string sibling("{t}big\0x", 8);
+  fill("hset", "{t}big", false);
+  EXPECT_EQ(runCmd({"hset", sibling, "a", "1", "b", "2"}),
+            Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"del", "{t}big"}), Command::fmtOne());
+  EXPECT_EQ(runCmd({"hlen", sibling}), Command::fmtLongLong(2));
+  EXPECT_EQ(runCmd({"hget", sibling, "b"}), Command::fmtBulk("2"));
+  EXPECT_EQ(runCmd({"exists", "{t}big"}), Command::fmtZero());
+}
+
+TEST(Command, DelBigKeyByRange) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->bigKeyDelRangeThreshold = 2048;
+  auto server = makeServerEntry(cfg);
+
+  testDelBigKeyByRange(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testScript(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    return expect.ok() ? expect.value() : expect.status().toString();
+  };
+  std::string body = "incrby KEYS[1] ARGV[1]\nget KEYS[1]";
+  std::string sha = redis_port::sha1hex(body);
+  EXPECT_EQ(runCmd({"cmdscript", "load", body}), Command::fmtBulk(sha));
+  EXPECT_EQ(runCmd({"cmdscript", "exists", sha, "0123"}),
+            "*2\r\n:1\r\n:0\r\n");
+  EXPECT_EQ(runCmd({"cmdevalsha", sha, "1", "sk", "5"}),
+            "*2\r\n:5\r\n$1\r\n5\r\n");
+  EXPECT_EQ(runCmd({"cmdeval", body, "1", "sk", "2"}),
+            "*2\r\n:7\r\n$1\r\n7\r\n");
+  EXPECT_EQ(runCmd({"cmdeval", "# check\nset KEYS[1] ARGV[1]; hset KEYS[2] f v",
+                    "2", "sk", "sh", "x"}),
+            "*2\r\n+OK\r\n:1\r\n");
+  EXPECT_EQ(runCmd({"get", "sk"}), Command::fmtBulk("x"));
+
+  // nothing runs if a command is not allowed
+  EXPECT_NE(runCmd({"cmdeval", "set KEYS[1] y\nset other y", "1", "sk"})
+              .find("not declared"),
+            std::string::npos);
+  EXPECT_NE(runCmd({"cmdeval", "set KEYS[1] y\nmulti", "1", "sk"})
+              .find("not allowed"),
+            std::string::npos);
+  EXPECT_NE(runCmd({"cmdeval", "set KEYS[1] ARGV[2]", "1", "sk", "y"})
+              .find("out of the arguments"),
+            std::string::npos);
+  EXPECT_EQ(runCmd({"get", "sk"}), Command::fmtBulk("x"));
+
+  // the commands before an error are rolled back
+  EXPECT_NE(runCmd({"cmdeval", "set KEYS[1] z\nlpush KEYS[1] z", "1", "sk"})
+              .find("WRONGTYPE"),
+            std::string::npos);
+  EXPECT_EQ(runCmd({"get", "sk"}), Command::fmtBulk("x"));
+  // the error is on the line of the source, not of the steps
+  EXPECT_NE(runCmd({"cmdeval", "# c\n\nset KEYS[1] z; lpush KEYS[1] z",
+                    "1", "sk"})
+              .find("line 3 'lpush'"),
+            std::string::npos);
+
+  // compare and set
+  std::string cas =
+    "if eq ARGV[1] get KEYS[1]\nset KEYS[1] ARGV[2]\nelse\nget KEYS[1]\nend";
+  EXPECT_EQ(runCmd({"cmdeval", cas, "1", "sk", "y", "z"}),
+            "*1\r\n$1\r\nx\r\n");
+  EXPECT_EQ(runCmd({"cmdeval", cas, "1", "sk", "x", "z"}), "*1\r\n+OK\r\n");
+  EXPECT_EQ(runCmd({"get", "sk"}), Command::fmtBulk("z"));
+  std::string nested =
+    "if ne 1 get KEYS[1]\nset KEYS[1] 1\nif lt 10 llen KEYS[2]\n"
+    "rpush KEYS[2] a\nend\nelse\nllen KEYS[2]\nend";
+  EXPECT_EQ(runCmd({"cmdeval", nested, "2", "nk", "nl"}),
+            "*2\r\n+OK\r\n:1\r\n");
+  EXPECT_EQ(runCmd({"get", "nk"}), Command::fmtBulk("1"));
+  EXPECT_EQ(runCmd({"cmdeval", nested, "2", "nk", "nl"}), "*1\r\n:1\r\n");
+  EXPECT_NE(runCmd({"cmdeval", "if eq 1 set KEYS[1] 1\nend", "1", "sk"})
+              .find("read only"),
+            std::string::npos);
+  EXPECT_NE(runCmd({"cmdeval", "if eq 1 get KEYS[1]", "1", "sk"})
+              .find("without end"),
+            std::string::npos);
+  EXPECT_NE(runCmd({"cmdeval", "else\nget KEYS[1]", "1", "sk"})
+              .find("without if"),
+            std::string::npos);
+
+  // the read only scripts refuse the writes
+  EXPECT_NE(runCmd({"cmdeval_ro", "set KEYS[1] y", "1", "sk"})
+              .find("read-only"),
+            std::string::npos);
+  EXPECT_EQ(runCmd({"cmdeval_ro", "get KEYS[1]", "1", "sk"}),
+            "*1\r\n$1\r\nz\r\n");
+  EXPECT_TRUE(commandMap()["cmdeval"]->isWriteable());
+  EXPECT_TRUE(commandMap()["cmdevalsha_ro"]->isReadOnly());
+
+  EXPECT_EQ(runCmd({"cmdscript", "flush"}), Command::fmtOK());
+  EXPECT_NE(runCmd({"cmdevalsha", sha, "1", "sk", "1"})
+              .find("No matching script"),
+            std::string::npos);
+
+  // the scripts of redis are not run in another language
+  EXPECT_EQ(commandMap().count("eval"), 0u);
+  EXPECT_EQ(commandMap().count("evalsha"), 0u);
+  EXPECT_EQ(commandMap().count("script"), 0u);
+
+  // the cache keeps the 1024 scripts used last
+  auto nth = [](size_t i) { return "get KEYS[1]\n#" + std::to_string(i); };
+  for (size_t i = 0; i < 1024; i++) {
+    runCmd({"cmdscript", "load", nth(i)});
+  }
+  runCmd({"cmdscript", "exists", redis_port::sha1hex(nth(0))});
+  EXPECT_EQ(runCmd({"cmdscript", "load", body}), Command::fmtBulk(sha));
+  EXPECT_EQ(runCmd({"cmdscript", "exists", redis_port::sha1hex(nth(0)),
+                    redis_port::sha1hex(nth(1)), sha}),
+            "*3\r\n:1\r\n:0\r\n:1\r\n");
+}
+
+TEST(Command, script) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testScript(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+void testLatencyStats(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto runCmd = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    return expect.ok() ? expect.value() : expect.status().toString();
+  };
+  EXPECT_EQ(runCmd({"config", "resetstat", "latencystats"}), Command::fmtOK());
+  EXPECT_EQ(runCmd({"latency", "histogram", "set"}), "*0\r\n");
+  for (uint32_t i = 0; i < 10; i++) {
+    EXPECT_EQ(runCmd({"set", "lk", std::to_string(i)}), Command::fmtOK());
+    EXPECT_EQ(runCmd({"get", "lk"}), Command::fmtBulk(std::to_string(i)));
+  }
+
+  auto info = runCmd({"info", "latencystats"});
+  EXPECT_NE(info.find("# Latencystats\r\n"), std::string::npos);
+  EXPECT_NE(info.find("latency_percentiles_usec_set:p50="), std::string::npos);
+  // not run in a work pool, and every run is counted in the lock and
+  // storage stages
+  EXPECT_NE(info.find("latency_stages_usec_get:queue_calls=0,"),
+            std::string::npos);
+  EXPECT_NE(info.find(",lock_calls=10,"), std::string::npos);
+  EXPECT_NE(info.find(",storage_calls=10,"), std::string::npos);
+
+  std::string head =
+    "*2\r\n$3\r\nset\r\n*12\r\n$5\r\ncalls\r\n:10\r\n"
+    "$14\r\nhistogram_usec\r\n";
+  auto hist = runCmd({"latency", "histogram", "set", "nosuchcmd"});
+  EXPECT_EQ(hist.find(head), 0u);
+  EXPECT_NE(hist.find("$20\r\nstorage_histogram_usec\r\n"),
+            std::string::npos);
+
+  // not counted with latency-tracking off
+  EXPECT_EQ(runCmd({"config", "set", "latency-tracking", "no"}),
+            Command::fmtOK());
+  EXPECT_EQ(runCmd({"set", "lk", "v"}), Command::fmtOK());
+  EXPECT_EQ(runCmd({"latency", "histogram", "set"}).find(head), 0u);
+  EXPECT_EQ(runCmd({"config", "set", "latency-tracking", "yes"}),
+            Command::fmtOK());
+
+  EXPECT_EQ(runCmd({"latency", "histogram", "nosuchcmd"}), "*0\r\n");
+  EXPECT_NE(runCmd({"latency", "doctor"}).find("Unknown subcommand"),
+            std::string::npos);
+}
+
+TEST(Command, latencyStats) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  testLatencyStats(server);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
 TEST(Command, RenameCommandTTL) {
   const auto guard = MakeGuard([] { destroyEnv(); });
 
@@ -1674,6 +2442,7 @@ TEST(Command, info) {
     {"info", "binloginfo"},
     {"info", "cpu"},
     {"info", "commandstats"},
+    {"info", "latencystats"},
     {"info", "cluster"},
     {"info", "keyspace"},
     {"info", "backup"},
@@ -1708,6 +2477,7 @@ TEST(Command, info) {
     {{"config", "resetstat", "commandstats"}, Command::fmtOK()},
     {{"config", "resetstat", "stats"}, Command::fmtOK()},
     {{"config", "resetstat", "rocksdbstats"}, Command::fmtOK()},
+    {{"config", "resetstat", "latencystats"}, Command::fmtOK()},
     {{"config", "resetstat", "invalid"}, Command::fmtOK()},  // it's ok
     {{"tendisadmin", "sleep", "1"}, Command::fmtOK()},
     {{"tendisadmin", "recovery"}, Command::fmtOK()},
@@ -34,7 +34,9 @@
 #include "tendisplus/commands/release.h"
 #include "tendisplus/commands/version.h"
 #include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/countedtree.h"
 #include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/latency_stats.h"
 
 namespace tendisplus {
 
@@ -570,7 +572,13 @@ class IterAllCommand : public Command {
       cursor->seek(unhex.value());
     }
 
-    std::unordered_map<std::string, uint64_t> lIdx;
+    // the meta of the lists met, and the index of the first element of each
+    // segment of a segmented list by the segment id
+    struct ListIdx {
+      ListMetaValue meta;
+      std::unordered_map<uint64_t, uint64_t> segFirst;
+    };
+    std::unordered_map<std::string, ListIdx> lIdx;
     std::list<Record> result;
     uint64_t currentTs = msSinceEpoch();
     while (true) {
@@ -598,6 +606,12 @@ class IterAllCommand : public Command {
       if (!isRealEleType(keyType, valueType)) {
         continue;
       }
+      // the tree of the segments of a segmented list
+      if (keyType == RecordType::RT_LIST_ELE &&
+          CountedTree::isNodeKey(
+            exptRcd.value().getRecordKey().getSecondaryKey())) {
+        continue;
+      }
 
       // NOTE(qingping209) for compound structures(list/hash/set/zset/stream)
       // targetTtl is invalid if they are expired. it's a dirty fix and could
@@ -632,11 +646,11 @@ class IterAllCommand : public Command {
     } else {
       nextCursor = "0";
     }
+    // a segment of a segmented list is given out as its elements
     std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, 2);
-    Command::fmtBulk(ss, nextCursor);
-    Command::fmtMultiBulkLen(ss, result.size());
+    size_t entries = 0;
     for (const auto& o : result) {
+      entries++;
       Command::fmtMultiBulkLen(ss, 5);
       const auto& t = o.getRecordKey().getRecordType();
       const auto& vt = o.getRecordValue().getRecordType();
@@ -675,18 +689,60 @@ class IterAllCommand : public Command {
             if (!expLm.ok()) {
               return expLm.status();
             }
-            lIdx.emplace(std::make_pair(o.getRecordKey().prefixPk(),
-                                        expLm.value().getHead()));
+            ListIdx li{std::move(expLm.value()), {}};
+            if (li.meta.isSegmented()) {
+              CountedTree tree(o.getRecordKey().getChunkId(),
+                               o.getRecordKey().getDbId(),
+                               RecordType::RT_LIST_ELE,
+                               o.getRecordKey().getPrimaryKey(),
+                               kvstore);
+              auto eSegs = tree.entries(txn.get());
+              if (!eSegs.ok()) {
+                return eSegs.status();
+              }
+              uint64_t first = 0;
+              for (const auto& seg : eSegs.value()) {
+                li.segFirst[seg.id] = first;
+                first += seg.count;
+              }
+            }
+            lIdx.emplace(o.getRecordKey().prefixPk(), std::move(li));
           }
-          auto& head = lIdx[o.getRecordKey().prefixPk()];
+          const auto& li = lIdx.at(o.getRecordKey().prefixPk());
+          const auto& lm = li.meta;
           auto expIdx = tendisplus::stoul(o.getRecordKey().getSecondaryKey());
           if (!expIdx.ok()) {
             return expIdx.status();
           }
-          Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
-          Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
-          Command::fmtBulk(ss, std::to_string(expIdx.value() - head));
-          Command::fmtBulk(ss, o.getRecordValue().getValue());
+          if (!lm.isSegmented()) {
+            Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
+            Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
+            Command::fmtBulk(ss,
+                             std::to_string(expIdx.value() - lm.getHead()));
+            Command::fmtBulk(ss, o.getRecordValue().getValue());
+            break;
+          }
+          auto segIt = li.segFirst.find(expIdx.value());
+          if (segIt == li.segFirst.end()) {
+            return {ErrorCodes::ERR_INTERNAL, "list segment not in the tree"};
+          }
+          uint64_t first = segIt->second;
+          auto expSeg = ListSegment::decode(o.getRecordValue().getValue());
+          if (!expSeg.ok()) {
+            return expSeg.status();
+          }
+          const auto& eles = expSeg.value().getElements();
+          for (size_t i = 0; i < eles.size(); ++i) {
+            if (i > 0) {
+              entries++;
+              Command::fmtMultiBulkLen(ss, 5);
+              Command::fmtBulk(ss, std::to_string(static_cast<uint32_t>(vt)));
+            }
+            Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
+            Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
+            Command::fmtBulk(ss, std::to_string(first + i));
+            Command::fmtBulk(ss, eles[i]);
+          }
           break;
         }
         case RecordType::RT_ZSET_H_ELE: {
@@ -705,7 +761,12 @@ class IterAllCommand : public Command {
           INVARIANT_D(0);
       }
     }
-    return ss.str();
+    std::stringstream reply;
+    Command::fmtMultiBulkLen(reply, 2);
+    Command::fmtBulk(reply, nextCursor);
+    Command::fmtMultiBulkLen(reply, entries);
+    reply << ss.str();
+    return reply.str();
   }
 } iterAllCmd;
 
@@ -1806,6 +1867,7 @@ class InfoCommand : public Command {
     infoBinlogInfo(allsections, defsections, section, sess, result);
     infoCPU(allsections, defsections, section, sess, result);
     infoCommandStats(allsections, defsections, section, sess, result);
+    infoLatencyStats(allsections, defsections, section, sess, result);
     infoKeyspace(allsections, defsections, section, sess, result);
     infoBackup(allsections, defsections, section, sess, result);
     infoDataset(allsections, defsections, section, sess, result);
@@ -1881,7 +1943,9 @@ class InfoCommand : public Command {
       auto server = sess->getServerEntry();
       std::stringstream ss;
       ss << "# Clients\r\n"
-         << "connected_clients:" << server->getSessionCount() << "\r\n";
+         << "connected_clients:" << server->getSessionCount() << "\r\n"
+         << "blocked_clients:" << server->getBlockingMgr()->getBlockedCount()
+         << "\r\n";
       ss << "\r\n";
       result << ss.str();
     }
@@ -2115,6 +2179,50 @@ class InfoCommand : public Command {
     }
   }
 
+  // the percentiles are the upper bounds of the histogram buckets, see
+  // LatencyHistogram
+  static void infoLatencyStats(bool allsections,
+                               bool defsections,
+                               const std::string& section,
+                               Session* sess,
+                               std::stringstream& result) {
+    if (allsections || section == "latencystats") {
+      std::stringstream ss;
+      ss << "# Latencystats\r\n";
+      ss << std::fixed << std::setprecision(3);
+      for (const auto& kv : commandMap()) {
+        auto id = kv.second->getLatencyId();
+        LatencyHistogram total;
+        LatencyStats::merge(id, LatencyStage::TOTAL, &total);
+        if (total.count() == 0) {
+          continue;
+        }
+        ss << "latency_percentiles_usec_" << kv.first
+           << ":p50=" << total.percentile(50) / 1000.0
+           << ",p99=" << total.percentile(99) / 1000.0
+           << ",p99.9=" << total.percentile(99.9) / 1000.0 << "\r\n";
+        ss << "latency_stages_usec_" << kv.first << ":";
+        for (auto stage : {LatencyStage::QUEUE,
+                           LatencyStage::LOCK,
+                           LatencyStage::STORAGE,
+                           LatencyStage::REPLY}) {
+          LatencyHistogram h;
+          LatencyStats::merge(id, stage, &h);
+          std::string name = LatencyStats::stageName(stage);
+          if (stage != LatencyStage::QUEUE) {
+            ss << ",";
+          }
+          ss << name << "_calls=" << h.count() << "," << name
+             << "_p50=" << h.percentile(50) / 1000.0 << "," << name
+             << "_p99=" << h.percentile(99) / 1000.0;
+        }
+        ss << "\r\n";
+      }
+      ss << "\r\n";
+      result << ss.str();
+    }
+  }
+
   static void infoKeyspace(bool allsections,
                            bool defsections,
                            const std::string& section,
@@ -2475,7 +2583,7 @@ class ObjectCommand : public Command {
         {RecordType::RT_KV, "raw"},
         {RecordType::RT_LIST_META, "linkedlist"},
         {RecordType::RT_HASH_META, "hashtable"},
-        {RecordType::RT_SET_META, "ziplist"},
+        {RecordType::RT_SET_META, "hashtable"},
         {RecordType::RT_ZSET_META, "skiplist"},
       };
 
@@ -2493,6 +2601,42 @@ class ObjectCommand : public Command {
       if (arg1 == "refcount") {
         return Command::fmtOne();
       } else if (arg1 == "encoding") {
+        if (vt == RecordType::RT_HASH_META) {
+          auto eHashMeta = HashMetaValue::decode(rv.value().getValue());
+          if (!eHashMeta.ok()) {
+            return eHashMeta.status();
+          }
+          if (eHashMeta.value().isPacked()) {
+            return Command::fmtBulk("listpack");
+          }
+        }
+        if (vt == RecordType::RT_SET_META) {
+          auto eSetMeta = SetMetaValue::decode(rv.value().getValue());
+          if (!eSetMeta.ok()) {
+            return eSetMeta.status();
+          }
+          if (eSetMeta.value().isPacked()) {
+            return Command::fmtBulk("listpack");
+          }
+        }
+        if (vt == RecordType::RT_ZSET_META) {
+          auto eZsetMeta = ZSlMetaValue::decode(rv.value().getValue());
+          if (!eZsetMeta.ok()) {
+            return eZsetMeta.status();
+          }
+          if (eZsetMeta.value().isPacked()) {
+            return Command::fmtBulk("listpack");
+          }
+        }
+        if (vt == RecordType::RT_LIST_META) {
+          auto eListMeta = ListMetaValue::decode(rv.value().getValue());
+          if (!eListMeta.ok()) {
+            return eListMeta.status();
+          }
+          if (eListMeta.value().isSegmented()) {
+            return Command::fmtBulk("quicklist");
+          }
+        }
         return Command::fmtBulk(m.at(vt));
       } else if (arg1 == "idletime") {
         return Command::fmtLongLong(0);
@@ -2629,6 +2773,10 @@ class ConfigCommand : public Command {
           kv.second->resetStatInfo();
         }
       }
+      if (reset_all || configName == "latencystats") {
+        LOG(INFO) << "reset latencystats";
+        LatencyStats::reset();
+      }
       if (reset_all || configName == "stats") {
         LOG(INFO) << "reset stats";
         std::stringstream ss;
@@ -3399,6 +3547,108 @@ class slowlogCommand : public Command {
   }
 } slowlogCmd;
 
+// LATENCY HISTOGRAM [command ...], the histograms of the commands and
+// their stages, in the cumulative counts of the power of two microseconds
+// as redis does.
+class LatencyCommand : public Command {
+ public:
+  LatencyCommand() : Command("latency", "aslt") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    if (toLower(args[1]) != "histogram") {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Unknown subcommand or wrong number of arguments for '" +
+                args[1] + "'"};
+    }
+    std::map<std::string, Command*> cmds;
+    if (args.size() == 2) {
+      cmds.insert(commandMap().begin(), commandMap().end());
+    } else {
+      for (size_t i = 2; i < args.size(); i++) {
+        auto it = commandMap().find(toLower(args[i]));
+        if (it != commandMap().end()) {
+          cmds.insert(*it);
+        }
+      }
+    }
+
+    std::stringstream body;
+    uint32_t n = 0;
+    for (const auto& kv : cmds) {
+      auto id = kv.second->getLatencyId();
+      LatencyHistogram total;
+      LatencyStats::merge(id, LatencyStage::TOTAL, &total);
+      if (total.count() == 0) {
+        continue;
+      }
+      n++;
+      Command::fmtBulk(body, kv.first);
+      Command::fmtMultiBulkLen(body, 2 + 2 * LatencyStats::STAGES);
+      Command::fmtBulk(body, "calls");
+      Command::fmtLongLong(body, total.count());
+      for (uint32_t i = 0; i < LatencyStats::STAGES; i++) {
+        auto stage = static_cast<LatencyStage>(i);
+        std::string name = "histogram_usec";
+        LatencyHistogram h;
+        if (stage == LatencyStage::TOTAL) {
+          h.merge(total);
+        } else {
+          name = std::string(LatencyStats::stageName(stage)) + "_" + name;
+          LatencyStats::merge(id, stage, &h);
+        }
+        Command::fmtBulk(body, name);
+        fmtHistogram(body, h);
+      }
+    }
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, 2 * n);
+    ss << body.str();
+    return ss.str();
+  }
+
+ private:
+  static void fmtHistogram(std::stringstream& ss, const LatencyHistogram& h) {
+    // the counts of the buckets under each power of two microseconds
+    std::map<uint64_t, uint64_t> usecBuckets;
+    for (uint32_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+      uint64_t count = h.bucketCount(i);
+      if (count == 0) {
+        continue;
+      }
+      uint64_t usec = 1;
+      while (usec * 1000 <= LatencyHistogram::bucketUpper(i) &&
+             usec < (1ULL << 40)) {
+        usec <<= 1;
+      }
+      usecBuckets[usec] += count;
+    }
+    Command::fmtMultiBulkLen(ss, 2 * usecBuckets.size());
+    uint64_t cumulative = 0;
+    for (const auto& kv : usecBuckets) {
+      cumulative += kv.second;
+      Command::fmtLongLong(ss, kv.first);
+      Command::fmtLongLong(ss, cumulative);
+    }
+  }
+} latencyCmd;
+
 class reshapeCommand : public Command {
  public:
   reshapeCommand() : Command("reshape", "sM") {}
@@ -10,7 +10,8 @@
 #include <limits>
 #include "tendisplus/commands/dump.h"
 #include "tendisplus/commands/command.h"
-#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/zsetindex.h"
+#include "tendisplus/storage/countedtree.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/storage/record.h"
@@ -466,20 +467,12 @@ class ListSerializer : public Serializer {
     uint32_t lenSz(0);
     std::vector<std::string> ziplist;
     size_t zlCnt(0);
-    for (size_t i = head; i != tail; i++) {
-      RecordKey nodeKey(expdb.value().chunkId,
-                        _sess->getCtx()->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        _key,
-                        std::to_string(i));
-      auto expNodeVal = kvstore->getKV(nodeKey, txn.get());
-      if (!expNodeVal.ok()) {
-        return expNodeVal.status();
-      }
-      byteSz += expNodeVal.value().getValue().size();
+    size_t added(0);
+    auto addNode = [&](std::string node) -> Status {
+      byteSz += node.size();
       lenSz++;
-      ziplist.emplace_back(std::move(expNodeVal.value().getValue()));
-      if ((byteSz > ZLBYTE_LIMIT || lenSz > ZLLEN_LIMIT) || i == tail - 1) {
+      ziplist.emplace_back(std::move(node));
+      if ((byteSz > ZLBYTE_LIMIT || lenSz > ZLLEN_LIMIT) || ++added == len) {
         ++zlCnt;
         auto ezlBytes = formatZiplist(payload, &_pos, ziplist, byteSz);
         if (!ezlBytes.ok()) {
@@ -490,6 +483,55 @@ class ListSerializer : public Serializer {
         byteSz = 0;
         lenSz = 0;
       }
+      return {ErrorCodes::ERR_OK, ""};
+    };
+    // a segmented list keeps its elements in segments keyed by segment id
+    std::vector<uint64_t> nodeIds;
+    if (expListMeta.value().isSegmented()) {
+      CountedTree tree(expdb.value().chunkId,
+                       _sess->getCtx()->getDbId(),
+                       RecordType::RT_LIST_ELE,
+                       _key,
+                       kvstore);
+      auto eSegs = tree.entries(txn.get());
+      if (!eSegs.ok()) {
+        return eSegs.status();
+      }
+      for (const auto& seg : eSegs.value()) {
+        nodeIds.push_back(seg.id);
+      }
+    } else {
+      for (size_t i = head; i != tail; i++) {
+        nodeIds.push_back(i);
+      }
+    }
+    for (uint64_t id : nodeIds) {
+      RecordKey nodeKey(expdb.value().chunkId,
+                        _sess->getCtx()->getDbId(),
+                        RecordType::RT_LIST_ELE,
+                        _key,
+                        std::to_string(id));
+      auto expNodeVal = kvstore->getKV(nodeKey, txn.get());
+      if (!expNodeVal.ok()) {
+        return expNodeVal.status();
+      }
+      if (!expListMeta.value().isSegmented()) {
+        auto s = addNode(std::move(expNodeVal.value().getValue()));
+        if (!s.ok()) {
+          return s;
+        }
+        continue;
+      }
+      auto expSeg = ListSegment::decode(expNodeVal.value().getValue());
+      if (!expSeg.ok()) {
+        return expSeg.status();
+      }
+      for (auto& ele : *expSeg.value().getMutableElements()) {
+        auto s = addNode(std::move(ele));
+        if (!s.ok()) {
+          return s;
+        }
+      }
     }
 
     auto expQlUsed = saveLen(payload, &notAligned, zlCnt);
@@ -527,6 +569,13 @@ class SetSerializer : public Serializer {
     if (!expwr.ok()) {
       return expwr.status();
     }
+    if (expMeta.value().isPacked()) {
+      for (const auto& entry : expMeta.value().getEntries().getEntries()) {
+        Serializer::saveString(payload, &_pos, entry.first);
+      }
+      _begin = 0;
+      return _pos - _begin;
+    }
 
     auto server = _sess->getServerEntry();
     auto expdb = server->getSegmentMgr()->getDbHasLocked(_sess, _key);
@@ -596,15 +645,15 @@ class ZsetSerializer : public Serializer {
       return eMeta.status();
     }
     ZSlMetaValue meta = eMeta.value();
-    SkipList zsl(
+    auto zsl = makeZsetIndex(
       expdb.value().chunkId, _sess->getCtx()->getDbId(), _key, meta, kvstore);
 
-    auto expwr = saveLen(payload, &_pos, zsl.getCount() - 1);
+    auto expwr = saveLen(payload, &_pos, zsl->getCount() - 1);
     if (!expwr.ok()) {
       return expwr.status();
     }
 
-    auto rev = zsl.scanByRank(0, zsl.getCount() - 1, true, txn.get());
+    auto rev = zsl->scanByRank(0, zsl->getCount() - 1, true, txn.get());
     if (!rev.ok()) {
       return rev.status();
     }
@@ -637,6 +686,14 @@ class HashSerializer : public Serializer {
     if (!expwr.ok()) {
       return expwr.status();
     }
+    if (expHashMeta.value().isPacked()) {
+      for (const auto& entry : expHashMeta.value().getEntries().getEntries()) {
+        Serializer::saveString(payload, &_pos, entry.first);
+        Serializer::saveString(payload, &_pos, entry.second);
+      }
+      _begin = 0;
+      return _pos - _begin;
+    }
 
     auto server = _sess->getServerEntry();
     auto expdb = server->getSegmentMgr()->getDbHasLocked(_sess, _key);
@@ -1155,6 +1212,8 @@ class ZsetDeserializer : public Deserializer {
     }
     INVARIANT_D(eMeta.status().code() == ErrorCodes::ERR_NOTFOUND);
     ZSlMetaValue meta(1, 1, 0);
+    meta.setScoreKeys(
+      _sess->getServerEntry()->getParams()->zsetScoreBlockEntries);
     RecordValue rv(meta.encode(),
                    RecordType::RT_ZSET_META,
                    _sess->getCtx()->getVersionEP(),
@@ -1163,16 +1222,18 @@ class ZsetDeserializer : public Deserializer {
     if (!s.ok()) {
       return s;
     }
-    RecordKey headRk(rk.getChunkId(),
-                     rk.getDbId(),
-                     RecordType::RT_ZSET_S_ELE,
-                     rk.getPrimaryKey(),
-                     std::to_string(ZSlMetaValue::HEAD_ID));
-    ZSlEleValue headVal;
-    RecordValue headRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
-    s = kvstore->setKV(headRk, headRv, txn.get());
-    if (!s.ok()) {
-      return s;
+    if (!meta.isScoreKeys()) {
+      RecordKey headRk(rk.getChunkId(),
+                       rk.getDbId(),
+                       RecordType::RT_ZSET_S_ELE,
+                       rk.getPrimaryKey(),
+                       std::to_string(ZSlMetaValue::HEAD_ID));
+      ZSlEleValue headVal;
+      RecordValue headRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+      s = kvstore->setKV(headRk, headRv, txn.get());
+      if (!s.ok()) {
+        return s;
+      }
     }
     Expected<uint64_t> expCmt = txn->commit();
     if (!expCmt.ok()) {
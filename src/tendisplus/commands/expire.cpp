@@ -48,7 +48,7 @@ Expected<bool> expireAfterNow(Session* sess,
   if (!expdb.ok()) {
     return expdb.status();
   }
-  // uint32_t storeId = expdb.value().dbId;
+  uint32_t storeId = expdb.value().dbId;
   PStore kvstore = expdb.value().store;
   SessionCtx* pCtx = sess->getCtx();
   RecordKey rk(expdb.value().chunkId, pCtx->getDbId(), type, key, "");
@@ -105,6 +105,10 @@ Expected<bool> expireAfterNow(Session* sess,
     auto commitStatus = txn->commit();
     s = commitStatus.status();
     if (s.ok()) {
+      if (vt != RecordType::RT_KV && !Command::noExpire()) {
+        Command::addExpire(
+          sess, storeId, TTLIndex(key, vt, pCtx->getDbId(), expireAt));
+      }
       return true;
     } else if (s.code() != ErrorCodes::ERR_COMMIT_RETRY) {
       return s;
@@ -325,11 +329,10 @@ class ExistsCommand : public Command {
       return locklist.status();
     }
 
-    for (size_t j = 1; j < args.size(); j++) {
-      const std::string& key = args[j];
-
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, key, RecordType::RT_DATA_META);
+    std::vector<std::string> keys(args.begin() + 1, args.end());
+    auto rvs =
+      Command::expireKeysIfNeeded(sess, keys, RecordType::RT_DATA_META);
+    for (auto& rv : rvs) {
       if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
         continue;
       } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
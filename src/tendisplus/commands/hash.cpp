@@ -19,6 +19,86 @@
 
 namespace tendisplus {
 
+// A small hash may be packed into its meta, the fields are then read and
+// written through the HashMetaValue instead of RT_HASH_ELE records, see
+// hash-max-packed-entries.
+Expected<RecordValue> getHashField(PStore kvstore,
+                                   Transaction* txn,
+                                   const HashMetaValue& hashMeta,
+                                   const RecordKey& subRk) {
+  if (!hashMeta.isPacked()) {
+    return kvstore->getKV(subRk, txn);
+  }
+  auto value = hashMeta.getEntries().get(subRk.getSecondaryKey());
+  if (value == nullptr) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return RecordValue(*value, RecordType::RT_HASH_ELE, -1);
+}
+
+Status setHashField(PStore kvstore,
+                    Transaction* txn,
+                    HashMetaValue* hashMeta,
+                    const RecordKey& subRk,
+                    const RecordValue& subRv) {
+  if (!hashMeta->isPacked()) {
+    return kvstore->setKV(subRk, subRv, txn);
+  }
+  hashMeta->getMutableEntries()->set(subRk.getSecondaryKey(),
+                                     subRv.getValue());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status delHashField(PStore kvstore,
+                    Transaction* txn,
+                    HashMetaValue* hashMeta,
+                    const RecordKey& subRk) {
+  if (!hashMeta->isPacked()) {
+    return kvstore->delKV(subRk, txn);
+  }
+  hashMeta->getMutableEntries()->erase(subRk.getSecondaryKey());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// a newly created hash starts packed if packing is enabled
+void initHashMeta(Session* sess, HashMetaValue* hashMeta) {
+  if (sess->getServerEntry()->getParams()->hashMaxPackedEntries > 0) {
+    hashMeta->setPacked(true);
+  }
+}
+
+// should be called before the meta of a modified hash is written. A packed
+// hash which outgrows the limits is converted to RT_HASH_ELE records, and
+// is never packed again.
+Status expandHashIfNeeded(Session* sess,
+                          PStore kvstore,
+                          Transaction* txn,
+                          const RecordKey& metaRk,
+                          HashMetaValue* hashMeta) {
+  if (!hashMeta->isPacked()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  const auto& params = sess->getServerEntry()->getParams();
+  if (hashMeta->getEntries().fits(params->hashMaxPackedEntries,
+                                  params->hashMaxPackedValue)) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  for (const auto& entry : hashMeta->getEntries().getEntries()) {
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_HASH_ELE,
+                    metaRk.getPrimaryKey(),
+                    entry.first);
+    RecordValue subRv(entry.second, RecordType::RT_HASH_ELE, -1);
+    Status s = kvstore->setKV(subRk, subRv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  hashMeta->setPacked(false);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Expected<std::string> hincrfloatGeneric(Session* sess,
                                         const RecordKey& metaRk,
                                         const Expected<RecordValue>& eValue,
@@ -45,9 +125,12 @@ Expected<std::string> hincrfloatGeneric(Session* sess,
       return exptHashMeta.status();
     }
     hashMeta = std::move(exptHashMeta.value());
-  }  // no else, else not found , so subkeyCount = 0, ttl = 0
+  } else {
+    // not found, so subkeyCount = 0, ttl = 0
+    initHashMeta(sess, &hashMeta);
+  }
 
-  auto getSubkeyExpt = kvstore->getKV(subRk, txn.get());
+  auto getSubkeyExpt = getHashField(kvstore, txn.get(), hashMeta, subRk);
   long double nowVal = 0;
   if (getSubkeyExpt.ok()) {
     Expected<long double> val =
@@ -66,16 +149,21 @@ Expected<std::string> hincrfloatGeneric(Session* sess,
   nowVal += inc;
   RecordValue newVal(
     ::tendisplus::ldtos(nowVal, true), RecordType::RT_HASH_ELE, -1);
+  Status setStatus =
+    setHashField(kvstore, txn.get(), &hashMeta, subRk, newVal);
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
+  setStatus = expandHashIfNeeded(sess, kvstore, txn.get(), metaRk, &hashMeta);
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
-  Status setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
-  if (!setStatus.ok()) {
-    return setStatus;
-  }
-  setStatus = kvstore->setKV(subRk, newVal, txn.get());
+  setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
   if (!setStatus.ok()) {
     return setStatus;
   }
@@ -113,9 +201,12 @@ Expected<std::string> hincrGeneric(Session* sess,
       return exptHashMeta.status();
     }
     hashMeta = std::move(exptHashMeta.value());
-  }  // no else, else not found , so subkeyCount = 0, ttl = 0
+  } else {
+    // not found, so subkeyCount = 0, ttl = 0
+    initHashMeta(sess, &hashMeta);
+  }
 
-  auto getSubkeyExpt = kvstore->getKV(subRk, txn.get());
+  auto getSubkeyExpt = getHashField(kvstore, txn.get(), hashMeta, subRk);
   int64_t nowVal = 0;
   if (getSubkeyExpt.ok()) {
     Expected<int64_t> val =
@@ -137,16 +228,21 @@ Expected<std::string> hincrGeneric(Session* sess,
   }
   nowVal += inc;
   RecordValue newVal(std::to_string(nowVal), RecordType::RT_HASH_ELE, -1);
+  Status setStatus =
+    setHashField(kvstore, txn.get(), &hashMeta, subRk, newVal);
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
+  setStatus = expandHashIfNeeded(sess, kvstore, txn.get(), metaRk, &hashMeta);
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
-  Status setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
-  if (!setStatus.ok()) {
-    return setStatus;
-  }
-  setStatus = kvstore->setKV(subRk, newVal, txn.get());
+  setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
   if (!setStatus.ok()) {
     return setStatus;
   }
@@ -260,7 +356,13 @@ class HExistsCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-    Expected<RecordValue> eVal = kvstore->getKV(subRk, txn.get());
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    Expected<RecordValue> eVal =
+      getHashField(kvstore, txn.get(), exptHashMeta.value(), subRk);
     if (eVal.ok()) {
       return Command::fmtOne();
     } else if (eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -329,16 +431,35 @@ class HAllCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    std::list<Record> result;
+    if (exptHashMeta.value().isPacked()) {
+      for (const auto& entry : exptHashMeta.value().getEntries().getEntries()) {
+        result.emplace_back(RecordKey(expdb.value().chunkId,
+                                      metaRk.getDbId(),
+                                      RecordType::RT_HASH_ELE,
+                                      metaRk.getPrimaryKey(),
+                                      entry.first),
+                            RecordValue(entry.second,
+                                        RecordType::RT_HASH_ELE,
+                                        -1));
+      }
+      return std::move(result);
+    }
+
     RecordKey fakeEle(expdb.value().chunkId,
                       metaRk.getDbId(),
                       RecordType::RT_HASH_ELE,
                       metaRk.getPrimaryKey(),
                       "");
     std::string prefix = fakeEle.prefixPk();
-    auto cursor = txn->createDataCursor();
+    auto cursor = txn->createPrefixDataCursor(prefix);
     cursor->seek(prefix);
 
-    std::list<Record> result;
     while (true) {
       Expected<Record> exptRcd = cursor->next();
       if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -363,17 +484,20 @@ class HGetAllCommand : public HAllCommand {
   HGetAllCommand() : HAllCommand("hgetall", "r") {}
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     Expected<std::list<Record>> rcds = getRecords(sess);
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size() * 2);
+    writer->appendMultiBulkLen(rcds.value().size() * 2);
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
+      writer->appendBulk(v.getRecordKey().getSecondaryKey());
+      writer->appendBulk(v.getRecordValue().getValue());
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 } hgetAllCmd;
 
@@ -382,16 +506,19 @@ class HKeysCommand : public HAllCommand {
   HKeysCommand() : HAllCommand("hkeys", "rS") {}
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     Expected<std::list<Record>> rcds = getRecords(sess);
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
+    writer->appendMultiBulkLen(rcds.value().size());
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
+      writer->appendBulk(v.getRecordKey().getSecondaryKey());
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 } hkeysCmd;
 
@@ -400,16 +527,19 @@ class HValsCommand : public HAllCommand {
   HValsCommand() : HAllCommand("hvals", "rS") {}
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     Expected<std::list<Record>> rcds = getRecords(sess);
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
+    writer->appendMultiBulkLen(rcds.value().size());
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
+      writer->appendBulk(v.getRecordValue().getValue());
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 } hvalsCmd;
 
@@ -471,7 +601,13 @@ class HGetRecordCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-    Expected<RecordValue> eVal = kvstore->getKV(subRk, txn.get());
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    Expected<RecordValue> eVal =
+      getHashField(kvstore, txn.get(), exptHashMeta.value(), subRk);
     if (eVal.ok()) {
       return std::move(Record(std::move(subRk), std::move(eVal.value())));
     } else {
@@ -785,13 +921,35 @@ class HMGetGeneric : public Command {
       Command::fmtMultiBulkLen(ss, args.size() - 2);
     }
 
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    if (exptHashMeta.value().isPacked()) {
+      const auto& entries = exptHashMeta.value().getEntries();
+      for (size_t i = 2; i < args.size(); ++i) {
+        auto value = entries.get(args[i]);
+        if (value == nullptr) {
+          Command::fmtNull(ss);
+        } else {
+          Command::fmtBulk(ss, *value);
+        }
+      }
+      return ss.str();
+    }
+
+    std::vector<RecordKey> subKeys;
+    subKeys.reserve(args.size() - 2);
     for (size_t i = 2; i < args.size(); ++i) {
-      RecordKey subKey(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_HASH_ELE,
-                       key,
-                       args[i]);
-      Expected<RecordValue> eValue = kvstore->getKV(subKey, txn.get());
+      subKeys.emplace_back(expdb.value().chunkId,
+                           pCtx->getDbId(),
+                           RecordType::RT_HASH_ELE,
+                           key,
+                           args[i]);
+    }
+    auto eValues = kvstore->getKVs(subKeys, txn.get());
+    for (auto& eValue : eValues) {
       if (!eValue.ok()) {
         if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
           Command::fmtNull(ss);
@@ -865,7 +1023,10 @@ Status hmcas(Session* sess,
     }
     hashMeta = std::move(exptHashMeta.value());
     cas = eValue.value().getCas();
-  }  // no else, else not found , so subkeyCount = 0, ttl = 0, cas = 0
+  } else {
+    // not found, so subkeyCount = 0, ttl = 0, cas = 0
+    initHashMeta(sess, &hashMeta);
+  }
 
   if (cmp) {
     // kv should exist for comparison
@@ -890,7 +1051,7 @@ Status hmcas(Session* sess,
                  RecordType::RT_HASH_ELE,
                  key,
                  keyPos.first);
-    Expected<RecordValue> rv = kvstore->getKV(rk, txn.get());
+    Expected<RecordValue> rv = getHashField(kvstore, txn.get(), hashMeta, rk);
     if (rv.ok()) {
       existkvs[keyPos.first] = rv.value().getValue();
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -913,7 +1074,7 @@ Status hmcas(Session* sess,
     if (eop.value() == OPSET || (!exists && eop.value() == OPADD)) {
       RecordValue subrv(
         subargs[keyPos.second + 2], RecordType::RT_HASH_ELE, -1);
-      Status s = kvstore->setKV(subrk, subrv, txn.get());
+      Status s = setHashField(kvstore, txn.get(), &hashMeta, subrk, subrv);
       if (!s.ok()) {
         return s;
       }
@@ -928,7 +1089,7 @@ Status hmcas(Session* sess,
       }
       RecordValue subrv(
         std::to_string(ev1.value() + ev.value()), RecordType::RT_HASH_ELE, -1);
-      Status s = kvstore->setKV(subrk, subrv, txn.get());
+      Status s = setHashField(kvstore, txn.get(), &hashMeta, subrk, subrv);
       if (!s.ok()) {
         return s;
       }
@@ -952,13 +1113,17 @@ Status hmcas(Session* sess,
     }
   }
   hashMeta.setCount(hashMeta.getCount() + uniqkeys.size() - existkvs.size());
+  Status s = expandHashIfNeeded(sess, kvstore, txn.get(), metaRk, &hashMeta);
+  if (!s.ok()) {
+    return s;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
   metaValue.setCas(cas);
-  Status s = kvstore->setKV(metaRk, metaValue, txn.get());
+  s = kvstore->setKV(metaRk, metaValue, txn.get());
   if (!s.ok()) {
     return s;
   }
@@ -1156,30 +1321,39 @@ class HMSetGeneric : public Command {
         return exptHashMeta.status();
       }
       hashMeta = std::move(exptHashMeta.value());
-    }  // no else, else not found , so subkeyCount = 0, ttl = 0
+    } else {
+      // not found, so subkeyCount = 0, ttl = 0
+      initHashMeta(sess, &hashMeta);
+    }
 
     for (const auto& v : rcds) {
-      auto getSubkeyExpt = kvstore->getKV(v.getRecordKey(), txn.get());
+      auto getSubkeyExpt =
+        getHashField(kvstore, txn.get(), hashMeta, v.getRecordKey());
       if (!getSubkeyExpt.ok()) {
         if (getSubkeyExpt.status().code() != ErrorCodes::ERR_NOTFOUND) {
           return getSubkeyExpt.status();
         }
         inserted += 1;
       }
-      Status setStatus =
-        kvstore->setKV(v.getRecordKey(), v.getRecordValue(), txn.get());
+      Status setStatus = setHashField(
+        kvstore, txn.get(), &hashMeta, v.getRecordKey(), v.getRecordValue());
       if (!setStatus.ok()) {
         return setStatus;
       }
     }
     hashMeta.setCount(hashMeta.getCount() + inserted);
+    Status setStatus =
+      expandHashIfNeeded(sess, kvstore, txn.get(), metaRk, &hashMeta);
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
     RecordValue metaValue(hashMeta.encode(),
                           RecordType::RT_HASH_META,
                           sess->getCtx()->getVersionEP(),
                           ttl,
                           eValue);
     metaValue.setCas(-1);
-    Status setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
+    setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
     if (!setStatus.ok()) {
       return setStatus;
     }
@@ -1347,10 +1521,13 @@ class HSetGeneric : public Command {
         return exptHashMeta.status();
       }
       hashMeta = std::move(exptHashMeta.value());
-    }  // no else, else not found , so subkeyCount = 0, ttl = 0
+    } else {
+      // not found, so subkeyCount = 0, ttl = 0
+      initHashMeta(sess, &hashMeta);
+    }
 
     bool updated = false;
-    auto getSubkeyExpt = kvstore->getKV(subRk, txn.get());
+    auto getSubkeyExpt = getHashField(kvstore, txn.get(), hashMeta, subRk);
     if (getSubkeyExpt.ok()) {
       updated = true;
     } else if (getSubkeyExpt.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -1364,16 +1541,22 @@ class HSetGeneric : public Command {
       return Command::fmtZero();
     }
 
+    Status setStatus =
+      setHashField(kvstore, txn.get(), &hashMeta, subRk, subRv);
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
+    setStatus =
+      expandHashIfNeeded(sess, kvstore, txn.get(), metaRk, &hashMeta);
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
     RecordValue metaValue(hashMeta.encode(),
                           RecordType::RT_HASH_META,
                           sess->getCtx()->getVersionEP(),
                           ttl,
                           eValue);
-    Status setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
-    if (!setStatus.ok()) {
-      return setStatus;
-    }
-    setStatus = kvstore->setKV(subRk, subRv, txn.get());
+    setStatus = kvstore->setKV(metaRk, metaValue, txn.get());
     if (!setStatus.ok()) {
       return setStatus;
     }
@@ -1457,14 +1640,15 @@ class HDelCommand : public Command {
                       RecordType::RT_HASH_ELE,
                       metaKey.getPrimaryKey(),
                       args[i]);
-      Expected<RecordValue> eVal = kvstore->getKV(subRk, txn);
+      Expected<RecordValue> eVal =
+        getHashField(kvstore, txn, hashMeta, subRk);
       if (eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
         continue;
       }
       if (!eVal.ok()) {
         return eVal.status();
       }
-      Status s = kvstore->delKV(subRk, txn);
+      Status s = delHashField(kvstore, txn, &hashMeta, subRk);
       if (!s.ok()) {
         return s;
       }
@@ -1703,12 +1703,12 @@ class MGetCommand : public Command {
       return locklist.status();
     }
 
+    std::vector<std::string> keys(args.begin() + 1, args.end());
+    auto rvs = Command::expireKeysIfNeeded(sess, keys, RecordType::RT_KV);
+
     std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, sess->getArgs().size() - 1);
-    for (size_t i = 1; i < sess->getArgs().size(); ++i) {
-      const std::string& key = sess->getArgs()[i];
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+    Command::fmtMultiBulkLen(ss, keys.size());
+    for (auto& rv : rvs) {
       if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
           rv.status().code() == ErrorCodes::ERR_NOTFOUND ||
           rv.status().code() == ErrorCodes::ERR_WRONG_TYPE) {
@@ -2220,6 +2220,14 @@ class RenameGenericCommand : public Command {
 
     pCtx->commitAll("rename");
     rollback = false;
+    if (rv.value().getTtl() > 0 && !Command::noExpire()) {
+      Command::addExpire(sess,
+                         dstdb.value().dbId,
+                         TTLIndex(dst,
+                                  rv.value().getRecordType(),
+                                  sess->getCtx()->getDbId(),
+                                  rv.value().getTtl()));
+    }
 
     return _flagnx ? Command::fmtOne() : Command::fmtOK();
   }
@@ -15,6 +15,7 @@
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/countedtree.h"
 
 namespace tendisplus {
 
@@ -27,6 +28,407 @@ enum class ListPos {
   LP_TAIL,
 };
 
+// segmented lists, see ListMetaValue. A segment takes new elements until
+// it holds entries elements or more than bytes bytes, a segment growing
+// beyond that by LINSERT is split in halves.
+struct SegmentLimit {
+  uint64_t entries;
+  uint64_t bytes;
+};
+
+// the limit of the segmented lists which exist when segmenting is turned
+// off later
+constexpr uint64_t DEFAULT_SEGMENT_ENTRIES = 128;
+
+SegmentLimit getSegmentLimit(Session* sess) {
+  const auto& params = sess->getServerEntry()->getParams();
+  uint64_t entries = params->listMaxSegmentEntries;
+  return {entries ? entries : DEFAULT_SEGMENT_ENTRIES,
+          std::max<uint64_t>(params->listMaxSegmentBytes, 1)};
+}
+
+uint64_t segmentBytes(const ListSegment& seg) {
+  uint64_t bytes = 0;
+  for (const auto& ele : seg.getElements()) {
+    bytes += ele.size();
+  }
+  return bytes;
+}
+
+bool isSegmentFull(const ListSegment& seg, const SegmentLimit& limit) {
+  return seg.size() >= limit.entries || segmentBytes(seg) >= limit.bytes;
+}
+
+RecordKey segmentKey(const RecordKey& metaRk, uint64_t id) {
+  return RecordKey(metaRk.getChunkId(),
+                   metaRk.getDbId(),
+                   RecordType::RT_LIST_ELE,
+                   metaRk.getPrimaryKey(),
+                   std::to_string(id));
+}
+
+// the segments of a list in order, the entries have the ids and the sizes
+// of the segments
+CountedTree listTree(const RecordKey& metaRk, PStore kvstore) {
+  return CountedTree(metaRk.getChunkId(),
+                     metaRk.getDbId(),
+                     RecordType::RT_LIST_ELE,
+                     metaRk.getPrimaryKey(),
+                     kvstore);
+}
+
+Expected<ListSegment> loadSegment(PStore kvstore,
+                                  Transaction* txn,
+                                  const RecordKey& metaRk,
+                                  const CountedTree& tree,
+                                  const CountedTree::Pos& pos) {
+  const auto& entry = tree.get(pos);
+  auto eRv = kvstore->getKV(segmentKey(metaRk, entry.id), txn);
+  if (!eRv.ok()) {
+    return eRv.status();
+  }
+  auto eSeg = ListSegment::decode(eRv.value().getValue());
+  if (eSeg.ok() && eSeg.value().size() != entry.count) {
+    return {ErrorCodes::ERR_DECODE, "list segment count mismatch"};
+  }
+  return eSeg;
+}
+
+Status dropSegment(PStore kvstore,
+                   Transaction* txn,
+                   const RecordKey& metaRk,
+                   CountedTree* tree,
+                   const CountedTree::Pos& pos) {
+  RecordKey subRk = segmentKey(metaRk, tree->get(pos).id);
+  auto s = tree->erase(pos, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return kvstore->delKV(subRk, txn);
+}
+
+// write the segment at pos, an empty one is removed from the list. pos is
+// invalid afterwards.
+Status saveSegment(PStore kvstore,
+                   Transaction* txn,
+                   const RecordKey& metaRk,
+                   CountedTree* tree,
+                   const CountedTree::Pos& pos,
+                   const ListSegment& seg) {
+  if (seg.size() == 0) {
+    return dropSegment(kvstore, txn, metaRk, tree, pos);
+  }
+  RecordKey subRk = segmentKey(metaRk, tree->get(pos).id);
+  auto s = tree->setCount(pos, seg.size(), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  RecordValue subRv(seg.encode(), RecordType::RT_LIST_ELE, -1);
+  return kvstore->setKV(subRk, subRv, txn);
+}
+
+// write the nodes of the tree changed and the length to the meta
+Status saveTree(CountedTree* tree, Transaction* txn, ListMetaValue* lm) {
+  auto eTotal = tree->total(txn);
+  if (!eTotal.ok()) {
+    return eTotal.status();
+  }
+  lm->setTail(lm->getHead() + eTotal.value());
+  return tree->save(txn);
+}
+
+// only the segment at the end pushed to and the new ones are written, with
+// the nodes of the tree on their paths
+Status segmentedPush(Session* sess,
+                     PStore kvstore,
+                     Transaction* txn,
+                     const RecordKey& metaRk,
+                     ListMetaValue* lm,
+                     const std::vector<std::string>& args,
+                     ListPos pos) {
+  SegmentLimit limit = getSegmentLimit(sess);
+  bool atHead = pos == ListPos::LP_HEAD;
+  CountedTree tree = listTree(metaRk, kvstore);
+  ListSegment seg;
+  uint64_t id = 0;
+  auto ePos = atHead ? tree.first(txn) : tree.last(txn);
+  // whether seg is in the tree already, a new one is added on writing
+  bool inTree = ePos.ok();
+  if (inTree) {
+    auto eSeg = loadSegment(kvstore, txn, metaRk, tree, ePos.value());
+    if (!eSeg.ok()) {
+      return eSeg.status();
+    }
+    seg = std::move(eSeg.value());
+    id = tree.get(ePos.value()).id;
+  } else if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    auto eId = tree.allocId(txn);
+    if (!eId.ok()) {
+      return eId.status();
+    }
+    id = eId.value();
+  } else {
+    return ePos.status();
+  }
+  auto flush = [&]() -> Status {
+    Status s;
+    if (inTree) {
+      auto eEnd = atHead ? tree.first(txn) : tree.last(txn);
+      if (!eEnd.ok()) {
+        return eEnd.status();
+      }
+      s = tree.setCount(eEnd.value(), seg.size(), txn);
+    } else {
+      CountedTree::Entry entry{"", id, seg.size()};
+      s = atHead ? tree.pushFront(entry, txn) : tree.pushBack(entry, txn);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    RecordValue subRv(seg.encode(), RecordType::RT_LIST_ELE, -1);
+    return kvstore->setKV(segmentKey(metaRk, id), subRv, txn);
+  };
+  for (const auto& ele : args) {
+    if (isSegmentFull(seg, limit)) {
+      auto s = flush();
+      if (!s.ok()) {
+        return s;
+      }
+      auto eId = tree.allocId(txn);
+      if (!eId.ok()) {
+        return eId.status();
+      }
+      id = eId.value();
+      inTree = false;
+      seg = ListSegment();
+    }
+    auto eles = seg.getMutableElements();
+    eles->insert(atHead ? eles->begin() : eles->end(), ele);
+  }
+  auto s = flush();
+  if (!s.ok()) {
+    return s;
+  }
+  return saveTree(&tree, txn, lm);
+}
+
+Expected<std::string> segmentedPop(PStore kvstore,
+                                   Transaction* txn,
+                                   const RecordKey& metaRk,
+                                   ListMetaValue* lm,
+                                   ListPos pos) {
+  CountedTree tree = listTree(metaRk, kvstore);
+  auto ePos = pos == ListPos::LP_HEAD ? tree.first(txn) : tree.last(txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  auto eSeg = loadSegment(kvstore, txn, metaRk, tree, ePos.value());
+  if (!eSeg.ok()) {
+    return eSeg.status();
+  }
+  auto eles = eSeg.value().getMutableElements();
+  INVARIANT_D(!eles->empty());
+  if (eles->empty()) {
+    return {ErrorCodes::ERR_INTERNAL, "empty list segment"};
+  }
+  std::string val;
+  if (pos == ListPos::LP_HEAD) {
+    val = std::move(eles->front());
+    eles->erase(eles->begin());
+  } else {
+    val = std::move(eles->back());
+    eles->pop_back();
+  }
+  auto s = saveSegment(kvstore, txn, metaRk, &tree, ePos.value(),
+                       eSeg.value());
+  if (!s.ok()) {
+    return s;
+  }
+  s = saveTree(&tree, txn, lm);
+  if (!s.ok()) {
+    return s;
+  }
+  return val;
+}
+
+// remove at most count elements equal to value from the pos end, 0 for
+// all of them, return the number removed
+Expected<uint64_t> segmentedRemove(PStore kvstore,
+                                   Transaction* txn,
+                                   const RecordKey& metaRk,
+                                   ListMetaValue* lm,
+                                   const std::string& value,
+                                   uint64_t count,
+                                   ListPos pos) {
+  bool fromHead = pos == ListPos::LP_HEAD;
+  CountedTree tree = listTree(metaRk, kvstore);
+  auto eTotal = tree.total(txn);
+  if (!eTotal.ok()) {
+    return eTotal.status();
+  }
+  uint64_t total = eTotal.value();
+  uint64_t removed = 0;
+  // an index in the segment to look into next, the tree is sought again
+  // after a segment is changed
+  uint64_t idx = fromHead ? 0 : total - 1;
+  bool more = total > 0;
+  while (more && (count == 0 || removed < count)) {
+    auto ePos = tree.seekCount(idx, txn);
+    if (!ePos.ok()) {
+      return ePos.status();
+    }
+    uint64_t before = ePos.value().before;
+    auto eSeg = loadSegment(kvstore, txn, metaRk, tree, ePos.value());
+    if (!eSeg.ok()) {
+      return eSeg.status();
+    }
+    auto eles = eSeg.value().getMutableElements();
+    size_t oldSize = eles->size();
+    for (size_t i = 0; i < oldSize && (count == 0 || removed < count); ++i) {
+      size_t j = fromHead ? i - (oldSize - eles->size()) : oldSize - 1 - i;
+      if ((*eles)[j] == value) {
+        eles->erase(eles->begin() + j);
+        removed++;
+      }
+    }
+    if (eles->size() != oldSize) {
+      auto s = saveSegment(kvstore, txn, metaRk, &tree, ePos.value(),
+                           eSeg.value());
+      if (!s.ok()) {
+        return s;
+      }
+      total -= oldSize - eles->size();
+    }
+    if (fromHead) {
+      idx = before + eles->size();
+      more = idx < total;
+    } else {
+      more = before > 0;
+      idx = before - 1;
+    }
+  }
+  auto s = saveTree(&tree, txn, lm);
+  if (!s.ok()) {
+    return s;
+  }
+  return removed;
+}
+
+// insert value before or after the first pivot, return false if there is
+// no pivot. The segment is split in halves if it grows beyond the limit.
+Expected<bool> segmentedInsert(Session* sess,
+                               PStore kvstore,
+                               Transaction* txn,
+                               const RecordKey& metaRk,
+                               ListMetaValue* lm,
+                               const std::string& pivot,
+                               const std::string& value,
+                               bool before) {
+  SegmentLimit limit = getSegmentLimit(sess);
+  CountedTree tree = listTree(metaRk, kvstore);
+  auto ePos = tree.first(txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return false;
+  } else if (!ePos.ok()) {
+    return ePos.status();
+  }
+  CountedTree::Pos segPos = std::move(ePos.value());
+  while (true) {
+    auto eSeg = loadSegment(kvstore, txn, metaRk, tree, segPos);
+    if (!eSeg.ok()) {
+      return eSeg.status();
+    }
+    ListSegment& seg = eSeg.value();
+    auto eles = seg.getMutableElements();
+    auto it = std::find(eles->begin(), eles->end(), pivot);
+    if (it == eles->end()) {
+      auto eNext = tree.next(&segPos, txn);
+      if (!eNext.ok()) {
+        return eNext.status();
+      }
+      if (!eNext.value()) {
+        return false;
+      }
+      continue;
+    }
+    eles->insert(before ? it : it + 1, value);
+    ListSegment right;
+    if (eles->size() > 1 && (eles->size() > limit.entries ||
+                             segmentBytes(seg) > limit.bytes)) {
+      size_t half = eles->size() / 2;
+      right.getMutableElements()->assign(
+        std::make_move_iterator(eles->begin() + half),
+        std::make_move_iterator(eles->end()));
+      eles->resize(half);
+    }
+    uint64_t leftBefore = segPos.before;
+    auto s = saveSegment(kvstore, txn, metaRk, &tree, segPos, seg);
+    if (!s.ok()) {
+      return s;
+    }
+    if (right.size() > 0) {
+      auto eId = tree.allocId(txn);
+      if (!eId.ok()) {
+        return eId.status();
+      }
+      auto eLeft = tree.seekCount(leftBefore, txn);
+      if (!eLeft.ok()) {
+        return eLeft.status();
+      }
+      s = tree.insert(
+        eLeft.value(), true, {"", eId.value(), right.size()}, txn);
+      if (!s.ok()) {
+        return s;
+      }
+      RecordValue subRv(right.encode(), RecordType::RT_LIST_ELE, -1);
+      s = kvstore->setKV(segmentKey(metaRk, eId.value()), subRv, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    s = saveTree(&tree, txn, lm);
+    if (!s.ok()) {
+      return s;
+    }
+    return true;
+  }
+}
+
+// rewrite a plain list into segments, its elements are read one by one
+// anyway by the commands calling it
+Status convertToSegmented(Session* sess,
+                          PStore kvstore,
+                          Transaction* txn,
+                          const RecordKey& metaRk,
+                          ListMetaValue* lm) {
+  INVARIANT_D(!lm->isSegmented());
+  std::vector<std::string> eles;
+  for (uint64_t i = lm->getHead(); i < lm->getTail(); ++i) {
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_LIST_ELE,
+                    metaRk.getPrimaryKey(),
+                    std::to_string(i));
+    auto eRv = kvstore->getKV(subRk, txn);
+    if (!eRv.ok()) {
+      return eRv.status();
+    }
+    eles.emplace_back(eRv.value().getValue());
+    auto s = kvstore->delKV(subRk, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  lm->setSegmented(true);
+  return segmentedPush(sess, kvstore, txn, metaRk, lm, eles, ListPos::LP_TAIL);
+}
+
+// whether the plain lists are converted to segmented ones on LINSERT/LREM
+bool needSegmented(Session* sess, const ListMetaValue& lm) {
+  return !lm.isSegmented() &&
+    sess->getServerEntry()->getParams()->listMaxSegmentEntries > 0;
+}
+
 Expected<std::string> genericPop(Session* sess,
                                  PStore kvstore,
                                  Transaction* txn,
@@ -53,6 +455,28 @@ Expected<std::string> genericPop(Session* sess,
   if (head == tail) {
     return {ErrorCodes::ERR_INTERNAL, "invalid head or tail of list"};
   }
+  if (lm.isSegmented()) {
+    auto val = segmentedPop(kvstore, txn, metaRk, &lm, pos);
+    if (!val.ok()) {
+      return val.status();
+    }
+    Status s;
+    if (lm.getHead() == lm.getTail()) {
+      s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn);
+    } else {
+      s = kvstore->setKV(metaRk,
+                         RecordValue(lm.encode(),
+                                     RecordType::RT_LIST_META,
+                                     sess->getCtx()->getVersionEP(),
+                                     ttl,
+                                     rv),
+                         txn);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    return val;
+  }
   uint64_t idx;
   if (pos == ListPos::LP_HEAD) {
     idx = head++;
@@ -116,30 +540,39 @@ Expected<std::string> genericPush(Session* sess,
     return rv.status();
   } else if (needExist) {
     return Command::fmtZero();
+  } else if (sess->getServerEntry()->getParams()->listMaxSegmentEntries > 0) {
+    lm.setSegmented(true);
   }
 
-  uint64_t head = lm.getHead();
-  uint64_t tail = lm.getTail();
-  for (size_t i = 0; i < args.size(); ++i) {
-    uint64_t idx;
-    if (pos == ListPos::LP_HEAD) {
-      idx = --head;
-    } else {
-      idx = tail++;
-    }
-    RecordKey subRk(metaRk.getChunkId(),
-                    metaRk.getDbId(),
-                    RecordType::RT_LIST_ELE,
-                    metaRk.getPrimaryKey(),
-                    std::to_string(idx));
-    RecordValue subRv(args[i], RecordType::RT_LIST_ELE, -1);
-    Status s = kvstore->setKV(subRk, subRv, txn);
+  if (lm.isSegmented()) {
+    Status s = segmentedPush(sess, kvstore, txn, metaRk, &lm, args, pos);
     if (!s.ok()) {
       return s;
     }
+  } else {
+    uint64_t head = lm.getHead();
+    uint64_t tail = lm.getTail();
+    for (size_t i = 0; i < args.size(); ++i) {
+      uint64_t idx;
+      if (pos == ListPos::LP_HEAD) {
+        idx = --head;
+      } else {
+        idx = tail++;
+      }
+      RecordKey subRk(metaRk.getChunkId(),
+                      metaRk.getDbId(),
+                      RecordType::RT_LIST_ELE,
+                      metaRk.getPrimaryKey(),
+                      std::to_string(idx));
+      RecordValue subRv(args[i], RecordType::RT_LIST_ELE, -1);
+      Status s = kvstore->setKV(subRk, subRv, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    lm.setHead(head);
+    lm.setTail(tail);
   }
-  lm.setHead(head);
-  lm.setTail(tail);
   Status s = kvstore->setKV(metaRk,
                             RecordValue(lm.encode(),
                                         RecordType::RT_LIST_META,
@@ -153,6 +586,69 @@ Expected<std::string> genericPush(Session* sess,
   return Command::fmtLongLong(lm.getTail() - lm.getHead());
 }
 
+// requirement: X lock of the key held.
+// return ERR_NOTFOUND if the list does not exist
+Expected<std::string> listPopInLock(Session* sess,
+                                    const std::string& key,
+                                    ListPos pos) {
+  SessionCtx* pCtx = sess->getCtx();
+  INVARIANT(pCtx != nullptr);
+  auto server = sess->getServerEntry();
+  auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+  if (!expdb.ok()) {
+    return expdb.status();
+  }
+  Expected<RecordValue> rv =
+    Command::expireKeyIfNeeded(sess, key, RecordType::RT_LIST_META);
+  if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  } else if (!rv.ok()) {
+    return rv.status();
+  }
+
+  // record exists
+  RecordKey metaRk(expdb.value().chunkId,
+                   pCtx->getDbId(),
+                   RecordType::RT_LIST_META,
+                   key,
+                   "");
+  PStore kvstore = expdb.value().store;
+
+  for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    Expected<std::string> s1 =
+      genericPop(sess, kvstore, txn.get(), metaRk, rv, pos);
+    if (!s1.ok()) {
+      return s1.status();
+    }
+    auto s = txn->commit();
+    if (s.ok()) {
+      return s1.value();
+    } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+      return s.status();
+    }
+    if (i == Command::RETRY_CNT - 1) {
+      return s.status();
+    } else {
+      continue;
+    }
+  }
+
+  INVARIANT_D(0);
+  return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+}
+
+// wake up the sessions blocked on the key, after the push is committed
+// and before the key lock is released.
+void signalListPushed(Session* sess, const std::string& key, size_t n) {
+  sess->getServerEntry()->getBlockingMgr()->signalKeyReady(
+    sess->getCtx()->getDbId(), key, n);
+}
+
 class LLenCommand : public Command {
  public:
   LLenCommand() : Command("llen", "rF") {}
@@ -226,60 +722,19 @@ class ListPopWrapper : public Command {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
 
-    SessionCtx* pCtx = sess->getCtx();
-    INVARIANT(pCtx != nullptr);
-
     auto server = sess->getServerEntry();
     auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
       sess, key, mgl::LockMode::LOCK_X);
     if (!expdb.ok()) {
       return expdb.status();
     }
-    Expected<RecordValue> rv =
-      Command::expireKeyIfNeeded(sess, key, RecordType::RT_LIST_META);
-    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    auto v = listPopInLock(sess, key, _pos);
+    if (v.status().code() == ErrorCodes::ERR_NOTFOUND) {
       return Command::fmtNull();
-    } else if (!rv.ok()) {
-      return rv.status();
-    }
-
-    // record exists
-    RecordKey metaRk(expdb.value().chunkId,
-                     pCtx->getDbId(),
-                     RecordType::RT_LIST_META,
-                     key,
-                     "");
-    PStore kvstore = expdb.value().store;
-
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      Expected<std::string> s1 =
-        genericPop(sess, kvstore, txn.get(), metaRk, rv, _pos);
-      if (s1.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        return Command::fmtNull();
-      } else if (!s1.ok()) {
-        return s1.status();
-      }
-      auto s = txn->commit();
-      if (s.ok()) {
-        return Command::fmtBulk(s1.value());
-      } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return s.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return s.status();
-      } else {
-        continue;
-      }
+    } else if (!v.ok()) {
+      return v.status();
     }
-
-    INVARIANT_D(0);
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+    return Command::fmtBulk(v.value());
   }
 
  private:
@@ -357,66 +812,351 @@ class ListPushWrapper : public Command {
     for (size_t i = 2; i < args.size(); ++i) {
       valargs.push_back(args[i]);
     }
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      Expected<std::string> s1 = genericPush(
-        sess, kvstore, txn.get(), metaRk, rv, valargs, _pos, _needExist);
-      if (!s1.ok()) {
-        return s1.status();
-      }
-      auto s = txn->commit();
-      if (s.ok()) {
-        return s1.value();
-      } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return s.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return s.status();
-      } else {
-        continue;
+    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
+      auto ptxn = kvstore->createTransaction(sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+      Expected<std::string> s1 = genericPush(
+        sess, kvstore, txn.get(), metaRk, rv, valargs, _pos, _needExist);
+      if (!s1.ok()) {
+        return s1.status();
+      }
+      auto s = txn->commit();
+      if (s.ok()) {
+        signalListPushed(sess, key, valargs.size());
+        return s1.value();
+      } else if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+        return s.status();
+      }
+      if (i == RETRY_CNT - 1) {
+        return s.status();
+      } else {
+        continue;
+      }
+    }
+
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
+
+ private:
+  ListPos _pos;
+  bool _needExist;
+};
+
+class LPushCommand : public ListPushWrapper {
+ public:
+  LPushCommand() : ListPushWrapper("lpush", "wmF", ListPos::LP_HEAD, false) {}
+} lpushCommand;
+
+class RPushCommand : public ListPushWrapper {
+ public:
+  RPushCommand() : ListPushWrapper("rpush", "wmF", ListPos::LP_TAIL, false) {}
+} rpushCommand;
+
+class LPushXCommand : public ListPushWrapper {
+ public:
+  LPushXCommand() : ListPushWrapper("lpushx", "wmF", ListPos::LP_HEAD, true) {}
+} lpushxCommand;
+
+class RPushXCommand : public ListPushWrapper {
+ public:
+  RPushXCommand() : ListPushWrapper("rpushx", "wmF", ListPos::LP_TAIL, true) {}
+} rpushxCommand;
+
+// requirement: X locks of key1 and key2 held.
+// return ERR_NOTFOUND if key1 does not exist
+// NOTE(deyukong): atomic is not guaranteed
+Expected<std::string> rpoplpushInLock(Session* sess,
+                                      const std::string& key1,
+                                      const std::string& key2) {
+  SessionCtx* pCtx = sess->getCtx();
+  auto server = sess->getServerEntry();
+  INVARIANT(pCtx != nullptr);
+
+  Expected<RecordValue> rv =
+    Command::expireKeyIfNeeded(sess, key1, RecordType::RT_LIST_META);
+  if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+      rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  } else if (!rv.ok()) {
+    return rv.status();
+  }
+
+  auto expdb1 = server->getSegmentMgr()->getDbHasLocked(sess, key1);
+  if (!expdb1.ok()) {
+    return expdb1.status();
+  }
+  RecordKey metaRk1(expdb1.value().chunkId,
+                    pCtx->getDbId(),
+                    RecordType::RT_LIST_META,
+                    key1,
+                    "");
+  PStore kvstore1 = expdb1.value().store;
+  auto etxn = pCtx->createTransaction(kvstore1);
+  if (!etxn.ok()) {
+    return etxn.status();
+  }
+  bool rollback = true;
+  const auto guard = MakeGuard([&rollback, &pCtx] {
+    if (rollback) {
+      pCtx->rollbackAll();
+    }
+  });
+
+  std::string val = "";
+  for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+    Expected<std::string> s =
+      genericPop(sess, kvstore1, etxn.value(), metaRk1, rv, ListPos::LP_TAIL);
+    if (s.ok()) {
+      val = std::move(s.value());
+      break;
+    }
+    if (s.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return {ErrorCodes::ERR_NOTFOUND, ""};
+    }
+
+    if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+      return s.status();
+    }
+    if (i == Command::RETRY_CNT - 1) {
+      return s.status();
+    } else {
+      continue;
+    }
+  }
+
+  if (key1 == key2) {
+    // NOTE(vinchen): if key1 == key2, it should getkv of rv2 using
+    // etxn, because key1 has be pop() by etxn. Otherwise if rv2 =
+    // Command::expireKeyIfNeeded(), it would get the old value.
+    auto rv2 = kvstore1->getKV(metaRk1, etxn.value());
+    // Only means that former pop has removed this meta key.
+    // if (!rv2.ok()) {
+    // INVARIANT(0);
+    // return {ErrorCodes::ERR_NOTFOUND, ""};
+    // }
+
+    for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+      auto s = genericPush(sess,
+                           kvstore1,
+                           etxn.value(),
+                           metaRk1,
+                           rv2,
+                           {val},
+                           ListPos::LP_HEAD,
+                           false /*need_exist*/);
+      if (s.ok()) {
+        pCtx->commitAll("rpoplpush");
+        rollback = false;
+        signalListPushed(sess, key2, 1);
+        return val;
+      }
+      if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+        return s.status();
+      }
+      if (i == Command::RETRY_CNT - 1) {
+        return s.status();
+      } else {
+        continue;
+      }
+    }
+  } else {
+    auto expdb2 = server->getSegmentMgr()->getDbHasLocked(sess, key2);
+    if (!expdb2.ok()) {
+      return expdb2.status();
+    }
+    RecordKey metaRk2(expdb2.value().chunkId,
+                      pCtx->getDbId(),
+                      RecordType::RT_LIST_META,
+                      key2,
+                      "");
+    PStore kvstore2 = expdb2.value().store;
+
+    auto etxn2 = pCtx->createTransaction(kvstore2);
+    if (!etxn2.ok()) {
+      return etxn2.status();
+    }
+
+    Expected<RecordValue> rv2 =
+      Command::expireKeyIfNeeded(sess, key2, RecordType::RT_LIST_META);
+    if (rv2.status().code() != ErrorCodes::ERR_OK &&
+        rv2.status().code() != ErrorCodes::ERR_EXPIRED &&
+        rv2.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return rv2.status();
+    }
+
+    for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+      auto s = genericPush(sess,
+                           kvstore2,
+                           etxn2.value(),
+                           metaRk2,
+                           rv2,
+                           {val},
+                           ListPos::LP_HEAD,
+                           false /*need_exist*/);
+      if (s.ok()) {
+        pCtx->commitAll("rpoplpush");
+        rollback = false;
+        signalListPushed(sess, key2, 1);
+        return val;
+      }
+      if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
+        return s.status();
+      }
+      if (i == Command::RETRY_CNT - 1) {
+        return s.status();
+      } else {
+        continue;
+      }
+    }
+  }
+  INVARIANT_D(0);
+  return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+}
+
+class RPopLPushCommand : public Command {
+ public:
+  RPopLPushCommand() : Command("rpoplpush", "wm") {}
+
+  ssize_t arity() const {
+    return 3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 2;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    auto server = sess->getServerEntry();
+
+    auto index = getKeysFromCommand(args);
+    auto locklist = server->getSegmentMgr()->getAllKeysLocked(
+      sess, args, index, mgl::LockMode::LOCK_X);
+    if (!locklist.ok()) {
+      return locklist.status();
+    }
+    auto v = rpoplpushInLock(sess, args[1], args[2]);
+    if (v.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtNull();
+    } else if (!v.ok()) {
+      return v.status();
+    }
+    return Command::fmtBulk(v.value());
+  }
+} rpoplpushCmd;
+
+// the timeout of the blocking commands is in seconds, return it in ms
+Expected<uint64_t> getBlockingTimeout(const std::string& s) {
+  auto d = ::tendisplus::stod(s);
+  if (!d.ok() || d.value() > 1e12) {
+    return {ErrorCodes::ERR_PARSEOPT,
+            "timeout is not a float or out of range"};
+  }
+  if (d.value() < 0) {
+    return {ErrorCodes::ERR_PARSEOPT, "timeout is negative"};
+  }
+  uint64_t ms = static_cast<uint64_t>(d.value() * 1000);
+  if (ms == 0 && d.value() > 0) {
+    // 0 means blocking forever
+    ms = 1;
+  }
+  return ms;
+}
+
+class BListPopWrapper : public Command {
+ public:
+  explicit BListPopWrapper(ListPos pos)
+    : Command(pos == ListPos::LP_HEAD ? "blpop" : "brpop", "ws"), _pos(pos) {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return -2;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    auto timeout = getBlockingTimeout(args.back());
+    if (!timeout.ok()) {
+      return timeout.status();
+    }
+
+    auto server = sess->getServerEntry();
+    auto index = getKeysFromCommand(args);
+    auto locklist = server->getSegmentMgr()->getAllKeysLocked(
+      sess, args, index, mgl::LockMode::LOCK_X);
+    if (!locklist.ok()) {
+      return locklist.status();
+    }
+
+    std::vector<std::string> keys;
+    for (auto i : index) {
+      const std::string& key = args[i];
+      auto v = listPopInLock(sess, key, _pos);
+      if (v.ok()) {
+        std::stringstream ss;
+        Command::fmtMultiBulkLen(ss, 2);
+        Command::fmtBulk(ss, key);
+        Command::fmtBulk(ss, v.value());
+        return ss.str();
+      } else if (v.status().code() != ErrorCodes::ERR_NOTFOUND) {
+        return v.status();
       }
+      keys.push_back(key);
     }
 
-    INVARIANT_D(0);
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+    // it is blocked with the key locks held, so no push is missed.
+    // like redis, it does not block in a transaction.
+    if (sess->getCtx()->isInMulti() ||
+        !sess->blockOnKeys(keys, timeout.value(), Command::fmtNullArray())
+           .ok()) {
+      return Command::fmtNullArray();
+    }
+    return std::string();
   }
 
  private:
   ListPos _pos;
-  bool _needExist;
 };
 
-class LPushCommand : public ListPushWrapper {
- public:
-  LPushCommand() : ListPushWrapper("lpush", "wmF", ListPos::LP_HEAD, false) {}
-} lpushCommand;
-
-class RPushCommand : public ListPushWrapper {
- public:
-  RPushCommand() : ListPushWrapper("rpush", "wmF", ListPos::LP_TAIL, false) {}
-} rpushCommand;
-
-class LPushXCommand : public ListPushWrapper {
+class BLPopCommand : public BListPopWrapper {
  public:
-  LPushXCommand() : ListPushWrapper("lpushx", "wmF", ListPos::LP_HEAD, true) {}
-} lpushxCommand;
+  BLPopCommand() : BListPopWrapper(ListPos::LP_HEAD) {}
+} blpopCommand;
 
-class RPushXCommand : public ListPushWrapper {
+class BRPopCommand : public BListPopWrapper {
  public:
-  RPushXCommand() : ListPushWrapper("rpushx", "wmF", ListPos::LP_TAIL, true) {}
-} rpushxCommand;
+  BRPopCommand() : BListPopWrapper(ListPos::LP_TAIL) {}
+} brpopCommand;
 
-// NOTE(deyukong): atomic is not guaranteed
-class RPopLPushCommand : public Command {
+class BRPopLPushCommand : public Command {
  public:
-  RPopLPushCommand() : Command("rpoplpush", "wm") {}
+  BRPopLPushCommand() : Command("brpoplpush", "wms") {}
 
   ssize_t arity() const {
-    return 3;
+    return 4;
   }
 
   int32_t firstkey() const {
@@ -433,159 +1173,33 @@ class RPopLPushCommand : public Command {
 
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
-    const std::string& key1 = args[1];
-    const std::string& key2 = args[2];
+    auto timeout = getBlockingTimeout(args[3]);
+    if (!timeout.ok()) {
+      return timeout.status();
+    }
 
-    SessionCtx* pCtx = sess->getCtx();
     auto server = sess->getServerEntry();
-    INVARIANT(pCtx != nullptr);
-
     auto index = getKeysFromCommand(args);
     auto locklist = server->getSegmentMgr()->getAllKeysLocked(
       sess, args, index, mgl::LockMode::LOCK_X);
     if (!locklist.ok()) {
       return locklist.status();
     }
-
-    Expected<RecordValue> rv =
-      Command::expireKeyIfNeeded(sess, key1, RecordType::RT_LIST_META);
-    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtNull();
-    } else if (!rv.ok()) {
-      return rv.status();
-    }
-
-    auto expdb1 = server->getSegmentMgr()->getDbHasLocked(sess, key1);
-    if (!expdb1.ok()) {
-      return expdb1.status();
-    }
-    RecordKey metaRk1(expdb1.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_META,
-                      key1,
-                      "");
-    PStore kvstore1 = expdb1.value().store;
-    auto etxn = pCtx->createTransaction(kvstore1);
-    if (!etxn.ok()) {
-      return etxn.status();
-    }
-    bool rollback = true;
-    const auto guard = MakeGuard([&rollback, &pCtx] {
-      if (rollback) {
-        pCtx->rollbackAll();
-      }
-    });
-
-    std::string val = "";
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      Expected<std::string> s =
-        genericPop(sess, kvstore1, etxn.value(), metaRk1, rv, ListPos::LP_TAIL);
-      if (s.ok()) {
-        val = std::move(s.value());
-        break;
-      }
-      if (s.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        return Command::fmtNull();
-      }
-
-      if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return s.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return s.status();
-      } else {
-        continue;
-      }
+    auto v = rpoplpushInLock(sess, args[1], args[2]);
+    if (v.ok()) {
+      return Command::fmtBulk(v.value());
+    } else if (v.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return v.status();
     }
 
-    if (key1 == key2) {
-      // NOTE(vinchen): if key1 == key2, it should getkv of rv2 using
-      // etxn, because key1 has be pop() by etxn. Otherwise if rv2 =
-      // Command::expireKeyIfNeeded(), it would get the old value.
-      auto rv2 = kvstore1->getKV(metaRk1, etxn.value());
-      // Only means that former pop has removed this meta key.
-      // if (!rv2.ok()) {
-      // INVARIANT(0);
-      // return Command::fmtNull();
-      // }
-
-      for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-        auto s = genericPush(sess,
-                             kvstore1,
-                             etxn.value(),
-                             metaRk1,
-                             rv2,
-                             {val},
-                             ListPos::LP_HEAD,
-                             false /*need_exist*/);
-        if (s.ok()) {
-          pCtx->commitAll("rpoplpush");
-          rollback = false;
-          return Command::fmtBulk(val);
-        }
-        if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-          return s.status();
-        }
-        if (i == RETRY_CNT - 1) {
-          return s.status();
-        } else {
-          continue;
-        }
-      }
-    } else {
-      auto expdb2 = server->getSegmentMgr()->getDbHasLocked(sess, key2);
-      if (!expdb2.ok()) {
-        return expdb2.status();
-      }
-      RecordKey metaRk2(expdb2.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_LIST_META,
-                        key2,
-                        "");
-      PStore kvstore2 = expdb2.value().store;
-
-      auto etxn2 = pCtx->createTransaction(kvstore2);
-      if (!etxn2.ok()) {
-        return etxn2.status();
-      }
-
-      Expected<RecordValue> rv2 =
-        Command::expireKeyIfNeeded(sess, key2, RecordType::RT_LIST_META);
-      if (rv2.status().code() != ErrorCodes::ERR_OK &&
-          rv2.status().code() != ErrorCodes::ERR_EXPIRED &&
-          rv2.status().code() != ErrorCodes::ERR_NOTFOUND) {
-        return rv2.status();
-      }
-
-      for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-        auto s = genericPush(sess,
-                             kvstore2,
-                             etxn2.value(),
-                             metaRk2,
-                             rv2,
-                             {val},
-                             ListPos::LP_HEAD,
-                             false /*need_exist*/);
-        if (s.ok()) {
-          pCtx->commitAll("rpoplpush");
-          rollback = false;
-          return Command::fmtBulk(val);
-        }
-        if (s.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-          return s.status();
-        }
-        if (i == RETRY_CNT - 1) {
-          return s.status();
-        } else {
-          continue;
-        }
-      }
+    if (sess->getCtx()->isInMulti() ||
+        !sess->blockOnKeys({args[1]}, timeout.value(), Command::fmtNull())
+           .ok()) {
+      return Command::fmtNull();
     }
-    INVARIANT_D(0);
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+    return std::string();
   }
-} rpoplpushCmd;
+} brpoplpushCmd;
 
 class LtrimCommand : public Command {
  public:
@@ -681,6 +1295,82 @@ class LtrimCommand : public Command {
     return commitstatus.status();
   }
 
+  // keep the elements in [start, end] in one txn, the segments are dropped
+  // from the ends of the list and only the two at the bounds are rewritten
+  Status trimListSegmented(Session* sess,
+                           PStore kvstore,
+                           const RecordKey& mk,
+                           ListMetaValue* lm,
+                           int64_t start,
+                           int64_t end,
+                           const Expected<RecordValue>& rv) {
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    CountedTree tree = listTree(mk, kvstore);
+    auto eTotal = tree.total(txn.get());
+    if (!eTotal.ok()) {
+      return eTotal.status();
+    }
+    uint64_t total = eTotal.value();
+    // the elements to drop from the tail, then from the head
+    uint64_t drops[2] = {total - std::min<uint64_t>(end + 1, total),
+                         static_cast<uint64_t>(start)};
+    for (int i = 0; i < 2; ++i) {
+      bool atTail = i == 0;
+      while (drops[i] > 0 && total > 0) {
+        auto ePos = atTail ? tree.last(txn.get()) : tree.first(txn.get());
+        if (!ePos.ok()) {
+          return ePos.status();
+        }
+        uint64_t count = tree.get(ePos.value()).count;
+        uint64_t drop = std::min(count, drops[i]);
+        Status s;
+        if (drop == count) {
+          s = dropSegment(kvstore, txn.get(), mk, &tree, ePos.value());
+        } else {
+          auto eSeg = loadSegment(kvstore, txn.get(), mk, tree, ePos.value());
+          if (!eSeg.ok()) {
+            return eSeg.status();
+          }
+          auto eles = eSeg.value().getMutableElements();
+          if (atTail) {
+            eles->resize(count - drop);
+          } else {
+            eles->erase(eles->begin(), eles->begin() + drop);
+          }
+          s = saveSegment(
+            kvstore, txn.get(), mk, &tree, ePos.value(), eSeg.value());
+        }
+        if (!s.ok()) {
+          return s;
+        }
+        drops[i] -= drop;
+        total -= drop;
+      }
+    }
+    Status st = saveTree(&tree, txn.get(), lm);
+    if (!st.ok()) {
+      return st;
+    }
+    if (lm->getHead() == lm->getTail()) {
+      st = Command::delKeyAndTTL(sess, mk, rv.value(), txn.get());
+    } else {
+      RecordValue metarcd(lm->encode(),
+                          RecordType::RT_LIST_META,
+                          sess->getCtx()->getVersionEP(),
+                          rv.value().getTtl(),
+                          rv);
+      st = kvstore->setKV(mk, metarcd, txn.get());
+    }
+    if (!st.ok()) {
+      return st;
+    }
+    return txn->commit().status();
+  }
+
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
@@ -749,7 +1439,13 @@ class LtrimCommand : public Command {
     if (end >= len) {
       end = len - 1;
     }
-    Status st = trimListPessimistic(sess, kvstore, metaRk, lm, start, end, rv);
+    Status st;
+    if (lm.isSegmented()) {
+      st = trimListSegmented(
+        sess, kvstore, metaRk, &exptLm.value(), start, end, rv);
+    } else {
+      st = trimListPessimistic(sess, kvstore, metaRk, lm, start, end, rv);
+    }
     if (!st.ok()) {
       return st;
     }
@@ -778,6 +1474,10 @@ class LRangeCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
     Expected<int64_t> estart = ::tendisplus::stoll(args[2]);
@@ -799,9 +1499,11 @@ class LRangeCommand : public Command {
     Expected<RecordValue> rv =
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_LIST_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
-      return fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     } else if (!rv.ok()) {
       return rv.status();
     }
@@ -843,15 +1545,51 @@ class LRangeCommand : public Command {
       start = 0;
     }
     if (start > end || start >= len) {
-      return Command::fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     }
     if (end >= len) {
       end = len - 1;
     }
     int64_t rangelen = (end - start) + 1;
+    if (lm.isSegmented()) {
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_LIST_META,
+                       key,
+                       "");
+      CountedTree tree = listTree(metaRk, kvstore);
+      auto ePos = tree.seekCount(start, txn.get());
+      if (!ePos.ok()) {
+        return ePos.status();
+      }
+      CountedTree::Pos segPos = std::move(ePos.value());
+      uint64_t offset = start - segPos.before;
+      writer->appendMultiBulkLen(rangelen);
+      while (true) {
+        auto eSeg = loadSegment(kvstore, txn.get(), metaRk, tree, segPos);
+        if (!eSeg.ok()) {
+          return eSeg.status();
+        }
+        const auto& eles = eSeg.value().getElements();
+        for (; offset < eles.size() && rangelen > 0; ++offset, --rangelen) {
+          writer->appendBulk(eles[offset]);
+        }
+        if (rangelen == 0) {
+          return {ErrorCodes::ERR_OK, ""};
+        }
+        auto eNext = tree.next(&segPos, txn.get());
+        if (!eNext.ok()) {
+          return eNext.status();
+        }
+        if (!eNext.value()) {
+          return {ErrorCodes::ERR_INTERNAL, "list segments too short"};
+        }
+        offset = 0;
+      }
+    }
     start += head;
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rangelen);
+    writer->appendMultiBulkLen(rangelen);
     while (rangelen--) {
       RecordKey subRk(expdb.value().chunkId,
                       pCtx->getDbId(),
@@ -860,13 +1598,13 @@ class LRangeCommand : public Command {
                       std::to_string(start));
       Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
       if (eSubVal.ok()) {
-        Command::fmtBulk(ss, eSubVal.value().getValue());
+        writer->appendBulk(eSubVal.value().getValue());
       } else {
         return eSubVal.status();
       }
       start++;
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 } lrangeCmd;
 
@@ -951,6 +1689,19 @@ class LIndexCommand : public Command {
     if (mappingIdx < head || mappingIdx >= tail) {
       return fmtNull();
     }
+    if (lm.isSegmented()) {
+      CountedTree tree = listTree(metaRk, kvstore);
+      auto ePos = tree.seekCount(mappingIdx - head, txn.get());
+      if (!ePos.ok()) {
+        return ePos.status();
+      }
+      auto eSeg = loadSegment(kvstore, txn.get(), metaRk, tree, ePos.value());
+      if (!eSeg.ok()) {
+        return eSeg.status();
+      }
+      uint64_t offset = mappingIdx - head - ePos.value().before;
+      return fmtBulk(eSeg.value().getElements()[offset]);
+    }
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_LIST_ELE,
@@ -1035,22 +1786,41 @@ class LSetCommand : public Command {
       }
       std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(realIndex));
-      RecordValue subRv(value, RecordType::RT_LIST_ELE, -1);
-      Status s = kvstore->setKV(subRk, subRv, txn.get());
-      if (!s.ok()) {
-        return s;
-      }
-      // update meta key's revision
       RecordKey metaRk(expdb.value().chunkId,
                        pCtx->getDbId(),
                        RecordType::RT_LIST_META,
                        key,
                        "");
+      Status s;
+      if (lm.isSegmented()) {
+        CountedTree tree = listTree(metaRk, kvstore);
+        auto ePos = tree.seekCount(realIndex - head, txn.get());
+        if (!ePos.ok()) {
+          return ePos.status();
+        }
+        auto eSeg =
+          loadSegment(kvstore, txn.get(), metaRk, tree, ePos.value());
+        if (!eSeg.ok()) {
+          return eSeg.status();
+        }
+        uint64_t offset = realIndex - head - ePos.value().before;
+        (*eSeg.value().getMutableElements())[offset] = value;
+        // the size is kept, no node of the tree is changed
+        s = saveSegment(
+          kvstore, txn.get(), metaRk, &tree, ePos.value(), eSeg.value());
+      } else {
+        RecordKey subRk(expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_LIST_ELE,
+                        key,
+                        std::to_string(realIndex));
+        RecordValue subRv(value, RecordType::RT_LIST_ELE, -1);
+        s = kvstore->setKV(subRk, subRv, txn.get());
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      // update meta key's revision
       s = kvstore->setKV(metaRk,
                          RecordValue(lm.encode(),
                                      RecordType::RT_LIST_META,
@@ -1140,13 +1910,11 @@ class LRemCommand : public Command {
       return expLm.status();
     }
     ListMetaValue lm = std::move(expLm.value());
-    uint64_t head = lm.getHead();
-    uint64_t tail = lm.getTail();
-
-    size_t len = tail - head;
-    uint64_t index = pos == ListPos::LP_HEAD ? head : tail - 1;
-    std::vector<uint64_t> hole;
-    hole.push_back(head - 1);
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_LIST_META,
+                     key,
+                     "");
 
     PStore kvstore = expdb.value().store;
     auto ptxn = kvstore->createTransaction(sess);
@@ -1155,6 +1923,52 @@ class LRemCommand : public Command {
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
+    if (needSegmented(sess, lm)) {
+      Status s = convertToSegmented(sess, kvstore, txn.get(), metaRk, &lm);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (lm.isSegmented()) {
+      auto eRemoved =
+        segmentedRemove(kvstore, txn.get(), metaRk, &lm, value, count, pos);
+      if (!eRemoved.ok()) {
+        return eRemoved.status();
+      }
+      // nothing is committed, including the conversion
+      if (eRemoved.value() == 0) {
+        return Command::fmtZero();
+      }
+      Status s;
+      if (lm.getHead() == lm.getTail()) {
+        s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn.get());
+      } else {
+        s = kvstore->setKV(metaRk,
+                           RecordValue(lm.encode(),
+                                       RecordType::RT_LIST_META,
+                                       sess->getCtx()->getVersionEP(),
+                                       rv.value().getTtl(),
+                                       rv),
+                           txn.get());
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      Expected<uint64_t> expCmt = txn->commit();
+      if (!expCmt.ok()) {
+        return expCmt.status();
+      }
+      return Command::fmtLongLong(static_cast<int64_t>(eRemoved.value()));
+    }
+
+    uint64_t head = lm.getHead();
+    uint64_t tail = lm.getTail();
+
+    size_t len = tail - head;
+    uint64_t index = pos == ListPos::LP_HEAD ? head : tail - 1;
+    std::vector<uint64_t> hole;
+    hole.push_back(head - 1);
+
     for (size_t i = 0; i < len; i++) {
       RecordKey subRk(expdb.value().chunkId,
                       pCtx->getDbId(),
@@ -1285,11 +2099,6 @@ class LRemCommand : public Command {
 
     lm.setHead(head);
     lm.setTail(tail);
-    RecordKey metaRk(expdb.value().chunkId,
-                     pCtx->getDbId(),
-                     RecordType::RT_LIST_META,
-                     key,
-                     "");
     Status s;
     if (head == tail) {
       s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn.get());
@@ -1373,10 +2182,11 @@ class LInsertCommand : public Command {
     }
 
     ListMetaValue lm = std::move(expLm.value());
-    uint64_t head = lm.getHead();
-    uint64_t tail = lm.getTail();
-    uint64_t len = tail - head;
-    uint64_t index = head;
+    RecordKey metaRk(expdb.value().chunkId,
+                     pCtx->getDbId(),
+                     RecordType::RT_LIST_META,
+                     key,
+                     "");
 
     PStore kvstore = expdb.value().store;
     auto ptxn = kvstore->createTransaction(sess);
@@ -1384,6 +2194,44 @@ class LInsertCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    if (needSegmented(sess, lm)) {
+      Status s = convertToSegmented(sess, kvstore, txn.get(), metaRk, &lm);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (lm.isSegmented()) {
+      auto eFound = segmentedInsert(
+        sess, kvstore, txn.get(), metaRk, &lm, pivot, value, step > 0);
+      if (!eFound.ok()) {
+        return eFound.status();
+      }
+      // nothing is committed, including the conversion
+      if (!eFound.value()) {
+        return Command::fmtLongLong(-1);
+      }
+      Status s = kvstore->setKV(metaRk,
+                                RecordValue(lm.encode(),
+                                            RecordType::RT_LIST_META,
+                                            pCtx->getVersionEP(),
+                                            rv.value().getTtl(),
+                                            rv),
+                                txn.get());
+      if (!s.ok()) {
+        return s;
+      }
+      Expected<uint64_t> expCmt = txn->commit();
+      if (!expCmt.ok()) {
+        return expCmt.status();
+      }
+      return Command::fmtLongLong(lm.getTail() - lm.getHead());
+    }
+
+    uint64_t head = lm.getHead();
+    uint64_t tail = lm.getTail();
+    uint64_t len = tail - head;
+    uint64_t index = head;
     while (len > 0) {
       RecordKey subRk(expdb.value().chunkId,
                       pCtx->getDbId(),
@@ -1464,11 +2312,6 @@ class LInsertCommand : public Command {
 
     lm.setHead(head);
     lm.setTail(tail);
-    RecordKey metaRk(expdb.value().chunkId,
-                     pCtx->getDbId(),
-                     RecordType::RT_LIST_META,
-                     key,
-                     "");
     s = kvstore->setKV(metaRk,
                        RecordValue(lm.encode(),
                                    RecordType::RT_LIST_META,
@@ -312,8 +312,9 @@ class FullSyncCommand : public Command {
  public:
   FullSyncCommand() : Command("fullsync", "a") {}
 
+  // fullsync storeId slaveIp slavePort [window]
   ssize_t arity() const {
-    return 4;
+    return -4;
   }
 
   int32_t firstkey() const {
@@ -462,6 +463,11 @@ class ApplyBinlogsGeneric : public Command {
     auto replMgr = svr->getReplManager();
     INVARIANT(replMgr != nullptr);
 
+    if (mode == BinlogApplyMode::KEEP_BINLOG_ID &&
+        replMgr->isParallelApplyEnabled()) {
+      return runParallel(sess, storeId, binlogs, binlogCnt);
+    }
+
     size_t cnt = 0;
     BinlogReader reader(binlogs);
     while (true) {
@@ -505,6 +511,36 @@ class ApplyBinlogsGeneric : public Command {
     return {ErrorCodes::ERR_OK, ""};
   }
 
+  static Status runParallel(Session* sess,
+                            uint32_t storeId,
+                            const std::string& binlogs,
+                            size_t binlogCnt) {
+    auto replMgr = sess->getServerEntry()->getReplManager();
+    std::vector<ReplLogRawV2> logs;
+    logs.reserve(binlogCnt);
+    BinlogReader reader(binlogs);
+    while (true) {
+      auto eLog = reader.next();
+      if (eLog.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      } else if (!eLog.ok()) {
+        LOG(ERROR) << "reader.next() failed:" << eLog.status().toString();
+        return eLog.status();
+      }
+      logs.emplace_back(std::move(eLog.value()));
+    }
+    if (logs.size() != binlogCnt) {
+      return {ErrorCodes::ERR_PARSEOPT, "invalid binlog size of binlog count"};
+    }
+
+    auto s = replMgr->applyRepllogsV2(sess, storeId, logs);
+    if (!s.ok()) {
+      LOG(ERROR) << "applyRepllogsV2 failed:" << s.toString();
+      return s;
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
   static Status runFlush(Session* sess,
                          uint32_t storeId,
                          const std::string& binlogs,
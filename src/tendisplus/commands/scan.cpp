@@ -14,11 +14,64 @@
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/time.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/varint.h"
-#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/zsetindex.h"
 
 namespace tendisplus {
+
+// the same as Command::scan(), but for a hash, set or zset packed in its
+// meta. The cursor is also an encoded sub key of the type of fake, so it is
+// still valid if the key is expanded between two calls.
+Expected<std::pair<std::string, std::list<Record>>> scanPacked(
+  const RecordKey& fake,
+  const PackedEntries& packed,
+  const std::string& from,
+  uint64_t cnt) {
+  std::string start;
+  if (from != "0") {
+    auto unhex = unhexlify(from);
+    if (!unhex.ok()) {
+      return unhex.status();
+    }
+    start = std::move(unhex.value());
+  }
+  const auto& entries = packed.getEntries();
+  // encoded sub key and index of the entry
+  std::vector<std::pair<std::string, size_t>> keys;
+  for (size_t i = 0; i < entries.size(); i++) {
+    RecordKey rk(fake.getChunkId(),
+                 fake.getDbId(),
+                 fake.getRecordType(),
+                 fake.getPrimaryKey(),
+                 entries[i].first);
+    std::string encoded = rk.encode();
+    if (encoded >= start) {
+      keys.emplace_back(std::move(encoded), i);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::list<Record> result;
+  std::string nextCursor = "0";
+  for (const auto& k : keys) {
+    if (result.size() == cnt) {
+      nextCursor = hexlify(k.first);
+      break;
+    }
+    const auto& entry = entries[k.second];
+    result.emplace_back(RecordKey(fake.getChunkId(),
+                                  fake.getDbId(),
+                                  fake.getRecordType(),
+                                  fake.getPrimaryKey(),
+                                  entry.first),
+                        RecordValue(entry.second, fake.getRecordType(), -1));
+  }
+  return std::move(
+    std::pair<std::string, std::list<Record>>(nextCursor, std::move(result)));
+}
+
 class ScanGenericCommand : public Command {
  public:
   ScanGenericCommand(const std::string& name, const char* sflags)
@@ -116,12 +169,13 @@ class ScanGenericCommand : public Command {
         return eMetaContent.status();
       }
       ZSlMetaValue meta = eMetaContent.value();
-      SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+      auto sl = makeZsetIndex(
+        expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
       Zrangespec range;
       if (zslParseRange(cursor.c_str(), maxscore.c_str(), &range) != 0) {
         return {ErrorCodes::ERR_ZSLPARSERANGE, ""};
       }
-      auto arr = sl.scanByScore(range, 0, count + 1, false, txn.get());
+      auto arr = sl->scanByScore(range, 0, count + 1, false, txn.get());
       if (!arr.ok()) {
         return arr.status();
       }
@@ -143,7 +197,37 @@ class ScanGenericCommand : public Command {
 
     RecordKey fake = genFakeRcd(expdb.value().chunkId, pCtx->getDbId(), key);
 
-    auto batch = Command::scan(fake.prefixPk(), cursor, count, txn.get());
+    bool packed = false;
+    PackedEntries entries;
+    if (getRcdType() == RecordType::RT_HASH_META) {
+      auto eHashMeta = HashMetaValue::decode(rv.value().getValue());
+      if (!eHashMeta.ok()) {
+        return eHashMeta.status();
+      }
+      packed = eHashMeta.value().isPacked();
+      entries = eHashMeta.value().getEntries();
+    } else if (getRcdType() == RecordType::RT_SET_META) {
+      auto eSetMeta = SetMetaValue::decode(rv.value().getValue());
+      if (!eSetMeta.ok()) {
+        return eSetMeta.status();
+      }
+      packed = eSetMeta.value().isPacked();
+      entries = eSetMeta.value().getEntries();
+    } else if (getRcdType() == RecordType::RT_ZSET_META) {
+      auto eZsetMeta = ZSlMetaValue::decode(rv.value().getValue());
+      if (!eZsetMeta.ok()) {
+        return eZsetMeta.status();
+      }
+      packed = eZsetMeta.value().isPacked();
+      entries = eZsetMeta.value().getEntries();
+    }
+    Expected<std::pair<std::string, std::list<Record>>> batch =
+      {ErrorCodes::ERR_INTERNAL, ""};
+    if (packed) {
+      batch = scanPacked(fake, entries, cursor, count);
+    } else {
+      batch = Command::scan(fake.prefixPk(), cursor, count, txn.get());
+    }
     if (!batch.ok()) {
       return batch.status();
     }
@@ -334,9 +418,163 @@ class ScanCommand : public Command {
     return false;
   }
 
-  // NOTE(deyukong): tendis did not impl this api
+  // the cursor is hexlify(storeId + encoded RecordKey), the
+  // RecordKey is the next RT_DATA_META key to visit in that store. "0" means
+  // start from the first store, and the returned cursor is "0" when done.
   Expected<std::string> run(Session* sess) final {
-    return Command::fmtZeroBulkLen();
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& cursor = args[1];
+    std::string pat;
+    bool usePatten = false;
+    std::string type;
+    uint64_t count = 10;
+    for (size_t i = 2; i < args.size(); i += 2) {
+      if (i + 1 >= args.size()) {
+        return {ErrorCodes::ERR_PARSEOPT, "syntax error"};
+      }
+      auto opt = toLower(args[i]);
+      if (opt == "count") {
+        Expected<uint64_t> ecnt = ::tendisplus::stoul(args[i + 1]);
+        if (!ecnt.ok()) {
+          return ecnt.status();
+        }
+        if (ecnt.value() < 1) {
+          return {ErrorCodes::ERR_PARSEOPT, "syntax error"};
+        }
+        count = ecnt.value();
+      } else if (opt == "match") {
+        pat = args[i + 1];
+        usePatten = !(pat[0] == '*' && pat.size() == 1);
+      } else if (opt == "type") {
+        type = toLower(args[i + 1]);
+      } else {
+        return {ErrorCodes::ERR_PARSEOPT, "syntax error"};
+      }
+    }
+
+    auto server = sess->getServerEntry();
+    uint32_t storeId = 0;
+    std::string from;
+    if (cursor != "0") {
+      auto unhex = unhexlify(cursor);
+      if (!unhex.ok() || unhex.value().size() < sizeof(uint32_t)) {
+        return {ErrorCodes::ERR_PARSEOPT, "invalid cursor"};
+      }
+      storeId = int32Decode(unhex.value().c_str());
+      from = unhex.value().substr(sizeof(uint32_t));
+      if (storeId >= server->getKVStoreCount()) {
+        return {ErrorCodes::ERR_PARSEOPT, "invalid cursor"};
+      }
+    }
+
+    uint32_t dbId = sess->getCtx()->getDbId();
+    uint32_t chunkSize = server->getSegmentMgr()->getChunkSize();
+    auto ts = msSinceEpoch();
+    // like redis, bound the work done by one call, so that
+    // a sparse keyspace does not pin the worker thread.
+    uint64_t maxVisit = count * 10;
+    uint64_t visited = 0;
+    std::list<std::string> result;
+    std::string nextCursor = "0";
+    for (; storeId < server->getKVStoreCount(); storeId++, from.clear()) {
+      auto expdb =
+        server->getSegmentMgr()->getDb(sess, storeId, mgl::LockMode::LOCK_IS);
+      if (!expdb.ok()) {
+        if (expdb.status().code() == ErrorCodes::ERR_STORE_NOT_OPEN) {
+          continue;
+        }
+        return expdb.status();
+      }
+      PStore kvstore = expdb.value().store;
+      auto ptxn = kvstore->createTransaction(sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+      auto dataCursor = txn->createDataCursor();
+      dataCursor->seek(from.empty() ? metaPrefix(0, dbId) : from);
+
+      while (true) {
+        auto expKey = dataCursor->key();
+        if (expKey.status().code() == ErrorCodes::ERR_EXHAUST) {
+          break;
+        }
+        if (!expKey.ok()) {
+          return expKey.status();
+        }
+        const std::string& rawKey = expKey.value();
+        uint32_t chunkId = RecordKey::decodeChunkId(rawKey);
+        if (chunkId >= chunkSize) {
+          break;
+        }
+        if (result.size() >= count || visited >= maxVisit) {
+          nextCursor = encodeCursor(storeId, rawKey);
+          break;
+        }
+        visited++;
+        // skip the sub keys and the meta keys of other dbs in this chunk
+        if (RecordKey::decodeType(rawKey) != RecordType::RT_DATA_META ||
+            RecordKey::decodeDbId(rawKey) != dbId) {
+          if (RecordKey::decodeType(rawKey) == RecordType::RT_DATA_META &&
+              RecordKey::decodeDbId(rawKey) < dbId) {
+            dataCursor->seek(metaPrefix(chunkId, dbId));
+          } else {
+            dataCursor->seek(metaPrefix(chunkId + 1, dbId));
+          }
+          continue;
+        }
+
+        auto exptRcd = dataCursor->next();
+        if (!exptRcd.ok()) {
+          return exptRcd.status();
+        }
+        const RecordKey& rk = exptRcd.value().getRecordKey();
+        const RecordValue& rv = exptRcd.value().getRecordValue();
+        auto ttl = rv.getTtl();
+        if (!Command::noExpire() && ttl != 0 && ttl < ts) {
+          continue;
+        }
+        if (!type.empty() && toLower(rt2Str(rv.getRecordType())) != type) {
+          continue;
+        }
+        const std::string& key = rk.getPrimaryKey();
+        if (usePatten &&
+            !redis_port::stringmatchlen(
+              pat.c_str(), pat.size(), key.c_str(), key.size(), 0)) {
+          continue;
+        }
+        result.emplace_back(key);
+      }
+      if (nextCursor != "0") {
+        break;
+      }
+    }
+
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, 2);
+    Command::fmtBulk(ss, nextCursor);
+    Command::fmtMultiBulkLen(ss, result.size());
+    for (const auto& v : result) {
+      Command::fmtBulk(ss, v);
+    }
+    return ss.str();
+  }
+
+ private:
+  // the first possible RT_DATA_META key of dbId in chunkId
+  static std::string metaPrefix(uint32_t chunkId, uint32_t dbId) {
+    RecordKey tmplRk(chunkId, dbId, RecordType::RT_KV, "", "");
+    std::string prefix = tmplRk.prefixSlotType();
+    prefix.resize(prefix.size() + sizeof(uint32_t));
+    int32Encode(&prefix[prefix.size() - sizeof(uint32_t)], dbId);
+    return prefix;
+  }
+
+  static std::string encodeCursor(uint32_t storeId, const std::string& key) {
+    std::string raw(sizeof(uint32_t), '\0');
+    int32Encode(&raw[0], storeId);
+    raw.append(key);
+    return hexlify(raw);
   }
 } scanCmd;
 
@@ -0,0 +1,668 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "tendisplus/commands/command.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+// Script is a list of commands run with the keys locked once, for the
+// read-modify-write flows which need several round trips otherwise.
+// There is no lua interpreter in tendis, so this is not the scripting of
+// redis and it doesn't take the names of its commands: EVAL, EVALSHA and
+// SCRIPT are left unimplemented, the scripts are run by CMDEVAL. A script
+// is the commands one per line (or separated by ';'), with the arguments
+// separated by spaces. An argument KEYS[n] or ARGV[n] is the n-th key or
+// argument of CMDEVAL, 1-based. Lines starting with '#' are comments.
+// The commands can be run on a condition:
+//   if <op> <value> <read only command>
+//   ...
+//   else
+//   ...
+//   end
+// <op> is eq or ne to compare the reply of the command as a string, or lt,
+// le, gt or ge to compare it as a number. A nil reply is only ne to any
+// value. The reply of a script is the replies of the commands run, without
+// the ones of the conditions.
+class Script {
+ public:
+  struct Arg {
+    enum Kind { LITERAL, KEY, ARGV };
+    Kind kind;
+    std::string text;
+    uint32_t index;
+  };
+
+  enum class CmpOp { EQ, NE, LT, LE, GT, GE };
+
+  struct Step {
+    enum Kind { CMD, IF, ELSE, END };
+    Kind kind;
+    // the command of a CMD or of the condition of an IF
+    std::vector<Arg> args;
+    CmpOp op;
+    Arg value;
+    // the step after a false IF, or after the steps before an ELSE
+    size_t jump;
+    // the line of the step in the source, 1-based
+    uint32_t line;
+  };
+
+  static Expected<std::shared_ptr<Script>> compile(const std::string& body) {
+    auto script = std::make_shared<Script>();
+    // the statements with the lines they are on
+    std::vector<std::pair<std::string, uint32_t>> stmts;
+    std::string stmt;
+    uint32_t lineNo = 1;
+    for (auto c : body) {
+      if (c == '\n' || c == ';') {
+        stmts.emplace_back(std::move(stmt), lineNo);
+        stmt.clear();
+        lineNo += c == '\n';
+      } else {
+        stmt.push_back(c);
+      }
+    }
+    stmts.emplace_back(std::move(stmt), lineNo);
+
+    // the IF and ELSE steps waiting for their END
+    std::vector<size_t> open;
+    for (auto& l : stmts) {
+      std::vector<Arg> args;
+      std::stringstream ss(l.first);
+      std::string token;
+      while (ss >> token) {
+        auto arg = parseArg(token);
+        if (!arg.ok()) {
+          return arg.status();
+        }
+        args.emplace_back(std::move(arg.value()));
+      }
+      if (args.empty() || args[0].text[0] == '#') {
+        continue;
+      }
+      if (args[0].kind != Arg::LITERAL) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "the command name of a script can not be a variable"};
+      }
+      args[0].text = toLower(args[0].text);
+      auto& steps = script->_steps;
+      const auto& name = args[0].text;
+      if (name == "else" || name == "end") {
+        if (args.size() != 1) {
+          return {ErrorCodes::ERR_PARSEOPT, "syntax error after " + name};
+        }
+        if (open.empty() || (name == "else" &&
+                             steps[open.back()].kind == Step::ELSE)) {
+          return {ErrorCodes::ERR_PARSEOPT, name + " without if"};
+        }
+        auto begin = open.back();
+        open.pop_back();
+        if (name == "else") {
+          steps[begin].jump = steps.size() + 1;
+          open.push_back(steps.size());
+          steps.push_back({Step::ELSE, {}, CmpOp::EQ, {}, 0, l.second});
+        } else {
+          steps[begin].jump = steps.size();
+          steps.push_back({Step::END, {}, CmpOp::EQ, {}, 0, l.second});
+        }
+        continue;
+      }
+      if (name == "if") {
+        if (args.size() < 4 || args[1].kind != Arg::LITERAL) {
+          return {ErrorCodes::ERR_PARSEOPT, "syntax error in if"};
+        }
+        auto op = parseCmpOp(toLower(args[1].text));
+        if (!op.ok()) {
+          return op.status();
+        }
+        Step step{Step::IF, {}, op.value(), args[2], 0, l.second};
+        step.args.assign(args.begin() + 3, args.end());
+        if (step.args[0].kind != Arg::LITERAL) {
+          return {ErrorCodes::ERR_PARSEOPT,
+                  "the command name of a script can not be a variable"};
+        }
+        step.args[0].text = toLower(step.args[0].text);
+        auto c = checkCommand(step.args[0].text);
+        if (!c.ok()) {
+          return c.status();
+        }
+        if (!c.value()->isReadOnly()) {
+          return {ErrorCodes::ERR_PARSEOPT,
+                  "the command '" + step.args[0].text +
+                    "' of a condition must be read only"};
+        }
+        open.push_back(steps.size());
+        steps.emplace_back(std::move(step));
+        continue;
+      }
+      auto c = checkCommand(name);
+      if (!c.ok()) {
+        return c.status();
+      }
+      script->_write |= c.value()->isWriteable();
+      steps.push_back(
+        {Step::CMD, std::move(args), CmpOp::EQ, {}, 0, l.second});
+    }
+    if (!open.empty()) {
+      return {ErrorCodes::ERR_PARSEOPT, "if without end"};
+    }
+    if (script->_steps.empty()) {
+      return {ErrorCodes::ERR_PARSEOPT, "empty script"};
+    }
+    return script;
+  }
+
+  // the arguments with the variables replaced
+  static Expected<std::string> bind(const Arg& arg,
+                                    const std::vector<std::string>& keys,
+                                    const std::vector<std::string>& argv) {
+    if (arg.kind == Arg::LITERAL) {
+      return arg.text;
+    }
+    const auto& vars = arg.kind == Arg::KEY ? keys : argv;
+    if (arg.index == 0 || arg.index > vars.size()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              arg.text + " is out of the arguments given"};
+    }
+    return vars[arg.index - 1];
+  }
+
+  static Expected<std::vector<std::string>> bind(
+    const std::vector<Arg>& args,
+    const std::vector<std::string>& keys,
+    const std::vector<std::string>& argv) {
+    std::vector<std::string> cmd;
+    cmd.reserve(args.size());
+    for (const auto& arg : args) {
+      auto v = bind(arg, keys, argv);
+      if (!v.ok()) {
+        return v.status();
+      }
+      cmd.emplace_back(std::move(v.value()));
+    }
+    return cmd;
+  }
+
+  // compare the reply of a condition with the value
+  static Expected<bool> compare(const std::string& reply,
+                                CmpOp op,
+                                const std::string& value) {
+    if (reply.empty()) {
+      return {ErrorCodes::ERR_INTERNAL, "empty reply of condition"};
+    }
+    std::string v;
+    switch (reply[0]) {
+      case ':':
+      case '+':
+        v = reply.substr(1, reply.find("\r\n") - 1);
+        break;
+      case '$': {
+        auto pos = reply.find("\r\n");
+        if (reply.compare(1, pos - 1, "-1") == 0) {
+          return op == CmpOp::NE;
+        }
+        v = reply.substr(pos + 2, reply.size() - pos - 4);
+        break;
+      }
+      case '*':
+        if (reply.compare(0, 4, "*-1\r") == 0) {
+          return op == CmpOp::NE;
+        }
+        return {ErrorCodes::ERR_PARSEOPT,
+                "the reply of a condition can not be an array"};
+      default:
+        return {ErrorCodes::ERR_PARSEOPT, "invalid reply of condition"};
+    }
+    if (op == CmpOp::EQ || op == CmpOp::NE) {
+      return (v == value) == (op == CmpOp::EQ);
+    }
+    auto l = tendisplus::stold(v);
+    auto r = tendisplus::stold(value);
+    if (!l.ok() || !r.ok()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "the reply or the value of a condition is not a number"};
+    }
+    switch (op) {
+      case CmpOp::LT:
+        return l.value() < r.value();
+      case CmpOp::LE:
+        return l.value() <= r.value();
+      case CmpOp::GT:
+        return l.value() > r.value();
+      default:
+        return l.value() >= r.value();
+    }
+  }
+
+  const std::vector<Step>& getSteps() const {
+    return _steps;
+  }
+
+  bool isWrite() const {
+    return _write;
+  }
+
+ private:
+  static Expected<Arg> parseArg(const std::string& token) {
+    for (auto kind : {Arg::KEY, Arg::ARGV}) {
+      std::string prefix = kind == Arg::KEY ? "KEYS[" : "ARGV[";
+      if (token.size() <= prefix.size() + 1 ||
+          token.compare(0, prefix.size(), prefix) != 0 ||
+          token.back() != ']') {
+        continue;
+      }
+      auto index = tendisplus::stoul(
+        token.substr(prefix.size(), token.size() - prefix.size() - 1));
+      if (!index.ok() || index.value() > UINT32_MAX) {
+        return {ErrorCodes::ERR_PARSEOPT, "invalid variable " + token};
+      }
+      return Arg{kind, token, static_cast<uint32_t>(index.value())};
+    }
+    return Arg{Arg::LITERAL, token, 0};
+  }
+
+  static Expected<CmpOp> parseCmpOp(const std::string& op) {
+    static const std::unordered_map<std::string, CmpOp> ops = {
+      {"eq", CmpOp::EQ},
+      {"ne", CmpOp::NE},
+      {"lt", CmpOp::LT},
+      {"le", CmpOp::LE},
+      {"gt", CmpOp::GT},
+      {"ge", CmpOp::GE},
+    };
+    auto it = ops.find(op);
+    if (it == ops.end()) {
+      return {ErrorCodes::ERR_PARSEOPT, "unknown operator '" + op + "' in if"};
+    }
+    return it->second;
+  }
+
+  static Expected<Command*> checkCommand(const std::string& name) {
+    auto it = commandMap().find(name);
+    if (it == commandMap().end()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "unknown command '" + name + "' in script"};
+    }
+    auto c = it->second;
+    if (c->isNoScript() || c->isAdmin()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "command '" + name + "' is not allowed in script"};
+    }
+    // the writes without keys, as flushdb, lock the whole stores and
+    // would wait on the key locks held by the script
+    if (c->isWriteable() && c->firstkey() == 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "command '" + name + "' is not allowed in script"};
+    }
+    return c;
+  }
+
+  std::vector<Step> _steps;
+  bool _write = false;
+};
+
+// the compiled scripts by their sha1, shared by all the sessions. It keeps
+// the kMaxScripts used last, CMDEVALSHA of an evicted one fails as of an
+// unknown one and the client loads it again. CMDSCRIPT FLUSH empties it.
+class ScriptCache {
+ public:
+  static constexpr size_t kMaxScripts = 1024;
+
+  static ScriptCache& instance() {
+    static ScriptCache cache;
+    return cache;
+  }
+
+  // compile the script if it is not cached, return its sha1
+  Expected<std::pair<std::string, std::shared_ptr<Script>>> load(
+    const std::string& body) {
+    auto sha = redis_port::sha1hex(body);
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      auto script = touch(sha);
+      if (script) {
+        return std::make_pair(sha, script);
+      }
+    }
+    auto script = Script::compile(body);
+    if (!script.ok()) {
+      return script.status();
+    }
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (!touch(sha)) {
+      _lru.push_front(sha);
+      _scripts.emplace(sha, std::make_pair(script.value(), _lru.begin()));
+      if (_scripts.size() > kMaxScripts) {
+        _scripts.erase(_lru.back());
+        _lru.pop_back();
+      }
+    }
+    return std::make_pair(sha, script.value());
+  }
+
+  std::shared_ptr<Script> get(const std::string& sha) {
+    std::lock_guard<std::mutex> lk(_mutex);
+    return touch(toLower(sha));
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lk(_mutex);
+    _scripts.clear();
+    _lru.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _scripts.size();
+  }
+
+ private:
+  // the cached script, moved to the front of the lru, with _mutex held
+  std::shared_ptr<Script> touch(const std::string& sha) {
+    auto it = _scripts.find(sha);
+    if (it == _scripts.end()) {
+      return nullptr;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.second);
+    return it->second.first;
+  }
+
+  std::mutex _mutex;
+  // the sha1 of the scripts, the one used last first
+  std::list<std::string> _lru;
+  std::unordered_map<
+    std::string,
+    std::pair<std::shared_ptr<Script>, std::list<std::string>::iterator>>
+    _scripts;
+};
+
+class EvalGenericCommand : public Command {
+ public:
+  EvalGenericCommand(const std::string& name, const char* sflags)
+    : Command(name, sflags) {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  std::vector<int> getKeysFromCommand(const std::vector<std::string>& argv) {
+    std::vector<int> keyindex;
+    auto numkeys = tendisplus::stoll(argv[2]);
+    if (!numkeys.ok() || numkeys.value() < 0 ||
+        numkeys.value() > static_cast<int64_t>(argv.size()) - 3) {
+      return keyindex;
+    }
+    for (int i = 3; i < 3 + numkeys.value(); i++) {
+      keyindex.push_back(i);
+    }
+    return keyindex;
+  }
+
+  // The declared keys are locked once for the whole script, the commands
+  // run in a local session holding the locks, so they don't lock the keys
+  // again. The commands share one txn of each store: the writes of a store
+  // are committed at the end in one binlog, the slaves apply the effects
+  // and never run the script. The writes are all rolled back if a command
+  // fails, but the commits of different stores are not atomic.
+  Expected<std::string> runScript(Session* sess,
+                                  const Script& script,
+                                  bool readOnly) {
+    if (readOnly && script.isWrite()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Write commands are not allowed from read-only scripts"};
+    }
+    const auto& args = sess->getArgs();
+    auto numkeys = tendisplus::stoll(args[2]);
+    if (!numkeys.ok()) {
+      return numkeys.status();
+    }
+    if (numkeys.value() < 0) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Number of keys can't be negative"};
+    }
+    if (numkeys.value() > static_cast<int64_t>(args.size()) - 3) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "Number of keys can't be greater than number of args"};
+    }
+    auto index = getKeysFromCommand(args);
+    std::vector<std::string> keys;
+    std::unordered_set<std::string> keySet;
+    for (auto i : index) {
+      keys.push_back(args[i]);
+      keySet.insert(args[i]);
+    }
+    std::vector<std::string> argv(args.begin() + 3 + numkeys.value(),
+                                  args.end());
+
+    // check all the commands before running any of them
+    const auto& steps = script.getSteps();
+    std::vector<std::vector<std::string>> cmds(steps.size());
+    std::vector<std::string> values(steps.size());
+    for (size_t i = 0; i < steps.size(); i++) {
+      if (steps[i].kind != Script::Step::CMD &&
+          steps[i].kind != Script::Step::IF) {
+        continue;
+      }
+      auto cmdArgs = Script::bind(steps[i].args, keys, argv);
+      if (!cmdArgs.ok()) {
+        return cmdArgs.status();
+      }
+      if (steps[i].kind == Script::Step::IF) {
+        auto value = Script::bind(steps[i].value, keys, argv);
+        if (!value.ok()) {
+          return value.status();
+        }
+        values[i] = std::move(value.value());
+      }
+      auto s = checkArgs(cmdArgs.value(), keySet);
+      if (!s.ok()) {
+        return s;
+      }
+      cmds[i] = std::move(cmdArgs.value());
+    }
+
+    LocalSessionGuard sg(sess->getServerEntry(), sess);
+    auto lsess = sg.getSession();
+    auto locklist =
+      sess->getServerEntry()->getSegmentMgr()->getAllKeysLocked(
+        lsess,
+        args,
+        index,
+        script.isWrite() ? mgl::LockMode::LOCK_X : Command::RdLock());
+    if (!locklist.ok()) {
+      return locklist.status();
+    }
+
+    auto ctx = lsess->getCtx();
+    ctx->beginSharedTxns();
+    bool committed = false;
+    const auto guard = MakeGuard([&ctx, &committed] {
+      if (!committed) {
+        ctx->rollbackSharedTxns();
+      }
+    });
+
+    std::stringstream ss;
+    uint32_t replies = 0;
+    size_t pc = 0;
+    while (pc < steps.size()) {
+      const auto& step = steps[pc];
+      if (step.kind == Script::Step::ELSE) {
+        pc = step.jump;
+        continue;
+      } else if (step.kind == Script::Step::END) {
+        pc++;
+        continue;
+      }
+      const auto& cmdArgs = cmds[pc];
+      lsess->setArgs(cmdArgs);
+      auto expCmd = Command::precheck(lsess);
+      if (!expCmd.ok()) {
+        return expCmd.status();
+      }
+      auto ret = Command::runSessionCmd(lsess);
+      if (!ret.ok()) {
+        auto err = ret.status().toString();
+        sdstrim(err, "-\r\n");
+        return {ret.status().code(),
+                "Error running script, line " + std::to_string(step.line) +
+                  " '" + cmdArgs[0] + "': " + err};
+      }
+      if (step.kind == Script::Step::IF) {
+        auto cond = Script::compare(ret.value(), step.op, values[pc]);
+        if (!cond.ok()) {
+          return cond.status();
+        }
+        pc = cond.value() ? pc + 1 : step.jump;
+        continue;
+      }
+      ss << ret.value();
+      replies++;
+      pc++;
+    }
+    committed = true;
+    auto s = ctx->commitSharedTxns(args[0]);
+    if (!s.ok()) {
+      return s;
+    }
+
+    std::stringstream reply;
+    Command::fmtMultiBulkLen(reply, replies);
+    reply << ss.str();
+    return reply.str();
+  }
+
+ private:
+  static Status checkArgs(const std::vector<std::string>& cmdArgs,
+                          const std::unordered_set<std::string>& keySet) {
+    auto it = commandMap().find(cmdArgs[0]);
+    if (it == commandMap().end()) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "unknown command '" + cmdArgs[0] + "' in script"};
+    }
+    auto cmd = it->second;
+    ssize_t arity = cmd->arity();
+    if ((arity > 0 && arity != ssize_t(cmdArgs.size())) ||
+        ssize_t(cmdArgs.size()) < -arity) {
+      return {ErrorCodes::ERR_WRONG_ARGS_SIZE,
+              "wrong number of arguments for '" + cmdArgs[0] +
+                "' command in script"};
+    }
+    for (auto i : cmd->getKeysFromCommand(cmdArgs)) {
+      if (keySet.count(cmdArgs[i]) == 0) {
+        return {ErrorCodes::ERR_PARSEOPT,
+                "key '" + cmdArgs[i] + "' of '" + cmdArgs[0] +
+                  "' in script is not declared"};
+      }
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+};
+
+class EvalCommand : public EvalGenericCommand {
+ public:
+  EvalCommand(const std::string& name, const char* sflags)
+    : EvalGenericCommand(name, sflags) {}
+
+  Expected<std::string> run(Session* sess) final {
+    auto script = ScriptCache::instance().load(sess->getArgs()[1]);
+    if (!script.ok()) {
+      return script.status();
+    }
+    return runScript(sess, *script.value().second, isReadOnly());
+  }
+};
+
+class EvalShaCommand : public EvalGenericCommand {
+ public:
+  EvalShaCommand(const std::string& name, const char* sflags)
+    : EvalGenericCommand(name, sflags) {}
+
+  Expected<std::string> run(Session* sess) final {
+    auto script = ScriptCache::instance().get(sess->getArgs()[1]);
+    if (!script) {
+      return {ErrorCodes::ERR_PARSEOPT,
+              "No matching script. Please use CMDEVAL."};
+    }
+    return runScript(sess, *script, isReadOnly());
+  }
+};
+
+// the _ro ones refuse the scripts with writes, they can run on the replicas
+EvalCommand evalCmd("cmdeval", "ws");
+EvalCommand evalRoCmd("cmdeval_ro", "rs");
+EvalShaCommand evalShaCmd("cmdevalsha", "ws");
+EvalShaCommand evalShaRoCmd("cmdevalsha_ro", "rs");
+
+class ScriptCommand : public Command {
+ public:
+  ScriptCommand() : Command("cmdscript", "s") {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const auto& args = sess->getArgs();
+    auto& cache = ScriptCache::instance();
+    auto op = toLower(args[1]);
+    if (op == "load" && args.size() == 3) {
+      auto script = cache.load(args[2]);
+      if (!script.ok()) {
+        return script.status();
+      }
+      return Command::fmtBulk(script.value().first);
+    } else if (op == "exists" && args.size() >= 3) {
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, args.size() - 2);
+      for (size_t i = 2; i < args.size(); i++) {
+        Command::fmtLongLong(ss, cache.get(args[i]) ? 1 : 0);
+      }
+      return ss.str();
+    } else if (op == "flush" && args.size() == 2) {
+      cache.flush();
+      return Command::fmtOK();
+    }
+    return {ErrorCodes::ERR_PARSEOPT,
+            "Unknown CMDSCRIPT subcommand or wrong # of args."};
+  }
+} scriptCmd;
+
+}  // namespace tendisplus
@@ -8,6 +8,9 @@
 #include <algorithm>
 #include <cctype>
 #include <clocale>
+#include <cstring>
+#include <functional>
+#include <list>
 #include <vector>
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/string.h"
@@ -20,6 +23,85 @@ namespace tendisplus {
 
 Expected<bool> delGeneric(Session* sess, const std::string& key);
 
+// A small set may be packed into its meta, the members are then read and
+// written through the SetMetaValue instead of RT_SET_ELE records, see
+// set-max-packed-entries.
+Expected<RecordValue> getSetMember(PStore kvstore,
+                                   Transaction* txn,
+                                   const SetMetaValue& sm,
+                                   const RecordKey& subRk) {
+  if (!sm.isPacked()) {
+    return kvstore->getKV(subRk, txn);
+  }
+  if (sm.getEntries().get(subRk.getSecondaryKey()) == nullptr) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return RecordValue("", RecordType::RT_SET_ELE, -1);
+}
+
+Status setSetMember(PStore kvstore,
+                    Transaction* txn,
+                    SetMetaValue* sm,
+                    const RecordKey& subRk) {
+  if (!sm->isPacked()) {
+    return kvstore->setKV(
+      subRk, RecordValue("", RecordType::RT_SET_ELE, -1), txn);
+  }
+  sm->getMutableEntries()->set(subRk.getSecondaryKey(), "");
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status delSetMember(PStore kvstore,
+                    Transaction* txn,
+                    SetMetaValue* sm,
+                    const RecordKey& subRk) {
+  if (!sm->isPacked()) {
+    return kvstore->delKV(subRk, txn);
+  }
+  sm->getMutableEntries()->erase(subRk.getSecondaryKey());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// a newly created set starts packed if packing is enabled
+void initSetMeta(Session* sess, SetMetaValue* sm) {
+  if (sess->getServerEntry()->getParams()->setMaxPackedEntries > 0) {
+    sm->setPacked(true);
+  }
+}
+
+// should be called before the meta of a modified set is written. A packed
+// set which outgrows the limits, or any packed set if force, is converted
+// to RT_SET_ELE records, and is never packed again.
+Status expandSetIfNeeded(Session* sess,
+                         PStore kvstore,
+                         Transaction* txn,
+                         const RecordKey& metaRk,
+                         SetMetaValue* sm,
+                         bool force = false) {
+  if (!sm->isPacked()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  const auto& params = sess->getServerEntry()->getParams();
+  if (!force && sm->getEntries().fits(params->setMaxPackedEntries,
+                            params->setMaxPackedValue)) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  for (const auto& entry : sm->getEntries().getEntries()) {
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_SET_ELE,
+                    metaRk.getPrimaryKey(),
+                    entry.first);
+    Status s = kvstore->setKV(
+      subRk, RecordValue("", RecordType::RT_SET_ELE, -1), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  sm->setPacked(false);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Expected<std::string> genericSRem(Session* sess,
                                   PStore kvstore,
                                   Transaction* txn,
@@ -51,7 +133,7 @@ Expected<std::string> genericSRem(Session* sess,
                     RecordType::RT_SET_ELE,
                     metaRk.getPrimaryKey(),
                     args[i]);
-    Expected<RecordValue> rv = kvstore->getKV(subRk, txn);
+    Expected<RecordValue> rv = getSetMember(kvstore, txn, sm, subRk);
     if (rv.ok()) {
       cnt += 1;
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -59,7 +141,7 @@ Expected<std::string> genericSRem(Session* sess,
     } else {
       return rv.status();
     }
-    Status s = kvstore->delKV(subRk, txn);
+    Status s = delSetMember(kvstore, txn, &sm, subRk);
     if (!s.ok()) {
       return s;
     }
@@ -115,6 +197,20 @@ Expected<std::string> genericSAdd(Session* sess,
   } else if (rv.status().code() != ErrorCodes::ERR_NOTFOUND &&
              rv.status().code() != ErrorCodes::ERR_EXPIRED) {
     return rv.status();
+  } else {
+    initSetMeta(sess, &sm);
+  }
+
+  // a batch which can never fit is not packed member by member
+  const auto& params = sess->getServerEntry()->getParams();
+  Status s = expandSetIfNeeded(sess,
+                               kvstore,
+                               txn,
+                               metaRk,
+                               &sm,
+                               args.size() - 2 > params->setMaxPackedEntries);
+  if (!s.ok()) {
+    return s;
   }
 
   uint64_t cnt = 0;
@@ -125,29 +221,32 @@ Expected<std::string> genericSAdd(Session* sess,
                     metaRk.getPrimaryKey(),
                     args[i]);
 
-      Expected<RecordValue> subrv = kvstore->getKV(subRk, txn);
-      if (subrv.ok()) {
-        continue;
-      } else if (subrv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        cnt += 1;
-      } else {
-        return subrv.status();
-      }
+    Expected<RecordValue> subrv = getSetMember(kvstore, txn, sm, subRk);
+    if (subrv.ok()) {
+      continue;
+    } else if (subrv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      cnt += 1;
+    } else {
+      return subrv.status();
+    }
 
-    RecordValue subRv("", RecordType::RT_SET_ELE, -1);
-    Status s = kvstore->setKV(subRk, subRv, txn);
+    s = setSetMember(kvstore, txn, &sm, subRk);
     if (!s.ok()) {
       return s;
     }
   }
   sm.setCount(sm.getCount() + cnt);
-  Status s = kvstore->setKV(metaRk,
-                            RecordValue(sm.encode(),
-                                        RecordType::RT_SET_META,
-                                        sess->getCtx()->getVersionEP(),
-                                        ttl,
-                                        rv),
-                            txn);
+  s = expandSetIfNeeded(sess, kvstore, txn, metaRk, &sm);
+  if (!s.ok()) {
+    return s;
+  }
+  s = kvstore->setKV(metaRk,
+                     RecordValue(sm.encode(),
+                                 RecordType::RT_SET_META,
+                                 sess->getCtx()->getVersionEP(),
+                                 ttl,
+                                 rv),
+                     txn);
   if (!s.ok()) {
     return s;
   }
@@ -218,9 +317,15 @@ class SMembersCommand : public Command {
 
     std::stringstream ss;
     Command::fmtMultiBulkLen(ss, ssize);
-    auto cursor = txn->createDataCursor();
+    if (exptSm.value().isPacked()) {
+      for (const auto& entry : exptSm.value().getEntries().getEntries()) {
+        Command::fmtBulk(ss, entry.first);
+      }
+      return ss.str();
+    }
     RecordKey fake = {
       expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
+    auto cursor = txn->createPrefixDataCursor(fake.prefixPk());
     cursor->seek(fake.prefixPk());
     while (true) {
       Expected<Record> exptRcd = cursor->next();
@@ -303,12 +408,17 @@ class SIsMemberCommand : public Command {
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
+    Expected<SetMetaValue> exptSm = SetMetaValue::decode(rv.value().getValue());
+    if (!exptSm.ok()) {
+      return exptSm.status();
+    }
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_SET_ELE,
                     key,
                     subkey);
-    Expected<RecordValue> eSubVal = kvstore->getKV(subRk, txn.get());
+    Expected<RecordValue> eSubVal =
+      getSetMember(kvstore, txn.get(), exptSm.value(), subRk);
     if (eSubVal.ok()) {
       return Command::fmtOne();
     } else if (eSubVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -319,6 +429,96 @@ class SIsMemberCommand : public Command {
   }
 } sIsMemberCmd;
 
+class SMIsMemberCommand : public Command {
+ public:
+  SMIsMemberCommand() : Command("smismember", "rF") {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, args.size() - 2);
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, key, RecordType::RT_SET_META);
+    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      for (size_t i = 2; i < args.size(); ++i) {
+        Command::fmtLongLong(ss, 0);
+      }
+      return ss.str();
+    } else if (!rv.ok()) {
+      return rv.status();
+    }
+
+    PStore kvstore = expdb.value().store;
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    Expected<SetMetaValue> exptSm = SetMetaValue::decode(rv.value().getValue());
+    if (!exptSm.ok()) {
+      return exptSm.status();
+    }
+    if (exptSm.value().isPacked()) {
+      const auto& entries = exptSm.value().getEntries();
+      for (size_t i = 2; i < args.size(); ++i) {
+        Command::fmtLongLong(ss, entries.get(args[i]) != nullptr);
+      }
+      return ss.str();
+    }
+
+    std::vector<RecordKey> subRks;
+    subRks.reserve(args.size() - 2);
+    for (size_t i = 2; i < args.size(); ++i) {
+      subRks.emplace_back(expdb.value().chunkId,
+                          pCtx->getDbId(),
+                          RecordType::RT_SET_ELE,
+                          key,
+                          args[i]);
+    }
+    auto eSubVals = kvstore->getKVs(subRks, txn.get());
+    for (auto& eSubVal : eSubVals) {
+      if (eSubVal.ok()) {
+        Command::fmtLongLong(ss, 1);
+      } else if (eSubVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        Command::fmtLongLong(ss, 0);
+      } else {
+        return eSubVal.status();
+      }
+    }
+    return ss.str();
+  }
+} sMIsMemberCmd;
+
 class SrandMemberCommand : public Command {
  public:
   SrandMemberCommand() : Command("srandmember", "rR") {}
@@ -434,28 +634,40 @@ class SrandMemberCommand : public Command {
       // TODO(vinchen):  should be configable
       return {ErrorCodes::ERR_INTERNAL, "bulk too big"};
     }
-    RecordKey fake = {
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
-    cursor->seek(fake.prefixPk());
-    while (true) {
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-        break;
-      }
-      if (!exptRcd.ok()) {
-        return exptRcd.status();
-      }
-      if (cnt++ < beginIdx) {
-        continue;
-      }
-      if (cnt > ssize) {
-        break;
-      }
-      if (peek < remain) {
-        vals.emplace_back(exptRcd.value().getRecordKey().getSecondaryKey());
+    if (exptSm.value().isPacked()) {
+      const auto& entries = exptSm.value().getEntries().getEntries();
+      for (size_t i = beginIdx; i < entries.size() && peek < remain; ++i) {
+        vals.emplace_back(entries[i].first);
         peek++;
-      } else {
-        break;
+      }
+    } else {
+      RecordKey fake = {expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_SET_ELE,
+                        key,
+                        ""};
+      cursor->seek(fake.prefixPk());
+      while (true) {
+        Expected<Record> exptRcd = cursor->next();
+        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+          break;
+        }
+        if (!exptRcd.ok()) {
+          return exptRcd.status();
+        }
+        if (cnt++ < beginIdx) {
+          continue;
+        }
+        if (cnt > ssize) {
+          break;
+        }
+        if (peek < remain) {
+          const auto& rcdKey = exptRcd.value().getRecordKey();
+          vals.emplace_back(rcdKey.getSecondaryKey());
+          peek++;
+        } else {
+          break;
+        }
       }
     }
     // TODO(vinchen): vals should be shuffle here
@@ -551,13 +763,31 @@ class SpopCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-    RecordKey fake = {
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
-    auto batch = Command::scan(fake.prefixPk(), "0", count, txn.get());
-    if (!batch.ok()) {
-      return batch.status();
+    std::list<Record> rcds;
+    if (sm.isPacked()) {
+      for (const auto& entry : sm.getEntries().getEntries()) {
+        if (rcds.size() >= count) {
+          break;
+        }
+        rcds.emplace_back(RecordKey(expdb.value().chunkId,
+                                    pCtx->getDbId(),
+                                    RecordType::RT_SET_ELE,
+                                    key,
+                                    entry.first),
+                          RecordValue("", RecordType::RT_SET_ELE, -1));
+      }
+    } else {
+      RecordKey fake = {expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_SET_ELE,
+                        key,
+                        ""};
+      auto batch = Command::scan(fake.prefixPk(), "0", count, txn.get());
+      if (!batch.ok()) {
+        return batch.status();
+      }
+      rcds = std::move(batch.value().second);
     }
-    const auto& rcds = batch.value().second;
     if (rcds.size() == 0) {
       return Command::fmtNull();
     }
@@ -579,12 +809,14 @@ class SpopCommand : public Command {
         return ptxn.status();
       }
       std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+      // a retry starts again from the meta read
+      SetMetaValue newSm = sm;
 
       // avoid string copy, directly delete elements according to rcds.
       Status s;
       for (auto iter = rcds.begin(); iter != rcds.end(); iter++) {
         const RecordKey& subRk = iter->getRecordKey();
-        s = kvstore->delKV(subRk, txn.get());
+        s = delSetMember(kvstore, txn.get(), &newSm, subRk);
         if (!s.ok()) {
           return s;
         }
@@ -597,9 +829,9 @@ class SpopCommand : public Command {
           return s;
         }
       } else {
-        sm.setCount(sm.getCount() - rcds.size());
+        newSm.setCount(sm.getCount() - rcds.size());
         s = kvstore->setKV(metaRk,
-                           RecordValue(sm.encode(),
+                           RecordValue(newSm.encode(),
                                        RecordType::RT_SET_META,
                                        pCtx->getVersionEP(),
                                        rv.value().getTtl(),
@@ -834,198 +1066,598 @@ class SRemCommand : public Command {
   }
 } sremCommand;
 
-class SdiffgenericCommand : public Command {
- public:
-  SdiffgenericCommand(const std::string& name, const char* sflags, bool store)
-    : Command(name, sflags), _store(store) {}
+namespace {
+
+// a set is merged when it has at most SET_MERGE_RATIO times the members of
+// the set driving the merge, the bigger ones are probed by batches instead
+constexpr uint64_t SET_MERGE_RATIO = 16;
+// the members probed by one getKVs, or written by one transaction
+constexpr size_t SET_BATCH_SIZE = 256;
+// the members stepped over by a cursor before it seeks
+constexpr uint32_t SET_MAX_STEPS = 8;
+
+enum class SetOp { INTER, UNION, DIFF };
+
+using SetEmit = std::function<Status(const std::string&)>;
+
+// compare a + suffix with b + suffix without building them, it is the order
+// of the members of a set in rocksdb, as the record key of a member is the
+// prefix of the set, the member, and a suffix depending on the key length.
+int compareMember(const std::string& a,
+                  const std::string& b,
+                  const std::string& suffix) {
+  size_t n = std::min(a.size(), b.size());
+  int c = memcmp(a.data(), b.data(), n);
+  if (c != 0 || a.size() == b.size()) {
+    return c;
+  }
+  // compare the rest of the longer one and the suffix with the suffix
+  const std::string& longer = a.size() > b.size() ? a : b;
+  int sign = a.size() > b.size() ? 1 : -1;
+  for (size_t i = 0; i < suffix.size(); i++) {
+    size_t pos = n + i;
+    uint8_t x =
+      pos < longer.size() ? longer[pos] : suffix[pos - longer.size()];
+    uint8_t y = suffix[i];
+    if (x != y) {
+      return x < y ? -sign : sign;
+    }
+  }
+  return sign;
+}
 
-  Expected<std::string> run(Session* sess) final {
-    const std::vector<std::string>& args = sess->getArgs();
-    size_t startkey = _store ? 2 : 1;
-    std::set<std::string> result;
+// SetSource reads the members of a set by a cursor, in the order of rocksdb,
+// and probes members in it. The sets with the same suffix are read in the
+// same order, so they can be merged. The members of a packed set are
+// sorted in the same order in memory.
+class SetSource {
+ public:
+  static Expected<std::unique_ptr<SetSource>> open(Session* sess,
+                                                   const std::string& key,
+                                                   const SetMetaValue& sm) {
     auto server = sess->getServerEntry();
-    SessionCtx* pCtx = sess->getCtx();
-
-    std::vector<int> index = getKeysFromCommand(args);
-    auto lock = server->getSegmentMgr()->getAllKeysLocked(
-      sess, args, index, _store ? mgl::LockMode::LOCK_X : Command::RdLock());
-    if (!lock.ok()) {
-      return lock.status();
+    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
+    if (!expdb.ok()) {
+      return expdb.status();
     }
+    PStore kvstore = expdb.value().store;
+    auto ptxn = kvstore->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    RecordKey fake(expdb.value().chunkId,
+                   sess->getCtx()->getDbId(),
+                   RecordType::RT_SET_ELE,
+                   key,
+                   "");
+    return std::unique_ptr<SetSource>(
+      new SetSource(kvstore, std::move(ptxn.value()), fake, sm));
+  }
 
-    for (size_t i = startkey; i < args.size(); ++i) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
-        continue;
-      } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        continue;
-      } else if (!rv.ok()) {
-        return rv.status();
-      }
-
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
+  uint64_t count() const {
+    return _count;
+  }
+  const std::string& suffix() const {
+    return _suffix;
+  }
+  bool valid() const {
+    return _valid;
+  }
+  // the member under the cursor, if valid()
+  const std::string& member() const {
+    return _member;
+  }
 
-      PStore kvstore = expdb.value().store;
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      auto cursor = txn->createDataCursor();
-      RecordKey fake = {expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_SET_ELE,
-                        args[i],
-                        ""};
-      cursor->seek(fake.prefixPk());
-      while (true) {
-        Expected<Record> exptRcd = cursor->next();
-        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-          break;
-        }
-        if (!exptRcd.ok()) {
-          return exptRcd.status();
-        }
-        Record& rcd = exptRcd.value();
-        const RecordKey& rcdkey = rcd.getRecordKey();
-        if (rcdkey.prefixPk() != fake.prefixPk()) {
-          break;
-        }
-        if (i == startkey) {
-          result.insert(rcdkey.getSecondaryKey());
-        } else {
-          result.erase(rcdkey.getSecondaryKey());
-        }
-      }
+  // move the cursor to the first member
+  Status start() {
+    _valid = true;
+    if (_packed.size() > 0) {
+      _pos = 0;
+      return next();
     }
+    _cursor = _txn->createPrefixDataCursor(_prefix);
+    _cursor->seek(_prefix);
+    return next();
+  }
 
-    if (!_store) {
-      std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (auto& v : result) {
-        Command::fmtBulk(ss, v);
+  Status next() {
+    if (_packed.size() > 0) {
+      _valid = _pos < _members.size();
+      if (_valid) {
+        _member = _members[_pos++];
       }
-      return ss.str();
+      return {ErrorCodes::ERR_OK, ""};
     }
-
-    const std::string& storeKey = args[1];
-    Expected<bool> deleted = delGeneric(sess, storeKey);
-    // Expected<bool> deleted = Command::delKeyChkExpire(sess, storeKey,
-    // RecordType::RT_SET_META);
-    if (!deleted.ok()) {
-      return deleted.status();
+    Expected<Record> exptRcd = _cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      _valid = false;
+      return {ErrorCodes::ERR_OK, ""};
     }
-
-    std::vector<std::string> newKeys(2);
-    for (auto& v : result) {
-      newKeys.push_back(std::move(v));
+    if (!exptRcd.ok()) {
+      return exptRcd.status();
     }
-
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
-    if (!expdb.ok()) {
-      return expdb.status();
+    const RecordKey& rcdkey = exptRcd.value().getRecordKey();
+    if (rcdkey.getChunkId() != _fake.getChunkId() ||
+        rcdkey.getDbId() != _fake.getDbId() ||
+        rcdkey.getRecordType() != RecordType::RT_SET_ELE ||
+        rcdkey.getPrimaryKey() != _fake.getPrimaryKey()) {
+      _valid = false;
+      return {ErrorCodes::ERR_OK, ""};
     }
-    PStore kvstore = expdb.value().store;
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_SET_META,
-                      storeKey,
-                      "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    _member = rcdkey.getSecondaryKey();
+    return {ErrorCodes::ERR_OK, ""};
+  }
 
-      Expected<std::string> addStore = genericSAdd(
-        sess,
-        kvstore,
-        txn.get(),
-        storeRk,
-        {ErrorCodes::ERR_NOTFOUND, ""}, /* storeKey has been deleted */
-        newKeys);
-      if (addStore.ok()) {
-        auto s1 = txn->commit();
-        if (!s1.ok()) {
-          return s1.status();
-        }
-        return addStore.value();
+  // move the cursor to the first member not less than target, it seeks if
+  // target is not found in a few steps
+  Status skipTo(const std::string& target) {
+    uint32_t steps = 0;
+    while (_valid && compareMember(_member, target, _suffix) < 0) {
+      if (++steps > SET_MAX_STEPS && _packed.size() == 0) {
+        _cursor->seek(_prefix + target + _suffix);
+        return next();
       }
-      if (addStore.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return addStore.status();
+      auto s = next();
+      if (!s.ok()) {
+        return s;
       }
-      if (i == RETRY_CNT - 1) {
-        return addStore.status();
-      } else {
-        continue;
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // whether each of the members is in the set, by one getKVs
+  Expected<std::vector<bool>> contains(
+    const std::vector<std::string>& members) {
+    if (_packed.size() > 0) {
+      std::vector<bool> found;
+      found.reserve(members.size());
+      for (const auto& m : members) {
+        found.push_back(_packed.get(m) != nullptr);
+      }
+      return found;
+    }
+    std::vector<RecordKey> subRks;
+    subRks.reserve(members.size());
+    for (const auto& m : members) {
+      subRks.emplace_back(_fake.getChunkId(),
+                          _fake.getDbId(),
+                          RecordType::RT_SET_ELE,
+                          _fake.getPrimaryKey(),
+                          m);
+    }
+    auto subValues = _store->getKVs(subRks, _txn.get());
+    std::vector<bool> found(members.size(), false);
+    for (size_t i = 0; i < members.size(); i++) {
+      if (subValues[i].ok()) {
+        found[i] = true;
+      } else if (subValues[i].status().code() != ErrorCodes::ERR_NOTFOUND) {
+        return subValues[i].status();
       }
     }
-    return {ErrorCodes::ERR_INTERNAL, "currently unrechable"};
+    return found;
   }
 
  private:
-  bool _store;
+  SetSource(PStore store,
+            std::unique_ptr<Transaction> txn,
+            const RecordKey& fake,
+            const SetMetaValue& sm)
+    : _store(std::move(store)),
+      _txn(std::move(txn)),
+      _fake(fake),
+      _prefix(fake.prefixPk()),
+      _suffix(fake.encode().substr(_prefix.size())),
+      _count(sm.getCount()),
+      _valid(false),
+      _pos(0) {
+    if (!sm.isPacked()) {
+      return;
+    }
+    _packed = sm.getEntries();
+    for (const auto& entry : _packed.getEntries()) {
+      _members.push_back(entry.first);
+    }
+    std::sort(_members.begin(),
+              _members.end(),
+              [this](const std::string& a, const std::string& b) {
+                return compareMember(a, b, _suffix) < 0;
+              });
+  }
+
+  PStore _store;
+  std::unique_ptr<Transaction> _txn;
+  std::unique_ptr<BasicDataCursor> _cursor;
+  RecordKey _fake;
+  std::string _prefix;
+  std::string _suffix;
+  uint64_t _count;
+  bool _valid;
+  std::string _member;
+  // the members of a packed set, and the position of the next one
+  PackedEntries _packed;
+  std::vector<std::string> _members;
+  size_t _pos;
 };
 
-class SdiffCommand : public SdiffgenericCommand {
+// SetFilter passes the members found in all of its sets (keepFound), or in
+// none of them, to emit. The members are probed by batches.
+class SetFilter {
  public:
-  SdiffCommand() : SdiffgenericCommand("sdiff", "rS", false) {}
+  SetFilter(bool keepFound, std::vector<SetSource*> sets, const SetEmit& emit)
+    : _keepFound(keepFound), _sets(std::move(sets)), _emit(emit) {}
 
-  ssize_t arity() const {
-    return -2;
+  Status add(const std::string& member) {
+    if (_sets.empty()) {
+      return _emit(member);
+    }
+    _batch.push_back(member);
+    if (_batch.size() < SET_BATCH_SIZE) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    return flush();
   }
 
-  int32_t firstkey() const {
-    return 1;
+  Status flush() {
+    for (auto set : _sets) {
+      if (_batch.empty()) {
+        break;
+      }
+      auto found = set->contains(_batch);
+      if (!found.ok()) {
+        return found.status();
+      }
+      size_t kept = 0;
+      for (size_t i = 0; i < _batch.size(); i++) {
+        if (found.value()[i] != _keepFound) {
+          continue;
+        }
+        if (kept != i) {
+          _batch[kept] = std::move(_batch[i]);
+        }
+        kept++;
+      }
+      _batch.resize(kept);
+    }
+    for (const auto& m : _batch) {
+      auto s = _emit(m);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    _batch.clear();
+    return {ErrorCodes::ERR_OK, ""};
   }
 
-  int32_t lastkey() const {
-    return -1;
+ private:
+  bool _keepFound;
+  std::vector<SetSource*> _sets;
+  const SetEmit& _emit;
+  std::vector<std::string> _batch;
+};
+
+// split the sets after the driver into the ones merged with it and the
+// ones probed
+void planSetMerge(const std::vector<SetSource*>& sets,
+                  std::vector<SetSource*>* merged,
+                  std::vector<SetSource*>* probed) {
+  SetSource* driver = sets[0];
+  merged->push_back(driver);
+  for (size_t i = 1; i < sets.size(); i++) {
+    if (sets[i]->suffix() == driver->suffix() &&
+        sets[i]->count() / SET_MERGE_RATIO <= driver->count()) {
+      merged->push_back(sets[i]);
+    } else {
+      probed->push_back(sets[i]);
+    }
   }
+}
 
-  int32_t keystep() const {
-    return 1;
+// the members of the smallest set are merged with the sets in the same
+// order, by leapfrogging their cursors, then probed in the others
+Status setInter(std::vector<SetSource*> sets, const SetEmit& emit) {
+  std::stable_sort(
+    sets.begin(), sets.end(), [](const SetSource* a, const SetSource* b) {
+      return a->count() < b->count();
+    });
+  std::vector<SetSource*> merged, probed;
+  planSetMerge(sets, &merged, &probed);
+  for (auto set : merged) {
+    auto s = set->start();
+    if (!s.ok()) {
+      return s;
+    }
+    if (!set->valid()) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
   }
-} sdiffcmd;
 
-class SdiffStoreCommand : public SdiffgenericCommand {
- public:
-  SdiffStoreCommand() : SdiffgenericCommand("sdiffstore", "wm", true) {}
+  SetFilter filter(true, std::move(probed), emit);
+  // the sets on target are merged[i] and the agreed - 1 ones before it
+  std::string target = merged[0]->member();
+  size_t agreed = 1;
+  size_t i = 0;
+  while (true) {
+    SetSource* set = merged[i];
+    if (agreed == merged.size()) {
+      auto s = filter.add(target);
+      if (!s.ok()) {
+        return s;
+      }
+      s = set->next();
+      if (!s.ok()) {
+        return s;
+      }
+      if (!set->valid()) {
+        break;
+      }
+      target = set->member();
+      agreed = 1;
+      continue;
+    }
+    i = (i + 1) % merged.size();
+    set = merged[i];
+    auto s = set->skipTo(target);
+    if (!s.ok()) {
+      return s;
+    }
+    if (!set->valid()) {
+      break;
+    }
+    if (set->member() == target) {
+      agreed++;
+    } else {
+      target = set->member();
+      agreed = 1;
+    }
+  }
+  return filter.flush();
+}
 
-  ssize_t arity() const {
-    return -3;
+// the members of the first set are looked for in the sets merged with it,
+// and those not found are probed in the others
+Status setDiff(const std::vector<SetSource*>& sets, const SetEmit& emit) {
+  std::vector<SetSource*> merged, probed;
+  planSetMerge(sets, &merged, &probed);
+  for (auto set : merged) {
+    auto s = set->start();
+    if (!s.ok()) {
+      return s;
+    }
   }
 
-  int32_t firstkey() const {
-    return 1;
+  SetFilter filter(false, std::move(probed), emit);
+  SetSource* first = merged[0];
+  while (first->valid()) {
+    bool found = false;
+    for (size_t i = 1; i < merged.size() && !found; i++) {
+      auto s = merged[i]->skipTo(first->member());
+      if (!s.ok()) {
+        return s;
+      }
+      found = merged[i]->valid() && merged[i]->member() == first->member();
+    }
+    if (!found) {
+      auto s = filter.add(first->member());
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    auto s = first->next();
+    if (!s.ok()) {
+      return s;
+    }
   }
+  return filter.flush();
+}
 
-  int32_t lastkey() const {
-    return -1;
+// the sets are grouped by their orders, the sets of a group are merged, and
+// the members of a group are probed in the groups before it. The biggest
+// groups go first, as their members are probed less.
+Status setUnion(const std::vector<SetSource*>& sets, const SetEmit& emit) {
+  std::vector<std::vector<SetSource*>> groups;
+  std::vector<uint64_t> counts;
+  for (auto set : sets) {
+    size_t g = 0;
+    while (g < groups.size() && groups[g][0]->suffix() != set->suffix()) {
+      g++;
+    }
+    if (g == groups.size()) {
+      groups.emplace_back();
+      counts.push_back(0);
+    }
+    groups[g].push_back(set);
+    counts[g] += set->count();
+  }
+  std::vector<size_t> order(groups.size());
+  for (size_t g = 0; g < order.size(); g++) {
+    order[g] = g;
+  }
+  std::stable_sort(order.begin(), order.end(), [&counts](size_t a, size_t b) {
+    return counts[a] > counts[b];
+  });
+
+  std::vector<SetSource*> done;
+  for (auto g : order) {
+    const auto& group = groups[g];
+    for (auto set : group) {
+      auto s = set->start();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    SetFilter filter(false, done, emit);
+    const std::string& suffix = group[0]->suffix();
+    while (true) {
+      SetSource* least = nullptr;
+      for (auto set : group) {
+        if (set->valid() &&
+            (!least ||
+             compareMember(set->member(), least->member(), suffix) < 0)) {
+          least = set;
+        }
+      }
+      if (!least) {
+        break;
+      }
+      std::string member = least->member();
+      auto s = filter.add(member);
+      if (!s.ok()) {
+        return s;
+      }
+      for (auto set : group) {
+        if (set->valid() && set->member() == member) {
+          s = set->next();
+          if (!s.ok()) {
+            return s;
+          }
+        }
+      }
+    }
+    auto s = filter.flush();
+    if (!s.ok()) {
+      return s;
+    }
+    done.insert(done.end(), group.begin(), group.end());
   }
+  return {ErrorCodes::ERR_OK, ""};
+}
 
-  int32_t keystep() const {
-    return 1;
+Status setOperate(SetOp op,
+                  const std::vector<SetSource*>& sets,
+                  const SetEmit& emit) {
+  if (sets.empty()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  switch (op) {
+    case SetOp::INTER:
+      return setInter(sets, emit);
+    case SetOp::DIFF:
+      return setDiff(sets, emit);
+    case SetOp::UNION:
+      return setUnion(sets, emit);
+    default:
+      INVARIANT_D(0);
+      return {ErrorCodes::ERR_INTERNAL, "invalid set op"};
+  }
+}
+
+// SetWriter adds the members to a new set by batches, the meta is written
+// with each batch, so the set is whole after each commit. A set written by
+// a single batch is packed if it is small enough.
+class SetWriter {
+ public:
+  SetWriter(Session* sess, PStore store, const RecordKey& metaRk)
+    : _sess(sess), _store(std::move(store)), _metaRk(metaRk), _count(0) {}
+
+  Status add(const std::string& member) {
+    _batch.push_back(member);
+    if (_batch.size() < SET_BATCH_SIZE) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    return flush(false);
+  }
+
+  // write the members left, and return the count of the set
+  Expected<uint64_t> finish() {
+    auto s = flush(true);
+    if (!s.ok()) {
+      return s;
+    }
+    return _count;
+  }
+
+ private:
+  Status flush(bool last) {
+    if (_batch.empty()) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    SetMetaValue sm(_count + _batch.size());
+    if (last && _count == 0) {
+      initSetMeta(_sess, &sm);
+    }
+    if (sm.isPacked()) {
+      const auto& params = _sess->getServerEntry()->getParams();
+      for (const auto& m : _batch) {
+        sm.getMutableEntries()->set(m, "");
+      }
+      if (!sm.getEntries().fits(params->setMaxPackedEntries,
+                                params->setMaxPackedValue)) {
+        sm.setPacked(false);
+      }
+    }
+    Expected<RecordValue> oldRv(ErrorCodes::ERR_NOTFOUND, "");
+    for (uint32_t i = 0; i < Command::RETRY_CNT; ++i) {
+      auto ptxn = _store->createTransaction(_sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+      Status s = {ErrorCodes::ERR_OK, ""};
+      for (const auto& m : _batch) {
+        if (sm.isPacked()) {
+          break;
+        }
+        RecordKey subRk(_metaRk.getChunkId(),
+                        _metaRk.getDbId(),
+                        RecordType::RT_SET_ELE,
+                        _metaRk.getPrimaryKey(),
+                        m);
+        s = _store->setKV(
+          subRk, RecordValue("", RecordType::RT_SET_ELE, -1), txn.get());
+        if (!s.ok()) {
+          break;
+        }
+      }
+      if (s.ok()) {
+        s = _store->setKV(_metaRk,
+                          RecordValue(sm.encode(),
+                                      RecordType::RT_SET_META,
+                                      _sess->getCtx()->getVersionEP(),
+                                      0,
+                                      oldRv),
+                          txn.get());
+      }
+      if (s.ok()) {
+        s = txn->commit().status();
+      }
+      if (s.ok()) {
+        _count += _batch.size();
+        _batch.clear();
+        return s;
+      }
+      if (s.code() != ErrorCodes::ERR_COMMIT_RETRY ||
+          i == Command::RETRY_CNT - 1) {
+        return s;
+      }
+    }
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
   }
-} sdiffstoreCommand;
 
-// Implement O(n*m) intersection
-// which n is the cardinality of the smallest set
-// m is the num of sets input
-class SintergenericCommand : public Command {
+  Session* _sess;
+  PStore _store;
+  RecordKey _metaRk;
+  uint64_t _count;
+  std::vector<std::string> _batch;
+};
+
+}  // namespace
+
+// SINTER, SUNION and SDIFF stream the members of the sets by cursors, the
+// sets in the same order are merge joined, and the others are probed by
+// batches, so only a batch of members is kept besides the reply. The STORE
+// variants write the result by batches as it is made.
+class SetOpGenericCommand : public Command {
  public:
-  SintergenericCommand(const std::string& name, const char* sflags, bool store)
-    : Command(name, sflags), _store(store) {}
+  SetOpGenericCommand(const std::string& name,
+                      const char* sflags,
+                      SetOp op,
+                      bool store)
+    : Command(name, sflags), _op(op), _store(store) {}
 
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     size_t startkey = _store ? 2 : 1;
-    std::set<std::string> result;
     auto server = sess->getServerEntry();
     SessionCtx* pCtx = sess->getCtx();
 
@@ -1036,179 +1668,174 @@ class SintergenericCommand : public Command {
       return lock.status();
     }
 
-    // stored all sets sorted by their length
-    std::vector<std::pair<size_t, uint64_t>> setList;
-    for (size_t i = startkey; i < args.size(); i++) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-
-      // if one set is empty, their intersection is empty set, so just
-      // return it.
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        if (_store) {
-          continue;
+    std::vector<std::string> keys(args.begin() + startkey, args.end());
+    auto rvs =
+      Command::expireKeysIfNeeded(sess, keys, RecordType::RT_SET_META);
+    // the result is empty if a set of sinter, or the first set of sdiff,
+    // does not exist
+    bool empty = false;
+    std::vector<std::unique_ptr<SetSource>> sources;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      Expected<RecordValue>& rv = rvs[i];
+      SetMetaValue sm;
+      if (rv.ok()) {
+        Expected<SetMetaValue> expSetMeta =
+          SetMetaValue::decode(rv.value().getValue());
+        if (!expSetMeta.ok()) {
+          return expSetMeta.status();
         }
-        return Command::fmtNull();
-      } else if (!rv.ok()) {
+        sm = std::move(expSetMeta.value());
+      } else if (rv.status().code() != ErrorCodes::ERR_EXPIRED &&
+                 rv.status().code() != ErrorCodes::ERR_NOTFOUND) {
         return rv.status();
       }
-
-      Expected<SetMetaValue> expSetMeta =
-        SetMetaValue::decode(rv.value().getValue());
-
-      uint64_t setLength = expSetMeta.value().getCount();
-      if (setLength == 0) {
-        if (_store) {
-          continue;
+      if (sm.getCount() == 0) {
+        if (_op == SetOp::INTER) {
+          empty = true;
+          break;
         }
-        return Command::fmtNull();
-      }
-      setList.push_back(std::make_pair(i, setLength));
-    }
-    std::sort(setList.begin(), setList.end(), [](auto& left, auto& right) {
-      return left.second < right.second;
-    });
-
-    for (size_t i = 0; i < setList.size(); i++) {
-      const std::string& key = args[setList[i].first];
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
-      PStore kvstore = expdb.value().store;
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
+        empty = empty || (_op == SetOp::DIFF && i == 0);
+        continue;
       }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      if (i == 0) {
-        auto cursor = txn->createDataCursor();
-        RecordKey fakeRk(expdb.value().chunkId,
-                         pCtx->getDbId(),
-                         RecordType::RT_SET_ELE,
-                         key,
-                         "");
-        cursor->seek(fakeRk.prefixPk());
-        while (true) {
-          Expected<Record> expRcd = cursor->next();
-          if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-            break;
-          }
-          if (!expRcd.ok()) {
-            return expRcd.status();
-          }
-          Record& rcd = expRcd.value();
-          const RecordKey& rcdKey = rcd.getRecordKey();
-          if (rcdKey.prefixPk() != fakeRk.prefixPk()) {
-            break;
-          }
-          result.insert(rcdKey.getSecondaryKey());
-        }
-        // for the smallest set
-        // input all its keys into set, then goto next loop;
+      if (empty) {
         continue;
       }
-      if (result.size() == 0) {
-        if (_store) {
-          // we must del the storeKey before we return
-          break;
-        }
-        // has no intersection, just return empty set
-        return Command::fmtNull();
+      auto expSource = SetSource::open(sess, keys[i], sm);
+      if (!expSource.ok()) {
+        return expSource.status();
       }
-
-      for (auto iter = result.begin(); iter != result.end();) {
-        RecordKey subRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_SET_ELE,
-                        key,
-                        *iter);
-        Expected<RecordValue> subValue = kvstore->getKV(subRk, txn.get());
-        // if key not found, erase it
-        if (!subValue.ok() ||
-            subValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
-          // then the old iterator will be invalid
-          // new value is the iterator to the next element
-          iter = result.erase(iter);
-        } else {
-          // otherwise move forward manually
-          iter++;
-        }
+      sources.emplace_back(std::move(expSource.value()));
+    }
+    std::vector<SetSource*> sets;
+    if (!empty) {
+      for (const auto& source : sources) {
+        sets.push_back(source.get());
       }
     }
 
     if (!_store) {
+      if (empty && _op == SetOp::INTER) {
+        return Command::fmtNull();
+      }
       std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (auto& v : result) {
-        Command::fmtBulk(ss, v);
+      uint64_t n = 0;
+      auto s = setOperate(_op, sets, [&ss, &n](const std::string& member) {
+        Command::fmtBulk(ss, member);
+        n++;
+        return Status(ErrorCodes::ERR_OK, "");
+      });
+      if (!s.ok()) {
+        return s;
+      }
+      std::stringstream reply;
+      Command::fmtMultiBulkLen(reply, n);
+      reply << ss.str();
+      return reply.str();
+    }
+
+    // the key stored is deleted before it is written, so the result is
+    // kept in memory if it is also read
+    const std::string& storeKey = args[1];
+    bool readStoreKey =
+      std::find(keys.begin(), keys.end(), storeKey) != keys.end();
+    std::vector<std::string> members;
+    if (readStoreKey) {
+      auto s = setOperate(_op, sets, [&members](const std::string& member) {
+        members.push_back(member);
+        return Status(ErrorCodes::ERR_OK, "");
+      });
+      if (!s.ok()) {
+        return s;
       }
-      return ss.str();
+      sets.clear();
+      sources.clear();
     }
 
-    const std::string& storeKey = args[1];
     Expected<bool> deleted = delGeneric(sess, storeKey);
-    // Expected<bool> deleted = Command::delKeyChkExpire(sess, storeKey,
-    // RecordType::RT_SET_META);
     if (!deleted.ok()) {
       return deleted.status();
     }
 
-    std::vector<std::string> newKeys(2);
-    for (auto& v : result) {
-      newKeys.push_back(std::move(v));
-    }
-
     auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
     if (!expdb.ok()) {
       return expdb.status();
     }
-    PStore kvstore = expdb.value().store;
     RecordKey storeRk(expdb.value().chunkId,
                       pCtx->getDbId(),
                       RecordType::RT_SET_META,
                       storeKey,
                       "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      Expected<std::string> addStore =
-        genericSAdd(sess,
-                    kvstore,
-                    txn.get(),
-                    storeRk,
-                    {ErrorCodes::ERR_NOTFOUND, ""},
-                    newKeys);
-      if (addStore.ok()) {
-        auto s1 = txn->commit();
-        if (!s1.ok()) {
-          return s1.status();
-        }
-        return addStore.value();
-      }
-      if (addStore.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return addStore.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return addStore.status();
-      } else {
-        continue;
+    SetWriter writer(sess, expdb.value().store, storeRk);
+    for (const auto& member : members) {
+      auto s = writer.add(member);
+      if (!s.ok()) {
+        return s;
       }
     }
-    return {ErrorCodes::ERR_INTERNAL, "currently unrechable"};
+    auto s = setOperate(_op, sets, [&writer](const std::string& member) {
+      return writer.add(member);
+    });
+    if (!s.ok()) {
+      return s;
+    }
+    auto expCount = writer.finish();
+    if (!expCount.ok()) {
+      return expCount.status();
+    }
+    return Command::fmtLongLong(expCount.value());
   }
 
  private:
+  SetOp _op;
   bool _store;
 };
 
-class SinterCommand : public SintergenericCommand {
+class SdiffCommand : public SetOpGenericCommand {
+ public:
+  SdiffCommand() : SetOpGenericCommand("sdiff", "rS", SetOp::DIFF, false) {}
+
+  ssize_t arity() const {
+    return -2;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return -1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+} sdiffcmd;
+
+class SdiffStoreCommand : public SetOpGenericCommand {
  public:
-  SinterCommand() : SintergenericCommand("sinter", "rS", false) {}
+  SdiffStoreCommand()
+    : SetOpGenericCommand("sdiffstore", "wm", SetOp::DIFF, true) {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return -1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+} sdiffstoreCommand;
+
+class SinterCommand : public SetOpGenericCommand {
+ public:
+  SinterCommand() : SetOpGenericCommand("sinter", "rS", SetOp::INTER, false) {}
 
   ssize_t arity() const {
     return -2;
@@ -1227,9 +1854,10 @@ class SinterCommand : public SintergenericCommand {
   }
 } sinterCommand;
 
-class SinterStoreCommand : public SintergenericCommand {
+class SinterStoreCommand : public SetOpGenericCommand {
  public:
-  SinterStoreCommand() : SintergenericCommand("sinterstore", "wm", true) {}
+  SinterStoreCommand()
+    : SetOpGenericCommand("sinterstore", "wm", SetOp::INTER, true) {}
 
   ssize_t arity() const {
     return -3;
@@ -1388,139 +2016,9 @@ class SmoveCommand : public Command {
   }
 } smoveCommand;
 
-class SuniongenericCommand : public Command {
- public:
-  SuniongenericCommand(const std::string& name, const char* sflags, bool store)
-    : Command(name, sflags), _store(store) {}
-
-  Expected<std::string> run(Session* sess) final {
-    const std::vector<std::string>& args = sess->getArgs();
-    size_t startkey = _store ? 2 : 1;
-    std::unordered_set<std::string> result;
-    auto server = sess->getServerEntry();
-    SessionCtx* pCtx = sess->getCtx();
-
-    std::vector<int> index = getKeysFromCommand(args);
-    auto lock = server->getSegmentMgr()->getAllKeysLocked(
-      sess, args, index, _store ? mgl::LockMode::LOCK_X : Command::RdLock());
-    if (!lock.ok()) {
-      return lock.status();
-    }
-
-    for (size_t i = startkey; i < args.size(); ++i) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        continue;
-      } else if (!rv.ok()) {
-        return rv.status();
-      }
-
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
-      PStore kvstore = expdb.value().store;
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      auto cursor = txn->createDataCursor();
-      RecordKey fakeRk(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_SET_ELE,
-                       args[i],
-                       "");
-      cursor->seek(fakeRk.prefixPk());
-      while (true) {
-        Expected<Record> exptRcd = cursor->next();
-        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-          break;
-        }
-        if (!exptRcd.ok()) {
-          return exptRcd.status();
-        }
-
-        Record& rcd = exptRcd.value();
-        const RecordKey& rcdkey = rcd.getRecordKey();
-        if (rcdkey.prefixPk() != fakeRk.prefixPk()) {
-          break;
-        }
-        result.insert(rcdkey.getSecondaryKey());
-      }
-    }
-
-    if (!_store) {
-      std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (const auto& v : result) {
-        Command::fmtBulk(ss, v);
-      }
-      return ss.str();
-    }
-
-    const std::string& storeKey = args[1];
-    Expected<bool> deleted = delGeneric(sess, storeKey);
-    if (!deleted.ok()) {
-      return deleted.status();
-    }
-
-    std::vector<std::string> newKeys(2);
-    for (const auto& v : result) {
-      newKeys.push_back(std::move(v));
-    }
-
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
-    if (!expdb.ok()) {
-      return expdb.status();
-    }
-    PStore kvstore = expdb.value().store;
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_SET_META,
-                      storeKey,
-                      "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      auto ptxn = kvstore->createTransaction(sess);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      std::unique_ptr<Transaction> txn = std::move(ptxn.value());
-      Expected<std::string> addStore =
-        genericSAdd(sess,
-                    kvstore,
-                    txn.get(),
-                    storeRk,
-                    {ErrorCodes::ERR_NOTFOUND, ""},
-                    newKeys);
-      if (addStore.ok()) {
-        auto s1 = txn->commit();
-        if (!s1.ok()) {
-          return s1.status();
-        }
-        return addStore.value();
-      }
-      if (addStore.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return addStore.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return addStore.status();
-      } else {
-        continue;
-      }
-    }
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
-  }
-
- private:
-  bool _store;
-};
-
-class SunionCommand : public SuniongenericCommand {
+class SunionCommand : public SetOpGenericCommand {
  public:
-  SunionCommand() : SuniongenericCommand("sunion", "rS", false) {}
+  SunionCommand() : SetOpGenericCommand("sunion", "rS", SetOp::UNION, false) {}
 
   ssize_t arity() const {
     return -2;
@@ -1539,9 +2037,10 @@ class SunionCommand : public SuniongenericCommand {
   }
 } sunionCommand;
 
-class SunionStoreCommand : public SuniongenericCommand {
+class SunionStoreCommand : public SetOpGenericCommand {
  public:
-  SunionStoreCommand() : SuniongenericCommand("sunionstore", "wm", true) {}
+  SunionStoreCommand()
+    : SetOpGenericCommand("sunionstore", "wm", SetOp::UNION, true) {}
 
   ssize_t arity() const {
     return -3;
@@ -12,7 +12,8 @@
 #include "tendisplus/commands/command.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
-#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/zsetindex.h"
+#include "tendisplus/storage/countedtree.h"
 
 namespace tendisplus {
 constexpr uint64_t MAXSEQ = 9223372036854775807ULL;
@@ -94,6 +95,19 @@ class SortCommand : public Command {
     std::unique_ptr<Transaction> ROTxn = std::move(byExptxn.value());
 
     if (fieldKey.size() != 0) {
+      if (byRv.value().getRecordType() == RecordType::RT_HASH_META) {
+        auto eHashMeta = HashMetaValue::decode(byRv.value().getValue());
+        if (!eHashMeta.ok()) {
+          return eHashMeta.status();
+        }
+        if (eHashMeta.value().isPacked()) {
+          auto value = eHashMeta.value().getEntries().get(fieldKey);
+          if (value == nullptr) {
+            return {ErrorCodes::ERR_NOTFOUND, ""};
+          }
+          return *value;
+        }
+      }
       RecordKey hashRk(expdb.value().chunkId,
                        pCtx->getDbId(),
                        RecordType::RT_HASH_ELE,
@@ -264,7 +278,9 @@ class SortCommand : public Command {
     // get the length of the object
     ssize_t veclen(0);
     uint64_t lHead(0), lTail(0);
-    std::unique_ptr<SkipList> sl(nullptr);
+    bool lSegmented = false;
+    SetMetaValue setMeta;
+    std::unique_ptr<ZsetIndex> sl(nullptr);
     switch (keyType) {
       case RecordType::RT_LIST_META: {
         auto lm = ListMetaValue::decode(rv->getValue());
@@ -274,6 +290,7 @@ class SortCommand : public Command {
         lHead = lm.value().getHead();
         lTail = lm.value().getTail();
         veclen = lTail - lHead;
+        lSegmented = lm.value().isSegmented();
         break;
       }
       case RecordType::RT_SET_META: {
@@ -282,6 +299,7 @@ class SortCommand : public Command {
           return sm.status();
         }
         veclen = sm.value().getCount();
+        setMeta = std::move(sm.value());
         break;
       }
       case RecordType::RT_ZSET_META: {
@@ -291,11 +309,11 @@ class SortCommand : public Command {
         }
         ZSlMetaValue meta = zm.value();
         veclen = meta.getCount() - 1;
-        sl = std::make_unique<SkipList>(metaRk.getChunkId(),
-                                        metaRk.getDbId(),
-                                        metaRk.getPrimaryKey(),
-                                        meta,
-                                        kvstore);
+        sl = makeZsetIndex(metaRk.getChunkId(),
+                           metaRk.getDbId(),
+                           metaRk.getPrimaryKey(),
+                           meta,
+                           kvstore);
         break;
       }
       default:
@@ -354,7 +372,49 @@ class SortCommand : public Command {
         }
       }
 
+      // the segments of a segmented list in order
+      std::vector<CountedTree::Entry> lSegments;
+      if (lSegmented) {
+        CountedTree tree(expdb.value().chunkId,
+                         pCtx->getDbId(),
+                         RecordType::RT_LIST_ELE,
+                         key,
+                         kvstore);
+        auto eSegs = tree.entries(txn.get());
+        if (!eSegs.ok()) {
+          return eSegs.status();
+        }
+        lSegments = std::move(eSegs.value());
+      }
+      std::vector<std::string> segEles;
+      for (const auto& seg : lSegments) {
+        RecordKey segRk(expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_LIST_ELE,
+                        key,
+                        std::to_string(seg.id));
+        Expected<RecordValue> expRv = kvstore->getKV(segRk, txn.get());
+        if (!expRv.ok()) {
+          return expRv.status();
+        }
+        auto expSeg = ListSegment::decode(expRv.value().getValue());
+        if (!expSeg.ok()) {
+          return expSeg.status();
+        }
+        for (auto& ele : *expSeg.value().getMutableElements()) {
+          segEles.emplace_back(std::move(ele));
+        }
+      }
+
       while (sign * static_cast<int64_t>(stop - pos) >= 0) {
+        if (lSegmented) {
+          if (pos - lHead >= segEles.size()) {
+            return {ErrorCodes::ERR_NOTFOUND, ""};
+          }
+          records.emplace_back(Element{segEles[pos - lHead], 0});
+          pos += sign;
+          continue;
+        }
         RecordKey subRk(expdb.value().chunkId,
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
@@ -367,6 +427,10 @@ class SortCommand : public Command {
         records.emplace_back(Element{expRv.value().getValue(), 0});
         pos += sign;
       }
+    } else if (keyType == RecordType::RT_SET_META && setMeta.isPacked()) {
+      for (const auto& entry : setMeta.getEntries().getEntries()) {
+        records.emplace_back(Element{entry.first, 0});
+      }
     } else if (keyType == RecordType::RT_SET_META) {
       auto cursor = txn->createDataCursor();
       RecordKey fakeRk = {expdb.value().chunkId,
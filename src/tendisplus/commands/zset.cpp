@@ -16,12 +16,118 @@
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
-#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/zsetindex.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/varint.h"
 
 namespace tendisplus {
 Expected<bool> delGeneric(Session* sess, const std::string& key);
+
+// A small zset may be packed into its meta, the scores are then kept by
+// the PackedZset index instead of RT_ZSET_H_ELE records, see
+// zset-max-packed-entries. packed is ZsetIndex::getPacked(), the index
+// changes the packed scores by itself, so the writes are skipped then.
+Expected<RecordValue> getZsetScore(PStore kvstore,
+                                   Transaction* txn,
+                                   const PackedEntries* packed,
+                                   const RecordKey& hk) {
+  if (packed == nullptr) {
+    return kvstore->getKV(hk, txn);
+  }
+  auto value = packed->get(hk.getSecondaryKey());
+  if (value == nullptr) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return RecordValue(*value, RecordType::RT_ZSET_H_ELE, -1);
+}
+
+Status setZsetScore(PStore kvstore,
+                    Transaction* txn,
+                    const PackedEntries* packed,
+                    const RecordKey& hk,
+                    double score) {
+  if (packed != nullptr) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  RecordValue hv(score, RecordType::RT_ZSET_H_ELE);
+  return kvstore->setKV(hk, hv, txn);
+}
+
+Status delZsetScore(PStore kvstore,
+                    Transaction* txn,
+                    const PackedEntries* packed,
+                    const RecordKey& hk) {
+  if (packed != nullptr) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  return kvstore->delKV(hk, txn);
+}
+
+// the head of the skiplist of a new zset
+Status addZsetHead(PStore kvstore, Transaction* txn, const RecordKey& mk) {
+  RecordKey head(mk.getChunkId(),
+                 mk.getDbId(),
+                 RecordType::RT_ZSET_S_ELE,
+                 mk.getPrimaryKey(),
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  return kvstore->setKV(head, subRv, txn);
+}
+
+// should be called before the meta of a modified zset is written. A packed
+// zset which outgrows the limits, or force, is converted to the index of a
+// new zset with RT_ZSET_H_ELE records, and is never packed again.
+Status expandZsetIfNeeded(Session* sess,
+                          PStore kvstore,
+                          Transaction* txn,
+                          const RecordKey& mk,
+                          std::unique_ptr<ZsetIndex>* sl,
+                          bool force = false) {
+  const PackedEntries* packed = (*sl)->getPacked();
+  if (packed == nullptr) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  const auto& params = sess->getServerEntry()->getParams();
+  // the scores are 8 bytes, only the members are limited
+  uint64_t maxValue =
+    std::max<uint64_t>(params->zsetMaxPackedValue, sizeof(double));
+  if (!force && packed->fits(params->zsetMaxPackedEntries, maxValue)) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  ZSlMetaValue meta(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
+  meta.setScoreKeys(params->zsetScoreBlockEntries);
+  if (!meta.isScoreKeys()) {
+    Status s = addZsetHead(kvstore, txn, mk);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  auto index = makeZsetIndex(
+    mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  for (const auto& entry : packed->getEntries()) {
+    Expected<double> score = ::tendisplus::doubleDecode(entry.second);
+    if (!score.ok()) {
+      return score.status();
+    }
+    Status s = index->insert(score.value(), entry.first, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    RecordKey hk(mk.getChunkId(),
+                 mk.getDbId(),
+                 RecordType::RT_ZSET_H_ELE,
+                 mk.getPrimaryKey(),
+                 entry.first);
+    s = setZsetScore(kvstore, txn, nullptr, hk, score.value());
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  *sl = std::move(index);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Expected<std::string> genericZrem(Session* sess,
                                   PStore kvstore,
                                   const RecordKey& mk,
@@ -47,7 +153,8 @@ Expected<std::string> genericZrem(Session* sess,
     return eMetaContent.status();
   }
   ZSlMetaValue meta = eMetaContent.value();
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  auto sl = makeZsetIndex(
+    mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
 
   uint32_t cnt = 0;
   for (const auto& subkey : subkeys) {
@@ -56,7 +163,8 @@ Expected<std::string> genericZrem(Session* sess,
                  RecordType::RT_ZSET_H_ELE,
                  mk.getPrimaryKey(),
                  subkey);
-    Expected<RecordValue> eValue = kvstore->getKV(hk, txn.get());
+    Expected<RecordValue> eValue =
+      getZsetScore(kvstore, txn.get(), sl->getPacked(), hk);
     if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
       return eValue.status();
     }
@@ -69,21 +177,21 @@ Expected<std::string> genericZrem(Session* sess,
       if (!oldScore.ok()) {
         return oldScore.status();
       }
-      Status s = sl.remove(oldScore.value(), subkey, txn.get());
+      Status s = sl->remove(oldScore.value(), subkey, txn.get());
       if (!s.ok()) {
         return s;
       }
-      s = kvstore->delKV(hk, txn.get());
+      s = delZsetScore(kvstore, txn.get(), sl->getPacked(), hk);
       if (!s.ok()) {
         return s;
       }
     }
   }
   Status s;
-  if (sl.getCount() > 1) {
-    s = sl.save(txn.get(), eMeta, pCtx->getVersionEP());
+  if (sl->getCount() > 1) {
+    s = sl->save(txn.get(), eMeta, pCtx->getVersionEP());
   } else {
-    INVARIANT(sl.getCount() == 1);
+    INVARIANT(sl->getCount() == 1);
     s = Command::delKeyAndTTL(sess, mk, eMeta.value(), txn.get());
     if (!s.ok()) {
       return s;
@@ -156,22 +264,25 @@ Expected<std::string> genericZadd(Session* sess,
                 eMeta.status().code() == ErrorCodes::ERR_EXPIRED);
     // head node also included into the count
     ZSlMetaValue tmp(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
+    const auto& params = sess->getServerEntry()->getParams();
+    if (params->zsetMaxPackedEntries > 0) {
+      // a new zset starts packed, without the skiplist head
+      tmp.setPacked(true);
+    } else {
+      // the members are kept under score keys, without the skiplist head
+      tmp.setScoreKeys(params->zsetScoreBlockEntries);
+    }
     RecordValue rv(
       tmp.encode(), RecordType::RT_ZSET_META, pCtx->getVersionEP());
     Status s = kvstore->setKV(mk, rv, txn.get());
     if (!s.ok()) {
       return s;
     }
-    RecordKey head(mk.getChunkId(),
-                   pCtx->getDbId(),
-                   RecordType::RT_ZSET_S_ELE,
-                   mk.getPrimaryKey(),
-                   std::to_string(ZSlMetaValue::HEAD_ID));
-    ZSlEleValue headVal;
-    RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
-    s = kvstore->setKV(head, subRv, txn.get());
-    if (!s.ok()) {
-      return s;
+    if (!tmp.isScoreKeys() && !tmp.isPacked()) {
+      s = addZsetHead(kvstore, txn.get(), mk);
+      if (!s.ok()) {
+        return s;
+      }
     }
     Expected<RecordValue> eMeta = kvstore->getKV(mk, txn.get());
     if (!eMeta.ok()) {
@@ -184,10 +295,24 @@ Expected<std::string> genericZadd(Session* sess,
     meta = eMetaContent.value();
   }
 
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  auto sl = makeZsetIndex(
+    mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  // a batch too big for a packed zset, as from ZUNIONSTORE, is added to the
+  // expanded zset instead of the packed one
+  Status s = expandZsetIfNeeded(
+    sess,
+    kvstore,
+    txn.get(),
+    mk,
+    &sl,
+    subKeys.size() >
+      sess->getServerEntry()->getParams()->zsetMaxPackedEntries);
+  if (!s.ok()) {
+    return s;
+  }
   std::stringstream ss;
   double newScore = 0;
-  // sl.traverse(ss, txn.get());
+  // sl->traverse(ss, txn.get());
   for (const auto& entry : subKeys) {
     RecordKey hk(mk.getChunkId(),
                  pCtx->getDbId(),
@@ -198,7 +323,8 @@ Expected<std::string> genericZadd(Session* sess,
     if (std::isnan(newScore)) {
       return {ErrorCodes::ERR_NAN, ""};
     }
-    Expected<RecordValue> eValue = kvstore->getKV(hk, txn.get());
+    Expected<RecordValue> eValue =
+      getZsetScore(kvstore, txn.get(), sl->getPacked(), hk);
     if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
       return eValue.status();
     }
@@ -208,12 +334,11 @@ Expected<std::string> genericZadd(Session* sess,
       }
       added++;
       processed++;
-      Status s = sl.insert(entry.second, entry.first, txn.get());
+      Status s = sl->insert(entry.second, entry.first, txn.get());
       if (!s.ok()) {
         return s;
       }
-      RecordValue hv(newScore, RecordType::RT_ZSET_H_ELE);
-      s = kvstore->setKV(hk, hv, txn.get());
+      s = setZsetScore(kvstore, txn.get(), sl->getPacked(), hk, newScore);
       if (!s.ok()) {
         return s;
       }
@@ -239,23 +364,26 @@ Expected<std::string> genericZadd(Session* sess,
       updated++;
       processed++;
       // change score
-      Status s = sl.remove(oldScore.value(), entry.first, txn.get());
+      Status s = sl->remove(oldScore.value(), entry.first, txn.get());
       if (!s.ok()) {
         return s;
       }
-      s = sl.insert(newScore, entry.first, txn.get());
+      s = sl->insert(newScore, entry.first, txn.get());
       if (!s.ok()) {
         return s;
       }
-      RecordValue hv(newScore, RecordType::RT_ZSET_H_ELE);
-      s = kvstore->setKV(hk, hv, txn.get());
+      s = setZsetScore(kvstore, txn.get(), sl->getPacked(), hk, newScore);
       if (!s.ok()) {
         return s;
       }
     }
   }
+  s = expandZsetIfNeeded(sess, kvstore, txn.get(), mk, &sl);
+  if (!s.ok()) {
+    return s;
+  }
   // NOTE(vinchen): skiplist save one time
-  Status s = sl.save(txn.get(), eMeta, sess->getCtx()->getVersionEP());
+  s = sl->save(txn.get(), eMeta, sess->getCtx()->getVersionEP());
   if (!s.ok()) {
     return s;
   }
@@ -285,13 +413,21 @@ Expected<std::string> genericZRank(Session* sess,
   }
   std::unique_ptr<Transaction> txn = std::move(ptxn.value());
 
+  auto eMetaContent = ZSlMetaValue::decode(mv.getValue());
+  if (!eMetaContent.ok()) {
+    return eMetaContent.status();
+  }
+  const ZSlMetaValue& meta = eMetaContent.value();
+  auto sl = makeZsetIndex(
+    mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+
   RecordKey hk(mk.getChunkId(),
                mk.getDbId(),
                RecordType::RT_ZSET_H_ELE,
                mk.getPrimaryKey(),
                subkey);
   Expected<RecordValue> eValue =
-    kvstore->getKV(hk, txn.get(), RecordType::RT_ZSET_H_ELE);
+    getZsetScore(kvstore, txn.get(), sl->getPacked(), hk);
   if (!eValue.ok()) {
     if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
       return Command::fmtNull();
@@ -304,13 +440,7 @@ Expected<std::string> genericZRank(Session* sess,
     return score.status();
   }
 
-  auto eMetaContent = ZSlMetaValue::decode(mv.getValue());
-  if (!eMetaContent.ok()) {
-    return eMetaContent.status();
-  }
-  const ZSlMetaValue& meta = eMetaContent.value();
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
-  Expected<uint32_t> rank = sl.rank(score.value(), subkey, txn.get());
+  Expected<uint32_t> rank = sl->rank(score.value(), subkey, txn.get());
   if (!rank.ok()) {
     return rank.status();
   }
@@ -387,11 +517,11 @@ class ZRemByRangeGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(
+    auto sl = makeZsetIndex(
       mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
 
     if (_type == Type::RANK) {
-      int64_t llen = sl.getCount() - 1;
+      int64_t llen = sl->getCount() - 1;
       if (start < 0) {
         start = llen + start;
       }
@@ -411,19 +541,19 @@ class ZRemByRangeGenericCommand : public Command {
 
     std::list<std::pair<double, std::string>> result;
     if (_type == Type::RANK) {
-      auto tmp = sl.removeRangeByRank(start + 1, end + 1, txn.get());
+      auto tmp = sl->removeRangeByRank(start + 1, end + 1, txn.get());
       if (!tmp.ok()) {
         return tmp.status();
       }
       result = std::move(tmp.value());
     } else if (_type == Type::SCORE) {
-      auto tmp = sl.removeRangeByScore(range, txn.get());
+      auto tmp = sl->removeRangeByScore(range, txn.get());
       if (!tmp.ok()) {
         return tmp.status();
       }
       result = std::move(tmp.value());
     } else if (_type == Type::LEX) {
-      auto tmp = sl.removeRangeByLex(lexrange, txn.get());
+      auto tmp = sl->removeRangeByLex(lexrange, txn.get());
       if (!tmp.ok()) {
         return tmp.status();
       }
@@ -435,17 +565,17 @@ class ZRemByRangeGenericCommand : public Command {
                    RecordType::RT_ZSET_H_ELE,
                    mk.getPrimaryKey(),
                    v.second);
-      auto s = kvstore->delKV(hk, txn.get());
+      auto s = delZsetScore(kvstore, txn.get(), sl->getPacked(), hk);
       if (!s.ok()) {
         return s;
       }
     }
 
     Status s;
-    if (sl.getCount() > 1) {
-      s = sl.save(txn.get(), eMeta, pCtx->getVersionEP());
+    if (sl->getCount() > 1) {
+      s = sl->save(txn.get(), eMeta, pCtx->getVersionEP());
     } else {
-      INVARIANT(sl.getCount() == 1);
+      INVARIANT(sl->getCount() == 1);
       s = Command::delKeyAndTTL(sess, mk, eMeta.value(), txn.get());
       if (!s.ok()) {
         return s;
@@ -916,35 +1046,13 @@ class ZCountCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
-    auto f = sl.firstInRange(range, txn.get());
-    if (!f.ok()) {
-      return f.status();
-    }
-    if (f.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtZero();
-    }
-    auto first = sl.getCacheNode(f.value());
-    Expected<uint32_t> rank =
-      sl.rank(first->getScore(), first->getSubKey(), txn.get());
-    if (!rank.ok()) {
-      return rank.status();
+    auto sl = makeZsetIndex(
+      expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    auto count = sl->countInRange(range, txn.get());
+    if (!count.ok()) {
+      return count.status();
     }
-    // sl.getCount()-1 : total skiplist nodes exclude head
-    uint32_t count = (sl.getCount() - 1 - (rank.value() - 1));
-    auto l = sl.lastInRange(range, txn.get());
-    if (!l.ok()) {
-      return l.status();
-    }
-    if (l.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtLongLong(count);
-    }
-    auto last = sl.getCacheNode(l.value());
-    rank = sl.rank(last->getScore(), last->getSubKey(), txn.get());
-    if (!rank.ok()) {
-      return rank.status();
-    }
-    return Command::fmtLongLong(count - (sl.getCount() - 1 - rank.value()));
+    return Command::fmtLongLong(count.value());
   }
 } zcountCommand;
 
@@ -1006,36 +1114,14 @@ class ZlexCountCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    auto sl = makeZsetIndex(
+      expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
 
-    auto f = sl.firstInLexRange(range, txn.get());
-    if (!f.ok()) {
-      return f.status();
-    }
-    if (f.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtZero();
-    }
-    auto first = sl.getCacheNode(f.value());
-    Expected<uint32_t> rank =
-      sl.rank(first->getScore(), first->getSubKey(), txn.get());
-    if (!rank.ok()) {
-      return rank.status();
+    auto count = sl->countInLexRange(range, txn.get());
+    if (!count.ok()) {
+      return count.status();
     }
-    // sl.getCount()-1 : total skiplist nodes exclude head
-    uint32_t count = (sl.getCount() - 1 - (rank.value() - 1));
-    auto l = sl.lastInLexRange(range, txn.get());
-    if (!l.ok()) {
-      return l.status();
-    }
-    if (l.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtLongLong(count);
-    }
-    auto last = sl.getCacheNode(l.value());
-    rank = sl.rank(last->getScore(), last->getSubKey(), txn.get());
-    if (!rank.ok()) {
-      return rank.status();
-    }
-    return Command::fmtLongLong(count - (sl.getCount() - 1 - rank.value()));
+    return Command::fmtLongLong(count.value());
   }
 } zlexCntCmd;
 
@@ -1067,6 +1153,10 @@ class ZRangeByScoreGenericCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
     uint64_t offset = 0;
@@ -1124,7 +1214,8 @@ class ZRangeByScoreGenericCommand : public Command {
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
         rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     } else if (!rv.ok()) {
       return rv.status();
     }
@@ -1142,24 +1233,24 @@ class ZRangeByScoreGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
-    auto arr = sl.scanByScore(range, offset, limit, _rev, txn.get());
+    auto sl = makeZsetIndex(
+      expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    auto arr = sl->scanByScore(range, offset, limit, _rev, txn.get());
     if (!arr.ok()) {
       return arr.status();
     }
-    std::stringstream ss;
     if (withscore) {
-      Command::fmtMultiBulkLen(ss, arr.value().size() * 2);
+      writer->appendMultiBulkLen(arr.value().size() * 2);
     } else {
-      Command::fmtMultiBulkLen(ss, arr.value().size());
+      writer->appendMultiBulkLen(arr.value().size());
     }
     for (const auto& v : arr.value()) {
-      Command::fmtBulk(ss, v.second);
+      writer->appendBulk(v.second);
       if (withscore) {
-        Command::fmtBulk(ss, ::tendisplus::dtos(v.first));
+        writer->appendBulk(::tendisplus::dtos(v.first));
       }
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 
  private:
@@ -1205,6 +1296,10 @@ class ZRangeByLexGenericCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
     uint64_t offset = 0;
@@ -1259,7 +1354,8 @@ class ZRangeByLexGenericCommand : public Command {
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
         rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     } else if (!rv.ok()) {
       return rv.status();
     }
@@ -1277,17 +1373,17 @@ class ZRangeByLexGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
-    auto arr = sl.scanByLex(range, offset, limit, _rev, txn.get());
+    auto sl = makeZsetIndex(
+      expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    auto arr = sl->scanByLex(range, offset, limit, _rev, txn.get());
     if (!arr.ok()) {
       return arr.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, arr.value().size());
+    writer->appendMultiBulkLen(arr.value().size());
     for (const auto& v : arr.value()) {
-      Command::fmtBulk(ss, v.second);
+      writer->appendBulk(v.second);
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 
  private:
@@ -1332,6 +1428,10 @@ class ZRangeGenericCommand : public Command {
   }
 
   Expected<std::string> run(Session* sess) final {
+    return runByWriter(sess);
+  }
+
+  Status runWriter(Session* sess, RespWriter* writer) final {
     const std::vector<std::string>& args = sess->getArgs();
     const std::string& key = args[1];
     Expected<int64_t> estart = ::tendisplus::stoll(args[2]);
@@ -1360,7 +1460,8 @@ class ZRangeGenericCommand : public Command {
       Command::expireKeyIfNeeded(sess, key, RecordType::RT_ZSET_META);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
         rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     } else if (!rv.ok()) {
       return rv.status();
     }
@@ -1378,8 +1479,9 @@ class ZRangeGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
-    int64_t len = sl.getCount() - 1;
+    auto sl = makeZsetIndex(
+      expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    int64_t len = sl->getCount() - 1;
     if (start < 0) {
       start = len + start;
     }
@@ -1390,29 +1492,29 @@ class ZRangeGenericCommand : public Command {
       start = 0;
     }
     if (start > end || start >= len) {
-      return Command::fmtZeroBulkLen();
+      writer->appendRaw(Command::fmtZeroBulkLen());
+      return {ErrorCodes::ERR_OK, ""};
     }
     if (end >= len) {
       end = len - 1;
     }
     int64_t rangeLen = end - start + 1;
-    auto arr = sl.scanByRank(start, rangeLen, _rev, txn.get());
+    auto arr = sl->scanByRank(start, rangeLen, _rev, txn.get());
     if (!arr.ok()) {
       return arr.status();
     }
-    std::stringstream ss;
     if (withscore) {
-      Command::fmtMultiBulkLen(ss, arr.value().size() * 2);
+      writer->appendMultiBulkLen(arr.value().size() * 2);
     } else {
-      Command::fmtMultiBulkLen(ss, arr.value().size());
+      writer->appendMultiBulkLen(arr.value().size());
     }
     for (const auto& v : arr.value()) {
-      Command::fmtBulk(ss, v.second);
+      writer->appendBulk(v.second);
       if (withscore) {
-        Command::fmtBulk(ss, ::tendisplus::dtos(v.first));
+        writer->appendBulk(::tendisplus::dtos(v.first));
       }
     }
-    return ss.str();
+    return {ErrorCodes::ERR_OK, ""};
   }
 
  private:
@@ -1485,12 +1587,18 @@ class ZScoreCommand : public Command {
       return ptxn.status();
     }
     std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto eMetaContent = ZSlMetaValue::decode(rv.value().getValue());
+    if (!eMetaContent.ok()) {
+      return eMetaContent.status();
+    }
+    const ZSlMetaValue& meta = eMetaContent.value();
     RecordKey hk(expdb.value().chunkId,
                  pCtx->getDbId(),
                  RecordType::RT_ZSET_H_ELE,
                  key,
                  subkey);
-    Expected<RecordValue> eValue = kvstore->getKV(hk, txn.get());
+    Expected<RecordValue> eValue = getZsetScore(
+      kvstore, txn.get(), meta.isPacked() ? &meta.getEntries() : nullptr, hk);
     if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
       return eValue.status();
     }
@@ -1863,12 +1971,12 @@ class ZUnionInterGenericCommand : public Command {
         if (keyType == RecordType::RT_ZSET_META) {
           Expected<ZSlMetaValue> zslMeta =
             ZSlMetaValue::decode(zsetList[i].second.getValue());
-          SkipList sl(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      key,
-                      zslMeta.value(),
-                      kvstore);
-          auto arr = sl.scanByRank(0, sl.getCount() - 1, false, txn.get());
+          auto sl = makeZsetIndex(expdb.value().chunkId,
+                                  pCtx->getDbId(),
+                                  key,
+                                  zslMeta.value(),
+                                  kvstore);
+          auto arr = sl->scanByRank(0, sl->getCount() - 1, false, txn.get());
           if (!arr.ok()) {
             return arr.status();
           }
@@ -1883,12 +1991,29 @@ class ZUnionInterGenericCommand : public Command {
             zunionInterAggregate(&scoreMap[v.second], value, aggr);
           }
         } else if (keyType == RecordType::RT_SET_META) {
-          auto cursor = txn->createDataCursor();
+          auto addMember = [&](const std::string& subkey) {
+            if (!scoreMap.count(subkey)) {
+              scoreMap[subkey] = 1 * w;
+              return;
+            }
+            zunionInterAggregate(&scoreMap[subkey], 1 * w, aggr);
+          };
+          // a packed set has no RT_SET_ELE records for the cursor
+          Expected<SetMetaValue> eSetMeta =
+            SetMetaValue::decode(zsetList[i].second.getValue());
+          if (!eSetMeta.ok()) {
+            return eSetMeta.status();
+          }
+          const auto& packed = eSetMeta.value().getEntries();
+          for (const auto& entry : packed.getEntries()) {
+            addMember(entry.first);
+          }
           RecordKey rk(expdb.value().chunkId,
                        pCtx->getDbId(),
                        RecordType::RT_SET_ELE,
                        key,
                        "");
+          auto cursor = txn->createPrefixDataCursor(rk.prefixPk());
           cursor->seek(rk.prefixPk());
           while (true) {
             Expected<Record> expRcd = cursor->next();
@@ -1903,12 +2028,7 @@ class ZUnionInterGenericCommand : public Command {
             if (rcdKey.prefixPk() != rk.prefixPk()) {
               break;
             }
-            const std::string& subkey = rcdKey.getSecondaryKey();
-            if (!scoreMap.count(subkey)) {
-              scoreMap[subkey] = 1 * w;
-              continue;
-            }
-            zunionInterAggregate(&scoreMap[subkey], 1 * w, aggr);
+            addMember(rcdKey.getSecondaryKey());
           }
         }
         continue;
@@ -1916,11 +2036,35 @@ class ZUnionInterGenericCommand : public Command {
         RecordType eleType = keyType == RecordType::RT_ZSET_META
           ? RecordType::RT_ZSET_H_ELE
           : RecordType::RT_SET_ELE;
+        // the members of a packed set or zset are probed in its meta
+        bool isPacked = false;
+        PackedEntries packed;
+        const std::string& metaValue = zsetList[i].second.getValue();
+        if (keyType == RecordType::RT_ZSET_META) {
+          auto eMeta = ZSlMetaValue::decode(metaValue);
+          if (!eMeta.ok()) {
+            return eMeta.status();
+          }
+          isPacked = eMeta.value().isPacked();
+          packed = eMeta.value().getEntries();
+        } else {
+          auto eMeta = SetMetaValue::decode(metaValue);
+          if (!eMeta.ok()) {
+            return eMeta.status();
+          }
+          isPacked = eMeta.value().isPacked();
+          packed = eMeta.value().getEntries();
+        }
         for (auto iter = scoreMap.begin(); iter != scoreMap.end();) {
           const std::string& subkey = iter->first;
           RecordKey rk(
             expdb.value().chunkId, pCtx->getDbId(), eleType, key, subkey);
-          auto eVal = kvstore->getKV(rk, txn.get());
+          Expected<RecordValue> eVal = {ErrorCodes::ERR_NOTFOUND, ""};
+          if (!isPacked) {
+            eVal = kvstore->getKV(rk, txn.get());
+          } else if (packed.get(subkey) != nullptr) {
+            eVal = RecordValue(*packed.get(subkey), eleType, -1);
+          }
 
           if (!eVal.ok() || eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
             iter = scoreMap.erase(iter);
@@ -6,6 +6,7 @@
 #include <limits>
 #include "tendisplus/lock/lock.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/latency_stats.h"
 #include "tendisplus/server/server_entry.h"
 
 namespace tendisplus {
@@ -196,18 +197,67 @@ Expected<std::unique_ptr<KeyLock>> KeyLock::AquireKeyLock(
   uint64_t lockTimeoutMs) {
   if (sess->getCtx()->isLockedByMe(key, mode)) {
     return std::unique_ptr<KeyLock>(nullptr);
+  }
+  // the command is run again after the session yielded on this lock
+  auto parked = sess->getCtx()->takeParkedLock();
+  if (parked) {
+    if (parked->getKey() == key && parked->getMode() == mode &&
+        parked->adopt()) {
+      return std::move(parked);
+    }
+    // only the commands of one key yield, it is not expected, but the
+    // parked lock can't be kept while waiting for the others
+    parked.reset();
+  }
+  if (sess->getCtx()->isLockYieldable()) {
+    return yieldKeyLock(storeId, chunkId, key, mode, sess, mgr, lockTimeoutMs);
+  }
+  auto lock = std::make_unique<KeyLock>(
+    storeId, chunkId, key, mode, sess, mgr, lockTimeoutMs);
+  if (lock->getLockResult() == mgl::LockRes::LOCKRES_OK) {
+    return lock;
+  } else if (lock->getLockResult() == mgl::LockRes::LOCKRES_TIMEOUT) {
+    return {ErrorCodes::ERR_LOCK_TIMEOUT, "Lock wait timeout"};
   } else {
-    auto lock = std::make_unique<KeyLock>(
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_UNKNOWN, "unknown error"};
+  }
+}
+
+Expected<std::unique_ptr<KeyLock>> KeyLock::yieldKeyLock(
+  uint32_t storeId,
+  uint32_t chunkId,
+  const std::string& key,
+  mgl::LockMode mode,
+  Session* sess,
+  mgl::MGLockMgr* mgr,
+  uint64_t lockTimeoutMs) {
+  // wait for the grant before it may come
+  auto s = sess->yieldOnLock(lockTimeoutMs);
+  if (!s.ok()) {
+    sess->getCtx()->setLockYieldable(false);
+    return AquireKeyLock(
       storeId, chunkId, key, mode, sess, mgr, lockTimeoutMs);
-    if (lock->getLockResult() == mgl::LockRes::LOCKRES_OK) {
-      return lock;
-    } else if (lock->getLockResult() == mgl::LockRes::LOCKRES_TIMEOUT) {
-      return {ErrorCodes::ERR_LOCK_TIMEOUT, "Lock wait timeout"};
-    } else {
-      INVARIANT_D(0);
-      return {ErrorCodes::ERR_UNKNOWN, "unknown error"};
-    }
   }
+  std::weak_ptr<Session> weak = sess->shared_from_this();
+  auto lock = std::make_unique<KeyLock>(
+    storeId, chunkId, key, mode, sess, mgr, lockTimeoutMs, [weak]() {
+      auto sess = weak.lock();
+      if (sess) {
+        sess->lockGranted();
+      }
+    });
+  if (lock->getLockResult() == mgl::LockRes::LOCKRES_OK) {
+    sess->cancelYield();
+    return std::move(lock);
+  }
+  if (lock->getLockResult() != mgl::LockRes::LOCKRES_WAIT) {
+    // the parent locks are timed out
+    sess->cancelYield();
+    return {ErrorCodes::ERR_LOCK_TIMEOUT, "Lock wait timeout"};
+  }
+  sess->getCtx()->setParkedLock(std::move(lock));
+  return {ErrorCodes::ERR_LOCK_YIELD, "Lock wait yielded"};
 }
 
 KeyLock::KeyLock(uint32_t storeId,
@@ -217,6 +267,16 @@ KeyLock::KeyLock(uint32_t storeId,
                  Session* sess,
                  mgl::MGLockMgr* mgr,
                  uint64_t lockTimeoutMs)
+  : KeyLock(storeId, chunkId, key, mode, sess, mgr, lockTimeoutMs, nullptr) {}
+
+KeyLock::KeyLock(uint32_t storeId,
+                 uint32_t chunkId,
+                 const std::string& key,
+                 mgl::LockMode mode,
+                 Session* sess,
+                 mgl::MGLockMgr* mgr,
+                 uint64_t lockTimeoutMs,
+                 std::function<void()> onGrant)
   // :ILock(new StoreLock(storeId, getParentMode(mode), nullptr, mgr,
   // lockTimeoutMs),
   : ILock(new ChunkLock(
@@ -231,7 +291,11 @@ KeyLock::KeyLock(uint32_t storeId,
     if (_sess) {
       _sess->getCtx()->setWaitLock(storeId, chunkId, key, mode);
     }
-    _lockResult = _mgl->lock(target, mode, lockTimeoutMs);
+    if (onGrant) {
+      _lockResult = _mgl->lockAsync(target, mode, std::move(onGrant));
+    } else {
+      _lockResult = _mgl->lock(target, mode, lockTimeoutMs);
+    }
     if (_sess) {
       _sess->getCtx()->setWaitLock(0, 0, "", mgl::LockMode::LOCK_NONE);
       if (_lockResult == mgl::LockRes::LOCKRES_OK) {
@@ -242,6 +306,23 @@ KeyLock::KeyLock(uint32_t storeId,
   }
 }
 
+bool KeyLock::adopt() {
+  INVARIANT_D(_lockResult == mgl::LockRes::LOCKRES_WAIT);
+  if (_mgl->getStatus() != mgl::LockRes::LOCKRES_OK) {
+    return false;
+  }
+  _lockResult = mgl::LockRes::LOCKRES_OK;
+  // the session was parked while waiting, not timed by MGLock::lock()
+  if (LatencyStats::isTracking()) {
+    LatencyStats::addStageTime(LatencyStage::LOCK, _mgl->getAsyncWaitNs());
+  }
+  if (_sess) {
+    _sess->getCtx()->addLock(this);
+    _sess->getCtx()->setKeylock(_key, getMode());
+  }
+  return true;
+}
+
 KeyLock::~KeyLock() {
   if (_sess && _lockResult == mgl::LockRes::LOCKRES_OK) {
     _sess->getCtx()->unsetKeylock(_key);
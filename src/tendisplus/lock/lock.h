@@ -8,6 +8,7 @@
 #include <string>
 #include <utility>
 #include <memory>
+#include <functional>
 
 #include "tendisplus/lock/mgl/mgl.h"
 #include "tendisplus/server/session.h"
@@ -110,14 +111,38 @@ class KeyLock : public ILock {
           Session* sess,
           mgl::MGLockMgr* mgr,
           uint64_t lockTimeoutMs = 3600000);
+  // the key lock is waited by mgl::MGLock::lockAsync() if onGrant is set,
+  // the lock result is LOCKRES_WAIT until adopt().
+  KeyLock(uint32_t storeId,
+          uint32_t chunkId,
+          const std::string& key,
+          mgl::LockMode mode,
+          Session* sess,
+          mgl::MGLockMgr* mgr,
+          uint64_t lockTimeoutMs,
+          std::function<void()> onGrant);
   uint32_t getStoreId() const final;
   uint32_t getChunkId() const final;
   std::string getKey() const final;
+  // take the lock waited asynchronously as granted, false if it is not
+  // granted yet
+  bool adopt();
   // remove lock from session before that lock has really been unlocked in its
   // parent's destructor.
   virtual ~KeyLock();
 
  private:
+  // the session yields the executor thread instead of waiting the lock,
+  // see Session::yieldOnLock()
+  static Expected<std::unique_ptr<KeyLock>> yieldKeyLock(
+    uint32_t storeId,
+    uint32_t chunkId,
+    const std::string& key,
+    mgl::LockMode mode,
+    Session* sess,
+    mgl::MGLockMgr* mgr,
+    uint64_t lockTimeoutMs);
+
   const std::string _key;
 };
 
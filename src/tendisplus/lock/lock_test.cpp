@@ -6,6 +6,8 @@
 #include <string>
 #include <algorithm>
 #include <thread>  // NOLINT
+#include <vector>
+#include <atomic>
 
 #include "gtest/gtest.h"
 #include "glog/logging.h"
@@ -709,4 +711,42 @@ TEST(Lock, duplicateStoreLock) {
   LOG(INFO) << mgr->toString();
 }
 
+// lock/unlock throughput of the common write path: IX on store and chunk,
+// X on distinct keys, so only the intent locks are shared among threads.
+TEST(Lock, ContentionBench) {
+  auto mgr = std::make_unique<mgl::MGLockMgr>();
+  const auto duration = std::chrono::milliseconds(200);
+  for (uint32_t threadNum : {1, 2, 4, 8, 16, 32, 64}) {
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadNum; ++t) {
+      threads.emplace_back([&stop, &total, &mgr, t]() {
+        uint64_t ops = 0;
+        std::string prefix = "bench_" + std::to_string(t) + "_";
+        while (!stop.load(std::memory_order_relaxed)) {
+          KeyLock v(0,
+                    t % 4,
+                    prefix + std::to_string(ops % 64),
+                    mgl::LockMode::LOCK_X,
+                    nullptr,
+                    mgr.get());
+          EXPECT_EQ(v.getLockResult(), mgl::LockRes::LOCKRES_OK);
+          ++ops;
+        }
+        total += ops;
+      });
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& thd : threads) {
+      thd.join();
+    }
+    uint64_t opsPerSec = total * 1000 / duration.count();
+    LOG(INFO) << "threads:" << threadNum << " keylock ops/sec:" << opsPerSec;
+    EXPECT_GT(total.load(), 0U);
+  }
+  EXPECT_EQ(mgr->getLockList().size(), 0U);
+}
+
 }  // namespace tendisplus
@@ -2,12 +2,13 @@
 #include "tendisplus/lock/mgl/mgl.h"
 #include "tendisplus/lock/mgl/mgl_mgr.h"
 #include "tendisplus/utils/string.h"
+#include "tendisplus/utils/latency_stats.h"
+#include "tendisplus/utils/time.h"
 
 namespace tendisplus {
 namespace mgl {
 
 std::atomic<uint64_t> MGLock::_idGen(0);
-std::list<MGLock*> MGLock::_dummyList{};
 
 MGLock::MGLock(MGLockMgr* mgr)
   : _id(_idGen.fetch_add(1, std::memory_order_relaxed)),
@@ -15,9 +16,13 @@ MGLock::MGLock(MGLockMgr* mgr)
     _targetHash(0),
     _mode(LockMode::LOCK_NONE),
     _res(LockRes::LOCKRES_UNINITED),
-    _resIter(_dummyList.end()),
+    _prev(nullptr),
+    _next(nullptr),
+    _fastCtx(nullptr),
     _lockMgr(mgr),
-    _threadId(getCurThreadId()) {}
+    _threadId(getCurThreadId()),
+    _asyncStartNs(0),
+    _grantNs(0) {}
 
 MGLock::~MGLock() {
   INVARIANT_D(_res == LockRes::LOCKRES_UNINITED);
@@ -26,13 +31,18 @@ MGLock::~MGLock() {
 void MGLock::releaseLockResult() {
   std::lock_guard<std::mutex> lk(_mutex);
   _res = LockRes::LOCKRES_UNINITED;
-  _resIter = _dummyList.end();
+  _fastCtx = nullptr;
 }
 
-void MGLock::setLockResult(LockRes res, std::list<MGLock*>::iterator iter) {
+void MGLock::setLockResult(LockRes res) {
   std::lock_guard<std::mutex> lk(_mutex);
   _res = res;
-  _resIter = iter;
+}
+
+void MGLock::setFastLockResult(LockSchedCtx* ctx) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _res = LockRes::LOCKRES_OK;
+  _fastCtx = ctx;
 }
 
 void MGLock::unlock() {
@@ -48,28 +58,34 @@ void MGLock::unlock() {
     status = getStatus();
     INVARIANT_D(status == LockRes::LOCKRES_UNINITED);
   }
+  // it is never called once the lock is out of the lists
+  _onGrant = nullptr;
 }
 
-LockRes MGLock::lock(const std::string& target,
-                     LockMode mode,
-                     uint64_t timeoutMs) {
+LockRes MGLock::enqueue(const std::string& target, LockMode mode) {
   _target = target;
   _mode = mode;
   INVARIANT_D(getStatus() == LockRes::LOCKRES_UNINITED);
-  _resIter = _dummyList.end();
+  INVARIANT_D(_prev == nullptr && _next == nullptr && _fastCtx == nullptr);
   if (_target != "") {
     _targetHash = static_cast<uint64_t>(std::hash<std::string>{}(_target));
   } else {
     _targetHash = 0;
   }
   if (!_lockMgr) {
-    MGLockMgr::getInstance().lock(this);
-  } else {
-    _lockMgr->lock(this);
+    return MGLockMgr::getInstance().lock(this);
   }
-  if (getStatus() == LockRes::LOCKRES_OK) {
+  return _lockMgr->lock(this);
+}
+
+LockRes MGLock::lock(const std::string& target,
+                     LockMode mode,
+                     uint64_t timeoutMs) {
+  _onGrant = nullptr;
+  if (enqueue(target, mode) == LockRes::LOCKRES_OK) {
     return LockRes::LOCKRES_OK;
   }
+  LatencyStageTimer timer(LatencyStage::LOCK);
   if (waitLock(timeoutMs)) {
     return LockRes::LOCKRES_OK;
   } else {
@@ -77,11 +93,21 @@ LockRes MGLock::lock(const std::string& target,
   }
 }
 
-std::list<MGLock*>::iterator MGLock::getLockIter() const {
-  return _resIter;
+LockRes MGLock::lockAsync(const std::string& target,
+                          LockMode mode,
+                          std::function<void()> onGrant) {
+  _onGrant = std::move(onGrant);
+  _asyncStartNs = nsSinceEpoch();
+  _grantNs = 0;
+  return enqueue(target, mode);
 }
 
 void MGLock::notify() {
+  if (_onGrant) {
+    _grantNs = nsSinceEpoch();
+    _onGrant();
+    return;
+  }
   _cv.notify_one();
 }
 
@@ -92,6 +118,10 @@ bool MGLock::waitLock(uint64_t timeoutMs) {
   });
 }
 
+uint64_t MGLock::getAsyncWaitNs() const {
+  return _grantNs > _asyncStartNs ? _grantNs - _asyncStartNs : 0;
+}
+
 LockRes MGLock::getStatus() const {
   std::lock_guard<std::mutex> lk(_mutex);
   return _res;
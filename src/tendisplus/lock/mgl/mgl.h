@@ -2,8 +2,8 @@
 #define SRC_TENDISPLUS_LOCK_MGL_MGL_H__
 
 #include <atomic>
+#include <functional>
 #include <string>
-#include <list>
 #include <mutex>  // NOLINT
 #include <condition_variable>  // NOLINT
 
@@ -27,6 +27,12 @@ class MGLock {
     ~MGLock();
     LockRes lock(const std::string& target, LockMode mode,
                  uint64_t timeoutMs);
+    // never waits, it returns LOCKRES_OK if the lock is granted at once.
+    // Otherwise LOCKRES_WAIT is returned and onGrant is called when it is
+    // granted, by the thread unlocking with the mutex of the lock shard
+    // held. The lock is kept pending until it is granted or unlock().
+    LockRes lockAsync(const std::string& target, LockMode mode,
+                      std::function<void()> onGrant);
     void unlock();
     uint64_t getHash() const { return _targetHash; }
     LockMode getMode() const { return _mode; }
@@ -34,14 +40,22 @@ class MGLock {
     const std::string& getTarget() const { return _target; }
     std::string toString() const;
     uint64_t getThreadId() const { return _threadId; }
+    // the time from lockAsync() to the grant, it is 0 if granted at once.
+    // Read it after the grant is seen by onGrant.
+    uint64_t getAsyncWaitNs() const;
 
  private:
     friend class LockSchedCtx;
-    void setLockResult(LockRes res, std::list<MGLock*>::iterator iter);
+    friend class MGLockList;
+    friend class MGLockMgr;
+    void setLockResult(LockRes res);
+    // granted by the fast path of a pinned LockSchedCtx
+    void setFastLockResult(LockSchedCtx* ctx);
     void releaseLockResult();
-    std::list<MGLock*>::iterator getLockIter() const;
+    LockSchedCtx* getFastCtx() const { return _fastCtx; }
     void notify();
     bool waitLock(uint64_t timeoutMs);
+    LockRes enqueue(const std::string& target, LockMode mode);
 
     const uint64_t _id;
     std::string _target;
@@ -51,13 +65,21 @@ class MGLock {
     // wrote by MGLockMgr
     mutable std::mutex _mutex;
     std::condition_variable _cv;
+    // set before the lock is enqueued, called instead of notifying _cv
+    std::function<void()> _onGrant;
     LockRes _res;
-    std::list<MGLock*>::iterator _resIter;
+    // links in LockSchedCtx's running/pending list, protected by the
+    // LockShard's mutex
+    MGLock* _prev;
+    MGLock* _next;
+    LockSchedCtx* _fastCtx;
     MGLockMgr* _lockMgr;
     uint64_t _threadId;
+    uint64_t _asyncStartNs;
+    // set by the granting thread before onGrant is called
+    uint64_t _grantNs;
 
     static std::atomic<uint64_t> _idGen;
-    static std::list<MGLock*> _dummyList;
 };
 
 }  // namespace mgl
@@ -3,6 +3,8 @@
 // project for additional information.
 
 #include <utility>
+#include <tuple>
+#include <sstream>
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/lock/mgl/mgl_mgr.h"
 #include "tendisplus/lock/mgl/mgl.h"
@@ -43,34 +45,160 @@ bool isConflict(uint16_t modes, LockMode mode) {
   return (conflictTable[modeInt] & modes) != 0;
 }
 
+namespace {
+// layout of LockSchedCtx::_fastState
+constexpr uint64_t FAST_IS_ONE = 1ULL;
+constexpr uint64_t FAST_IX_ONE = 1ULL << 30;
+constexpr uint64_t FAST_CNT_MASK = (1ULL << 30) - 1;
+constexpr uint64_t FAST_SLOW = 1ULL << 63;
+
+uint64_t fastCount(uint64_t state, LockMode mode) {
+  if (mode == LockMode::LOCK_IS) {
+    return state & FAST_CNT_MASK;
+  }
+  return (state >> 30) & FAST_CNT_MASK;
+}
+
+bool isIntentMode(LockMode mode) {
+  return mode == LockMode::LOCK_IS || mode == LockMode::LOCK_IX;
+}
+}  // namespace
+
+void MGLockList::pushBack(MGLock* core) {
+  INVARIANT_D(core->_prev == nullptr && core->_next == nullptr);
+  core->_prev = _tail;
+  core->_next = nullptr;
+  if (_tail) {
+    _tail->_next = core;
+  } else {
+    _head = core;
+  }
+  _tail = core;
+  ++_size;
+}
+
+void MGLockList::erase(MGLock* core) {
+  INVARIANT_D(_size > 0);
+  if (core->_prev) {
+    core->_prev->_next = core->_next;
+  } else {
+    INVARIANT_D(_head == core);
+    _head = core->_next;
+  }
+  if (core->_next) {
+    core->_next->_prev = core->_prev;
+  } else {
+    INVARIANT_D(_tail == core);
+    _tail = core->_prev;
+  }
+  core->_prev = nullptr;
+  core->_next = nullptr;
+  --_size;
+}
+
 LockSchedCtx::LockSchedCtx()
   : _runningModes(0),
     _pendingModes(0),
-    _runningRefCnt(enum2Int(LockMode::LOCK_MODE_NUM), 0),
-    _pendingRefCnt(enum2Int(LockMode::LOCK_MODE_NUM), 0) {}
+    _runningRefCnt{0},
+    _pendingRefCnt{0},
+    _target(nullptr),
+    _fastState(0) {}
+
+void LockSchedCtx::pin(const std::string* target) {
+  INVARIANT_D(!isPinned());
+  _target = target;
+  updateSlowFlag();
+}
+
+void LockSchedCtx::unpin() {
+  INVARIANT_D(fastCount(_fastState.load(), LockMode::LOCK_IS) == 0);
+  INVARIANT_D(fastCount(_fastState.load(), LockMode::LOCK_IX) == 0);
+  _target = nullptr;
+  _fastState.store(0, std::memory_order_relaxed);
+}
+
+bool LockSchedCtx::tryFastLock(LockMode mode) {
+  INVARIANT_D(isIntentMode(mode));
+  uint64_t one = mode == LockMode::LOCK_IS ? FAST_IS_ONE : FAST_IX_ONE;
+  uint64_t state = _fastState.load(std::memory_order_acquire);
+  while ((state & FAST_SLOW) == 0) {
+    if (fastCount(state, mode) == FAST_CNT_MASK) {
+      return false;
+    }
+    if (_fastState.compare_exchange_weak(
+          state, state + one, std::memory_order_acq_rel)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LockSchedCtx::fastUnlock(LockMode mode) {
+  uint64_t one = mode == LockMode::LOCK_IS ? FAST_IS_ONE : FAST_IX_ONE;
+  uint64_t state =
+    _fastState.fetch_sub(one, std::memory_order_acq_rel) - one;
+  // the last fast lock of this mode is gone, S/X locks waiting for it
+  // should be scheduled under the shard mutex.
+  return (state & FAST_SLOW) != 0 && fastCount(state, mode) == 0;
+}
+
+uint16_t LockSchedCtx::getFastModes() const {
+  if (!isPinned()) {
+    return 0;
+  }
+  uint64_t state = _fastState.load(std::memory_order_acquire);
+  uint16_t modes = 0;
+  if (fastCount(state, LockMode::LOCK_IS) != 0) {
+    modes |= static_cast<uint16_t>(1 << enum2Int(LockMode::LOCK_IS));
+  }
+  if (fastCount(state, LockMode::LOCK_IX) != 0) {
+    modes |= static_cast<uint16_t>(1 << enum2Int(LockMode::LOCK_IX));
+  }
+  return modes;
+}
+
+// the fast path is closed as long as any S/X lock is running or pending,
+// so it can't starve them.
+void LockSchedCtx::updateSlowFlag() {
+  if (!isPinned()) {
+    return;
+  }
+  auto s = enum2Int(LockMode::LOCK_S);
+  auto x = enum2Int(LockMode::LOCK_X);
+  if (_runningRefCnt[s] || _runningRefCnt[x] || _pendingRefCnt[s] ||
+      _pendingRefCnt[x]) {
+    _fastState.fetch_or(FAST_SLOW, std::memory_order_acq_rel);
+  } else {
+    _fastState.fetch_and(~FAST_SLOW, std::memory_order_acq_rel);
+  }
+}
 
 // NOTE(deyukong): if compitable locks come endlessly,
 // and we always schedule compitable locks first.
 // Then the _pendingList will have no chance to schedule.
 void LockSchedCtx::lock(MGLock* core) {
   auto mode = core->getMode();
-  if (isConflict(_runningModes, mode) || _pendingList.size() >= 1) {
-    auto it = _pendingList.insert(_pendingList.end(), core);
+  if (isPinned() && !isIntentMode(mode)) {
+    // close the fast path before checking the fast lock holders
+    _fastState.fetch_or(FAST_SLOW, std::memory_order_acq_rel);
+  }
+  if (isConflict(_runningModes | getFastModes(), mode) ||
+      _pendingList.size() >= 1) {
+    _pendingList.pushBack(core);
     incrPendingRef(mode);
-    core->setLockResult(LockRes::LOCKRES_WAIT, it);
+    core->setLockResult(LockRes::LOCKRES_WAIT);
   } else {
-    auto it = _runningList.insert(_runningList.end(), core);
+    _runningList.pushBack(core);
     incrRunningRef(mode);
-    core->setLockResult(LockRes::LOCKRES_OK, it);
+    core->setLockResult(LockRes::LOCKRES_OK);
   }
 }
 
 void LockSchedCtx::schedPendingLocks() {
-  std::list<MGLock*>::iterator it = _pendingList.begin();
-  while (it != _pendingList.end()) {
-    MGLock* tmpLock = *it;
-    if (isConflict(_runningModes, tmpLock->getMode())) {
-      it++;
+  uint16_t fastModes = getFastModes();
+  while (!_pendingList.empty()) {
+    MGLock* tmpLock = _pendingList.front();
+    if (isConflict(_runningModes | fastModes, tmpLock->getMode())) {
       // NOTE(vinchen): Here, it should be break instead of continue.
       // Because of first come first lock/unlock, it can't release the
       // lock after the conflict pending lock. Otherwise, it would lead
@@ -79,9 +207,9 @@ void LockSchedCtx::schedPendingLocks() {
     }
     incrRunningRef(tmpLock->getMode());
     decPendingRef(tmpLock->getMode());
-    auto runningIt = _runningList.insert(_runningList.end(), tmpLock);
-    it = _pendingList.erase(it);
-    tmpLock->setLockResult(LockRes::LOCKRES_OK, runningIt);
+    _pendingList.erase(tmpLock);
+    _runningList.pushBack(tmpLock);
+    tmpLock->setLockResult(LockRes::LOCKRES_OK);
     tmpLock->notify();
   }
 }
@@ -89,16 +217,15 @@ void LockSchedCtx::schedPendingLocks() {
 bool LockSchedCtx::unlock(MGLock* core) {
   auto mode = core->getMode();
   if (core->getStatus() == LockRes::LOCKRES_OK) {
-    _runningList.erase(core->getLockIter());
+    _runningList.erase(core);
     decRunningRef(mode);
     core->releaseLockResult();
-    if (_runningModes != 0) {
-      return false;
+    if (_runningModes == 0) {
+      INVARIANT_D(_runningList.size() == 0);
+      schedPendingLocks();
     }
-    INVARIANT_D(_runningList.size() == 0);
-    schedPendingLocks();
   } else if (core->getStatus() == LockRes::LOCKRES_WAIT) {
-    _pendingList.erase(core->getLockIter());
+    _pendingList.erase(core);
     decPendingRef(mode);
     core->releaseLockResult();
     INVARIANT_D((_pendingModes == 0 && _pendingList.size() == 0) ||
@@ -107,6 +234,10 @@ bool LockSchedCtx::unlock(MGLock* core) {
   } else {
     INVARIANT_D(0);
   }
+  if (isPinned()) {
+    updateSlowFlag();
+    return false;
+  }
   return _pendingList.empty() && _runningList.empty();
 }
 
@@ -150,27 +281,32 @@ void LockSchedCtx::decRunningRef(LockMode mode) {
 
 std::string LockSchedCtx::toString() {
   std::stringstream ss;
-
-  for (auto i : _runningList) {
-    ss << "running: {" << i->toString() << "}\r\n";
-  }
-
-  for (auto i : _pendingList) {
-    ss << "pending: {" << i->toString() << "}\r\n";
+  for (auto& v : getShardLocks()) {
+    ss << v << "\r\n";
   }
-
   return ss.str();
 }
 
 std::vector<std::string> LockSchedCtx::getShardLocks() {
   std::vector<std::string> tempLocks;
-  for (auto i : _runningList) {
+  for (auto i = _runningList.front(); i != nullptr; i = i->_next) {
     tempLocks.push_back("running: {" + i->toString() + "}");
   }
 
-  for (auto i : _pendingList) {
+  for (auto i = _pendingList.front(); i != nullptr; i = i->_next) {
     tempLocks.push_back("pending: {" + i->toString() + "}");
   }
+
+  if (isPinned()) {
+    uint64_t state = _fastState.load(std::memory_order_acquire);
+    uint64_t is = fastCount(state, LockMode::LOCK_IS);
+    uint64_t ix = fastCount(state, LockMode::LOCK_IX);
+    if (is != 0 || ix != 0) {
+      tempLocks.push_back("fast: {target:" + *_target +
+                          " IS:" + std::to_string(is) +
+                          " IX:" + std::to_string(ix) + "}");
+    }
+  }
   return tempLocks;
 }
 
@@ -179,23 +315,72 @@ MGLockMgr& MGLockMgr::getInstance() {
   return mgr;
 }
 
-void MGLockMgr::lock(MGLock* core) {
+MGLockMgr::MGLockMgr()
+  : _shards(new LockShard[SHARD_NUM]),
+    _fastSlots(new std::atomic<LockSchedCtx*>[FAST_SLOT_NUM]) {
+  for (size_t i = 0; i < FAST_SLOT_NUM; i++) {
+    _fastSlots[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+LockRes MGLockMgr::lock(MGLock* core) {
   uint64_t hash = core->getHash();
-  LockShard& shard = _shards[hash % SHARD_NUM];
+  auto mode = core->getMode();
+  bool intent = isIntentMode(mode);
+  if (intent) {
+    // a pinned ctx is never released, its target is immutable
+    LockSchedCtx* ctx = getFastSlot(hash).load(std::memory_order_acquire);
+    if (ctx && *ctx->getTarget() == core->getTarget() &&
+        ctx->tryFastLock(mode)) {
+      core->setFastLockResult(ctx);
+      return LockRes::LOCKRES_OK;
+    }
+  }
+
+  LockShard& shard = getShard(hash);
   std::lock_guard<std::mutex> lk(shard.mutex);
   auto iter = shard.map.find(core->getTarget());
   if (iter == shard.map.end()) {
-    LockSchedCtx tmp;
-    auto insertResult = shard.map.emplace(core->getTarget(), std::move(tmp));
-    iter = insertResult.first;
+    iter = shard.map
+             .emplace(std::piecewise_construct,
+                      std::forward_as_tuple(core->getTarget()),
+                      std::forward_as_tuple())
+             .first;
   }
-  iter->second.lock(core);
-  return;
+  LockSchedCtx& ctx = iter->second;
+  ctx.lock(core);
+  if (intent && !ctx.isPinned()) {
+    auto& slot = getFastSlot(hash);
+    LockSchedCtx* expected = nullptr;
+    if (slot.load(std::memory_order_relaxed) == nullptr) {
+      // pin before publishing, the fast path reads the target
+      ctx.pin(&iter->first);
+      if (!slot.compare_exchange_strong(
+            expected, &ctx, std::memory_order_acq_rel)) {
+        ctx.unpin();
+      }
+    }
+  }
+  // it can only be granted later under the shard mutex
+  return core->getStatus();
 }
 
 void MGLockMgr::unlock(MGLock* core) {
   uint64_t hash = core->getHash();
-  LockShard& shard = _shards[hash % SHARD_NUM];
+  LockSchedCtx* fastCtx = core->getFastCtx();
+  if (fastCtx) {
+    INVARIANT_D(core->getStatus() == LockRes::LOCKRES_OK);
+    bool needSched = fastCtx->fastUnlock(core->getMode());
+    core->releaseLockResult();
+    if (needSched) {
+      LockShard& shard = getShard(hash);
+      std::lock_guard<std::mutex> lk(shard.mutex);
+      fastCtx->schedPendingLocks();
+    }
+    return;
+  }
+
+  LockShard& shard = getShard(hash);
   std::lock_guard<std::mutex> lk(shard.mutex);
 
   INVARIANT_D(core->getStatus() == LockRes::LOCKRES_WAIT ||
@@ -6,11 +6,12 @@
 #define SRC_TENDISPLUS_LOCK_MGL_MGL_MGR_H__
 
 #include <vector>
-#include <list>
 #include <unordered_map>
 #include <mutex>  // NOLINT
 #include <string>
 #include <set>
+#include <atomic>
+#include <memory>
 
 #include "tendisplus/lock/mgl/lock_defines.h"
 
@@ -19,28 +20,76 @@ namespace mgl {
 
 class MGLock;
 
+// intrusive FIFO list of MGLocks, linked by MGLock::_prev/_next,
+// so enqueueing a lock never allocates.
+class MGLockList {
+ public:
+  MGLockList() : _head(nullptr), _tail(nullptr), _size(0) {}
+  void pushBack(MGLock* core);
+  void erase(MGLock* core);
+  MGLock* front() const {
+    return _head;
+  }
+  bool empty() const {
+    return _size == 0;
+  }
+  size_t size() const {
+    return _size;
+  }
+
+ private:
+  MGLock* _head;
+  MGLock* _tail;
+  size_t _size;
+};
+
 // TODO(deyukong): this class should only be in mgl_mgr.cpp
-// not thread safe, protected by LockShard's mutex
+// not thread safe, protected by LockShard's mutex, except the fast path
+// of pinned targets which only touches _fastState.
 class LockSchedCtx {
  public:
   LockSchedCtx();
-  LockSchedCtx(LockSchedCtx&&) = default;
+  LockSchedCtx(const LockSchedCtx&) = delete;
+  LockSchedCtx(LockSchedCtx&&) = delete;
   void lock(MGLock* core);
   bool unlock(MGLock* core);
   std::string toString();
   std::vector<std::string> getShardLocks();
- private:
+
+  // A pinned ctx is published in MGLockMgr's fast slots and never erased.
+  // Its IS/IX locks can be granted by an atomic increment of _fastState
+  // as long as no S/X lock is running or pending on it.
+  void pin(const std::string* target);
+  void unpin();
+  bool isPinned() const {
+    return _target != nullptr;
+  }
+  const std::string* getTarget() const {
+    return _target;
+  }
+  bool tryFastLock(LockMode mode);
+  // return true if pending locks should be rescheduled
+  bool fastUnlock(LockMode mode);
   void schedPendingLocks();
+
+ private:
+  uint16_t getFastModes() const;
+  void updateSlowFlag();
   void incrPendingRef(LockMode mode);
   void incrRunningRef(LockMode mode);
   void decPendingRef(LockMode mode);
   void decRunningRef(LockMode mode);
   uint16_t _runningModes;
   uint16_t _pendingModes;
-  std::vector<uint16_t> _runningRefCnt;
-  std::vector<uint16_t> _pendingRefCnt;
-  std::list<MGLock*> _runningList;
-  std::list<MGLock*> _pendingList;
+  uint16_t _runningRefCnt[enum2Int(LockMode::LOCK_MODE_NUM)];
+  uint16_t _pendingRefCnt[enum2Int(LockMode::LOCK_MODE_NUM)];
+  MGLockList _runningList;
+  MGLockList _pendingList;
+
+  // the key in LockShard::map, nullptr if not pinned
+  const std::string* _target;
+  // IS count | IX count | FAST_SLOW flag
+  std::atomic<uint64_t> _fastState;
 };
 
 /* First come first lock
@@ -68,16 +117,29 @@ struct alignas(128) LockShard {
 // warning C4316: tendisplus::mgl::MGLockMgr
 class MGLockMgr {
  public:
-  MGLockMgr() = default;
-  void lock(MGLock* core);
+  MGLockMgr();
+  // return LOCKRES_OK or LOCKRES_WAIT, as it is decided when enqueued
+  LockRes lock(MGLock* core);
   void unlock(MGLock* core);
   static MGLockMgr& getInstance();
   std::string toString();
   std::vector<std::string> getLockList();
 
+  static constexpr size_t SHARD_NUM = 1024;
+  // targets locked in IS/IX mode(stores, chunks) are pinned in fast slots
+  // on their first intent lock, as long as the slot is free.
+  static constexpr size_t FAST_SLOT_NUM = 16384;
+
  private:
-  static constexpr size_t SHARD_NUM = 32;
-  LockShard _shards[SHARD_NUM];
+  LockShard& getShard(uint64_t hash) {
+    return _shards[hash % SHARD_NUM];
+  }
+  std::atomic<LockSchedCtx*>& getFastSlot(uint64_t hash) {
+    return _fastSlots[(hash / SHARD_NUM) % FAST_SLOT_NUM];
+  }
+
+  std::unique_ptr<LockShard[]> _shards;
+  std::unique_ptr<std::atomic<LockSchedCtx*>[]> _fastSlots;
 };
 
 }  // namespace mgl
@@ -1,7 +1,10 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <chrono>
 #include <thread>  // NOLINT
+#include <vector>
+#include <atomic>
 
 #include "gtest/gtest.h"
 
@@ -37,6 +40,35 @@ TEST(LockShard, Align) {
     EXPECT_GE(sizeof(LockShard), size_t(128));
 }
 
+TEST(MGL, LockAsync) {
+    MGLock l1(nullptr), l2(nullptr), l3(nullptr);
+    std::atomic<uint32_t> granted(0);
+    auto onGrant = [&granted]() { granted++; };
+    EXPECT_EQ(l1.lockAsync("something", LockMode::LOCK_X, onGrant),
+              LockRes::LOCKRES_OK);
+    EXPECT_EQ(l2.lockAsync("something", LockMode::LOCK_S, onGrant),
+              LockRes::LOCKRES_WAIT);
+    EXPECT_EQ(l3.lockAsync("something", LockMode::LOCK_S, onGrant),
+              LockRes::LOCKRES_WAIT);
+    EXPECT_EQ(granted, 0U);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    l1.unlock();
+    // granted and called back by the unlocking thread
+    EXPECT_EQ(granted, 2U);
+    EXPECT_EQ(l1.getAsyncWaitNs(), 0U);
+    EXPECT_GE(l2.getAsyncWaitNs(), 2000000U);
+    EXPECT_EQ(l2.getStatus(), LockRes::LOCKRES_OK);
+    EXPECT_EQ(l3.getStatus(), LockRes::LOCKRES_OK);
+
+    // a pending lock can be given up
+    EXPECT_EQ(l1.lockAsync("something", LockMode::LOCK_X, onGrant),
+              LockRes::LOCKRES_WAIT);
+    l1.unlock();
+    l2.unlock();
+    l3.unlock();
+    EXPECT_EQ(granted, 2U);
+}
+
 TEST(MGL, OneTarget) {
     MGLock l1(nullptr), l2(nullptr), l3(nullptr), l4(nullptr), l5(nullptr);
     EXPECT_EQ(l1.lock("something", LockMode::LOCK_IS, 1000),
@@ -106,5 +138,72 @@ TEST(MGL, Starvation) {
     l3.unlock();
 }
 
+TEST(MGL, FastPath) {
+    MGLockMgr mgr;
+    MGLock l1(&mgr), l2(&mgr), l3(&mgr), l4(&mgr);
+    // the first intent lock pins the target, the following ones
+    // are granted without the shard mutex
+    EXPECT_EQ(l1.lock("something", LockMode::LOCK_IS, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_EQ(l2.lock("something", LockMode::LOCK_IX, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_EQ(mgr.getLockList().size(), 2U);
+    std::thread tmp([&l3]() {
+        EXPECT_EQ(l3.lock("something", LockMode::LOCK_S, 10000),
+                          LockRes::LOCKRES_OK);
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // the fast path is closed by the pending S lock
+    EXPECT_EQ(l4.lock("something", LockMode::LOCK_IS, 1000),
+                      LockRes::LOCKRES_TIMEOUT);
+    l4.unlock();
+    l1.unlock();
+    l2.unlock();
+    tmp.join();
+    l3.unlock();
+    EXPECT_EQ(l4.lock("something", LockMode::LOCK_IS, 1000),
+                      LockRes::LOCKRES_OK);
+    l4.unlock();
+    EXPECT_EQ(mgr.getLockList().size(), 0U);
+}
+
+TEST(MGL, FastPathMultiThread) {
+    MGLockMgr mgr;
+    std::atomic<int> intents(0), exclusives(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 20000; ++i) {
+                MGLock l(&mgr);
+                bool exclusive = (i + t) % 100 == 0;
+                auto mode = exclusive ? LockMode::LOCK_X :
+                        (i % 2 ? LockMode::LOCK_IS : LockMode::LOCK_IX);
+                if (l.lock("store", mode, 100000) != LockRes::LOCKRES_OK) {
+                    failed = true;
+                }
+                if (exclusive) {
+                    if (exclusives.fetch_add(1) != 0 || intents.load() != 0) {
+                        failed = true;
+                    }
+                    exclusives.fetch_sub(1);
+                } else {
+                    intents.fetch_add(1);
+                    if (exclusives.load() != 0) {
+                        failed = true;
+                    }
+                    intents.fetch_sub(1);
+                }
+                l.unlock();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_FALSE(failed.load());
+    EXPECT_EQ(mgr.getLockList().size(), 0U);
+}
+
 }  // namespace mgl
 }  // namespace tendisplus
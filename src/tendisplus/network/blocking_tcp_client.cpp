@@ -9,8 +9,17 @@
 #include <utility>
 #include <memory>
 #include <string>
+#include <cstring>
 
 #include <algorithm>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "asio.hpp"
 #include "glog/logging.h"
 #include "tendisplus/utils/invariant.h"
@@ -18,6 +27,75 @@
 
 namespace tendisplus {
 
+FileSource::FileSource(const std::string& path)
+  : _path(path), _size(0), _fd(-1), _map(nullptr), _offset(0), _batch(0) {}
+
+FileSource::~FileSource() {
+#ifdef __linux__
+  if (_map) {
+    ::munmap(_map, _size);
+  }
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+#endif
+}
+
+Status FileSource::open() {
+#ifdef __linux__
+  _fd = ::open(_path.c_str(), O_RDONLY);
+  if (_fd < 0) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "open file:" + _path + " failed:" + strerror(errno)};
+  }
+  struct stat st;
+  if (::fstat(_fd, &st) != 0) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "stat file:" + _path + " failed:" + strerror(errno)};
+  }
+  _size = st.st_size;
+  if (_size == 0) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  void* map = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+  if (map != MAP_FAILED) {
+    _map = static_cast<char*>(map);
+    ::madvise(_map, _size, MADV_SEQUENTIAL);
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  LOG(WARNING) << "mmap file:" << _path << " failed:" << strerror(errno)
+               << ", read it by buffer";
+  ::close(_fd);
+  _fd = -1;
+#endif
+  _file.open(_path, std::ios::binary | std::ios::ate);
+  if (!_file.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open file failed:" + _path};
+  }
+  _size = _file.tellg();
+  _file.seekg(0);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<const char*> FileSource::next(size_t size) {
+  _offset += _batch;
+  _batch = 0;
+  if (size > _size - _offset) {
+    return {ErrorCodes::ERR_INTERNAL, "read file:" + _path + " beyond end"};
+  }
+  _batch = size;
+  if (_map) {
+    return _map + _offset;
+  }
+  _buf.resize(size);
+  _file.read(&_buf[0], size);
+  if (!_file) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "read file:" + _path + " failed:" + strerror(errno)};
+  }
+  return _buf.data();
+}
+
 BlockingTcpClient::BlockingTcpClient(std::shared_ptr<asio::io_context> ctx,
                                      asio::ip::tcp::socket socket,
                                      size_t maxBufSize,
@@ -293,6 +371,48 @@ Status BlockingTcpClient::writeOneBatch(const char* data,
   }
 }
 
+Status BlockingTcpClient::sendFile(FileSource* file,
+                                   std::chrono::seconds timeout) {
+  if (!file->_map) {
+    return writeData(file->_buf);
+  }
+#ifdef __linux__
+  int sock = _socket.native_handle();
+  off_t off = file->_offset;
+  size_t size = file->_batch;
+  uint64_t deadline = msSinceEpoch() + timeout.count() * 1000;
+  while (size) {
+    // the socket is non-blocking, wait for it to be writable on EAGAIN
+    ssize_t n =
+      ::sendfile(sock, file->_fd, &off, std::min(size, size_t(1) << 30));
+    if (n > 0) {
+      size -= n;
+      if (_rateLimiter) {
+        _rateLimiter->Request(n);
+      }
+      continue;
+    } else if (n == 0) {
+      closeSocket();
+      return {ErrorCodes::ERR_INTERNAL, "sendfile reaches end of file"};
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      std::string err = strerror(errno);
+      closeSocket();
+      return {ErrorCodes::ERR_NETWORK, err};
+    }
+    uint64_t now = msSinceEpoch();
+    if (now >= deadline) {
+      closeSocket();
+      return {ErrorCodes::ERR_TIMEOUT, "sendFile timeout"};
+    }
+    struct pollfd pfd = {sock, POLLOUT, 0};
+    ::poll(&pfd, 1, static_cast<int>(deadline - now));
+  }
+#endif
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status BlockingTcpClient::writeLine(const std::string& line) {
   std::string line1 = line;
   line1.append("\r\n");
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <chrono>  // NOLINT
+#include <fstream>
 #include <memory>
 
 #include "asio.hpp"
@@ -16,6 +17,38 @@
 #include "tendisplus/utils/rate_limiter.h"
 
 namespace tendisplus {
+
+// A file read by batches to be sent by BlockingTcpClient::sendFile(). On
+// linux it is mapped: the sender reads a batch (e.g. for a checksum) from
+// the page cache and sendfile() sends the same pages, so the content is
+// read once and never copied into user space. Elsewhere, or if it can't
+// be mapped, a batch is read into a buffer which is written to the socket.
+class FileSource {
+ public:
+  explicit FileSource(const std::string& path);
+  FileSource(const FileSource&) = delete;
+  FileSource& operator=(const FileSource&) = delete;
+  ~FileSource();
+  Status open();
+  uint64_t size() const {
+    return _size;
+  }
+  // the next size bytes of the file, valid until the next call
+  Expected<const char*> next(size_t size);
+
+ private:
+  friend class BlockingTcpClient;
+  std::string _path;
+  uint64_t _size;
+  int _fd;
+  char* _map;
+  std::ifstream _file;
+  std::string _buf;
+  // the batch returned by next()
+  uint64_t _offset;
+  size_t _batch;
+};
+
 class BlockingTcpClient
   : public std::enable_shared_from_this<BlockingTcpClient> {
  public:
@@ -42,6 +75,8 @@ class BlockingTcpClient
                        uint32_t size,
                        std::chrono::seconds timeout);
   Status writeData(const std::string& data);
+  // send the batch of the file returned by its last next()
+  Status sendFile(FileSource* file, std::chrono::seconds timeout);
 
   std::string getRemoteRepr() const {
     try {
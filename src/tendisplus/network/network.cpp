@@ -14,6 +14,9 @@
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/server/server_entry.h"
+#include "tendisplus/commands/command.h"
+#include "tendisplus/utils/string.h"
+#include "tendisplus/utils/latency_stats.h"
 
 namespace tendisplus {
 
@@ -50,6 +53,12 @@ constexpr ssize_t REDIS_IOBUF_LEN = (1024 * 16);
 constexpr ssize_t REDIS_MAX_QUERYBUF_LEN = (1024 * 1024 * 1024);
 constexpr ssize_t REDIS_INLINE_MAX_SIZE = (1024 * 64);
 constexpr ssize_t REDIS_MBULK_BIG_ARG = (1024 * 32);
+// queued replies are coalesced into one vectored write up to this size
+constexpr size_t MAX_COALESCED_RSP_BYTES = (1024 * 1024);
+// at most so many pipelined requests are executed in one scheduled task,
+// so a pipelining client can't monopolize an executor thread.
+constexpr uint32_t MAX_PIPELINE_BATCH =
+  1U << (NetworkMatrix::PIPELINE_DEPTH_BUCKETS - 1);
 
 std::string RequestMatrix::toString() const {
   std::stringstream ss;
@@ -72,11 +81,27 @@ RequestMatrix RequestMatrix::operator-(const RequestMatrix& right) {
   return result;
 }
 
+void NetworkMatrix::addPipelineDepth(uint32_t depth) {
+  size_t bucket = 0;
+  while (bucket + 1 < PIPELINE_DEPTH_BUCKETS &&
+         depth > pipelineDepthBucketBound(bucket)) {
+    bucket++;
+  }
+  ++pipelineBatches;
+  ++pipelineDepth[bucket];
+}
+
 std::string NetworkMatrix::toString() const {
   std::stringstream ss;
   ss << "\nstickyPackets\t" << stickyPackets << "\nconnCreated\t" << connCreated
      << "\nconnReleased\t" << connReleased << "\ninvalidPackets\t"
-     << invalidPackets;
+     << invalidPackets << "\npipelineBatches\t" << pipelineBatches
+     << "\nlockYields\t" << lockYields << "\nexecutorSwitches\t"
+     << executorSwitches;
+  for (size_t i = 0; i < PIPELINE_DEPTH_BUCKETS; i++) {
+    ss << "\npipelineDepth<=" << pipelineDepthBucketBound(i) << "\t"
+       << pipelineDepth[i];
+  }
   return ss.str();
 }
 
@@ -85,6 +110,12 @@ void NetworkMatrix::reset() {
   connCreated = 0;
   connReleased = 0;
   invalidPackets = 0;
+  pipelineBatches = 0;
+  lockYields = 0;
+  executorSwitches = 0;
+  for (auto& v : pipelineDepth) {
+    v = 0;
+  }
 }
 
 NetworkMatrix NetworkMatrix::operator-(const NetworkMatrix& right) {
@@ -93,9 +124,49 @@ NetworkMatrix NetworkMatrix::operator-(const NetworkMatrix& right) {
   result.connCreated = connCreated - right.connCreated;
   result.connReleased = connReleased - right.connReleased;
   result.invalidPackets = invalidPackets - right.invalidPackets;
+  result.pipelineBatches = pipelineBatches - right.pipelineBatches;
+  result.lockYields = lockYields - right.lockYields;
+  result.executorSwitches = executorSwitches - right.executorSwitches;
+  for (size_t i = 0; i < PIPELINE_DEPTH_BUCKETS; i++) {
+    result.pipelineDepth[i] = pipelineDepth[i] - right.pipelineDepth[i];
+  }
   return result;
 }
 
+// commands which take over the socket can't be executed behind other
+// pipelined commands whose responses are not sent yet.
+static bool isPipelineBarrier(const std::string& cmd) {
+  auto it = commandMap().find(toLower(cmd));
+  return it != commandMap().end() && it->second->isBgCmd();
+}
+
+// the key of a single key command, nullptr for the others
+// schedule the task in the work pool ctxId, a work pool is chosen for the
+// session if it has none yet
+template <typename fn>
+static void scheduleOn(ServerEntry* server,
+                       std::atomic<uint32_t>* ctxId,
+                       fn&& task) {
+  uint32_t old = ctxId->load(std::memory_order_relaxed);
+  uint32_t id = old;
+  server->schedule(std::forward<fn>(task), id);
+  if (id != old) {
+    ctxId->compare_exchange_strong(old, id, std::memory_order_relaxed);
+  }
+}
+
+static const std::string* singleKeyOf(const std::vector<std::string>& args) {
+  if (args.size() < 2) {
+    return nullptr;
+  }
+  auto it = commandMap().find(toLower(args[0]));
+  if (it == commandMap().end() || it->second->firstkey() != 1 ||
+      it->second->lastkey() != 1) {
+    return nullptr;
+  }
+  return &args[1];
+}
+
 NetworkAsio::NetworkAsio(std::shared_ptr<ServerEntry> server,
                          std::shared_ptr<NetworkMatrix> netMatrix,
                          std::shared_ptr<RequestMatrix> reqMatrix,
@@ -360,11 +431,20 @@ NetSession::NetSession(std::shared_ptr<ServerEntry> server,
     _sock(std::move(sock)),
     _queryBuf(std::vector<char>()),
     _queryBufPos(0),
+    _queryBufStart(0),
     _reqType(RedisReqMode::REDIS_REQ_UNKNOWN),
     _multibulklen(0),
     _bulkLen(-1),
     _isSendRunning(false),
     _isEnded(false),
+    _deferSend(false),
+    _sendBufferBytes(0),
+    _blockState(BlockState::NONE),
+    _wakeReason(BlockingManager::WakeReason::READY),
+    _blocked(false),
+    _blockSeq(0),
+    _blockDeadline(0),
+    _watchingPeer(false),
     _netMatrix(netMatrix),
     _reqMatrix(reqMatrix) {
   if (initSock) {
@@ -469,37 +549,103 @@ std::string NetSession::getLocalRepr() const {
   return "closed conn";
 }
 
+uint32_t NetSession::requestExecutor() const {
+  auto current = _ioCtxId.load(std::memory_order_relaxed);
+  if (!_server->getParams()->executorStoreAffinity) {
+    return current;
+  }
+  auto key = singleKeyOf(_args);
+  return key ? _server->getStoreExecutor(*key) : current;
+}
+
 void NetSession::schedule() {
   // incr the reference, so it's safe to remove sessions
   // from _serverEntry at executing time.
   auto self(shared_from_this());
-  _server->schedule([this, self]() { stepState(); }, _ioCtxId);
+  if (_state.load(std::memory_order_relaxed) == State::Process) {
+    auto id = requestExecutor();
+    if (id != _ioCtxId.load(std::memory_order_relaxed)) {
+      ++_netMatrix->executorSwitches;
+      _ioCtxId.store(id, std::memory_order_relaxed);
+    }
+  }
+  scheduleOn(_server, &_ioCtxId, [this, self]() { stepState(); });
 }
 
 asio::ip::tcp::socket NetSession::borrowConn() {
   return std::move(_sock);
 }
 
+SendBuffer::~SendBuffer() {
+  auto pool = ReplyChunkPool::getInstance();
+  for (auto& chunk : chunks) {
+    pool->put(std::move(chunk));
+  }
+}
+
 Status NetSession::setResponse(const std::string& s) {
+  auto v = std::make_shared<SendBuffer>();
+  v->chunks.emplace_back(s);
+  v->size = s.size();
+  return queueSendBuffer(std::move(v));
+}
+
+Status NetSession::setResponseChunks(RespWriter&& writer) {
+  auto v = std::make_shared<SendBuffer>();
+  v->size = writer.size();
+  v->chunks = writer.releaseChunks();
+  return queueSendBuffer(std::move(v));
+}
+
+Status NetSession::queueSendBuffer(std::shared_ptr<SendBuffer> v) {
   std::lock_guard<std::mutex> lk(_mutex);
   if (_isEnded) {
     _closeAfterRsp = true;
     return {ErrorCodes::ERR_NETWORK, "connection is ended"};
   }
 
-  auto v = std::make_shared<SendBuffer>();
-  std::copy(s.begin(), s.end(), std::back_inserter(v->buffer));
   v->closeAfterThis = _closeAfterRsp;
-  if (_isSendRunning) {
-    _sendBuffer.push_back(v);
-  } else {
+  v->latencyId = getCtx()->takeLatencyId();
+  if (v->latencyId != UINT32_MAX) {
+    v->queuedNs = nsSinceEpoch();
+  }
+  _sendBufferBytes += v->size;
+  _sendBuffer.push_back(std::move(v));
+  if (!_isSendRunning &&
+      (!_deferSend || _sendBufferBytes >= MAX_COALESCED_RSP_BYTES)) {
     _isSendRunning = true;
-    drainRsp(v);
+    drainRsp(popSendBuffersInLock());
   }
 
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void NetSession::setDeferSend(bool defer) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _deferSend = defer;
+  if (!defer && !_isEnded && !_isSendRunning && !_sendBuffer.empty()) {
+    _isSendRunning = true;
+    drainRsp(popSendBuffersInLock());
+  }
+}
+
+NetSession::SendBufferList NetSession::popSendBuffersInLock() {
+  SendBufferList bufs;
+  size_t bytes = 0;
+  while (!_sendBuffer.empty() && bytes < MAX_COALESCED_RSP_BYTES) {
+    auto buf = std::move(_sendBuffer.front());
+    _sendBuffer.pop_front();
+    bytes += buf->size;
+    _sendBufferBytes -= buf->size;
+    bool closeAfterThis = buf->closeAfterThis;
+    bufs.emplace_back(std::move(buf));
+    if (closeAfterThis) {
+      break;
+    }
+  }
+  return bufs;
+}
+
 void NetSession::start() {
   stepState();
 }
@@ -513,6 +659,160 @@ Status NetSession::cancel() {
   return {ErrorCodes::ERR_NETWORK, ec.message()};
 }
 
+Status NetSession::blockOnKeys(const std::vector<std::string>& keys,
+                               uint64_t timeoutMs,
+                               const std::string& timeoutRsp) {
+  // the session is not driven by stepState(), e.g. in tests
+  if (_state.load(std::memory_order_relaxed) == State::Created) {
+    return {ErrorCodes::ERR_INTERNAL, "session is not started"};
+  }
+  auto mgr = _server->getBlockingMgr();
+  if (_blockSeq == 0) {
+    _blockSeq = mgr->nextSeq();
+    _blockDeadline = timeoutMs ? msSinceEpoch() + timeoutMs : 0;
+  }
+  startBlock(_blockSeq, keys, _blockDeadline, timeoutRsp);
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status NetSession::yieldOnLock(uint64_t timeoutMs) {
+  if (_state.load(std::memory_order_relaxed) == State::Created) {
+    return {ErrorCodes::ERR_INTERNAL, "session is not started"};
+  }
+  // no keys, it is only woken by lockGranted() or the deadline
+  startBlock(_server->getBlockingMgr()->nextSeq(),
+             {},
+             msSinceEpoch() + timeoutMs,
+             Command::fmtErr(
+               Status(ErrorCodes::ERR_LOCK_TIMEOUT, "Lock wait timeout")
+                 .toString()));
+  ++_netMatrix->lockYields;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void NetSession::cancelYield() {
+  _server->getBlockingMgr()->unblock(id());
+  std::lock_guard<std::mutex> lk(_mutex);
+  // it may be woken already, by the grant or the deadline
+  _blockState = BlockState::NONE;
+  _blocked = false;
+}
+
+void NetSession::lockGranted() {
+  // false if it is timed out or canceled
+  if (_server->getBlockingMgr()->unblock(id())) {
+    wakeUp(BlockingManager::WakeReason::READY);
+  }
+}
+
+void NetSession::startBlock(uint64_t seq,
+                            const std::vector<std::string>& keys,
+                            uint64_t deadline,
+                            const std::string& timeoutRsp) {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    INVARIANT_D(_blockState == BlockState::NONE);
+    _blockState = BlockState::BLOCKING;
+  }
+  _blocked = true;
+  _blockTimeoutRsp = timeoutRsp;
+
+  std::weak_ptr<Session> weak = shared_from_this();
+  _server->getBlockingMgr()->block(
+    id(),
+    seq,
+    _ctx->getDbId(),
+    keys,
+    deadline,
+    [weak](BlockingManager::WakeReason reason) {
+      auto sess = weak.lock();
+      if (!sess) {
+        return false;
+      }
+      return static_cast<NetSession*>(sess.get())->wakeUp(reason);
+    });
+}
+
+bool NetSession::wakeUp(BlockingManager::WakeReason reason) {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_isEnded) {
+      return false;
+    }
+    if (_blockState == BlockState::BLOCKING) {
+      // let park() resume it
+      _blockState = BlockState::WOKEN;
+      _wakeReason = reason;
+      return true;
+    }
+    INVARIANT_D(_blockState == BlockState::PARKED);
+    _blockState = BlockState::NONE;
+  }
+  resumeBlocked(reason);
+  return true;
+}
+
+void NetSession::park() {
+  _blocked = false;
+  BlockingManager::WakeReason reason;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (_blockState == BlockState::BLOCKING) {
+      _blockState = BlockState::PARKED;
+      if (!_watchingPeer.exchange(true)) {
+        watchPeerClose();
+      }
+      return;
+    }
+    INVARIANT_D(_blockState == BlockState::WOKEN);
+    _blockState = BlockState::NONE;
+    reason = _wakeReason;
+  }
+  resumeBlocked(reason);
+}
+
+void NetSession::resumeBlocked(BlockingManager::WakeReason reason) {
+  auto self(shared_from_this());
+  scheduleOn(_server, &_ioCtxId, [this, self, reason]() {
+    if (reason == BlockingManager::WakeReason::TIMEOUT) {
+      // the lock waited is given up, if it is a lock wait
+      _ctx->takeParkedLock();
+      _blockSeq = 0;
+      setResponse(_blockTimeoutRsp);
+      resetMultiBulkCtx();
+    }
+    // run the blocking command again, or go on with the pipeline
+    setState(State::Process);
+    processReq();
+  });
+}
+
+void NetSession::watchPeerClose() {
+  auto self(shared_from_this());
+  _sock.async_wait(tcp::socket::wait_read,
+                   [this, self](const std::error_code& ec) {
+                     _watchingPeer = false;
+                     if (ec) {
+                       // canceled by client kill
+                       endSession();
+                       return;
+                     }
+                     char c;
+                     std::error_code rec;
+                     size_t n = _sock.receive(asio::buffer(&c, 1),
+                                              tcp::socket::message_peek,
+                                              rec);
+                     if (rec == asio::error::would_block) {
+                       return;
+                     }
+                     if (rec || n == 0) {
+                       endSession();
+                     }
+                     // else a pipelined request comes, it is read after
+                     // the session is woken up.
+                   });
+}
+
 // only for test!
 void NetSession::setArgs(const std::vector<std::string>& args) {
   _args = args;
@@ -534,45 +834,42 @@ void NetSession::setRspAndClose(const std::string& s) {
   resetMultiBulkCtx();
 }
 
-void NetSession::processInlineBuffer() {
-  char* newline = nullptr;
+NetSession::ParseResult NetSession::processInlineBuffer() {
+  const char* buf = _queryBuf.data() + _queryBufStart;
+  ssize_t len = _queryBufPos - _queryBufStart;
   std::vector<std::string> argv;
-  std::string aux;
   size_t querylen;
   size_t linefeed_chars = 1;
 
   /* Search for end of line */
-  newline = strchr(_queryBuf.data(), '\n');
+  const char* newline = findChar(buf, buf + len, '\n');
 
   /* Nothing to do without a \r\n */
-  if (newline == NULL) {
-    if (_queryBufPos > REDIS_INLINE_MAX_SIZE) {
+  if (newline == nullptr) {
+    if (len > REDIS_INLINE_MAX_SIZE) {
       ++_netMatrix->invalidPackets;
       setRspAndClose("Protocol error: too big inline request");
-      return;
+      return ParseResult::Error;
     }
-    setState(State::DrainReqNet);
-    schedule();
-    return;
+    return ParseResult::Incomplete;
   }
 
   /* Handle the \r\n case. */
-  if (newline && newline != _queryBuf.data() && *(newline - 1) == '\r') {
+  if (newline != buf && *(newline - 1) == '\r') {
     newline--;
     linefeed_chars++;
   }
 
   /* Split the input buffer up to the \r\n */
-  querylen = newline - (_queryBuf.data());
-  aux = std::string(_queryBuf.data(), querylen);
-  auto ret = redis_port::splitargs(argv, aux);
+  querylen = newline - buf;
+  auto ret = redis_port::splitargs(argv, std::string(buf, querylen));
   if (ret == NULL) {
     setRspAndClose("Protocol error: unbalanced quotes in request");
-    return;
+    return ParseResult::Error;
   }
 
   /* Leave data after the first line of the query in the buffer */
-  shiftQueryBuf(querylen + linefeed_chars, -1);
+  consumeQueryBuf(querylen + linefeed_chars);
 
   if (_args.size() != 0) {
     LOG(FATAL) << "BUG: _args.size:" << _args.size() << " not empty";
@@ -580,105 +877,99 @@ void NetSession::processInlineBuffer() {
 
   for (auto& v : argv) {
     if (v.length() != 0) {
-      _args.emplace_back(v);
+      _args.emplace_back(std::move(v));
     }
   }
 
-  setState(State::Process);
-  schedule();
+  return ParseResult::Completed;
 }
 
 // NOTE(deyukong): mainly port from redis::networking.c,
 // func:processMultibulkBuffer, the unportable part (long long, int and so on)
 // are all from the redis source code, quite ugly.
-// FIXME(deyukong): rewrite into a more c++ like code.
-void NetSession::processMultibulkBuffer() {
-  char* newLine = nullptr;
+// The lines are searched in the unread bytes only, and the parsed bytes are
+// consumed by moving _queryBufStart, so a pipeline is not moved in the
+// buffer once per request.
+NetSession::ParseResult NetSession::processMultibulkBuffer() {
+  const char* buf = _queryBuf.data() + _queryBufStart;
+  const char* bufEnd = _queryBuf.data() + _queryBufPos;
+  ssize_t len = bufEnd - buf;
+  const char* newLine = nullptr;
   long long ll;  // NOLINT(runtime/int)
-  int pos = 0;
+  ssize_t pos = 0;
   int ok = 0;
   if (_multibulklen == 0) {
-    newLine = strchr(_queryBuf.data(), '\r');
+    newLine = findChar(buf, bufEnd, '\r');
     if (newLine == nullptr) {
-      if (_queryBufPos > REDIS_INLINE_MAX_SIZE) {
+      if (len > REDIS_INLINE_MAX_SIZE) {
         ++_netMatrix->invalidPackets;
         setRspAndClose("Protocol error: too big mbulk count string");
-        return;
+        return ParseResult::Error;
       }
       // not complete line
-      setState(State::DrainReqNet);
-      schedule();
-      return;
+      return ParseResult::Incomplete;
     }
     /* Buffer should also contain \n */
-    if (newLine - _queryBuf.data() > _queryBufPos - 2) {
+    if (newLine - buf > len - 2) {
       // not complete line
-      setState(State::DrainReqNet);
-      schedule();
-      return;
+      return ParseResult::Incomplete;
     }
 
     /* We know for sure there is a whole line since newline != NULL,
      * so go ahead and find out the multi bulk length. */
-    if (_queryBuf[0] != '*') {
+    if (buf[0] != '*') {
       LOG(ERROR) << "multiBulk first char not *";
       ++_netMatrix->invalidPackets;
       setRspAndClose("Protocol error: multiBulk first char not *");
-      return;
+      return ParseResult::Error;
     }
-    char* newStart = _queryBuf.data() + 1;
+    const char* newStart = buf + 1;
     ok = redis_port::string2ll(newStart, newLine - newStart, &ll);
     if (!ok || ll > 1024 * 1024) {
       ++_netMatrix->invalidPackets;
       setRspAndClose("Protocol error: invalid multibulk length");
-      return;
+      return ParseResult::Error;
     }
-    pos = newLine - _queryBuf.data() + 2;
+    pos = newLine - buf + 2;
     if (ll <= 0) {
-      shiftQueryBuf(pos, -1);
+      consumeQueryBuf(pos);
 
       INVARIANT(_args.size() == 0);
-      setState(State::Process);
-      schedule();
-      return;
+      return ParseResult::Completed;
     }
     _multibulklen = ll;
+    _args.reserve(std::min(ll, 1024LL));
   }
 
   INVARIANT(_multibulklen > 0);
 
   while (_multibulklen) {
     if (_bulkLen == -1) {
-      newLine = strchr(_queryBuf.data() + pos, '\r');
+      newLine = findChar(buf + pos, bufEnd, '\r');
       if (newLine == nullptr) {
-        // NOTE(vinchen): For logical correctly, here it should minus
-        // pos. In fact, it is also a bug for redis. But because of the
-        // REDIS_MBULK_BIG_ARG optimization, it is not a problem in
-        // redis now.
-        if (_queryBufPos - pos > REDIS_INLINE_MAX_SIZE) {
+        if (len - pos > REDIS_INLINE_MAX_SIZE) {
           ++_netMatrix->invalidPackets;
           LOG(ERROR) << "_multibulklen = " << _multibulklen
                      << ", _queryBufPos = " << _queryBufPos << ", pos =" << pos;
           INVARIANT_D(0);
           setRspAndClose("Protocol error: too big bulk count string");
-          return;
+          return ParseResult::Error;
         }
         break;
       }
 
       /* Buffer should also contain \n */
-      if (newLine - _queryBuf.data() > _queryBufPos - 2) {
+      if (newLine - buf > len - 2) {
         break;
       }
-      if (_queryBuf.data()[pos] != '$') {
+      if (buf[pos] != '$') {
         std::stringstream s;
         ++_netMatrix->invalidPackets;
-        s << "Protocol error: expected '$', got '" << _queryBuf.data()[pos]
-          << "'";
+        s << "Protocol error: expected '$', got '" << buf[pos] << "'";
         setRspAndClose(s.str());
-        return;
+        return ParseResult::Error;
       }
-      char* newStart = _queryBuf.data() + pos + 1;
+      const char* newStart = buf + pos + 1;
       ok = redis_port::string2ll(newStart, newLine - newStart, &ll);
 
       uint32_t maxBulkLen = CONFIG_DEFAULT_PROTO_MAX_BULK_LEN;
@@ -688,41 +979,27 @@ void NetSession::processMultibulkBuffer() {
       if (!ok || ll < 0 || ll > maxBulkLen) {
         ++_netMatrix->invalidPackets;
         setRspAndClose("Protocol error: invalid bulk length");
-        return;
-      }
-      pos += newLine - (_queryBuf.data() + pos) + 2;
-      // the optimization of ll >= REDIS_MBULK_BIG_ARG
-      // is not ported from redis
-      if (ll >= REDIS_MBULK_BIG_ARG) {
-        /* If we are going to read a large object from network
-         * try to make it likely that it will start at c->querybuf
-         * boundary so that we can optimize object creation
-         * avoiding a large copy of data. */
-        shiftQueryBuf(pos, -1);
-        pos = 0;
+        return ParseResult::Error;
       }
+      pos = newLine - buf + 2;
+      // a big bulk is not moved to the buffer start as redis does,
+      // drainReqNet() makes room for all of it and reads it in one go.
       _bulkLen = ll;
     }
-    if (_queryBufPos - pos < _bulkLen + 2) {
+    if (len - pos < _bulkLen + 2) {
       // not complete
       break;
     } else {
-      // TODO(vinchen): There is a optimization is not ported from redis
-      _args.push_back(std::string(_queryBuf.data() + pos, _bulkLen));
+      _args.emplace_back(buf + pos, _bulkLen);
       pos += _bulkLen + 2;
       _bulkLen = -1;
       _multibulklen -= 1;
     }
   }
   if (pos != 0) {
-    shiftQueryBuf(pos, -1);
-  }
-  if (_multibulklen == 0) {
-    setState(State::Process);
-  } else {
-    setState(State::DrainReqNet);
+    consumeQueryBuf(pos);
   }
-  schedule();
+  return _multibulklen == 0 ? ParseResult::Completed : ParseResult::Incomplete;
 }
 
 void NetSession::drainReqCallback(const std::error_code& ec, size_t actualLen) {
@@ -761,57 +1038,58 @@ void NetSession::drainReqCallback(const std::error_code& ec, size_t actualLen) {
     setRspAndClose("Closing client that reached max query buffer length");
     return;
   }
+  switch (parseQueryBuf()) {
+    case ParseResult::Completed:
+      setState(State::Process);
+      schedule();
+      break;
+    case ParseResult::Incomplete:
+      // read the rest in this thread, it needs no executor
+      setState(State::DrainReqNet);
+      drainReqNet();
+      break;
+    case ParseResult::Error:
+      break;
+  }
+}
+
+NetSession::ParseResult NetSession::parseQueryBuf() {
   if (_reqType == RedisReqMode::REDIS_REQ_UNKNOWN) {
-    if (_queryBuf[0] == '*') {
+    if (_queryBuf[_queryBufStart] == '*') {
       _reqType = RedisReqMode::REDIS_REQ_MULTIBULK;
     } else {
       _reqType = RedisReqMode::REDIS_REQ_INLINE;
     }
   }
   if (_reqType == RedisReqMode::REDIS_REQ_MULTIBULK) {
-    processMultibulkBuffer();
+    return processMultibulkBuffer();
   } else if (_reqType == RedisReqMode::REDIS_REQ_INLINE) {
-    processInlineBuffer();
-  } else {
-    LOG(FATAL) << "unknown request type";
+    return processInlineBuffer();
   }
+  LOG(FATAL) << "unknown request type";
+  return ParseResult::Error;
 }
 
-// NOTE(deyukong): an O(n) impl of array shifting, an alternative to sdsrange,
-// which also has O(n) time-complexity
-void NetSession::shiftQueryBuf(ssize_t start, ssize_t end) {
-  if (_queryBufPos == 0) {
-    return;
-  }
-  int64_t newLen = 0;
-  if (start < 0) {
-    start = _queryBufPos + start;
-    if (start < 0) {
-      start = 0;
-    }
-  }
-  if (end < 0) {
-    end = _queryBufPos + end;
-    if (end < 0) {
-      end = 0;
-    }
-  }
-  newLen = (start > end) ? 0 : (end - start + 1);
-  if (newLen != 0) {
-    if (start >= _queryBufPos) {
-      newLen = 0;
-    } else if (end >= _queryBufPos) {
-      end = _queryBufPos - 1;
-      newLen = (start > end) ? 0 : (end - start) + 1;
-    }
-  } else {
-    start = 0;
+void NetSession::consumeQueryBuf(ssize_t len) {
+  _queryBufStart += len;
+  INVARIANT_D(_queryBufStart <= _queryBufPos);
+  if (_queryBufStart >= _queryBufPos) {
+    // all read, reuse the buffer from the start without moving
+    _queryBufStart = 0;
+    _queryBufPos = 0;
+    _queryBuf[0] = 0;
   }
-  if (start && newLen) {
-    memmove(_queryBuf.data(), _queryBuf.data() + start, newLen);
+}
+
+void NetSession::compactQueryBuf() {
+  if (_queryBufStart == 0) {
+    return;
   }
-  _queryBuf[newLen] = 0;
-  _queryBufPos = newLen;
+  ssize_t unread = _queryBufPos - _queryBufStart;
+  memmove(_queryBuf.data(), _queryBuf.data() + _queryBufStart, unread);
+  _queryBufStart = 0;
+  _queryBufPos = unread;
+  _queryBuf[_queryBufPos] = 0;
 }
 
 void NetSession::resetMultiBulkCtx() {
@@ -826,17 +1104,37 @@ void NetSession::drainReqBuf() {
   drainReqCallback(std::error_code(), 0);
 }
 
-void NetSession::drainReqNet() {
+size_t NetSession::reserveQueryBuf() {
   // we may do a sync-read to reduce async-callbacks
   size_t wantLen = REDIS_IOBUF_LEN;
+  bool bigBulk = _bulkLen >= REDIS_MBULK_BIG_ARG;
+  if (bigBulk) {
+    // read the rest of a big bulk in one go, the buffer is not resized
+    // or moved again until it is parsed
+    ssize_t rest = _bulkLen + 2 - (_queryBufPos - _queryBufStart);
+    wantLen = std::max(rest, REDIS_IOBUF_LEN);
+  }
   // here we use >= than >, so the last element will always be 0,
   // it's convinent for c-style string search
+  if (wantLen + _queryBufPos >= _queryBuf.size()) {
+    // move the unread bytes to the start only when it is short of room
+    compactQueryBuf();
+  }
   if (wantLen + _queryBufPos >= _queryBuf.size()) {
     // the fill should be as fast as memset in 02 mode, refer to here
     // NOLINT(whitespace/line_length)
     // https://stackoverflow.com/questions/8848575/fastest-way-to-reset-every-value-of-stdvectorint-to-0)
-    _queryBuf.resize((wantLen + _queryBufPos) * 2, 0);
+    size_t newSize = (wantLen + _queryBufPos) * 2;
+    if (bigBulk) {
+      newSize = wantLen + _queryBufPos + 1;
+    }
+    _queryBuf.resize(newSize, 0);
   }
+  return wantLen;
+}
+
+void NetSession::drainReqNet() {
+  size_t wantLen = reserveQueryBuf();
 
   // TODO(deyukong): I believe async_read_some wont callback if no
   // readable-event is set on the fd or this callback will be a deadloop
@@ -852,54 +1150,113 @@ void NetSession::drainReqNet() {
 
 void NetSession::processReq() {
   bool continueSched = true;
-  if (_args.size()) {
-    _ctx->setProcessPacketStart(nsSinceEpoch());
-    continueSched = _server->processRequest(reinterpret_cast<Session*>(this));
-    _reqMatrix->processed += 1;
-    _reqMatrix->processCost += nsSinceEpoch() - _ctx->getProcessPacketStart();
-    _ctx->setProcessPacketStart(0);
+  uint32_t depth = 0;
+  bool readMore = false;
+  State next = State::DrainReqNet;
+  setDeferSend(true);
+  while (true) {
+    if (_args.size()) {
+      _ctx->setProcessPacketStart(nsSinceEpoch());
+      continueSched = _server->processRequest(reinterpret_cast<Session*>(this));
+      _reqMatrix->processed += 1;
+      _reqMatrix->processCost += nsSinceEpoch() - _ctx->getProcessPacketStart();
+      _ctx->setProcessPacketStart(0);
+      ++depth;
+      if (_blocked) {
+        // keep _args, the command is run again when woken up
+        break;
+      }
+      _blockSeq = 0;
+    }
+    if (!continueSched || _closeAfterRsp) {
+      // closeAfterRsp, donot process more requests
+      // let drainRspCallback end this session
+      break;
+    }
+
+    resetMultiBulkCtx();
+    if (_queryBufPos == 0) {
+      readMore = true;
+      break;
+    }
+    ++_netMatrix->stickyPackets;
+    if (depth >= MAX_PIPELINE_BATCH) {
+      readMore = true;
+      next = State::DrainReqBuf;
+      break;
+    }
+    // the next request is already in _queryBuf, run it in this task
+    auto result = parseQueryBuf();
+    if (result == ParseResult::Error) {
+      break;
+    } else if (result == ParseResult::Incomplete) {
+      readMore = true;
+      break;
+    } else if (_args.size() && isPipelineBarrier(_args[0])) {
+      readMore = true;
+      next = State::Process;
+      break;
+    } else if (_args.size() &&
+               requestExecutor() != _ioCtxId.load(std::memory_order_relaxed)) {
+      // run it in the work pool owning its store
+      readMore = true;
+      next = State::Process;
+      break;
+    }
+  }
+
+  if (depth) {
+    _netMatrix->addPipelineDepth(depth);
   }
+  setDeferSend(false);
   if (!continueSched) {
     endSession();
-  } else if (!_closeAfterRsp) {
-    resetMultiBulkCtx();
-    if (_queryBufPos == 0) {
-      setState(State::DrainReqNet);
+  } else if (_blocked) {
+    park();
+  } else if (readMore) {
+    setState(next);
+    if (next == State::DrainReqNet) {
+      // only a read is to be started, no need to post a task for it
+      drainReqNet();
     } else {
-      setState(State::DrainReqBuf);
-      ++_netMatrix->stickyPackets;
+      schedule();
     }
-    schedule();
-  } else {
-    // closeAfterRsp, donot process more requests
-    // let drainRspCallback end this session
   }
 }
 
-void NetSession::drainRsp(std::shared_ptr<SendBuffer> buf) {
+void NetSession::drainRsp(SendBufferList bufs) {
   auto self(shared_from_this());
   uint64_t now = nsSinceEpoch();
+  std::vector<asio::const_buffer> seq;
+  for (const auto& buf : bufs) {
+    for (const auto& chunk : buf->chunks) {
+      seq.emplace_back(asio::buffer(chunk.data(), chunk.size()));
+    }
+  }
   asio::async_write(
     _sock,
-    asio::buffer(buf->buffer.data(), buf->buffer.size()),  // NOLINT
-    [this, self, buf, now](const std::error_code& ec, size_t actualLen) {
+    seq,
+    [this, self, bufs, now](const std::error_code& ec, size_t actualLen) {
       _reqMatrix->sendPacketCost += nsSinceEpoch() - now;
-      drainRspCallback(ec, actualLen, buf);
+      drainRspCallback(ec, actualLen, bufs);
     });
 }
 
 void NetSession::drainRspCallback(const std::error_code& ec,
                                   size_t actualLen,
-                                  std::shared_ptr<SendBuffer> buf) {
+                                  SendBufferList bufs) {
   if (ec) {
     LOG(WARNING) << "drainRspCallback:" << ec.message();
     endSession();
     return;
   }
-  if (actualLen != buf->buffer.size()) {
-    LOG(FATAL) << "conn:" << _connId << ",data:" << buf->buffer.data()
-               << ",actualLen:" << actualLen
-               << ",bufsize:" << buf->buffer.size() << ",invalid drainRsp len";
+  size_t expectLen = 0;
+  for (const auto& buf : bufs) {
+    expectLen += buf->size;
+  }
+  if (actualLen != expectLen) {
+    LOG(FATAL) << "conn:" << _connId << ",actualLen:" << actualLen
+               << ",bufsize:" << expectLen << ",invalid drainRsp len";
   }
 
   if (_server) {
@@ -907,7 +1264,16 @@ void NetSession::drainRspCallback(const std::error_code& ec,
     _server->getServerStat().netOutputBytes += actualLen;
   }
 
-  if (buf->closeAfterThis) {
+  uint64_t now = 0;
+  for (const auto& buf : bufs) {
+    if (buf->latencyId != UINT32_MAX) {
+      now = now ? now : nsSinceEpoch();
+      LatencyStats::record(
+        buf->latencyId, LatencyStage::REPLY, now - buf->queuedNs);
+    }
+  }
+
+  if (bufs.back()->closeAfterThis) {
     endSession();
     return;
   }
@@ -915,9 +1281,7 @@ void NetSession::drainRspCallback(const std::error_code& ec,
   std::lock_guard<std::mutex> lk(_mutex);
   INVARIANT(_isSendRunning);
   if (_sendBuffer.size() > 0) {
-    auto it = _sendBuffer.front();
-    _sendBuffer.pop_front();
-    drainRsp(it);
+    drainRsp(popSendBuffersInLock());
   } else {
     _isSendRunning = false;
   }
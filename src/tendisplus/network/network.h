@@ -21,6 +21,7 @@
 #include "tendisplus/network/blocking_tcp_client.h"
 #include "tendisplus/server/session.h"
 #include "tendisplus/server/server_params.h"
+#include "tendisplus/server/blocking_manager.h"
 #include "tendisplus/utils/status.h"
 #include "tendisplus/utils/atomic_utility.h"
 
@@ -39,10 +40,23 @@ enum class RedisReqMode : std::uint8_t {
 
 class NetworkMatrix {
  public:
+  // bucket i counts the batches of (2^(i-1), 2^i] pipelined commands
+  static constexpr size_t PIPELINE_DEPTH_BUCKETS = 8;
   Atom<uint64_t> stickyPackets{0};
   Atom<uint64_t> connCreated{0};
   Atom<uint64_t> connReleased{0};
   Atom<uint64_t> invalidPackets{0};
+  Atom<uint64_t> pipelineBatches{0};
+  // the lock waits which yield the executor thread
+  Atom<uint64_t> lockYields{0};
+  // the requests moved to the work pool owning their stores
+  Atom<uint64_t> executorSwitches{0};
+  Atom<uint64_t> pipelineDepth[PIPELINE_DEPTH_BUCKETS];
+  void addPipelineDepth(uint32_t depth);
+  // upper bound of the bucket
+  static uint32_t pipelineDepthBucketBound(size_t bucket) {
+    return 1U << bucket;
+  }
   NetworkMatrix operator-(const NetworkMatrix& right);
   std::string toString() const;
   void reset();
@@ -122,8 +136,17 @@ class NetworkAsio {
 };
 
 struct SendBuffer {
-  std::vector<char> buffer;
+  SendBuffer()
+    : size(0), closeAfterThis(false), latencyId(UINT32_MAX), queuedNs(0) {}
+  SendBuffer(const SendBuffer&) = delete;
+  // give the pooled chunks back to ReplyChunkPool
+  ~SendBuffer();
+  std::vector<std::string> chunks;
+  size_t size;
   bool closeAfterThis;
+  // the command replied, its reply stage is from queued to written
+  uint32_t latencyId;
+  uint64_t queuedNs;
 };
 
 // represent a ingress tcp-connection
@@ -143,6 +166,7 @@ class NetSession : public Session {
   virtual std::string getLocalRepr() const;
   asio::ip::tcp::socket borrowConn();
   virtual Status setResponse(const std::string& s);
+  Status setResponseChunks(RespWriter&& writer) override;
   void setCloseAfterRsp();
   virtual void start();
   virtual Status cancel();
@@ -158,10 +182,20 @@ class NetSession : public Session {
   // close session, and the socket(by raii)
   virtual void endSession();
 
+  Status blockOnKeys(const std::vector<std::string>& keys,
+                     uint64_t timeoutMs,
+                     const std::string& timeoutRsp) override;
+  Status yieldOnLock(uint64_t timeoutMs) override;
+  void cancelYield() override;
+  void lockGranted() override;
+  bool isBlocked() const override {
+    return _blocked;
+  }
+
   const std::vector<std::string>& getArgs() const;
   void setArgs(const std::vector<std::string>&);
   void setIoCtxId(uint32_t id) {
-    _ioCtxId = id;
+    _ioCtxId.store(id, std::memory_order_relaxed);
   }
   enum class State {
     Created,
@@ -175,19 +209,28 @@ class NetSession : public Session {
   virtual void schedule();
   virtual void stepState();
   virtual void setState(State s);
+  // the work pool to run the parsed request in, it is the pool owning the
+  // store of the key with executorStoreAffinity
+  uint32_t requestExecutor() const;
 
   // read data from socket
   virtual void drainReqNet();
+  // make room in _queryBuf for the next read, return the bytes to read
+  size_t reserveQueryBuf();
   virtual void drainReqBuf();
   virtual void drainReqCallback(const std::error_code& ec, size_t actualLen);
 
-  // send data to tcpbuff
-  virtual void drainRsp(std::shared_ptr<SendBuffer>);
+  // send data to tcpbuff, all the chunks of the buffers are written
+  // with one vectored write.
+  using SendBufferList = std::vector<std::shared_ptr<SendBuffer>>;
+  virtual void drainRsp(SendBufferList bufs);
   virtual void drainRspCallback(const std::error_code& ec,
                                 size_t actualLen,
-                                std::shared_ptr<SendBuffer> buf);
+                                SendBufferList bufs);
 
-  // handle msg parsed from drainReqCallback
+  // handle msg parsed from drainReqCallback, the following complete
+  // requests in _queryBuf are executed in the same task, and their
+  // responses are sent together.
   virtual void processReq();
   // cleanup state for next request
   virtual void resetMultiBulkCtx();
@@ -195,16 +238,61 @@ class NetSession : public Session {
  private:
   FRIEND_TEST(NetSession, drainReqInvalid);
   FRIEND_TEST(NetSession, Completed);
+  FRIEND_TEST(NetSession, Pipelined);
+  FRIEND_TEST(NetSession, StoreAffinity);
+  FRIEND_TEST(NetSession, BigBulk);
+  FRIEND_TEST(NetSession, ParserBench);
   FRIEND_TEST(Command, common);
 
-  void processMultibulkBuffer();
-  void processInlineBuffer();
+  enum class ParseResult {
+    Completed,
+    Incomplete,
+    // replied with an error and the session is closing
+    Error,
+  };
+  ParseResult parseQueryBuf();
+  ParseResult processMultibulkBuffer();
+  ParseResult processInlineBuffer();
 
   // network is ok, but client's msg is not ok, reply and close
   void setRspAndClose(const std::string&);
 
-  // utils to shift parsed partial params from _queryBuf
-  void shiftQueryBuf(ssize_t start, ssize_t end);
+  // the parsed bytes are skipped by moving _queryBufStart, and the buffer
+  // is reused from the start when all of it is parsed
+  void consumeQueryBuf(ssize_t len);
+  // move the unread bytes to the start of _queryBuf
+  void compactQueryBuf();
+
+  Status queueSendBuffer(std::shared_ptr<SendBuffer> buf);
+  // hold the queued responses while executing a pipeline, they are
+  // written with one vectored write when the pipeline ends.
+  void setDeferSend(bool defer);
+  // pop the queued buffers which can be sent in one write, in lock
+  SendBufferList popSendBuffersInLock();
+
+  enum class BlockState {
+    NONE,
+    // blocked by the current command, processReq() is still running
+    BLOCKING,
+    // woken up before processReq() ends
+    WOKEN,
+    // blocked and no task of the session is running
+    PARKED,
+  };
+  // called by BlockingManager, return false if the session is ended
+  bool wakeUp(BlockingManager::WakeReason reason);
+  // register the session in BlockingManager, woken by the keys or the
+  // deadline
+  void startBlock(uint64_t seq,
+                  const std::vector<std::string>& keys,
+                  uint64_t deadline,
+                  const std::string& timeoutRsp);
+  // called at the end of processReq() if the command blocked
+  void park();
+  void resumeBlocked(BlockingManager::WakeReason reason);
+  // no request is read from the socket while the session is parked,
+  // watch the socket so a closed client is not kept blocked.
+  void watchPeerClose();
 
  protected:
   uint64_t _connId;
@@ -212,24 +300,42 @@ class NetSession : public Session {
   std::atomic<State> _state;
   asio::ip::tcp::socket _sock;
   std::vector<char> _queryBuf;
+  // the bytes read end at _queryBufPos, and the unread ones start at
+  // _queryBufStart
   ssize_t _queryBufPos;
+  ssize_t _queryBufStart;
 
   // contexts for RedisReqMode::REDIS_REQ_MULTIBULK
   RedisReqMode _reqType;
   int64_t _multibulklen;
   int64_t _bulkLen;
 
-  // _mutex protects _isSendRunning, _isEnded, _sendBuffer
+  // _mutex protects _isSendRunning, _isEnded, _deferSend, _sendBuffer,
+  // _blockState and _wakeReason.
   // other variables will never be visited in send-threads.
   std::mutex _mutex;
   bool _isSendRunning;
   bool _isEnded;
+  bool _deferSend;
   bool _first;
   std::list<std::shared_ptr<SendBuffer>> _sendBuffer;
+  size_t _sendBufferBytes;
+
+  BlockState _blockState;
+  BlockingManager::WakeReason _wakeReason;
+  // set by blockOnKeys() and checked by processReq() in the same task
+  bool _blocked;
+  // kept when the blocking command is run again after woken up
+  uint64_t _blockSeq;
+  uint64_t _blockDeadline;
+  std::string _blockTimeoutRsp;
+  std::atomic<bool> _watchingPeer;
 
   std::shared_ptr<NetworkMatrix> _netMatrix;
   std::shared_ptr<RequestMatrix> _reqMatrix;
-  uint32_t _ioCtxId = UINT32_MAX;
+  // the work pool running the session, it is changed by the session's own
+  // task, and read by the threads waking it up
+  std::atomic<uint32_t> _ioCtxId{UINT32_MAX};
 };
 
 }  // namespace tendisplus
@@ -3,9 +3,13 @@
 // project for additional information.
 
 #include <stdio.h>
+#include <string.h>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <algorithm>
+#include <set>
 #include "gtest/gtest.h"
 #include "glog/logging.h"
 #include "tendisplus/network/network.h"
@@ -28,8 +32,17 @@ class NoSchedNetSession : public NetSession {
     : NetSession(
         server, std::move(sock), connid, initSock, netMatrix, reqMatrix) {}
 
+  // feed the session as drainReqNet() does, return the bytes read
+  size_t feed(const std::string& data, size_t offset) {
+    size_t n = std::min(reserveQueryBuf(), data.size() - offset);
+    memcpy(_queryBuf.data() + _queryBufPos, data.data() + offset, n);
+    drainReqCallback(std::error_code(), n);
+    return n;
+  }
+
  protected:
   virtual void schedule() {}
+  virtual void drainReqNet() {}
 };
 
 TEST(NetSession, drainReqInvalid) {
@@ -74,6 +87,7 @@ TEST(NetSession, drainReqInvalid) {
     hasCalled = false;
     sess->_queryBuf.clear();
     sess->_queryBufPos = 0;
+    sess->_queryBufStart = 0;
     sess->resetMultiBulkCtx();
     std::copy(
       s.first.begin(), s.first.end(), std::back_inserter(sess->_queryBuf));
@@ -138,6 +152,250 @@ TEST(NetSession, Completed) {
   EXPECT_EQ(sess->_args[1], "1");
 }
 
+TEST(NetSession, Pipelined) {
+  std::string s =
+    "*1\r\n$4\r\nping\r\n*2\r\n$3\r\nget\r\n$1\r\na\r\n"
+    "ping\r\n*2\r\n$3\r\nget\r\n$1\r";
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess =
+    std::make_shared<NoSchedNetSession>(nullptr,
+                                        std::move(socket),
+                                        1,
+                                        false,
+                                        std::make_shared<NetworkMatrix>(),
+                                        std::make_shared<RequestMatrix>());
+
+  sess->setState(NetSession::State::DrainReqNet);
+  sess->_queryBuf.resize(128, 0);
+  std::copy(s.begin(), s.end(), sess->_queryBuf.begin());
+  sess->drainReqCallback(std::error_code(), s.size());
+  EXPECT_EQ(sess->_state.load(), NetSession::State::Process);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"ping"}));
+  // the parsed bytes are skipped, not moved out of the buffer
+  EXPECT_EQ(sess->_queryBufStart, 14);
+  EXPECT_EQ(sess->_queryBufPos, static_cast<ssize_t>(s.size()));
+
+  // the following requests are parsed from the buffer without
+  // being scheduled again
+  sess->resetMultiBulkCtx();
+  EXPECT_EQ(sess->parseQueryBuf(), NetSession::ParseResult::Completed);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"get", "a"}));
+  sess->resetMultiBulkCtx();
+  EXPECT_EQ(sess->parseQueryBuf(), NetSession::ParseResult::Completed);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"ping"}));
+  sess->resetMultiBulkCtx();
+  EXPECT_EQ(sess->parseQueryBuf(), NetSession::ParseResult::Incomplete);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"get"}));
+  EXPECT_EQ(sess->_closeAfterRsp, false);
+}
+
+std::string respRequest(const std::vector<std::string>& args) {
+  std::string s = "*" + std::to_string(args.size()) + "\r\n";
+  for (const auto& arg : args) {
+    s += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+  }
+  return s;
+}
+
+TEST(NetSession, BigBulk) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess =
+    std::make_shared<NoSchedNetSession>(nullptr,
+                                        std::move(socket),
+                                        1,
+                                        false,
+                                        std::make_shared<NetworkMatrix>(),
+                                        std::make_shared<RequestMatrix>());
+
+  std::string value(100000, 'v');
+  std::string s = respRequest({"set", "k", value});
+  std::string ping = respRequest({"ping"});
+  s += ping;
+  sess->setState(NetSession::State::DrainReqNet);
+  size_t sent = 0;
+  uint32_t reads = 0;
+  while (sess->_state.load() == NetSession::State::DrainReqNet) {
+    sent += sess->feed(s, sent);
+    reads++;
+  }
+  EXPECT_EQ(sess->_state.load(), NetSession::State::Process);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"set", "k", value}));
+  // the rest of the bulk is read in one go into a buffer just big enough
+  EXPECT_EQ(reads, 2U);
+  EXPECT_EQ(sent, s.size() - ping.size());
+  EXPECT_EQ(sess->_queryBufPos, 0);
+  EXPECT_LE(sess->_queryBuf.size(), value.size() + 64);
+
+  sess->resetMultiBulkCtx();
+  sess->setState(NetSession::State::DrainReqNet);
+  sent += sess->feed(s, sent);
+  EXPECT_EQ(sent, s.size());
+  EXPECT_EQ(sess->_state.load(), NetSession::State::Process);
+  EXPECT_EQ(sess->_args, std::vector<std::string>({"ping"}));
+}
+
+// parse a corpus of requests read as drainReqNet() does, and run the
+// parsed ones as processReq() does without executing them. The corpus is
+// the raw requests of a client in the file of TENDIS_RESP_TRACE, or some
+// generated ones.
+TEST(NetSession, ParserBench) {
+  std::string corpus;
+  uint64_t expected = 0;
+  const char* trace = getenv("TENDIS_RESP_TRACE");
+  if (trace) {
+    std::ifstream in(trace, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    corpus = ss.str();
+  }
+  if (corpus.empty()) {
+    std::string value(128, 'v');
+    std::string bigValue(64 * 1024, 'b');
+    for (uint32_t i = 0; i < 200000; i++) {
+      std::string key = "key_" + std::to_string(i % 10000);
+      switch (i % 5) {
+        case 0:
+          corpus += respRequest({"set", key, value});
+          break;
+        case 1:
+          corpus += respRequest({"get", key});
+          break;
+        case 2:
+          corpus += respRequest({"hset", key, "field", value});
+          break;
+        case 3: {
+          std::vector<std::string> mget = {"mget"};
+          for (uint32_t j = 0; j < 10; j++) {
+            mget.emplace_back(key + "_" + std::to_string(j));
+          }
+          corpus += respRequest(mget);
+          break;
+        }
+        default:
+          if (i % 1000 == 4) {
+            corpus += respRequest({"set", key, bigValue});
+          } else {
+            corpus += "incr " + key + "\r\n";
+          }
+      }
+      expected++;
+    }
+  }
+
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess =
+    std::make_shared<NoSchedNetSession>(nullptr,
+                                        std::move(socket),
+                                        1,
+                                        false,
+                                        std::make_shared<NetworkMatrix>(),
+                                        std::make_shared<RequestMatrix>());
+  uint64_t requests = 0;
+  // the bytes moved if the buffer was shifted after every request
+  uint64_t shiftBytes = 0;
+  size_t sent = 0;
+  auto start = nsSinceEpoch();
+  sess->setState(NetSession::State::DrainReqNet);
+  while (sent < corpus.size()) {
+    sent += sess->feed(corpus, sent);
+    while (sess->_state.load() == NetSession::State::Process) {
+      requests++;
+      shiftBytes += sess->_queryBufPos - sess->_queryBufStart;
+      sess->resetMultiBulkCtx();
+      if (sess->_queryBufPos == 0) {
+        sess->setState(NetSession::State::DrainReqNet);
+        break;
+      }
+      auto result = sess->parseQueryBuf();
+      ASSERT_NE(result, NetSession::ParseResult::Error);
+      if (result == NetSession::ParseResult::Incomplete) {
+        sess->setState(NetSession::State::DrainReqNet);
+      }
+    }
+  }
+  auto cost = nsSinceEpoch() - start;
+  if (expected) {
+    EXPECT_EQ(requests, expected);
+  }
+  EXPECT_EQ(sess->_closeAfterRsp, false);
+  LOG(INFO) << "corpus bytes:" << corpus.size() << " requests:" << requests
+            << " cost per request:" << cost / std::max(requests, 1UL) << "ns"
+            << " MB/s:" << corpus.size() * 1000 / std::max(cost, 1UL)
+            << " bytes a shift per request would move:" << shiftBytes;
+}
+
+TEST(NetSession, StoreAffinity) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->executorThreadNum = 8;
+  cfg->executorWorkPoolSize = 2;
+  auto server = makeServerEntry(cfg);
+
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto sess =
+    std::make_shared<NoSchedNetSession>(server,
+                                        std::move(socket),
+                                        1,
+                                        false,
+                                        std::make_shared<NetworkMatrix>(),
+                                        std::make_shared<RequestMatrix>());
+  sess->setIoCtxId(0);
+  std::set<uint32_t> executors;
+  for (uint32_t i = 0; i < 100; i++) {
+    std::string key = "key_" + std::to_string(i);
+    sess->_args = {"set", key, "v"};
+    EXPECT_EQ(sess->requestExecutor(), 0U);
+
+    server->getParams()->executorStoreAffinity = true;
+    uint32_t id = sess->requestExecutor();
+    EXPECT_EQ(id, server->getStoreExecutor(key));
+    executors.insert(id);
+    // the same store, the same pool
+    sess->_args = {"hget", key, "f"};
+    EXPECT_EQ(sess->requestExecutor(), id);
+    // no single key, the pool of the session
+    sess->_args = {"mset", key, "v", "other", "v"};
+    EXPECT_EQ(sess->requestExecutor(), 0U);
+    sess->_args = {"ping"};
+    EXPECT_EQ(sess->requestExecutor(), 0U);
+    server->getParams()->executorStoreAffinity = false;
+  }
+  EXPECT_EQ(executors.size(), 4U);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+TEST(NetworkMatrix, PipelineDepth) {
+  NetworkMatrix m;
+  for (uint32_t depth : {1, 2, 3, 4, 5, 64, 100, 128, 1000}) {
+    m.addPipelineDepth(depth);
+  }
+  EXPECT_EQ(m.pipelineBatches.get(), 9U);
+  EXPECT_EQ(m.pipelineDepth[0].get(), 1U);  // 1
+  EXPECT_EQ(m.pipelineDepth[1].get(), 1U);  // 2
+  EXPECT_EQ(m.pipelineDepth[2].get(), 2U);  // 3, 4
+  EXPECT_EQ(m.pipelineDepth[3].get(), 1U);  // 5
+  EXPECT_EQ(m.pipelineDepth[6].get(), 1U);  // 64
+  EXPECT_EQ(m.pipelineDepth[7].get(), 3U);  // 100, 128, 1000
+
+  NetworkMatrix old = m;
+  m.addPipelineDepth(2);
+  auto diff = m - old;
+  EXPECT_EQ(diff.pipelineBatches.get(), 1U);
+  EXPECT_EQ(diff.pipelineDepth[1].get(), 1U);
+  EXPECT_EQ(diff.pipelineDepth[7].get(), 0U);
+  m.reset();
+  EXPECT_EQ(m.pipelineDepth[7].get(), 0U);
+}
+
 
 class session : public std::enable_shared_from_this<session> {
  public:
@@ -280,6 +538,57 @@ TEST(BlockingTcpClient, Common) {
   thd1.join();
 }
 
+TEST(BlockingTcpClient, SendFile) {
+  auto ioCtx = std::make_shared<asio::io_context>();
+  auto ioCtx1 = std::make_shared<asio::io_context>();
+  uint32_t port = 54021;
+  const auto guard = MakeGuard([] { remove("sendfile.txt"); });
+  std::ofstream out("sendfile.txt", std::ios::binary);
+  out << "hello world\r\nfile line\r\n";
+  out.close();
+
+  server svr(*ioCtx, port);
+
+  std::thread thd([&ioCtx] {
+    asio::io_context::work work(*ioCtx);
+    ioCtx->run();
+  });
+  std::thread thd1([&ioCtx1] {
+    asio::io_context::work work(*ioCtx1);
+    ioCtx1->run();
+  });
+
+  auto cli = std::make_shared<BlockingTcpClient>(ioCtx1, 128, 1024 * 1024, 10);
+  Status s = cli->connect("127.0.0.1", port, std::chrono::seconds(1));
+  EXPECT_TRUE(s.ok());
+
+  FileSource file("sendfile.txt");
+  EXPECT_TRUE(file.open().ok());
+  EXPECT_EQ(file.size(), 24u);
+  // the batches read are the ones sent
+  auto data = file.next(13);
+  EXPECT_TRUE(data.ok());
+  EXPECT_EQ(std::string(data.value(), 13), "hello world\r\n");
+  EXPECT_TRUE(cli->sendFile(&file, std::chrono::seconds(1)).ok());
+  data = file.next(11);
+  EXPECT_TRUE(data.ok());
+  EXPECT_EQ(std::string(data.value(), 11), "file line\r\n");
+  EXPECT_TRUE(cli->sendFile(&file, std::chrono::seconds(1)).ok());
+  EXPECT_FALSE(file.next(1).ok());
+
+  auto exps = cli->readLine(std::chrono::seconds(5));
+  EXPECT_TRUE(exps.ok());
+  EXPECT_EQ(exps.value(), "hello world");
+  exps = cli->readLine(std::chrono::seconds(5));
+  EXPECT_TRUE(exps.ok());
+  EXPECT_EQ(exps.value(), "file line");
+
+  ioCtx->stop();
+  ioCtx1->stop();
+  thd.join();
+  thd1.join();
+}
+
 class session2 : public std::enable_shared_from_this<session2> {
  public:
   explicit session2(asio::ip::tcp::socket socket)
@@ -31,11 +31,26 @@ SessionCtx::SessionCtx(Session* sess)
     _replOnly(false),
     _session(sess),
     _isMonitor(false),
-    _flags(0) {
+    _flags(0),
+    _lockYieldable(false),
+    _latencyId(UINT32_MAX),
+    _txnShared(false) {
   _perfContext.Reset();
   _ioContext.Reset();
 }
 
+// a parked lock is released here, it is never added to _locks
+SessionCtx::~SessionCtx() = default;
+
+void SessionCtx::setParkedLock(std::unique_ptr<KeyLock> lock) {
+  INVARIANT_D(_parkedLock == nullptr);
+  _parkedLock = std::move(lock);
+}
+
+std::unique_ptr<KeyLock> SessionCtx::takeParkedLock() {
+  return std::move(_parkedLock);
+}
+
 void SessionCtx::setProcessPacketStart(uint64_t start) {
   _processPacketStart = start;
 }
@@ -63,6 +78,8 @@ void SessionCtx::setAuthed() {
 void SessionCtx::addLock(ILock* lock) {
   std::lock_guard<std::mutex> lk(_mutex);
   _locks.push_back(lock);
+  // the command can't be run again once it holds a lock
+  _lockYieldable = false;
 }
 
 void SessionCtx::removeLock(ILock* lock) {
@@ -137,6 +154,58 @@ Status SessionCtx::commitAll(const std::string& cmd) {
   return s;
 }
 
+void SessionCtx::beginSharedTxns() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  INVARIANT_D(!_txnShared && _sharedTxns.empty());
+  _txnShared = true;
+}
+
+Transaction* SessionCtx::getSharedTxn(const std::string& dbId) const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto it = _sharedTxns.find(dbId);
+  return it == _sharedTxns.end() ? nullptr : it->second.get();
+}
+
+void SessionCtx::addSharedTxn(const std::string& dbId,
+                              std::unique_ptr<Transaction> txn) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  INVARIANT_D(_txnShared && _sharedTxns.count(dbId) == 0);
+  _sharedTxns[dbId] = std::move(txn);
+}
+
+Status SessionCtx::commitSharedTxns(const std::string& cmd) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  // the txns of the commands are over the shared ones
+  _txnMap.clear();
+  Status s = {ErrorCodes::ERR_OK, ""};
+  for (auto& txn : _sharedTxns) {
+    Expected<uint64_t> exptCommit = txn.second->commit();
+    if (!exptCommit.ok()) {
+      LOG(ERROR) << cmd << " commit error at kvstore " << txn.first
+                 << ". It lead to partial success.";
+      s = exptCommit.status();
+    }
+  }
+  _sharedTxns.clear();
+  _txnShared = false;
+  return s;
+}
+
+Status SessionCtx::rollbackSharedTxns() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _txnMap.clear();
+  Status s = {ErrorCodes::ERR_OK, ""};
+  for (auto& txn : _sharedTxns) {
+    s = txn.second->rollback();
+    if (!s.ok()) {
+      LOG(ERROR) << "rollback error at kvstore " << txn.first;
+    }
+  }
+  _sharedTxns.clear();
+  _txnShared = false;
+  return s;
+}
+
 Status SessionCtx::rollbackAll() {
   std::lock_guard<std::mutex> lk(_mutex);
   Status s = {ErrorCodes::ERR_OK, ""};
@@ -10,6 +10,7 @@
 #include <string>
 #include <algorithm>
 #include <list>
+#include <map>
 #include <vector>
 #include <tuple>
 #include <unordered_map>
@@ -33,6 +34,7 @@ namespace tendisplus {
 using SLSP = std::tuple<uint32_t, uint32_t, std::string, mgl::LockMode>;
 
 class ILock;
+class KeyLock;
 class SessionCtx {
   enum class PerfLevel : unsigned char {
     kUninitialized = 0,             // unknown setting
@@ -51,6 +53,7 @@ class SessionCtx {
   explicit SessionCtx(Session* sess);
   SessionCtx(const SessionCtx&) = delete;
   SessionCtx(SessionCtx&&) = delete;
+  ~SessionCtx();
   bool authed() const;
   void setAuthed();
   uint32_t getDbId() const;
@@ -76,6 +79,17 @@ class SessionCtx {
   Status commitAll(const std::string& cmd);
   Status rollbackAll();
   Expected<Transaction*> createTransaction(const PStore& kvstore);
+  // till commitSharedTxns() or rollbackSharedTxns(), the txns created by
+  // the kvstores for this session share one txn of each kvstore, their
+  // commit only ends their part, see RocksSharedTxn
+  void beginSharedTxns();
+  bool isTxnShared() const {
+    return _txnShared;
+  }
+  Transaction* getSharedTxn(const std::string& dbId) const;
+  void addSharedTxn(const std::string& dbId, std::unique_ptr<Transaction> txn);
+  Status commitSharedTxns(const std::string& cmd);
+  Status rollbackSharedTxns();
   void setExtendProtocol(bool v);
   void setExtendProtocolValue(uint64_t ts, uint64_t version);
   bool setPerfLevel(const std::string& level);
@@ -106,6 +120,32 @@ class SessionCtx {
 
   bool isLockedByMe(const std::string& key, mgl::LockMode mode);
 
+  // the command may yield the executor thread on its first lock wait,
+  // it is reset when a lock is taken
+  void setLockYieldable(bool v) {
+    _lockYieldable = v;
+  }
+  bool isLockYieldable() const {
+    return _lockYieldable;
+  }
+  // the lock waited by a yielded session, taken when it is run again
+  void setParkedLock(std::unique_ptr<KeyLock> lock);
+  std::unique_ptr<KeyLock> takeParkedLock();
+  bool hasParkedLock() const {
+    return _parkedLock != nullptr;
+  }
+
+  // the latency id of the command whose reply is queued next, see
+  // LatencyStats
+  void setLatencyId(uint32_t id) {
+    _latencyId = id;
+  }
+  uint32_t takeLatencyId() {
+    uint32_t id = _latencyId;
+    _latencyId = UINT32_MAX;
+    return id;
+  }
+
   uint32_t getIsMonitor() const;
   void setIsMonitor(bool in);
 
@@ -154,6 +194,9 @@ class SessionCtx {
   std::unordered_map<std::string, mgl::LockMode> _keylockmap;
   bool _isMonitor;
   uint32_t _flags;
+  bool _lockYieldable;
+  std::unique_ptr<KeyLock> _parkedLock;
+  uint32_t _latencyId;
 
   mutable std::mutex _mutex;
 
@@ -161,6 +204,9 @@ class SessionCtx {
   std::vector<ILock*> _locks;
   // multi key
   std::unordered_map<std::string, std::unique_ptr<Transaction>> _txnMap;
+  // shared txns, ordered by dbId
+  bool _txnShared;
+  std::map<std::string, std::unique_ptr<Transaction>> _sharedTxns;
   std::vector<std::string> _argsBrief;
   rocksdb::PerfContext _perfContext;
   rocksdb::IOStatsContext _ioContext;
@@ -18,6 +18,7 @@
 #include "tendisplus/utils/status.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/atomic_utility.h"
+#include "tendisplus/utils/latency_stats.h"
 
 namespace tendisplus {
 
@@ -56,7 +57,10 @@ class WorkerPool {
       int64_t outQueueTs = nsSinceEpoch();
       _matrix->queueTime += outQueueTs - enQueueTs;
       ++_matrix->executing;
+      // the queue stage of the first command run by the task
+      LatencyStats::setQueueWait(outQueueTs - enQueueTs);
       mytask();
+      LatencyStats::setQueueWait(0);
       --_matrix->inQueue;
       --_matrix->executing;
       int64_t endExeTs = nsSinceEpoch();
@@ -71,6 +75,9 @@ class WorkerPool {
     // _ioCtx->post(std::move(taskWrap));
   }
   void stop();
+  bool isRunning() const {
+    return _isRuning.load(std::memory_order_relaxed);
+  }
   size_t size() const;
   void resize(size_t poolSize);
 
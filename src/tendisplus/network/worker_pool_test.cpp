@@ -2,10 +2,18 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "glog/logging.h"
 #include "gtest/gtest.h"
 
 #include "tendisplus/network/worker_pool.h"
+#include "tendisplus/lock/mgl/mgl.h"
+#include "tendisplus/lock/mgl/mgl_mgr.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/test_util.h"
 
@@ -73,3 +81,99 @@ TEST(Workerpool, schedule) {
   t.join();
   auto guard = tendisplus::MakeGuard([]() { tendisplus::destroyEnv(); });
 }
+
+// Thousands of sessions wait a few keys on a pool of 2 threads. A waiting
+// session yields its thread, and it is scheduled again when its lock is
+// granted, so the pool is never pinned by the lock waits.
+TEST(Workerpool, lockYieldStress) {
+  using tendisplus::mgl::LockMode;
+  using tendisplus::mgl::LockRes;
+  using tendisplus::mgl::MGLock;
+  auto matrix = std::make_shared<tendisplus::PoolMatrix>();
+  tendisplus::WorkerPool pool("test-pool", matrix);
+  ASSERT_TRUE(pool.startup(2).ok());
+  tendisplus::mgl::MGLockMgr mgr;
+
+  const uint32_t sessions = 20000;
+  const uint32_t keys = 8;
+  // > 0 for the readers, -1 for the writer
+  std::vector<std::atomic<int32_t>> holders(keys);
+  for (auto& h : holders) {
+    h = 0;
+  }
+  std::atomic<bool> conflict(false);
+  std::atomic<uint32_t> done(0);
+  std::atomic<uint32_t> yielded(0);
+
+  // hold all the keys, so every session waits
+  std::vector<std::unique_ptr<MGLock>> blockers;
+  for (uint32_t k = 0; k < keys; k++) {
+    blockers.emplace_back(std::make_unique<MGLock>(&mgr));
+    ASSERT_EQ(blockers.back()->lock(
+                "key_" + std::to_string(k), LockMode::LOCK_X, 1000),
+              LockRes::LOCKRES_OK);
+  }
+
+  struct Sess {
+    std::unique_ptr<MGLock> lock;
+    uint32_t key;
+    LockMode mode;
+  };
+  auto run = [&](const std::shared_ptr<Sess>& s) {
+    auto& h = holders[s->key];
+    if (s->mode == LockMode::LOCK_X) {
+      if (h.exchange(-1) != 0) {
+        conflict = true;
+      }
+      h = 0;
+    } else {
+      if (h.fetch_add(1) < 0) {
+        conflict = true;
+      }
+      h.fetch_sub(1);
+    }
+    s->lock->unlock();
+    done++;
+  };
+  for (uint32_t i = 0; i < sessions; i++) {
+    pool.schedule([&, i]() {
+      auto s = std::make_shared<Sess>();
+      s->lock = std::make_unique<MGLock>(&mgr);
+      s->key = i % keys;
+      s->mode = i % 4 == 0 ? LockMode::LOCK_X : LockMode::LOCK_S;
+      auto res = s->lock->lockAsync(
+        "key_" + std::to_string(s->key), s->mode, [&pool, &run, s]() {
+          pool.schedule([&run, s]() { run(s); });
+        });
+      if (res == LockRes::LOCKRES_OK) {
+        run(s);
+      } else {
+        yielded++;
+      }
+    });
+  }
+
+  auto waitFor = [](std::function<bool()> cond, uint32_t sec) {
+    auto deadline = tendisplus::msSinceEpoch() + sec * 1000;
+    while (!cond() && tendisplus::msSinceEpoch() < deadline) {
+      usleep(1000);
+    }
+    return cond();
+  };
+  // all the sessions are waiting, with no thread held
+  EXPECT_TRUE(waitFor([&]() { return yielded == sessions; }, 30));
+  std::promise<void> probe;
+  pool.schedule([&probe]() { probe.set_value(); });
+  EXPECT_EQ(probe.get_future().wait_for(std::chrono::seconds(5)),
+            std::future_status::ready);
+  EXPECT_EQ(done, 0U);
+
+  for (auto& b : blockers) {
+    b->unlock();
+  }
+  EXPECT_TRUE(waitFor([&]() { return done == sessions; }, 60));
+  EXPECT_FALSE(conflict);
+  LOG(INFO) << "lockYieldStress pool:" << matrix->toString();
+
+  pool.stop();
+}
@@ -7,20 +7,26 @@
 #include <fstream>
 #include <string>
 #include <memory>
+#include <algorithm>
 
 #include "glog/logging.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 
 #include "tendisplus/replication/repl_manager.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
 
+// the most batches in flight a slave can ask for
+static constexpr uint64_t FULLSYNC_MAX_WINDOW = 1024;
+
 bool ReplManager::supplyFullSync(asio::ip::tcp::socket sock,
                                  const std::string& storeIdArg,
                                  const std::string& slaveIpArg,
-                                 const std::string& slavePortArg) {
+                                 const std::string& slavePortArg,
+                                 const std::string& windowArg) {
   std::shared_ptr<BlockingTcpClient> client =
     std::move(_svr->getNetwork()->createBlockingClient(std::move(sock),
                                                        64 * 1024 * 1024));
@@ -48,15 +54,25 @@ bool ReplManager::supplyFullSync(asio::ip::tcp::socket sock,
     client->writeLine("-ERR invalid expSlavePort");
     return false;
   }
+
+  auto expWindow = tendisplus::stoul(windowArg);
+  if (!expWindow.ok()) {
+    LOG(ERROR) << "ReplManager::supplyFullSync window error:" << windowArg;
+    client->writeLine("-ERR invalid window");
+    return false;
+  }
   LOG(INFO) << "ReplManager::supplyFullSync storeId:" << storeIdArg << " "
-            << slaveIpArg << ":" << slavePortArg;
+            << slaveIpArg << ":" << slavePortArg << " window:" << windowArg;
   uint16_t slavePort = static_cast<uint16_t>(expSlavePort.value());
+  uint32_t window = std::min(expWindow.value(), FULLSYNC_MAX_WINDOW);
   _fullPusher->schedule([this,
                          storeId,
                          client(std::move(client)),
                          slaveIpArg,
-                         slavePort]() mutable {
-    supplyFullSyncRoutine(std::move(client), storeId, slaveIpArg, slavePort);
+                         slavePort,
+                         window]() mutable {
+    supplyFullSyncRoutine(
+      std::move(client), storeId, slaveIpArg, slavePort, window);
   });
 
   return true;
@@ -244,6 +260,11 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
                       listenIpArg,
                       listen_port]() mutable {
     std::lock_guard<std::mutex> lk(_mutex);
+    if (_sstIngesting[storeId] != 0) {
+      LOG(WARNING) << "registerIncrSync storeId:" << storeId
+                   << " refused while ingesting sst files";
+      return false;
+    }
     // takenliu: recycleBinlog use firstPos, and incrSync use binlogPos+1
     if (_logRecycStatus[storeId]->firstBinlogId > (binlogPos + 1) &&
         _logRecycStatus[storeId]->firstBinlogId !=
@@ -299,6 +320,93 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
   return registPosOk;
 }
 
+// streaming mode, the slave asks for a window > 0
+// foreach file
+//     send filename
+//     foreach batch
+//         send content
+//         read +OK if window batches are not acked
+//     send crc64 of the file
+// read the +OK not read yet
+Status ReplManager::supplyFullSyncFiles(
+  BlockingTcpClient* client,
+  const std::string& dir,
+  const std::map<std::string, uint64_t>& flist,
+  uint32_t window) {
+  INVARIANT_D(window > 0);
+  size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
+  auto timeout = std::chrono::seconds(_cfg->timeoutSecBinlogWaitRsp);
+  uint32_t inFlight = 0;
+  auto readAck = [client, &inFlight, timeout]() -> Status {
+    auto rpl = client->readLine(timeout);
+    if (!rpl.ok()) {
+      return rpl.status();
+    }
+    if (rpl.value() != "+OK") {
+      return {ErrorCodes::ERR_NETWORK, "invalid ack:" + rpl.value()};
+    }
+    inFlight--;
+    return {ErrorCodes::ERR_OK, ""};
+  };
+
+  uint64_t totalBytes = 0;
+  uint64_t startTime = msSinceEpoch();
+  for (auto& fileInfo : flist) {
+    auto s = client->writeLine(fileInfo.first);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string fname = dir + "/" + fileInfo.first;
+    FileSource myfile(fname);
+    s = myfile.open();
+    if (!s.ok()) {
+      return s;
+    }
+
+    uint64_t crc = 0;
+    size_t remain = fileInfo.second;
+    while (remain) {
+      size_t batchSize = std::min(remain, fileBatch);
+      _rateLimiter->Request(batchSize);
+      auto data = myfile.next(batchSize);
+      if (!data.ok()) {
+        return data.status();
+      }
+      // the batch is checksummed from the mapped file and sent from the
+      // same pages by sendfile()
+      crc = redis_port::crc64(
+        crc, reinterpret_cast<const unsigned char*>(data.value()), batchSize);
+      s = client->sendFile(&myfile, timeout);
+      if (!s.ok()) {
+        return s;
+      }
+      remain -= batchSize;
+      if (++inFlight >= window) {
+        s = readAck();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    s = client->writeLine(std::to_string(crc));
+    if (!s.ok()) {
+      return s;
+    }
+    totalBytes += fileInfo.second;
+    LOG(INFO) << "fulsync send file success:" << fname << " crc:" << crc;
+  }
+  while (inFlight) {
+    auto s = readAck();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  uint64_t costMs = msSinceEpoch() - startTime;
+  LOG(INFO) << "fullsync send files:" << flist.size()
+            << ",bytes:" << totalBytes << ",cost:" << costMs << "ms";
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 // mpov's network communicate procedure
 // send binlogpos low watermark
 // send filelist={filename->filesize}
@@ -311,7 +419,8 @@ void ReplManager::supplyFullSyncRoutine(
   std::shared_ptr<BlockingTcpClient> client,
   uint32_t storeId,
   const string& slave_listen_ip,
-  uint16_t slave_listen_port) {
+  uint16_t slave_listen_port,
+  uint32_t window) {
   LocalSessionGuard sg(_svr.get());
   sg.getSession()->setArgs(
     {"masterfullsync", client->getRemoteRepr(), std::to_string(storeId)});
@@ -337,6 +446,13 @@ void ReplManager::supplyFullSyncRoutine(
 
   {
     std::lock_guard<std::mutex> lk(_mutex);
+    // the slave would miss the keys of the files, which have no binlog
+    if (_sstIngesting[storeId] != 0) {
+      client->writeLine("-ERR store is ingesting sst files, retry later");
+      LOG(WARNING) << "fullsync storeId:" << storeId
+                   << " refused while ingesting sst files";
+      return;
+    }
     uint64_t highestBinlogid = store->getHighestBinlogId();
     string slaveNode = slave_listen_ip + ":" + to_string(slave_listen_port);
     auto iter = _fullPushStatus[storeId].find(slaveNode);
@@ -454,52 +570,64 @@ void ReplManager::supplyFullSyncRoutine(
   LOG(INFO) << "fullsync " << storeId
             << " send fileList success:" << sb.GetString();
 
-  std::string readBuf;
-  size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
-  readBuf.reserve(fileBatch);
-  for (auto& fileInfo : bkInfo.value().getFileList()) {
-    s = client->writeLine(fileInfo.first);
+  if (window > 0) {
+    s = supplyFullSyncFiles(client.get(),
+                            store->dftBackupDir(),
+                            bkInfo.value().getFileList(),
+                            window);
     if (!s.ok()) {
-      LOG(ERROR) << "write fname:" << fileInfo.first
-                 << " to client failed:" << s.toString();
-      return;
-    }
-    LOG(INFO) << "fulsync send filename success:" << fileInfo.first;
-    std::string fname = store->dftBackupDir() + "/" + fileInfo.first;
-    auto myfile = std::ifstream(fname, std::ios::binary);
-    if (!myfile.is_open()) {
-      LOG(ERROR) << "open file:" << fname << " for read failed";
+      LOG(ERROR) << "send client:" << client->getRemoteRepr()
+                 << " files failed:" << s.toString();
       return;
     }
-    size_t remain = fileInfo.second;
-    while (remain) {
-      size_t batchSize = std::min(remain, fileBatch);
-      _rateLimiter->Request(batchSize);
-      readBuf.resize(batchSize);
-      remain -= batchSize;
-      myfile.read(&readBuf[0], batchSize);
-      if (!myfile) {
-        LOG(ERROR) << "read file:" << fname
-                   << " failed with err:" << strerror(errno);
-        return;
-      }
-      s = client->writeData(readBuf);
+  } else {
+    std::string readBuf;
+    size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
+    readBuf.reserve(fileBatch);
+    for (auto& fileInfo : bkInfo.value().getFileList()) {
+      s = client->writeLine(fileInfo.first);
       if (!s.ok()) {
-        LOG(ERROR) << "write bulk to client failed:" << s.toString();
+        LOG(ERROR) << "write fname:" << fileInfo.first
+                   << " to client failed:" << s.toString();
         return;
       }
-      secs = _cfg->timeoutSecBinlogWaitRsp;  // 10
-      auto rpl = client->readLine(std::chrono::seconds(secs));
-      if (!rpl.ok() || rpl.value() != "+OK") {
-        LOG(ERROR) << "send client:" << client->getRemoteRepr()
-                   << "file:" << fileInfo.first << ",size:" << fileInfo.second
-                   << " failed:"
-                   << (rpl.ok() ? rpl.value()
-                                : rpl.status().toString());  // NOLINT
+      LOG(INFO) << "fulsync send filename success:" << fileInfo.first;
+      std::string fname = store->dftBackupDir() + "/" + fileInfo.first;
+      auto myfile = std::ifstream(fname, std::ios::binary);
+      if (!myfile.is_open()) {
+        LOG(ERROR) << "open file:" << fname << " for read failed";
         return;
       }
+      size_t remain = fileInfo.second;
+      while (remain) {
+        size_t batchSize = std::min(remain, fileBatch);
+        _rateLimiter->Request(batchSize);
+        readBuf.resize(batchSize);
+        remain -= batchSize;
+        myfile.read(&readBuf[0], batchSize);
+        if (!myfile) {
+          LOG(ERROR) << "read file:" << fname
+                     << " failed with err:" << strerror(errno);
+          return;
+        }
+        s = client->writeData(readBuf);
+        if (!s.ok()) {
+          LOG(ERROR) << "write bulk to client failed:" << s.toString();
+          return;
+        }
+        secs = _cfg->timeoutSecBinlogWaitRsp;  // 10
+        auto rpl = client->readLine(std::chrono::seconds(secs));
+        if (!rpl.ok() || rpl.value() != "+OK") {
+          LOG(ERROR) << "send client:" << client->getRemoteRepr()
+                     << "file:" << fileInfo.first << ",size:" << fileInfo.second
+                     << " failed:"
+                     << (rpl.ok() ? rpl.value()
+                                  : rpl.status().toString());  // NOLINT
+          return;
+        }
+      }
+      LOG(INFO) << "fulsync send file success:" << fname;
     }
-    LOG(INFO) << "fulsync send file success:" << fname;
   }
   secs = _cfg->timeoutSecBinlogWaitRsp;  // 10
   Expected<std::string> reply = client->readLine(std::chrono::seconds(secs));
@@ -88,6 +88,7 @@ ReplManager::ReplManager(std::shared_ptr<ServerEntry> svr,
     _fullReceiveMatrix(std::make_shared<PoolMatrix>()),
     _incrCheckMatrix(std::make_shared<PoolMatrix>()),
     _logRecycleMatrix(std::make_shared<PoolMatrix>()),
+    _binlogApplyMatrix(std::make_shared<PoolMatrix>()),
     _connectMasterTimeoutMs(1000) {
   _cfg->serverParamsVar("incrPushThreadnum")->setUpdate([this]() {
     incrPusherResize(_cfg->incrPushThreadnum);
@@ -183,6 +184,15 @@ Status ReplManager::startup() {
     return s;
   }
 
+  if (_cfg->binlogApplyThreadnum > 0) {
+    _binlogApplier =
+      std::make_unique<WorkerPool>("tx-repl-apply", _binlogApplyMatrix);
+    s = _binlogApplier->startup(_cfg->binlogApplyThreadnum);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
   for (uint32_t i = 0; i < _svr->getKVStoreCount(); i++) {
     // here we are starting up, dont acquire a storelock.
     auto expdb =
@@ -227,6 +237,7 @@ Status ReplManager::startup() {
     _fullPushStatus.emplace_back(
       std::map<string, std::unique_ptr<MPovFullPushStatus>>());
 #endif
+    _sstIngesting.push_back(0);
 
     Status status;
 
@@ -617,6 +628,22 @@ bool ReplManager::hasSomeSlave(uint32_t storeId) {
   return false;
 }
 
+bool ReplManager::beginSstIngest(uint32_t storeId) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_pushStatus[storeId].size() != 0 ||
+      _fullPushStatus[storeId].size() != 0) {
+    return false;
+  }
+  _sstIngesting[storeId]++;
+  return true;
+}
+
+void ReplManager::endSstIngest(uint32_t storeId) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  INVARIANT_D(_sstIngesting[storeId] > 0);
+  _sstIngesting[storeId]--;
+}
+
 bool ReplManager::isSlaveOfSomeone(uint32_t storeId) {
   std::lock_guard<std::mutex> lk(_mutex);
   if (_syncMeta[storeId]->syncFromHost != "") {
@@ -1411,6 +1438,8 @@ void ReplManager::getReplInfoDetail(std::stringstream& ss) const {
       // lag in seconds
       ss << ",lag="
          << (msSinceEpoch() - _syncStatus[i]->lastBinlogTs) / 1000;
+      ss << ",applied_binlogs=" << _syncStatus[i]->appliedBinlogs;
+      ss << ",apply_time_us=" << _syncStatus[i]->applyTimeUs;
       if (_syncMeta[i]->replState == ReplState::REPL_ERR) {
         ss << ",error=" << _syncMeta[i]->replErr;
       }
@@ -1533,6 +1562,9 @@ void ReplManager::stop() {
   _fullReceiver->stop();
   _incrChecker->stop();
   _logRecycler->stop();
+  if (_binlogApplier) {
+    _binlogApplier->stop();
+  }
 
 #if defined(_WIN32) && _MSC_VER > 1900
   for (size_t i = 0; i < _pushStatus.size(); i++) {
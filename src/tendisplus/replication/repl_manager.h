@@ -37,6 +37,9 @@ struct SPovStatus {
   SCLOCK::time_point nextSchedTime;
   SCLOCK::time_point lastSyncTime;
   uint64_t lastBinlogTs;    // in milliseconds
+  // binlogs applied and the time spent, for the apply throughput
+  uint64_t appliedBinlogs = 0;
+  uint64_t applyTimeUs = 0;
 };
 
 struct MPovStatus {
@@ -153,7 +156,8 @@ class ReplManager {
   bool supplyFullSync(asio::ip::tcp::socket sock,
                       const std::string& storeIdArg,
                       const std::string& slaveIpArg,
-                      const std::string& slavePortArg);
+                      const std::string& slavePortArg,
+                      const std::string& windowArg);
   bool registerIncrSync(asio::ip::tcp::socket sock,
                         const std::string& storeIdArg,
                         const std::string& dstStoreIdArg,
@@ -176,12 +180,23 @@ class ReplManager {
                         uint32_t storeId,
                         const std::string& logKey,
                         const std::string& logValue);
+  // apply a batch of binlogs on _binlogApplier, see applyTxnsV2Parallel()
+  Status applyRepllogsV2(Session* sess,
+                         uint32_t storeId,
+                         const std::vector<ReplLogRawV2>& logs);
+  bool isParallelApplyEnabled() const {
+    return _binlogApplier != nullptr;
+  }
 #endif
   bool flushCurBinlogFs(uint32_t storeId);
   void appendJSONStat(rapidjson::PrettyWriter<rapidjson::StringBuffer>&) const;
   void getReplInfo(std::stringstream& ss) const;
   void onFlush(uint32_t storeId, uint64_t binlogid);
   bool hasSomeSlave(uint32_t storeId);
+  // the sst files ingested by a migrating task have no binlog, no slave can
+  // attach the store meanwhile. It fails if the store has some slave.
+  bool beginSstIngest(uint32_t storeId);
+  void endSstIngest(uint32_t storeId);
   bool isSlaveOfSomeone(uint32_t storeId);
   bool isSlaveOfSomeone();
   bool isSlaveFullSyncDone();
@@ -213,7 +228,14 @@ class ReplManager {
   void supplyFullSyncRoutine(std::shared_ptr<BlockingTcpClient> client,
                              uint32_t storeId,
                              const string& slave_listen_ip,
-                             uint16_t slave_listen_port);
+                             uint16_t slave_listen_port,
+                             uint32_t window);
+  // send the files with at most window batches not acked, each file is
+  // followed by its crc64
+  Status supplyFullSyncFiles(BlockingTcpClient* client,
+                             const std::string& dir,
+                             const std::map<std::string, uint64_t>& flist,
+                             uint32_t window);
   bool isFullSupplierFull() const;
 
   std::shared_ptr<BlockingTcpClient> createClient(const StoreMeta&,
@@ -280,6 +302,8 @@ class ReplManager {
   std::vector<std::map<string, std::unique_ptr<MPovFullPushStatus>>>
     _fullPushStatus;
 #endif
+  // master's pov, the sst snapshots being received, see beginSstIngest()
+  std::vector<uint32_t> _sstIngesting;
 
   // master and slave's pov, smallest binlogId, moves on when truncated
   std::vector<std::unique_ptr<RecycleBinlogStatus>> _logRecycStatus;
@@ -305,6 +329,10 @@ class ReplManager {
   // master and slave's pov, log recycler
   std::unique_ptr<WorkerPool> _logRecycler;
 
+  // slave's pov, workerpool of applying binlogs, nullptr if the binlogs
+  // are applied one by one in the session
+  std::unique_ptr<WorkerPool> _binlogApplier;
+
   std::atomic<uint64_t> _clientIdGen;
 
   const std::string _dumpPath;
@@ -316,6 +344,7 @@ class ReplManager {
   std::shared_ptr<PoolMatrix> _fullReceiveMatrix;
   std::shared_ptr<PoolMatrix> _incrCheckMatrix;
   std::shared_ptr<PoolMatrix> _logRecycleMatrix;
+  std::shared_ptr<PoolMatrix> _binlogApplyMatrix;
   uint64_t _connectMasterTimeoutMs;
 };
 
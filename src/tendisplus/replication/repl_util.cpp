@@ -7,6 +7,10 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <set>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>  // NOLINT
 #include "glog/logging.h"
 #include "tendisplus/commands/command.h"
 
@@ -290,6 +294,322 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
   return br;
 }
 
+namespace {
+
+struct DependencyState {
+  std::mutex mutex;
+  std::condition_variable cv;
+  WorkerPool* pool;
+  const std::function<Status(size_t)>* fn;
+  std::vector<bool>* done;
+  // number of the unfinished txns each one depends on
+  std::vector<size_t> pending;
+  std::vector<std::vector<size_t>> successors;
+  // scheduled but not finished
+  size_t running = 0;
+  // fn is called
+  size_t executing = 0;
+  // the caller is gone, fn and done can not be touched any more
+  bool abandoned = false;
+  Status status = {ErrorCodes::ERR_OK, ""};
+};
+
+void scheduleByDependency(std::shared_ptr<DependencyState> st, size_t idx) {
+  WorkerPool* pool = st->pool;
+  pool->schedule([st, idx]() {
+    {
+      std::lock_guard<std::mutex> lk(st->mutex);
+      if (st->abandoned || !st->status.ok()) {
+        --st->running;
+        st->cv.notify_all();
+        return;
+      }
+      ++st->executing;
+    }
+    Status s = (*st->fn)(idx);
+
+    std::vector<size_t> ready;
+    {
+      std::lock_guard<std::mutex> lk(st->mutex);
+      --st->executing;
+      if (s.ok()) {
+        (*st->done)[idx] = true;
+        for (auto next : st->successors[idx]) {
+          if (--st->pending[next] == 0 && st->status.ok()) {
+            ready.push_back(next);
+          }
+        }
+      } else if (st->status.ok()) {
+        st->status = s;
+      }
+      st->running += ready.size();
+    }
+    for (auto next : ready) {
+      scheduleByDependency(st, next);
+    }
+
+    std::lock_guard<std::mutex> lk(st->mutex);
+    --st->running;
+    st->cv.notify_all();
+  });
+}
+
+}  // namespace
+
+Status runByDependency(WorkerPool* pool,
+                       const std::vector<std::vector<std::string>>& keys,
+                       const std::function<Status(size_t)>& fn,
+                       std::vector<bool>* done) {
+  size_t n = keys.size();
+  done->assign(n, false);
+  if (n == 0) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  auto st = std::make_shared<DependencyState>();
+  st->pool = pool;
+  st->fn = &fn;
+  st->done = done;
+  st->pending.assign(n, 0);
+  st->successors.resize(n);
+
+  std::unordered_map<std::string, size_t> lastWriter;
+  std::vector<size_t> sinceBarrier;
+  size_t lastBarrier = n;
+  for (size_t i = 0; i < n; ++i) {
+    std::set<size_t> deps;
+    if (keys[i].empty()) {
+      deps.insert(sinceBarrier.begin(), sinceBarrier.end());
+      lastWriter.clear();
+      sinceBarrier.clear();
+    } else {
+      for (const auto& key : keys[i]) {
+        auto it = lastWriter.find(key);
+        if (it != lastWriter.end()) {
+          deps.insert(it->second);
+        }
+        lastWriter[key] = i;
+      }
+      sinceBarrier.push_back(i);
+    }
+    if (lastBarrier != n) {
+      deps.insert(lastBarrier);
+    }
+    if (keys[i].empty()) {
+      lastBarrier = i;
+    }
+    for (auto dep : deps) {
+      st->successors[dep].push_back(i);
+    }
+    st->pending[i] = deps.size();
+  }
+
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < n; ++i) {
+    if (st->pending[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lk(st->mutex);
+    st->running = ready.size();
+  }
+  for (auto i : ready) {
+    scheduleByDependency(st, i);
+  }
+
+  std::unique_lock<std::mutex> lk(st->mutex);
+  while (st->running != 0) {
+    st->cv.wait_for(lk, std::chrono::milliseconds(100));
+    // the tasks not started yet are dropped by a stopped pool
+    if (st->running != 0 && st->executing == 0 && !pool->isRunning()) {
+      st->abandoned = true;
+      if (st->status.ok()) {
+        st->status = {ErrorCodes::ERR_INTERNAL, "worker pool stopped"};
+      }
+      break;
+    }
+  }
+  return st->status;
+}
+
+namespace {
+
+// the txns changing the same chunkid/dbid/pk conflict with each other.
+// return no keys if the txn has to be applied exclusively.
+std::vector<std::string> getConflictKeys(
+  const std::vector<ReplLogValueEntryV2>& entries) {
+  std::vector<std::string> keys;
+  for (const auto& entry : entries) {
+    if (entry.getOp() != ReplOp::REPL_OP_SET &&
+        entry.getOp() != ReplOp::REPL_OP_DEL) {
+      // DEL_RANGE covers the keys out of the entries
+      return {};
+    }
+    auto rk = RecordKey::decode(entry.getOpKey());
+    if (!rk.ok()) {
+      return {};
+    }
+    keys.emplace_back(std::to_string(rk.value().getChunkId()) + "_" +
+                      std::to_string(rk.value().getDbId()) + "_" +
+                      rk.value().getPrimaryKey());
+  }
+  return keys;
+}
+
+struct TxnToApply {
+  std::unique_ptr<Transaction> txn;
+  std::vector<ReplLogValueEntryV2> entries;
+  uint64_t binlogId = 0;
+  uint64_t timestamp = 0;
+};
+
+// apply logs[begin, end) together, the result is accumulated
+Status applyTxnGroup(Session* sess,
+                     KVStore* store,
+                     const std::vector<ReplLogRawV2>& logs,
+                     size_t begin,
+                     size_t end,
+                     WorkerPool* pool,
+                     ParallelApplyResult* result) {
+  // the txns are created and given their binlogIds in the binlog order,
+  // so the highest visible binlogId only covers the contiguous committed
+  // ones no matter which order they are committed in.
+  std::vector<TxnToApply> txns;
+  std::vector<std::vector<std::string>> keys;
+  txns.reserve(end - begin);
+  keys.reserve(end - begin);
+  uint64_t lastBinlogId = store->getHighestBinlogId();
+  for (size_t i = begin; i < end; ++i) {
+    const auto& log = logs[i];
+    auto key = ReplLogKeyV2::decode(log.getReplLogKey());
+    if (!key.ok()) {
+      LOG(ERROR) << "ReplLogKeyV2::decode failed:" << key.status().toString();
+      return key.status();
+    }
+    auto value = ReplLogValueV2::decode(log.getReplLogValue());
+    if (!value.ok()) {
+      return value.status();
+    }
+
+    TxnToApply t;
+    size_t offset = value.value().getHdrSize();
+    auto data = value.value().getData();
+    size_t dataSize = value.value().getDataSize();
+    while (offset < dataSize) {
+      size_t size = 0;
+      auto entry = ReplLogValueEntryV2::decode(
+        (const char*)data + offset, dataSize - offset, &size);
+      if (!entry.ok()) {
+        return entry.status();
+      }
+      offset += size;
+      t.timestamp = entry.value().getTimestamp();
+      t.entries.emplace_back(std::move(entry.value()));
+    }
+    if (offset != dataSize) {
+      return {ErrorCodes::ERR_INTERNAL, "bad binlog"};
+    }
+
+    t.binlogId = key.value().getBinlogId();
+    if (t.binlogId <= lastBinlogId) {
+      string err = "binlogId:" + to_string(t.binlogId) +
+        " can't be smaller than highestBinlogId:" + to_string(lastBinlogId);
+      LOG(ERROR) << err;
+      return {ErrorCodes::ERR_MANUAL, err};
+    }
+    lastBinlogId = t.binlogId;
+
+    auto ptxn = store->createTransaction(sess);
+    if (!ptxn.ok()) {
+      LOG(ERROR) << "createTransaction failed:" << ptxn.status().toString();
+      return ptxn.status();
+    }
+    t.txn = std::move(ptxn.value());
+    // store the binlog directly, same as master
+    auto s = t.txn->setBinlogKV(
+      t.binlogId, log.getReplLogKey(), log.getReplLogValue());
+    if (!s.ok()) {
+      return s;
+    }
+    keys.emplace_back(getConflictKeys(t.entries));
+    txns.emplace_back(std::move(t));
+  }
+
+  std::vector<bool> done;
+  auto applyOne = [&txns](size_t i) -> Status {
+    auto& t = txns[i];
+    for (const auto& entry : t.entries) {
+      auto s = t.txn->applyBinlog(entry);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    auto expCmit = t.txn->commit();
+    t.txn.reset();
+    return expCmit.status();
+  };
+  Status s = runByDependency(pool, keys, applyOne, &done);
+
+  size_t appliedCnt = 0;
+  for (size_t i = 0; i < done.size(); ++i) {
+    if (!done[i]) {
+      result->hasHole =
+        std::find(done.begin() + i, done.end(), true) != done.end();
+      break;
+    }
+    result->applied.binlogId = txns[i].binlogId;
+    result->applied.binlogTs = txns[i].timestamp;
+    appliedCnt++;
+  }
+  // the txns not applied are rolled back here
+  txns.clear();
+
+  if (appliedCnt > 0) {
+    result->appliedCnt += appliedCnt;
+    store->setBinlogTime(result->applied.binlogTs);
+  }
+  return s;
+}
+
+}  // namespace
+
+Status applyTxnsV2Parallel(Session* sess,
+                           uint32_t storeId,
+                           const std::vector<ReplLogRawV2>& logs,
+                           WorkerPool* pool,
+                           ParallelApplyResult* result) {
+  *result = ParallelApplyResult();
+  auto svr = sess->getServerEntry();
+  auto expdb =
+    svr->getSegmentMgr()->getDb(sess, storeId, mgl::LockMode::LOCK_IX);
+  if (!expdb.ok()) {
+    LOG(ERROR) << "getDb failed:" << expdb.status().toString();
+    return expdb.status();
+  }
+  if (!sess->getCtx()->isReplOnly()) {
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "It is not a slave"};
+  }
+  auto store = std::move(expdb.value().store);
+  INVARIANT(store != nullptr);
+
+  // the binlogIds of a group are in flight together, keep them few. The
+  // txns of a group are created before any of them commits, an optimistic
+  // txn would fail on the keys committed by the txns it depends on, so
+  // they are applied one by one.
+  const size_t groupSize = store->isOptimisticTxn() ? 1 : 1024;
+  for (size_t begin = 0; begin < logs.size(); begin += groupSize) {
+    size_t end = std::min(logs.size(), begin + groupSize);
+    auto s =
+      applyTxnGroup(sess, store.get(), logs, begin, end, pool, result);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status sendWriter(BinlogWriter* writer,
                   BlockingTcpClient* client,
                   uint32_t dstStoreId,
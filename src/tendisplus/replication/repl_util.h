@@ -7,8 +7,11 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+#include <functional>
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/network/blocking_tcp_client.h"
+#include "tendisplus/network/worker_pool.h"
 #include "tendisplus/server/server_entry.h"
 
 namespace tendisplus {
@@ -58,6 +61,36 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
                                         const std::string& logValue,
                                         BinlogApplyMode mode);
 
+// run fn(0..n-1) on the pool. fn(i) starts after the earlier ones sharing
+// a key with it are done, an empty keys[i] makes i a barrier, which runs
+// after all the earlier ones and before all the later ones.
+// No more is started after a failure, it returns the first failure after
+// the running ones are done. done[i] is true if fn(i) succeeded.
+Status runByDependency(WorkerPool* pool,
+                       const std::vector<std::vector<std::string>>& keys,
+                       const std::function<Status(size_t)>& fn,
+                       std::vector<bool>* done);
+
+struct ParallelApplyResult {
+  // the last binlog applied with all the binlogs before it,
+  // binlogId is 0 if none is applied
+  BinlogResult applied;
+  size_t appliedCnt = 0;
+  // some binlogs after a failed one are committed, the store can not
+  // be caught up by resending binlogs
+  bool hasHole = false;
+};
+
+// apply a batch of binlogs of a store in KEEP_BINLOG_ID mode. The txns
+// touching the same chunkid/dbid/pk are applied in order, others are
+// applied in parallel on the pool. The txns of a store with optimistic
+// txns are applied one by one.
+Status applyTxnsV2Parallel(Session* sess,
+                           uint32_t storeId,
+                           const std::vector<ReplLogRawV2>& logs,
+                           WorkerPool* pool,
+                           ParallelApplyResult* result);
+
 Status sendWriter(BinlogWriter* writer,
                   BlockingTcpClient*,
                   uint32_t dstStoreId,
@@ -34,9 +34,13 @@ namespace tendisplus {
 Expected<BackupInfo> getBackupInfo(BlockingTcpClient* client,
                                    const StoreMeta& metaSnapshot,
                                    const string& ip,
-                                   uint16_t port) {
+                                   uint16_t port,
+                                   uint32_t window) {
   std::stringstream ss;
   ss << "FULLSYNC " << metaSnapshot.syncFromId << " " << ip << " " << port;
+  if (window > 0) {
+    ss << " " << window;
+  }
   Status s = client->writeLine(ss.str());
   if (!s.ok()) {
     LOG(WARNING) << "fullSync master failed:" << s.toString();
@@ -95,6 +99,7 @@ Expected<BackupInfo> getBackupInfo(BlockingTcpClient* client,
 //     read filename
 //     read content
 //     send +OK
+//     read crc64 of the file if in streaming mode
 // send +OK
 void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
   LOG(INFO) << "store:" << metaSnapshot.id << " fullsync start";
@@ -173,10 +178,14 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
 
   // 4) read backupinfo from master
   // get binlogPos and filelist, other messages get from "backup_meta" file
+  // the master keeps at most window batches not acked, the acks are
+  // the same as the stop-and-wait mode
+  uint32_t window = _cfg->fullSyncWindow;
   auto ebkInfo = getBackupInfo(client.get(),
                                metaSnapshot,
                                _svr->getParams()->bindIp,
-                               _svr->getParams()->port);
+                               _svr->getParams()->port,
+                               window);
   if (!ebkInfo.ok()) {
     LOG(WARNING) << "storeId:" << metaSnapshot.id
                  << ",syncMaster:" << metaSnapshot.syncFromHost << ":"
@@ -234,6 +243,7 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
     }
     size_t remain = flist.at(s.value());
     size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
+    uint64_t crc = 0;
     while (remain) {
       size_t batchSize = std::min(remain, fileBatch);
       remain -= batchSize;
@@ -245,6 +255,12 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
         return;
       }
       myfile.write(exptData.value().c_str(), exptData.value().size());
+      if (window > 0) {
+        crc = redis_port::crc64(
+          crc,
+          reinterpret_cast<const unsigned char*>(exptData.value().data()),
+          exptData.value().size());
+      }
       if (myfile.bad()) {
         LOG(ERROR) << "write file:" << fullFileName
                    << " failed:" << strerror(errno);
@@ -257,6 +273,21 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
         return;
       }
     }
+    if (window > 0) {
+      Expected<std::string> exptCrc =
+        client->readLine(std::chrono::seconds(100));
+      if (!exptCrc.ok()) {
+        LOG(ERROR) << "fullsync read crc failed:"
+                   << exptCrc.status().toString();
+        return;
+      }
+      if (exptCrc.value() != std::to_string(crc)) {
+        LOG(ERROR) << "fullsync file:" << fullFileName
+                   << " crc mismatch, master:" << exptCrc.value()
+                   << " slave:" << crc;
+        return;
+      }
+    }
     LOG(INFO) << "fullsync file:" << fullFileName << " transfer done";
     finishedFiles.insert(s.value());
   }
@@ -517,6 +548,7 @@ Status ReplManager::applyRepllogV2(Session* sess,
       binlogTs = msSinceEpoch();
     }
   } else {
+    auto start = nsSinceEpoch();
     auto binlog = applySingleTxnV2(sess,
                                    storeId,
                                    logKey,
@@ -530,11 +562,75 @@ Status ReplManager::applyRepllogV2(Session* sess,
       // If it's shutdown, we can get the largest binlogId from rocksdb.
       _syncMeta[storeId]->binlogId = binlog.value().binlogId;
       binlogTs = binlog.value().binlogTs;
+      _syncStatus[storeId]->appliedBinlogs++;
+      _syncStatus[storeId]->applyTimeUs += (nsSinceEpoch() - start) / 1000;
     }
   }
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status ReplManager::applyRepllogsV2(Session* sess,
+                                    uint32_t storeId,
+                                    const std::vector<ReplLogRawV2>& logs) {
+  INVARIANT_D(_binlogApplier != nullptr);
+  [this, storeId]() {
+    std::unique_lock<std::mutex> lk(_mutex);
+    _cv.wait(lk, [this, storeId] { return !_syncStatus[storeId]->isRunning; });
+    _syncStatus[storeId]->isRunning = true;
+  }();
+
+  uint64_t sessionId = sess->id();
+  uint64_t binlogTs = 0;
+  bool idMatch = [this, storeId, sessionId]() {
+    std::unique_lock<std::mutex> lk(_mutex);
+    return (sessionId == _syncStatus[storeId]->sessionId);
+  }();
+  auto guard = MakeGuard([this, storeId, &binlogTs, &idMatch] {
+    std::unique_lock<std::mutex> lk(_mutex);
+    INVARIANT_D(_syncStatus[storeId]->isRunning);
+    _syncStatus[storeId]->isRunning = false;
+    if (idMatch) {
+      _syncStatus[storeId]->lastSyncTime = SCLOCK::now();
+      if (binlogTs > _syncStatus[storeId]->lastBinlogTs) {
+        _syncStatus[storeId]->lastBinlogTs = binlogTs;
+      }
+    }
+  });
+
+  if (!idMatch) {
+    return {ErrorCodes::ERR_NOTFOUND, "sessionId not match"};
+  }
+
+  auto start = nsSinceEpoch();
+  ParallelApplyResult result;
+  Status s =
+    applyTxnsV2Parallel(sess, storeId, logs, _binlogApplier.get(), &result);
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (result.appliedCnt > 0) {
+    // NOTE: only the binlogs applied with all the binlogs before them
+    // are counted, the master resends the rest after reconnected.
+    _syncMeta[storeId]->binlogId = result.applied.binlogId;
+    binlogTs = result.applied.binlogTs;
+    _syncStatus[storeId]->appliedBinlogs += result.appliedCnt;
+    _syncStatus[storeId]->applyTimeUs += (nsSinceEpoch() - start) / 1000;
+  }
+  if (result.hasHole) {
+    // some binlogs after the failed one are committed, and the highest
+    // binlogId of the store has been moved beyond the failed one. The
+    // store can only be recovered by a fullsync.
+    LOG(ERROR) << "store:" << storeId << " apply binlogs failed after "
+               << _syncMeta[storeId]->binlogId << ":" << s.toString()
+               << ", need fullsync";
+    auto newMeta = _syncMeta[storeId]->copy();
+    newMeta->replState = ReplState::REPL_CONNECT;
+    newMeta->binlogId = Transaction::TXNID_UNINITED;
+    changeReplStateInLock(*newMeta, true);
+    _syncStatus[storeId]->sessionId = std::numeric_limits<uint64_t>::max();
+  }
+  return s;
+}
+
 std::ofstream* ReplManager::getCurBinlogFs(uint32_t storeId) {
   std::ofstream* fs = nullptr;
   uint32_t currentId = 0;
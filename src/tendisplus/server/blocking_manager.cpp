@@ -0,0 +1,164 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <utility>
+#include <algorithm>
+#include "glog/logging.h"
+#include "tendisplus/server/blocking_manager.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+BlockingManager::BlockingManager()
+  : _isRunning(false), _timer(nullptr), _seqGen(0), _blockedCount(0) {}
+
+BlockingManager::~BlockingManager() {
+  stop();
+}
+
+void BlockingManager::startup() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_isRunning) {
+    return;
+  }
+  _isRunning = true;
+  _timer = std::make_unique<std::thread>([this] {
+    pthread_setname_np(pthread_self(), "tx-block-timer");
+    timerLoop();
+  });
+}
+
+void BlockingManager::stop() {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (!_isRunning) {
+      return;
+    }
+    _isRunning = false;
+    _waiters.clear();
+    _keyWaiters.clear();
+    _deadlines.clear();
+    _blockedCount.store(0, std::memory_order_relaxed);
+  }
+  _cv.notify_all();
+  _timer->join();
+  _timer.reset();
+}
+
+uint64_t BlockingManager::nextSeq() {
+  return _seqGen.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void BlockingManager::block(uint64_t sessId,
+                            uint64_t seq,
+                            uint32_t dbId,
+                            const std::vector<std::string>& keys,
+                            uint64_t deadline,
+                            WakeFn fn) {
+  bool notify = false;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    INVARIANT_D(_waiters.find(sessId) == _waiters.end());
+    for (const auto& key : keys) {
+      _keyWaiters[std::make_pair(dbId, key)].emplace(seq, sessId);
+    }
+    if (deadline) {
+      // wake the timer if it is the nearest deadline
+      notify = _deadlines.empty() || deadline < _deadlines.begin()->first;
+      _deadlines.emplace(deadline, sessId);
+    }
+    _waiters.emplace(sessId, Waiter{seq, dbId, keys, deadline, std::move(fn)});
+    _blockedCount.store(_waiters.size(), std::memory_order_relaxed);
+  }
+  if (notify) {
+    _cv.notify_one();
+  }
+}
+
+BlockingManager::WakeFn BlockingManager::removeInLock(uint64_t sessId) {
+  auto it = _waiters.find(sessId);
+  if (it == _waiters.end()) {
+    return nullptr;
+  }
+  auto& waiter = it->second;
+  for (const auto& key : waiter.keys) {
+    auto kit = _keyWaiters.find(std::make_pair(waiter.dbId, key));
+    if (kit == _keyWaiters.end()) {
+      continue;
+    }
+    kit->second.erase(waiter.seq);
+    if (kit->second.empty()) {
+      _keyWaiters.erase(kit);
+    }
+  }
+  if (waiter.deadline) {
+    _deadlines.erase(std::make_pair(waiter.deadline, sessId));
+  }
+  WakeFn fn = std::move(waiter.fn);
+  _waiters.erase(it);
+  _blockedCount.store(_waiters.size(), std::memory_order_relaxed);
+  return fn;
+}
+
+bool BlockingManager::unblock(uint64_t sessId) {
+  if (_blockedCount.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  return removeInLock(sessId) != nullptr;
+}
+
+size_t BlockingManager::signalKeyReady(uint32_t dbId,
+                                       const std::string& key,
+                                       size_t n) {
+  if (_blockedCount.load(std::memory_order_relaxed) == 0) {
+    return 0;
+  }
+  size_t woken = 0;
+  auto keyId = std::make_pair(dbId, key);
+  while (woken < n) {
+    WakeFn fn;
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      auto kit = _keyWaiters.find(keyId);
+      if (kit == _keyWaiters.end()) {
+        break;
+      }
+      fn = removeInLock(kit->second.begin()->second);
+    }
+    INVARIANT_D(fn != nullptr);
+    if (fn && fn(WakeReason::READY)) {
+      ++woken;
+    }
+  }
+  return woken;
+}
+
+void BlockingManager::timerLoop() {
+  std::unique_lock<std::mutex> lk(_mutex);
+  while (_isRunning) {
+    if (_deadlines.empty()) {
+      _cv.wait(lk);
+      continue;
+    }
+    uint64_t now = msSinceEpoch();
+    uint64_t deadline = _deadlines.begin()->first;
+    if (deadline > now) {
+      _cv.wait_for(lk, std::chrono::milliseconds(deadline - now));
+      continue;
+    }
+    std::vector<WakeFn> expired;
+    while (!_deadlines.empty() && _deadlines.begin()->first <= now) {
+      expired.emplace_back(removeInLock(_deadlines.begin()->second));
+    }
+    lk.unlock();
+    for (auto& fn : expired) {
+      fn(WakeReason::TIMEOUT);
+    }
+    lk.lock();
+  }
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,101 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_BLOCKING_MANAGER_H_
+#define SRC_TENDISPLUS_SERVER_BLOCKING_MANAGER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <thread>              // NOLINT
+#include <mutex>               // NOLINT
+#include <condition_variable>  // NOLINT
+#include <atomic>
+
+namespace tendisplus {
+
+// BlockingManager keeps the sessions blocked by BLPOP/BRPOP/BRPOPLPUSH.
+// A blocked session holds no executor thread, it waits on one or more
+// keys until a push to one of the keys wakes it up, or it times out.
+//
+// The waiters of a key are woken in the order they were blocked. The
+// pushers call signalKeyReady() after the commit and before the key lock
+// is released, and the waiters are blocked with the key locks held, so
+// no wakeup is lost.
+class BlockingManager {
+ public:
+  enum class WakeReason {
+    READY,
+    TIMEOUT,
+  };
+  // called without the lock of BlockingManager, return false if the
+  // waiter is gone, then the next waiter of the key is woken instead.
+  using WakeFn = std::function<bool(WakeReason)>;
+
+  BlockingManager();
+  BlockingManager(const BlockingManager&) = delete;
+  BlockingManager(BlockingManager&&) = delete;
+  ~BlockingManager();
+  void startup();
+  // the blocked sessions are dropped without being woken
+  void stop();
+
+  // the order of a waiter. A woken waiter which finds the keys empty again
+  // is blocked with its old seq, so it keeps its place in the queues.
+  uint64_t nextSeq();
+  // deadline is in ms since epoch, 0 means waiting forever.
+  // a session can only block once at a time.
+  void block(uint64_t sessId,
+             uint64_t seq,
+             uint32_t dbId,
+             const std::vector<std::string>& keys,
+             uint64_t deadline,
+             WakeFn fn);
+  // remove the waiter without waking it, return false if it is not
+  // blocked or has been woken already.
+  bool unblock(uint64_t sessId);
+  // wake at most n waiters of the key, return the number woken
+  size_t signalKeyReady(uint32_t dbId, const std::string& key, size_t n);
+
+  size_t getBlockedCount() const {
+    return _blockedCount.load(std::memory_order_relaxed);
+  }
+
+ private:
+  using KeyId = std::pair<uint32_t, std::string>;
+  struct Waiter {
+    uint64_t seq;
+    uint32_t dbId;
+    std::vector<std::string> keys;
+    uint64_t deadline;
+    WakeFn fn;
+  };
+
+  // remove the waiter from all the indexes, in lock
+  WakeFn removeInLock(uint64_t sessId);
+  void timerLoop();
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _isRunning;
+  std::unique_ptr<std::thread> _timer;
+  std::atomic<uint64_t> _seqGen;
+  // pushers check it before taking the lock
+  std::atomic<size_t> _blockedCount;
+
+  std::unordered_map<uint64_t, Waiter> _waiters;
+  // seq -> sessId of the waiters of each key
+  std::map<KeyId, std::map<uint64_t, uint64_t>> _keyWaiters;
+  // (deadline, sessId)
+  std::set<std::pair<uint64_t, uint64_t>> _deadlines;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_BLOCKING_MANAGER_H_
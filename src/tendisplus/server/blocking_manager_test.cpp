@@ -0,0 +1,124 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+#include <vector>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+#include "tendisplus/server/blocking_manager.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+using WakeReason = BlockingManager::WakeReason;
+
+class WakeLog {
+ public:
+  BlockingManager::WakeFn fn(uint64_t id, bool alive = true) {
+    return [this, id, alive](WakeReason reason) {
+      if (!alive) {
+        return false;
+      }
+      std::lock_guard<std::mutex> lk(_mutex);
+      _woken.emplace_back(id, reason);
+      return true;
+    };
+  }
+  std::vector<std::pair<uint64_t, WakeReason>> get() {
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _woken;
+  }
+
+ private:
+  std::mutex _mutex;
+  std::vector<std::pair<uint64_t, WakeReason>> _woken;
+};
+
+TEST(BlockingManager, FifoWakeup) {
+  BlockingManager mgr;
+  mgr.startup();
+  WakeLog log;
+
+  uint64_t seq1 = mgr.nextSeq();
+  uint64_t seq2 = mgr.nextSeq();
+  uint64_t seq3 = mgr.nextSeq();
+  mgr.block(2, seq2, 0, {"a"}, 0, log.fn(2));
+  mgr.block(1, seq1, 0, {"a", "b"}, 0, log.fn(1));
+  mgr.block(3, seq3, 0, {"b"}, 0, log.fn(3));
+  EXPECT_EQ(mgr.getBlockedCount(), 3U);
+
+  // other dbs and keys wake nobody
+  EXPECT_EQ(mgr.signalKeyReady(1, "a", 1), 0U);
+  EXPECT_EQ(mgr.signalKeyReady(0, "c", 1), 0U);
+
+  // the earliest one is woken first, and leaves all its keys
+  EXPECT_EQ(mgr.signalKeyReady(0, "b", 1), 1U);
+  EXPECT_EQ(mgr.signalKeyReady(0, "a", 2), 1U);
+  EXPECT_EQ(mgr.signalKeyReady(0, "b", 2), 1U);
+  auto woken = log.get();
+  ASSERT_EQ(woken.size(), 3U);
+  EXPECT_EQ(woken[0].first, 1U);
+  EXPECT_EQ(woken[1].first, 2U);
+  EXPECT_EQ(woken[2].first, 3U);
+  EXPECT_EQ(mgr.getBlockedCount(), 0U);
+
+  // a waiter blocked again with its old seq keeps its place
+  mgr.block(4, mgr.nextSeq(), 0, {"a"}, 0, log.fn(4));
+  mgr.block(1, seq1, 0, {"a"}, 0, log.fn(1));
+  EXPECT_EQ(mgr.signalKeyReady(0, "a", 1), 1U);
+  EXPECT_EQ(log.get().back().first, 1U);
+
+  EXPECT_TRUE(mgr.unblock(4));
+  EXPECT_FALSE(mgr.unblock(4));
+  EXPECT_EQ(mgr.signalKeyReady(0, "a", 1), 0U);
+  mgr.stop();
+}
+
+TEST(BlockingManager, SkipGoneWaiter) {
+  BlockingManager mgr;
+  mgr.startup();
+  WakeLog log;
+
+  mgr.block(1, mgr.nextSeq(), 0, {"a"}, 0, log.fn(1, false));
+  mgr.block(2, mgr.nextSeq(), 0, {"a"}, 0, log.fn(2));
+  EXPECT_EQ(mgr.signalKeyReady(0, "a", 1), 1U);
+  auto woken = log.get();
+  ASSERT_EQ(woken.size(), 1U);
+  EXPECT_EQ(woken[0].first, 2U);
+  EXPECT_EQ(mgr.getBlockedCount(), 0U);
+  mgr.stop();
+}
+
+TEST(BlockingManager, Timeout) {
+  BlockingManager mgr;
+  mgr.startup();
+  WakeLog log;
+
+  uint64_t now = msSinceEpoch();
+  mgr.block(1, mgr.nextSeq(), 0, {"a"}, now + 300, log.fn(1));
+  mgr.block(2, mgr.nextSeq(), 0, {"a"}, now + 100, log.fn(2));
+  mgr.block(3, mgr.nextSeq(), 0, {"a"}, 0, log.fn(3));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto woken = log.get();
+  ASSERT_EQ(woken.size(), 1U);
+  EXPECT_EQ(woken[0].first, 2U);
+  EXPECT_EQ(woken[0].second, WakeReason::TIMEOUT);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  woken = log.get();
+  ASSERT_EQ(woken.size(), 2U);
+  EXPECT_EQ(woken[1].first, 1U);
+  EXPECT_EQ(woken[1].second, WakeReason::TIMEOUT);
+
+  // waiting forever
+  EXPECT_EQ(mgr.getBlockedCount(), 1U);
+  EXPECT_EQ(mgr.signalKeyReady(0, "a", 1), 1U);
+  EXPECT_EQ(log.get().back().second, WakeReason::READY);
+  mgr.stop();
+}
+
+}  // namespace tendisplus
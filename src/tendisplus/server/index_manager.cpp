@@ -4,7 +4,9 @@
 
 #include "tendisplus/server/index_manager.h"
 
+#include <algorithm>
 #include <chrono>  // NOLINT
+#include <limits>
 #include <memory>
 #include <vector>
 #include <utility>
@@ -18,6 +20,7 @@
 #include "tendisplus/utils/portable.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/time.h"
 
 
 namespace tendisplus {
@@ -30,13 +33,25 @@ IndexManager::IndexManager(std::shared_ptr<ServerEntry> svr,
     _deleterMatrix(std::make_shared<PoolMatrix>()),
     _totalDequeue(0),
     _totalEnqueue(0),
+    _expiredCnt(0),
+    _expireLagSum(0),
+    _expireLagMax(0),
     _scanBatch(cfg->scanCntIndexMgr),
     _scanPoolSize(cfg->scanJobCntIndexMgr),
     _delBatch(cfg->delCntIndexMgr),
     _delPoolSize(cfg->delJobCntIndexMgr),
-    _pauseTime(cfg->pauseTimeIndexMgr) {
+    _delRate(cfg->delRateIndexMgr),
+    _pauseTime(cfg->pauseTimeIndexMgr),
+    _wheelEnabled(cfg->expireWheelIndexMgr),
+    _wheelTickMs(std::max(cfg->wheelTickMsIndexMgr, 1u)) {
   for (size_t storeId = 0; storeId < svr->getKVStoreCount(); ++storeId) {
     _scanPoints[storeId] = std::move(std::string());
+    _wheels[storeId] =
+      std::make_unique<TimingWheel<TTLIndex>>(_wheelTickMs, msSinceEpoch());
+    _wheelLoaded[storeId] = {false};
+    _wheelLoading[storeId] = {false};
+    _delQuota[storeId] = 0;
+    _delQuotaMs[storeId] = msSinceEpoch();
     _scanJobStatus[storeId] = {false};
     _delJobStatus[storeId] = {false};
     _disableStatus[storeId] = {false};
@@ -172,10 +187,190 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void IndexManager::addExpire(uint32_t storeId, const TTLIndex& index) {
+  if (!_wheelEnabled ||
+      _disableStatus[storeId].load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  _wheels[storeId]->add(index.getTTL(), index);
+}
+
+Status IndexManager::loadExpireWheelJob(uint32_t storeId) {
+  auto guard = MakeGuard([this, storeId]() {
+    _wheelLoading[storeId].store(false, std::memory_order_release);
+  });
+  if (_disableStatus[storeId].load(std::memory_order_relaxed)) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  LocalSessionGuard sg(_svr.get());
+  auto expd = _svr->getSegmentMgr()->getDb(
+    sg.getSession(), storeId, mgl::LockMode::LOCK_IS, true);
+  if (!expd.ok()) {
+    return expd.status();
+  }
+  PStore store = expd.value().store;
+  if (store->getMode() != KVStore::StoreMode::READ_WRITE || !store->isOpen()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  auto ptxn = store->createTransaction(sg.getSession());
+  if (!ptxn.ok()) {
+    return ptxn.status();
+  }
+  std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+  // all the ttl indexes, the expired ones are due at once. The ones written
+  // meanwhile are added by addExpire() too, the duplicates only cost a
+  // lookup when they are due.
+  auto cursor =
+    txn->createTTLIndexCursor(std::numeric_limits<uint64_t>::max());
+  uint64_t loaded = 0;
+  std::vector<TTLIndex> batch;
+  auto flush = [this, storeId, &batch, &loaded]() {
+    std::lock_guard<std::mutex> lk(_mutex);
+    for (auto& index : batch) {
+      uint64_t ttl = index.getTTL();
+      _wheels[storeId]->add(ttl, std::move(index));
+    }
+    loaded += batch.size();
+    batch.clear();
+  };
+  while (true) {
+    auto record = cursor->next();
+    if (record.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!record.ok()) {
+      return record.status();
+    }
+    batch.emplace_back(std::move(record.value()));
+    if (batch.size() >= _scanBatch) {
+      flush();
+    }
+  }
+  flush();
+  _wheelLoaded[storeId].store(true, std::memory_order_release);
+  LOG(INFO) << "expire wheel of store " << storeId << " loaded " << loaded
+            << " ttl indexes";
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void IndexManager::advanceExpireWheels() {
+  bool migrating = _svr->getParams()->clusterEnabled &&
+    _svr->getMigrateManager()->existMigrateTask();
+  const auto& stores = _svr->getStores();
+  uint64_t now = msSinceEpoch();
+  for (uint32_t i = 0; i < _svr->getKVStoreCount(); ++i) {
+    if (_disableStatus[i].load(std::memory_order_relaxed)) {
+      continue;
+    }
+    const PStore& store = stores[i];
+    if (!store->isOpen() ||
+        store->getMode() != KVStore::StoreMode::READ_WRITE) {
+      // the binlogs applied on a slave are not added, so it is loaded
+      // again when it turns to master
+      if (_wheelLoaded[i].exchange(false)) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _wheels[i]->clear();
+      }
+      continue;
+    }
+    if (!_wheelLoaded[i].load(std::memory_order_acquire) &&
+        !_wheelLoading[i].exchange(true)) {
+      _indexScanner->schedule([this, i]() { loadExpireWheelJob(i); });
+    }
+    if (migrating) {
+      continue;
+    }
+
+    std::list<std::pair<uint64_t, TTLIndex>> due;
+    std::lock_guard<std::mutex> lk(_mutex);
+    // at most _scanBatch keys wait for the deleters, like the scanner
+    size_t pending = _expiredKeys[i].size();
+    if (pending >= _scanBatch) {
+      continue;
+    }
+    _totalEnqueue += _wheels[i]->advance(now, &due, _scanBatch - pending);
+    for (auto& entry : due) {
+      _expiredKeys[i].push_back(std::move(entry.second));
+    }
+  }
+}
+
+void IndexManager::recordExpireLag(uint64_t lag) {
+  _expiredCnt.fetch_add(1, std::memory_order_relaxed);
+  _expireLagSum.fetch_add(lag, std::memory_order_relaxed);
+  uint64_t max = _expireLagMax.load(std::memory_order_relaxed);
+  while (lag > max && !_expireLagMax.compare_exchange_weak(max, lag)) {
+  }
+}
+
+uint32_t IndexManager::takeDelQuota(uint32_t storeId) {
+  if (_delRate == 0) {
+    return _delBatch;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  uint64_t now = msSinceEpoch();
+  uint64_t refill = (now - std::min(now, _delQuotaMs[storeId])) * _delRate /
+    1000;
+  if (refill > 0) {
+    // a second of quota at most, not to burst after an idle time
+    _delQuota[storeId] = std::min(_delQuota[storeId] + refill,
+                                  static_cast<uint64_t>(_delRate));
+    _delQuotaMs[storeId] = now;
+  }
+  uint32_t quota = std::min(_delQuota[storeId],
+                            static_cast<uint64_t>(_delBatch));
+  _delQuota[storeId] -= quota;
+  return quota;
+}
+
+void IndexManager::returnDelQuota(uint32_t storeId, uint32_t quota) {
+  if (_delRate == 0 || quota == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  _delQuota[storeId] += quota;
+}
+
+void IndexManager::getStatInfo(std::stringstream& ss) {
+  uint64_t now = msSinceEpoch();
+  uint64_t pending = 0;
+  uint64_t pendingLag = 0;
+  uint64_t wheelKeys = 0;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    for (const auto& keys : _expiredKeys) {
+      pending += keys.second.size();
+      if (!keys.second.empty() && now > keys.second.front().getTTL()) {
+        pendingLag = std::max(pendingLag, now - keys.second.front().getTTL());
+      }
+    }
+    for (const auto& wheel : _wheels) {
+      wheelKeys += wheel.second->size();
+    }
+  }
+  uint64_t expired = _expiredCnt.load(std::memory_order_relaxed);
+  ss << "expired_keys:" << expired << "\r\n";
+  ss << "expire_lag_avg_ms:"
+     << (expired ? _expireLagSum.load(std::memory_order_relaxed) / expired : 0)
+     << "\r\n";
+  ss << "expire_lag_max_ms:" << _expireLagMax.load(std::memory_order_relaxed)
+     << "\r\n";
+  ss << "expire_pending_keys:" << pending << "\r\n";
+  ss << "expire_pending_lag_ms:" << pendingLag << "\r\n";
+  if (_wheelEnabled) {
+    ss << "expire_wheel_keys:" << wheelKeys << "\r\n";
+  }
+}
+
 Status IndexManager::stopStore(uint32_t storeId) {
   std::lock_guard<std::mutex> lk(_mutex);
 
   _expiredKeys[storeId].clear();
+  _wheels[storeId]->clear();
+  _wheelLoaded[storeId].store(false, std::memory_order_relaxed);
 
   _scanPoints[storeId] = std::move(std::string());
   _scanJobCnt[storeId] = {0u};
@@ -196,6 +391,12 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
     return 0;
   }
 
+  uint32_t quota = takeDelQuota(storeId);
+  if (quota == 0) {
+    _delJobStatus[storeId].store(false, std::memory_order_release);
+    return 0;
+  }
+
   _delJobCnt[storeId]++;
   uint32_t deletes = 0;
 
@@ -213,8 +414,12 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
     auto sess = sg.getSession();
     sess->getCtx()->setAuthed();
     sess->getCtx()->setDbId(index.getDbId());
-    Command::expireKeyIfNeeded(
+    auto expired = Command::expireKeyIfNeeded(
       sg.getSession(), index.getPriKey(), index.getType());
+    if (expired.status().code() == ErrorCodes::ERR_EXPIRED) {
+      uint64_t now = msSinceEpoch();
+      recordExpireLag(now > index.getTTL() ? now - index.getTTL() : 0);
+    }
 
     {
       std::lock_guard<std::mutex> lk(_mutex);
@@ -225,7 +430,7 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
     }
 
     // break if delete a number of keys in the current store
-    if (deletes == _delBatch) {
+    if (deletes == quota) {
       break;
     }
 
@@ -233,6 +438,7 @@ int IndexManager::tryDelExpiredKeysJob(uint32_t storeId) {
     TEST_SYNC_POINT_CALLBACK("InspectDelJobCnt", &_delJobCnt[storeId]);
   }
 
+  returnDelQuota(storeId, quota - deletes);
   _delJobCnt[storeId]--;
   _delJobStatus[storeId].store(false, std::memory_order_release);
   return deletes;
@@ -269,9 +475,15 @@ Status IndexManager::run() {
 
   TEST_SYNC_POINT_CALLBACK("BeforeIndexManagerLoop", &_isRunning);
   while (_isRunning.load(std::memory_order_relaxed)) {
-    scheScanExpired();
-    schedDelExpired();
-    std::this_thread::sleep_for(std::chrono::seconds(_pauseTime));
+    if (_wheelEnabled) {
+      advanceExpireWheels();
+      schedDelExpired();
+      std::this_thread::sleep_for(std::chrono::milliseconds(_wheelTickMs));
+    } else {
+      scheScanExpired();
+      schedDelExpired();
+      std::this_thread::sleep_for(std::chrono::seconds(_pauseTime));
+    }
   }
 
   LOG(WARNING) << "index manager exiting...";
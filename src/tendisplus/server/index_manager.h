@@ -12,6 +12,7 @@
 #include <memory>
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/network/worker_pool.h"
+#include "tendisplus/utils/timing_wheel.h"
 
 namespace tendisplus {
 
@@ -29,12 +30,34 @@ class IndexManager {
   int tryDelExpiredKeysJob(uint32_t storeId);
   bool isRunning();
   Status stopStore(uint32_t storeId);
+  // add the ttl index written to the expire wheel of the store, after the
+  // txn committed. It does nothing if the wheel is disabled.
+  void addExpire(uint32_t storeId, const TTLIndex& index);
+  // rebuild the expire wheel of the store from its ttl index
+  Status loadExpireWheelJob(uint32_t storeId);
+  void getStatInfo(std::stringstream& ss);
 
  private:
+  // move the ttl indexes expired in the wheels to _expiredKeys
+  void advanceExpireWheels();
+  void recordExpireLag(uint64_t lag);
+  // the deletes the store may do now, at most _delBatch. A deleter never
+  // waits for the quota, the keys left are deleted at a later round.
+  uint32_t takeDelQuota(uint32_t storeId);
+  void returnDelQuota(uint32_t storeId, uint32_t quota);
+
   std::unique_ptr<WorkerPool> _indexScanner;
   std::unique_ptr<WorkerPool> _keyDeleter;
   std::unordered_map<std::size_t, std::list<TTLIndex>> _expiredKeys;
   std::unordered_map<std::size_t, std::string> _scanPoints;
+  std::unordered_map<std::size_t, std::unique_ptr<TimingWheel<TTLIndex>>>
+    _wheels;
+  // the wheel holds all the ttl indexes of the store since it is master
+  JobStatus _wheelLoaded;
+  JobStatus _wheelLoading;
+  // refilled by _delRate per second, guarded by _mutex
+  std::unordered_map<std::size_t, uint64_t> _delQuota;
+  std::unordered_map<std::size_t, uint64_t> _delQuotaMs;
   JobStatus _scanJobStatus;
   JobStatus _delJobStatus;
   // when destroystore, _disableStatus[storeId] = true
@@ -52,12 +75,18 @@ class IndexManager {
 
   uint64_t _totalDequeue;
   uint64_t _totalEnqueue;
+  std::atomic<uint64_t> _expiredCnt;
+  std::atomic<uint64_t> _expireLagSum;
+  std::atomic<uint64_t> _expireLagMax;
 
   uint32_t _scanBatch;
   uint32_t _scanPoolSize;
   uint32_t _delBatch;
   uint32_t _delPoolSize;
+  uint32_t _delRate;
   uint32_t _pauseTime;
+  bool _wheelEnabled;
+  uint32_t _wheelTickMs;
 };
 
 }  // namespace tendisplus
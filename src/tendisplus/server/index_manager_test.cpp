@@ -305,4 +305,44 @@ TEST(IndexManager, singleJobRunning) {
   SyncPoint::GetInstance()->DisableProcessing();
   SyncPoint::GetInstance()->ClearAllCallBacks();
 }
+
+TEST(IndexManager, expireWheel) {
+  uint64_t totalDequeue = 0;
+  uint64_t totalEnqueue = 0;
+
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->LoadDependency({});
+
+  auto cfg = makeServerParam();
+  cfg->expireWheelIndexMgr = true;
+  cfg->wheelTickMsIndexMgr = 10;
+  cfg->delRateIndexMgr = 10000;
+
+  auto server = std::make_shared<ServerEntry>(cfg);
+  testScanIndex(server, cfg, 1024, 2, false, &totalEnqueue, &totalDequeue);
+
+  // the keys are deleted once, even if a ttl index is due twice
+  std::string expired = "expired_keys:" + std::to_string(1024 * 4) + "\r\n";
+  std::string stat;
+  for (uint32_t i = 0; i < 50 && stat.find(expired) == std::string::npos;
+       ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::stringstream ss;
+    server->getIndexMgr()->getStatInfo(ss);
+    stat = ss.str();
+  }
+  EXPECT_NE(stat.find(expired), std::string::npos) << stat;
+  EXPECT_NE(stat.find("expire_wheel_keys:0\r\n"), std::string::npos) << stat;
+  EXPECT_GE(totalEnqueue, 1024 * 4u);
+
+  server->stop();
+  ASSERT_EQ(server.use_count(), 1);
+
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+}
 }  // namespace tendisplus
@@ -3,7 +3,10 @@
 // project for additional information.
 
 #include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 #include <utility>
+#include <vector>
 #include <thread>  // NOLINT
 
 #include "gtest/gtest.h"
@@ -14,6 +17,8 @@
 #include "tendisplus/server/segment_manager.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/network/network.h"
+#include "tendisplus/network/worker_pool.h"
+#include "tendisplus/replication/repl_util.h"
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/sync_point.h"
@@ -1007,4 +1012,149 @@ TEST(Repl, BinlogVersion) {
   ASSERT_EQ(version2_slave2.use_count(), 1);
 }
 
+TEST(Repl, RunByDependency) {
+  auto pool =
+    std::make_unique<WorkerPool>("test-dep", std::make_shared<PoolMatrix>());
+  ASSERT_TRUE(pool->startup(4).ok());
+
+  // 3 is a barrier, 0/2/5 and 1/4 share keys
+  std::vector<std::vector<std::string>> keys = {
+    {"a"}, {"b"}, {"a", "c"}, {}, {"b"}, {"c"}, {"d"}};
+  std::mutex mutex;
+  std::vector<size_t> order;
+  auto fn = [&mutex, &order](size_t i) -> Status {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20 * (7 - i)));
+    std::lock_guard<std::mutex> lk(mutex);
+    order.push_back(i);
+    return {ErrorCodes::ERR_OK, ""};
+  };
+  std::vector<bool> done;
+  ASSERT_TRUE(runByDependency(pool.get(), keys, fn, &done).ok());
+  ASSERT_EQ(order.size(), keys.size());
+  std::vector<size_t> pos(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    pos[order[i]] = i;
+    EXPECT_TRUE(done[i]);
+  }
+  EXPECT_LT(pos[0], pos[2]);
+  EXPECT_LT(pos[1], pos[4]);
+  EXPECT_LT(pos[2], pos[5]);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (i < 3) {
+      EXPECT_LT(pos[i], pos[3]);
+    } else if (i > 3) {
+      EXPECT_GT(pos[i], pos[3]);
+    }
+  }
+  // no dependency between 0 and 1, the slower one finishes later
+  EXPECT_LT(pos[1], pos[0]);
+
+  // nothing depending on a failed one is run
+  order.clear();
+  auto failFn = [&mutex, &order](size_t i) -> Status {
+    if (i == 1) {
+      return {ErrorCodes::ERR_INTERNAL, "failed"};
+    }
+    std::lock_guard<std::mutex> lk(mutex);
+    order.push_back(i);
+    return {ErrorCodes::ERR_OK, ""};
+  };
+  auto s = runByDependency(pool.get(), keys, failFn, &done);
+  EXPECT_EQ(s.code(), ErrorCodes::ERR_INTERNAL);
+  EXPECT_FALSE(done[1]);
+  for (size_t i = 3; i < keys.size(); ++i) {
+    EXPECT_FALSE(done[i]);
+  }
+  for (auto i : order) {
+    EXPECT_TRUE(i == 0 || i == 2);
+  }
+  pool->stop();
+}
+
+TEST(Repl, ParallelApply) {
+  const auto guard = MakeGuard([] {
+    destroyEnv(master_dir);
+    destroyEnv(slave_dir);
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+  });
+  uint32_t storeCnt = 2;
+  EXPECT_TRUE(setupEnv(master_dir));
+  EXPECT_TRUE(setupEnv(slave_dir));
+  auto cfg1 = makeServerParam(master_port, storeCnt, master_dir, false);
+  auto cfg2 = makeServerParam(slave_port, storeCnt, slave_dir, false);
+  cfg2->binlogApplyThreadnum = 4;
+
+  auto master = std::make_shared<ServerEntry>(cfg1);
+  auto s = master->startup(cfg1);
+  INVARIANT(s.ok());
+  auto slave = std::make_shared<ServerEntry>(cfg2);
+  s = slave->startup(cfg2);
+  INVARIANT(s.ok());
+  EXPECT_TRUE(slave->getReplManager()->isParallelApplyEnabled());
+  {
+    auto ctx = std::make_shared<asio::io_context>();
+    auto session = makeSession(slave, ctx);
+    WorkLoad work(slave, session);
+    work.init();
+    work.slaveof("127.0.0.1", master_port);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(5));
+
+  // written after the fullsync, applied by incrsync
+  initData(master, recordSize);
+  waitSlaveCatchup(master, slave);
+  compareData(master, slave);
+
+  std::stringstream ss;
+  slave->getReplManager()->getReplInfo(ss);
+  EXPECT_NE(ss.str().find("applied_binlogs="), std::string::npos);
+
+  master->stop();
+  ASSERT_EQ(master.use_count(), 1);
+  slave->stop();
+  ASSERT_EQ(slave.use_count(), 1);
+}
+
+TEST(Repl, StreamingFullSync) {
+  const auto guard = MakeGuard([] {
+    destroyEnv(master_dir);
+    destroyEnv(slave_dir);
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+  });
+  uint32_t storeCnt = 2;
+  EXPECT_TRUE(setupEnv(master_dir));
+  EXPECT_TRUE(setupEnv(slave_dir));
+  auto cfg1 = makeServerParam(master_port, storeCnt, master_dir, false);
+  auto cfg2 = makeServerParam(slave_port, storeCnt, slave_dir, false);
+  // small batches to keep the window full
+  cfg1->binlogRateLimitMB = 1;
+  cfg2->binlogRateLimitMB = 1;
+  cfg2->fullSyncWindow = 8;
+
+  auto master = std::make_shared<ServerEntry>(cfg1);
+  auto s = master->startup(cfg1);
+  INVARIANT(s.ok());
+  // written before the fullsync, transferred by the checkpoint
+  initData(master, recordSize);
+
+  auto slave = std::make_shared<ServerEntry>(cfg2);
+  s = slave->startup(cfg2);
+  INVARIANT(s.ok());
+  {
+    auto ctx = std::make_shared<asio::io_context>();
+    auto session = makeSession(slave, ctx);
+    WorkLoad work(slave, session);
+    work.init();
+    work.slaveof("127.0.0.1", master_port);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(10));
+  waitSlaveCatchup(master, slave);
+  compareData(master, slave);
+
+  master->stop();
+  ASSERT_EQ(master.use_count(), 1);
+  slave->stop();
+  ASSERT_EQ(slave.use_count(), 1);
+}
+
 }  // namespace tendisplus
@@ -218,6 +218,7 @@ ServerEntry::ServerEntry()
     _mgLockMgr(nullptr),
     _clusterMgr(nullptr),
     _gcMgr(nullptr),
+    _blockingMgr(nullptr),
     _catalog(nullptr),
     _netMatrix(std::make_shared<NetworkMatrix>()),
     _poolMatrix(std::make_shared<PoolMatrix>()),
@@ -661,6 +662,9 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
     }
   }
 
+  _blockingMgr = std::make_unique<BlockingManager>();
+  _blockingMgr->startup();
+
   // listener should be the lastone to run.
   s = _network->run();
   if (!s.ok()) {
@@ -702,6 +706,12 @@ MigrateManager* ServerEntry::getMigrateManager() {
   return _migrateMgr.get();
 }
 
+uint32_t ServerEntry::getStoreExecutor(const std::string& key) const {
+  uint32_t chunkId = redis_port::keyHashSlot(key.c_str(), key.size()) %
+    _segmentMgr->getChunkSize();
+  return _segmentMgr->getStoreid(chunkId) % _executorList.size();
+}
+
 SegmentMgr* ServerEntry::getSegmentMgr() const {
   return _segmentMgr.get();
 }
@@ -726,6 +736,10 @@ GCManager* ServerEntry::getGcMgr() {
   return _gcMgr.get();
 }
 
+BlockingManager* ServerEntry::getBlockingMgr() {
+  return _blockingMgr.get();
+}
+
 std::string ServerEntry::requirepass() const {
   std::lock_guard<std::mutex> lk(_mutex);
   return _requirepass;
@@ -824,6 +838,9 @@ void ServerEntry::endSession(uint64_t connId) {
   if (pCtx->getIsMonitor()) {
     DelMonitorNoLock(connId);
   }
+  if (_blockingMgr) {
+    _blockingMgr->unblock(connId);
+  }
 #ifdef TENDIS_DEBUG
   if (it->second->getType() != Session::Type::LOCAL) {
     DLOG(INFO) << "ServerEntry endSession id:" << connId
@@ -986,6 +1003,8 @@ bool ServerEntry::processRequest(Session* sess) {
 
   auto expCmd = Command::precheck(sess);
   if (!expCmd.ok()) {
+    // the command yielded can't run again
+    sess->getCtx()->takeParkedLock();
     auto s =
       sess->setResponse(redis_port::errorReply(expCmd.status().toString()));
     if (!s.ok()) {
@@ -1004,9 +1023,18 @@ bool ServerEntry::processRequest(Session* sess) {
       NetSession* ns = dynamic_cast<NetSession*>(sess);
       INVARIANT(ns != nullptr);
       std::vector<std::string> args = ns->getArgs();
-      // we have called precheck, it should have 4 args
-      INVARIANT(args.size() == 4);
-      _replMgr->supplyFullSync(ns->borrowConn(), args[1], args[2], args[3]);
+      // we have called precheck, it should have 4 or 5 args, the 5th is
+      // the window of the streaming mode
+      if (args.size() > 5) {
+        auto s = sess->setResponse(redis_port::errorReply(
+          "wrong number of arguments for 'fullsync' command"));
+        return s.ok();
+      }
+      _replMgr->supplyFullSync(ns->borrowConn(),
+                               args[1],
+                               args[2],
+                               args[3],
+                               args.size() == 5 ? args[4] : "0");
       ++_serverStat.syncFull;
       return false;
     } else if (expCmdName == "incrsync") {
@@ -1031,10 +1059,14 @@ bool ServerEntry::processRequest(Session* sess) {
       NetSession* ns = dynamic_cast<NetSession*>(sess);
       INVARIANT(ns != nullptr);
       std::vector<std::string> args = ns->getArgs();
-      // we have called precheck, it should have 2 args
-      // INVARIANT(args.size() == 4);
-      _migrateMgr->dstReadyMigrate(
-        ns->borrowConn(), args[1], args[2], args[3], args[4]);
+      // we have called precheck, it should have 5 or 6 args
+      INVARIANT(args.size() >= 5);
+      _migrateMgr->dstReadyMigrate(ns->borrowConn(),
+                                   args[1],
+                                   args[2],
+                                   args[3],
+                                   args[4],
+                                   args.size() > 5 ? args[5] : "");
       return false;
     } else if (expCmdName == "preparemigrate") {
       LOG(INFO) << "prepare migrate command";
@@ -1061,17 +1093,42 @@ bool ServerEntry::processRequest(Session* sess) {
     }
   }
 
-  auto expect = Command::runSessionCmd(sess);
+  RespWriter writer;
+  // only a net session of a single command can be run again, and only a
+  // command of one key, as the one locking more keys would give up the
+  // lock parked when it asks for another, and go to the tail of the queue
+  // at each run.
+  auto cmd = expCmd.value();
+  sess->getCtx()->setLockYieldable(
+    _cfg->lockWaitYield && sess->getType() == Session::Type::NET &&
+    !sess->getCtx()->isInMulti() && cmd->getName() != "exec" &&
+    cmd->firstkey() > 0 && cmd->firstkey() == cmd->lastkey());
+  auto expect = Command::runSessionCmd(sess, &writer);
+  sess->getCtx()->setLockYieldable(false);
+  if (sess->getCtx()->hasParkedLock()) {
+    if (expect.code() == ErrorCodes::ERR_LOCK_YIELD) {
+      // it is run again when the lock is granted
+      return true;
+    }
+    // the lock of the last run is not taken by this one, and the session
+    // must not be woken up again for it
+    sess->getCtx()->takeParkedLock();
+    sess->cancelYield();
+  }
   if (!expect.ok()) {
-    auto s = sess->setResponse(Command::fmtErr(expect.status().toString()));
+    auto s = sess->setResponse(Command::fmtErr(expect.toString()));
     if (!s.ok()) {
       return false;
     }
     DLOG(ERROR) << "Command::runSessionCmd failed, cmd:" << sess->getCmdStr()
-                << " err:" << expect.status().toString();
+                << " err:" << expect.toString();
+    return true;
+  }
+  if (sess->isBlocked()) {
+    // it replies when it is woken up
     return true;
   }
-  auto s = sess->setResponse(expect.value());
+  auto s = sess->setResponseChunks(std::move(writer));
   if (!s.ok()) {
     return false;
   }
@@ -1118,6 +1175,18 @@ void ServerEntry::getStatInfo(std::stringstream& ss) const {
 
   ss << "total_stricky_packets:" << _netMatrix->stickyPackets.get() << "\r\n";
   ss << "total_invalid_packets:" << _netMatrix->invalidPackets.get() << "\r\n";
+  ss << "total_pipeline_batches:" << _netMatrix->pipelineBatches.get()
+     << "\r\n";
+  ss << "total_lock_yields:" << _netMatrix->lockYields.get() << "\r\n";
+  ss << "total_executor_switches:" << _netMatrix->executorSwitches.get()
+     << "\r\n";
+  ss << "pipeline_depth_histogram:";
+  for (size_t i = 0; i < NetworkMatrix::PIPELINE_DEPTH_BUCKETS; i++) {
+    ss << (i ? "," : "") << "le"
+       << NetworkMatrix::pipelineDepthBucketBound(i) << "="
+       << _netMatrix->pipelineDepth[i].get();
+  }
+  ss << "\r\n";
 
   ss << "total_net_input_bytes:" << _serverStat.netInputBytes.get() << "\r\n";
   ss << "total_net_output_bytes:" << _serverStat.netOutputBytes.get() << "\r\n";
@@ -1139,6 +1208,29 @@ void ServerEntry::getStatInfo(std::stringstream& ss) const {
   ss << "keyspace_misses:" << _serverStat.keyspaceMisses.get() << "\r\n";
   ss << "keyspace_wrong_versionep:" << _serverStat.keyspaceIncorrectEp.get()
      << "\r\n";
+  ValueCacheStat cacheSum = {0, 0, 0, 0, 0, 0, 0};
+  bool cacheEnabled = false;
+  for (const auto& store : _kvstores) {
+    ValueCacheStat cacheStat;
+    if (store->getValueCacheStat(&cacheStat)) {
+      cacheEnabled = true;
+      cacheSum.hits += cacheStat.hits;
+      cacheSum.misses += cacheStat.misses;
+      cacheSum.evicts += cacheStat.evicts;
+      cacheSum.entries += cacheStat.entries;
+      cacheSum.usage += cacheStat.usage;
+    }
+  }
+  if (cacheEnabled) {
+    ss << "value_cache_hits:" << cacheSum.hits << "\r\n";
+    ss << "value_cache_misses:" << cacheSum.misses << "\r\n";
+    ss << "value_cache_evicts:" << cacheSum.evicts << "\r\n";
+    ss << "value_cache_keys:" << cacheSum.entries << "\r\n";
+    ss << "value_cache_used_memory:" << cacheSum.usage << "\r\n";
+  }
+  if (_indexMgr) {
+    _indexMgr->getStatInfo(ss);
+  }
   ss << "scheduleNum:" << _scheduleNum << "\r\n";
 }
 
@@ -1156,6 +1248,20 @@ void ServerEntry::appendJSONStat(
     w.Uint64(_netMatrix->connReleased.get());
     w.Key("invalid_packets");
     w.Uint64(_netMatrix->invalidPackets.get());
+    w.Key("pipeline_batches");
+    w.Uint64(_netMatrix->pipelineBatches.get());
+    w.Key("lock_yields");
+    w.Uint64(_netMatrix->lockYields.get());
+    w.Key("executor_switches");
+    w.Uint64(_netMatrix->executorSwitches.get());
+    w.Key("pipeline_depth");
+    w.StartObject();
+    for (size_t i = 0; i < NetworkMatrix::PIPELINE_DEPTH_BUCKETS; i++) {
+      w.Key(("le" + std::to_string(NetworkMatrix::pipelineDepthBucketBound(i)))
+              .c_str());
+      w.Uint64(_netMatrix->pipelineDepth[i].get());
+    }
+    w.EndObject();
     w.EndObject();
   }
   if (sections.find("request") != sections.end()) {
@@ -1467,6 +1573,9 @@ void ServerEntry::stop() {
     _migrateMgr->stop();
   if (_indexMgr)
     _indexMgr->stop();
+  if (_blockingMgr) {
+    _blockingMgr->stop();
+  }
   {
     std::lock_guard<std::mutex> lk(_mutex);
     _sessions.clear();
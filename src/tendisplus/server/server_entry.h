@@ -28,6 +28,7 @@
 #include "tendisplus/lock/mgl/mgl_mgr.h"
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/cluster/gc_manager.h"
+#include "tendisplus/server/blocking_manager.h"
 
 #define SLOWLOG_ENTRY_MAX_ARGC 32;
 #define SLOWLOG_ENTRY_MAX_STRING 128;
@@ -148,6 +149,8 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
     }
     _executorList[ctxId]->schedule(std::forward<fn>(task));
   }
+  // the work pool owning the store of the key, see executorStoreAffinity
+  uint32_t getStoreExecutor(const std::string& key) const;
   std::shared_ptr<ServerParams>& getParams() {
     return _cfg;
   }
@@ -191,6 +194,7 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   IndexManager* getIndexMgr();
   ClusterManager* getClusterMgr();
   GCManager* getGcMgr();
+  BlockingManager* getBlockingMgr();
 
   // TODO(takenliu) : args exist at two places, has better way?
   std::string requirepass() const;
@@ -322,6 +326,7 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   std::unique_ptr<mgl::MGLockMgr> _mgLockMgr;
   std::unique_ptr<ClusterManager> _clusterMgr;
   std::unique_ptr<GCManager> _gcMgr;
+  std::unique_ptr<BlockingManager> _blockingMgr;
 
   std::vector<PStore> _kvstores;
   std::unique_ptr<Catalog> _catalog;
@@ -301,6 +301,9 @@ ServerParams::ServerParams() {
   REGISTER_VARS(delCntIndexMgr);
   REGISTER_VARS(delJobCntIndexMgr);
   REGISTER_VARS(pauseTimeIndexMgr);
+  REGISTER_VARS(expireWheelIndexMgr);
+  REGISTER_VARS(wheelTickMsIndexMgr);
+  REGISTER_VARS(delRateIndexMgr);
 
   REGISTER_VARS_DIFF_NAME("proto-max-bulk-len", protoMaxBulkLen);
   REGISTER_VARS_DIFF_NAME("databases", dbNum);
@@ -319,6 +322,7 @@ ServerParams::ServerParams() {
   REGISTER_VARS_DIFF_NAME_DYNAMIC("slowlog-flush-interval",
                                   slowlogFlushInterval);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("slowlog-file-enabled", slowlogFileEnabled);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("latency-tracking", latencyTracking);
 
   // NOTE(pecochen): this two params should provide their own interface to
   // update.
@@ -329,6 +333,8 @@ ServerParams::ServerParams() {
     executorThreadNum, executorThreadNumCheck, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(
     executorWorkPoolSize, nullptr, nullptr, 1, 200, false);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("executor-store-affinity",
+                                  executorStoreAffinity);
 
   REGISTER_VARS(binlogRateLimitMB);
   REGISTER_VARS(netBatchSize);
@@ -337,7 +343,10 @@ ServerParams::ServerParams() {
   REGISTER_VARS_SAME_NAME(incrPushThreadnum, nullptr, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(fullPushThreadnum, nullptr, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(fullReceiveThreadnum, nullptr, nullptr, 1, 200, true);
+  REGISTER_VARS_SAME_NAME(fullSyncWindow, nullptr, nullptr, 0, 1024, true);
   REGISTER_VARS_SAME_NAME(logRecycleThreadnum, nullptr, nullptr, 1, 200, true);
+  REGISTER_VARS_SAME_NAME(
+    binlogApplyThreadnum, nullptr, nullptr, 0, 200, false);
   REGISTER_VARS_FULL("truncateBinlogIntervalMs", truncateBinlogIntervalMs,
     NULL, NULL, 10, 5000, true)
   REGISTER_VARS_ALLOW_DYNAMIC_SET(truncateBinlogNum);
@@ -347,10 +356,31 @@ ServerParams::ServerParams() {
 
   REGISTER_VARS_ALLOW_DYNAMIC_SET(keysDefaultLimit);
   REGISTER_VARS_ALLOW_DYNAMIC_SET(lockWaitTimeOut);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("lock-wait-yield", lockWaitYield);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("hash-max-packed-entries",
+                                  hashMaxPackedEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("hash-max-packed-value", hashMaxPackedValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("set-max-packed-entries",
+                                  setMaxPackedEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("set-max-packed-value", setMaxPackedValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-max-packed-entries",
+                                  zsetMaxPackedEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-max-packed-value", zsetMaxPackedValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("list-max-segment-entries",
+                                  listMaxSegmentEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("list-max-segment-bytes",
+                                  listMaxSegmentBytes);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-score-block-entries",
+                                  zsetScoreBlockEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("bigkey-delete-range-threshold",
+                                  bigKeyDelRangeThreshold);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-expired-subkeys",
+                                  compactExpiredSubKeys);
 
   REGISTER_VARS_DIFF_NAME("rocks.blockcachemb", rocksBlockcacheMB);
   REGISTER_VARS_DIFF_NAME("rocks.blockcache_strict_capacity_limit",
                           rocksStrictCapacityLimit);
+  REGISTER_VARS_DIFF_NAME("kvstore-value-cache-mb", kvstoreValueCacheMB);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("rocks.disable_wal", rocksDisableWAL);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("rocks.flush_log_at_trx_commit",
                                   rocksFlushLogAtTrxCommit);
@@ -365,6 +395,7 @@ ServerParams::ServerParams() {
                      false);
   REGISTER_VARS_DIFF_NAME("rocks.level0_compress_enabled", level0Compress);
   REGISTER_VARS_DIFF_NAME("rocks.level1_compress_enabled", level1Compress);
+  REGISTER_VARS_DIFF_NAME("rocks.prefix_bloom_enabled", rocksPrefixBloom);
 
   REGISTER_VARS_SAME_NAME(
     migrateSenderThreadnum, nullptr, nullptr, 1, 200, true);
@@ -394,6 +425,18 @@ ServerParams::ServerParams() {
                                   migrateTaskSlotsLimit);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-rate-limit",
                                   migrateRateLimitMB);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-by-sst", migrateBySst);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-batch-frame",
+                                  migrateBatchFrame);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-frame-compress",
+                                  migrateFrameCompress);
+  REGISTER_VARS_FULL("cluster-migration-frame-window",
+                     migrateFrameWindow,
+                     nullptr,
+                     nullptr,
+                     1,
+                     1024,
+                     true);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("migrate-snapshot-retry-num",
                                   snapShotRetryCnt);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("binlog-send-batch", bingLogSendBatch);
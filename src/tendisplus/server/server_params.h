@@ -374,6 +374,13 @@ class ServerParams {
   uint32_t delCntIndexMgr = 10000;
   uint32_t delJobCntIndexMgr = 1;
   uint32_t pauseTimeIndexMgr = 10;
+  // expire the keys by an in-memory timing wheel of each store, fed by the
+  // writes setting ttl and rebuilt from the ttl index, instead of scanning
+  // the ttl index every pauseTimeIndexMgr seconds
+  bool expireWheelIndexMgr = false;
+  uint32_t wheelTickMsIndexMgr = 100;
+  // the expired keys deleted per second of each store, 0 for no limit
+  uint32_t delRateIndexMgr = 0;
 
   uint32_t protoMaxBulkLen = CONFIG_DEFAULT_PROTO_MAX_BULK_LEN;
   uint32_t dbNum = CONFIG_DEFAULT_DBNUM;
@@ -390,10 +397,16 @@ class ServerParams {
   uint32_t slowlogFlushInterval = CONFIG_DEFAULT_SLOWLOG_FLUSH_INTERVAL;
   uint64_t slowlogMaxLen = CONFIG_DEFAULT_SLOWLOG_LOG_MAX_LEN;
   bool slowlogFileEnabled = true;
+  // the latency histograms of each command and its stages, see
+  // LatencyStats and "info latencystats"
+  bool latencyTracking = true;
   bool binlogUsingDefaultCF = false;
   uint32_t netIoThreadNum = 0;
   uint32_t executorThreadNum = 0;
   uint32_t executorWorkPoolSize = 0;
+  // the requests of single key commands run in the work pool owning the
+  // store of the key, the pool of a store is storeId % the pools
+  bool executorStoreAffinity = false;
 
   uint32_t binlogRateLimitMB = 64;
   uint32_t netBatchSize = 1024 * 1024;
@@ -402,7 +415,10 @@ class ServerParams {
   uint32_t incrPushThreadnum = 4;
   uint32_t fullPushThreadnum = 4;
   uint32_t fullReceiveThreadnum = 4;
+  // batches of fullsync a slave keeps in flight, 0 for stop-and-wait
+  uint32_t fullSyncWindow = 0;
   uint32_t logRecycleThreadnum = 4;
+  uint32_t binlogApplyThreadnum = 0;
   uint32_t truncateBinlogIntervalMs = 1000;
   uint32_t truncateBinlogNum = 50000;
   uint32_t binlogFileSizeMB = 64;
@@ -411,10 +427,40 @@ class ServerParams {
 
   uint32_t keysDefaultLimit = 100;
   uint32_t lockWaitTimeOut = 3600;
+  // a command waiting its first key lock parks the session and frees the
+  // executor thread, it is run again when the lock is granted
+  bool lockWaitYield = false;
+  // a hash with no more fields than hashMaxPackedEntries and no field or
+  // value longer than hashMaxPackedValue is packed into its meta,
+  // 0 to disable. Older versions can not read packed hashes.
+  uint32_t hashMaxPackedEntries = 0;
+  uint32_t hashMaxPackedValue = 64;
+  // the same for the members of a set and a zset
+  uint32_t setMaxPackedEntries = 0;
+  uint32_t setMaxPackedValue = 64;
+  uint32_t zsetMaxPackedEntries = 0;
+  uint32_t zsetMaxPackedValue = 64;
+  // a new list keeps its elements in segments of at most
+  // listMaxSegmentEntries elements and about listMaxSegmentBytes bytes,
+  // 0 to disable. Older versions can not read segmented lists.
+  uint32_t listMaxSegmentEntries = 0;
+  uint32_t listMaxSegmentBytes = 8192;
+  // a new zset keeps its members under order-preserving score keys, counted
+  // in blocks of about zsetScoreBlockEntries members, 0 to keep the skiplist.
+  // Older versions can not read them.
+  uint32_t zsetScoreBlockEntries = 0;
+  // collections with no less sub keys than this are deleted with range
+  // tombstones instead of one tombstone per sub key, 0 to disable
+  uint32_t bigKeyDelRangeThreshold = 65536;
+  // the compaction filter also drops the expired collections, with their
+  // sub keys and ttl indexes, and the sub keys of the deleted ones
+  bool compactExpiredSubKeys = false;
 
   // parameter for rocksdb
   uint32_t rocksBlockcacheMB = 4096;
   bool rocksStrictCapacityLimit = false;
+  // decoded value cache of hot keys, shared by all kvstores, 0 to disable
+  uint32_t kvstoreValueCacheMB = 0;
   std::string rocksWALDir = "";
   string rocksCompressType = "snappy";
   // WriteOptions
@@ -422,6 +468,9 @@ class ServerParams {
   bool rocksFlushLogAtTrxCommit = false;
   bool level0Compress = false;
   bool level1Compress = false;
+  // prefix blooms for the sub keys of collections, taking effect when
+  // a kvstore is opened
+  bool rocksPrefixBloom = false;
 
   uint32_t bingLogSendBatch = 256;
   uint32_t bingLogSendBytes = 16 * 1024 * 1024;
@@ -441,6 +490,17 @@ class ServerParams {
   uint32_t migrateDistance = 10000;
   uint16_t migrateBinlogIter = 10;
   uint32_t migrateRateLimitMB = 32;
+  // the receiver asks for the snapshot of slots as sst files and ingests
+  // them, instead of writing the keys one by one. The ingested keys have no
+  // binlog, so it is used only by the stores without slaves
+  bool migrateBySst = false;
+  // the receiver asks for the snapshot of slots in frames of many keys,
+  // which are acked asynchronously, and compressed by snappy if
+  // migrateFrameCompress
+  bool migrateBatchFrame = false;
+  bool migrateFrameCompress = false;
+  // the frames sent but not acked yet
+  uint32_t migrateFrameWindow = 4;
   uint32_t clusterNodeTimeout = 15000;
   bool clusterRequireFullCoverage = true;
   bool clusterSlaveNoFailover = false;
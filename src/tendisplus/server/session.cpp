@@ -44,6 +44,10 @@ Session::~Session() {
 #endif
 }
 
+Status Session::setResponseChunks(RespWriter&& writer) {
+  return setResponse(writer.str());
+}
+
 uint64_t Session::getCtime() const {
   return _timestamp;
 }
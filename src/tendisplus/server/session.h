@@ -12,6 +12,7 @@
 #include <vector>
 #include "asio.hpp"
 #include "tendisplus/utils/status.h"
+#include "tendisplus/utils/resp_writer.h"
 
 namespace tendisplus {
 
@@ -31,6 +32,9 @@ class Session : public std::enable_shared_from_this<Session> {
   virtual ~Session();
   uint64_t id() const;
   virtual Status setResponse(const std::string& s) = 0;
+  // the default implementation flattens the chunks and calls setResponse,
+  // sessions which can do vectored writes should override it.
+  virtual Status setResponseChunks(RespWriter&& writer);
   const std::vector<std::string>& getArgs() const;
   Status processExtendProtocol();
   SessionCtx* getCtx() const;
@@ -57,6 +61,32 @@ class Session : public std::enable_shared_from_this<Session> {
   virtual Expected<uint32_t> getLocalPort() const {
     return {ErrorCodes::ERR_NETWORK, ""};
   }
+  // park the session after the current command until one of the keys in
+  // the current db is pushed, or timeoutMs (0 for forever) passes and
+  // timeoutRsp is replied. The command is run again when it is woken up.
+  // Sessions which can not be parked return an error, the command should
+  // reply as it times out.
+  virtual Status blockOnKeys(const std::vector<std::string>& keys,
+                             uint64_t timeoutMs,
+                             const std::string& timeoutRsp) {
+    return {ErrorCodes::ERR_INTERNAL, "session can not block"};
+  }
+  // park the session after the current command until lockGranted() is
+  // called, or timeoutMs passes and a lock timeout error is replied. The
+  // command is run again when it is woken up, and takes the lock granted,
+  // see KeyLock::AquireKeyLock(). It is called before the lock is queued,
+  // cancelYield() is called if the lock is granted at once.
+  virtual Status yieldOnLock(uint64_t timeoutMs) {
+    return {ErrorCodes::ERR_INTERNAL, "session can not yield"};
+  }
+  virtual void cancelYield() {}
+  // whether the current command is parked by blockOnKeys() or
+  // yieldOnLock(), it replies when it is woken up
+  virtual bool isBlocked() const {
+    return false;
+  }
+  // called by the thread granting the lock, with the lock shard mutex held
+  virtual void lockGranted() {}
 
   std::string getName() const;
   void setName(const std::string&);
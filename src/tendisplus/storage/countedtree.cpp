@@ -0,0 +1,527 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/countedtree.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+const char CountedTree::NODE_KEY_PREFIX[] = "\xff\xff";
+
+bool CountedTree::isNodeKey(const std::string& sk) {
+  return sk.compare(0, sizeof(NODE_KEY_PREFIX) - 1, NODE_KEY_PREFIX) == 0;
+}
+
+CountedTree::CountedTree(uint32_t chunkId,
+                         uint32_t dbId,
+                         RecordType type,
+                         const std::string& pk,
+                         PStore store,
+                         size_t fanout)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _type(type),
+    _pk(pk),
+    _store(store),
+    _fanout(std::max<size_t>(fanout, 2)) {}
+
+/*
+ * LEVEL|NEXT_ID|ENTRY_NUM|(len(KEY)|KEY|ID|COUNT)*
+ */
+std::string CountedTree::encodeNode(const Node& node) {
+  std::string value;
+  value.append(varintEncodeStr(node.level));
+  value.append(varintEncodeStr(node.nextId));
+  value.append(varintEncodeStr(node.entries.size()));
+  for (const auto& e : node.entries) {
+    value.append(varintEncodeStr(e.key.size()));
+    value.append(e.key);
+    value.append(varintEncodeStr(e.id));
+    value.append(varintEncodeStr(e.count));
+  }
+  return value;
+}
+
+Expected<CountedTree::Node> CountedTree::decodeNode(const std::string& val) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(val.data());
+  size_t len = val.size();
+  size_t offset = 0;
+  auto decode = [&](uint64_t* n) -> Status {
+    auto expt = varintDecodeFwd(data + offset, len - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    *n = expt.value().first;
+    return {ErrorCodes::ERR_OK, ""};
+  };
+  Node node;
+  uint64_t level = 0;
+  uint64_t num = 0;
+  for (auto n : {&level, &node.nextId, &num}) {
+    auto s = decode(n);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  node.level = static_cast<uint32_t>(level);
+  for (uint64_t i = 0; i < num; ++i) {
+    Entry e;
+    uint64_t keyLen = 0;
+    auto s = decode(&keyLen);
+    if (!s.ok()) {
+      return s;
+    }
+    if (keyLen > len - offset) {
+      return {ErrorCodes::ERR_DECODE, "invalid counted tree node"};
+    }
+    e.key.assign(val.data() + offset, keyLen);
+    offset += keyLen;
+    for (auto n : {&e.id, &e.count}) {
+      s = decode(n);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    node.entries.emplace_back(std::move(e));
+  }
+  if (offset != len) {
+    return {ErrorCodes::ERR_DECODE, "invalid counted tree node"};
+  }
+  return std::move(node);
+}
+
+RecordKey CountedTree::nodeKey(uint64_t id) const {
+  return RecordKey(_chunkId,
+                   _dbId,
+                   _type,
+                   _pk,
+                   NODE_KEY_PREFIX + std::to_string(id));
+}
+
+Expected<CountedTree::Node*> CountedTree::load(uint64_t id,
+                                               Transaction* txn) {
+  auto it = _nodes.find(id);
+  if (it != _nodes.end()) {
+    return &it->second;
+  }
+  auto eRv = _store->getKV(nodeKey(id), txn);
+  if (!eRv.ok()) {
+    if (eRv.status().code() == ErrorCodes::ERR_NOTFOUND && id == ROOT_ID) {
+      return &_nodes[id];
+    }
+    return eRv.status();
+  }
+  auto eNode = decodeNode(eRv.value().getValue());
+  if (!eNode.ok()) {
+    return eNode.status();
+  }
+  return &(_nodes[id] = std::move(eNode.value()));
+}
+
+const CountedTree::Entry& CountedTree::get(const Pos& pos) const {
+  const auto& node = _nodes.at(pos.path.back().first);
+  return node.entries[pos.path.back().second];
+}
+
+Expected<bool> CountedTree::empty(Transaction* txn) {
+  auto root = load(ROOT_ID, txn);
+  if (!root.ok()) {
+    return root.status();
+  }
+  return root.value()->entries.empty();
+}
+
+Expected<uint64_t> CountedTree::total(Transaction* txn) {
+  auto root = load(ROOT_ID, txn);
+  if (!root.ok()) {
+    return root.status();
+  }
+  uint64_t count = 0;
+  for (const auto& e : root.value()->entries) {
+    count += e.count;
+  }
+  return count;
+}
+
+Expected<uint64_t> CountedTree::allocId(Transaction* txn) {
+  auto root = load(ROOT_ID, txn);
+  if (!root.ok()) {
+    return root.status();
+  }
+  _dirty.insert(ROOT_ID);
+  return root.value()->nextId++;
+}
+
+Expected<CountedTree::Pos> CountedTree::seekCount(uint64_t n,
+                                                  Transaction* txn) {
+  Pos pos;
+  uint64_t id = ROOT_ID;
+  while (true) {
+    auto eNode = load(id, txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    const auto& entries = eNode.value()->entries;
+    size_t i = 0;
+    while (i < entries.size() && n >= entries[i].count) {
+      n -= entries[i].count;
+      pos.before += entries[i].count;
+      ++i;
+    }
+    if (i == entries.size()) {
+      return {ErrorCodes::ERR_NOTFOUND, "out of the counted tree"};
+    }
+    pos.path.emplace_back(id, i);
+    if (eNode.value()->level == 0) {
+      return std::move(pos);
+    }
+    id = entries[i].id;
+  }
+}
+
+Expected<CountedTree::Pos> CountedTree::seekKey(const std::string& key,
+                                                Transaction* txn) {
+  Pos pos;
+  uint64_t id = ROOT_ID;
+  while (true) {
+    auto eNode = load(id, txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    const auto& entries = eNode.value()->entries;
+    if (entries.empty()) {
+      return {ErrorCodes::ERR_NOTFOUND, "empty counted tree"};
+    }
+    auto it = std::upper_bound(
+      entries.begin(),
+      entries.end(),
+      key,
+      [](const std::string& k, const Entry& e) { return k < e.key; });
+    size_t i = it == entries.begin() ? 0 : it - entries.begin() - 1;
+    for (size_t j = 0; j < i; ++j) {
+      pos.before += entries[j].count;
+    }
+    pos.path.emplace_back(id, i);
+    if (eNode.value()->level == 0) {
+      return std::move(pos);
+    }
+    id = entries[i].id;
+  }
+}
+
+Status CountedTree::descend(Pos* pos, bool back, Transaction* txn) {
+  while (true) {
+    auto eNode = load(pos->path.back().first, txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    if (eNode.value()->level == 0) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    const auto& entry = eNode.value()->entries[pos->path.back().second];
+    auto eChild = load(entry.id, txn);
+    if (!eChild.ok()) {
+      return eChild.status();
+    }
+    const auto& entries = eChild.value()->entries;
+    INVARIANT_D(!entries.empty());
+    if (entries.empty()) {
+      return {ErrorCodes::ERR_DECODE, "empty counted tree node"};
+    }
+    pos->path.emplace_back(entry.id, back ? entries.size() - 1 : 0);
+  }
+}
+
+uint64_t CountedTree::countBefore(const Path& path) const {
+  uint64_t count = 0;
+  for (const auto& p : path) {
+    const auto& entries = _nodes.at(p.first).entries;
+    for (size_t j = 0; j < p.second; ++j) {
+      count += entries[j].count;
+    }
+  }
+  return count;
+}
+
+Expected<CountedTree::Pos> CountedTree::first(Transaction* txn) {
+  auto eEmpty = empty(txn);
+  if (!eEmpty.ok()) {
+    return eEmpty.status();
+  }
+  if (eEmpty.value()) {
+    return {ErrorCodes::ERR_NOTFOUND, "empty counted tree"};
+  }
+  Pos pos;
+  pos.path.emplace_back(ROOT_ID, 0);
+  auto s = descend(&pos, false, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return std::move(pos);
+}
+
+Expected<CountedTree::Pos> CountedTree::last(Transaction* txn) {
+  auto eEmpty = empty(txn);
+  if (!eEmpty.ok()) {
+    return eEmpty.status();
+  }
+  if (eEmpty.value()) {
+    return {ErrorCodes::ERR_NOTFOUND, "empty counted tree"};
+  }
+  Pos pos;
+  pos.path.emplace_back(ROOT_ID, _nodes.at(ROOT_ID).entries.size() - 1);
+  auto s = descend(&pos, true, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  pos.before = countBefore(pos.path);
+  return std::move(pos);
+}
+
+Expected<bool> CountedTree::next(Pos* pos, Transaction* txn) {
+  size_t level = pos->path.size();
+  while (level > 0) {
+    const auto& p = pos->path[level - 1];
+    if (p.second + 1 < _nodes.at(p.first).entries.size()) {
+      break;
+    }
+    --level;
+  }
+  if (level == 0) {
+    return false;
+  }
+  pos->before += get(*pos).count;
+  pos->path.resize(level);
+  pos->path.back().second++;
+  auto s = descend(pos, false, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  INVARIANT_D(pos->before == countBefore(pos->path));
+  return true;
+}
+
+Expected<bool> CountedTree::prev(Pos* pos, Transaction* txn) {
+  size_t level = pos->path.size();
+  while (level > 0 && pos->path[level - 1].second == 0) {
+    --level;
+  }
+  if (level == 0) {
+    return false;
+  }
+  pos->path.resize(level);
+  pos->path.back().second--;
+  auto s = descend(pos, true, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  pos->before = countBefore(pos->path);
+  return true;
+}
+
+Expected<std::vector<CountedTree::Entry>> CountedTree::entries(
+  Transaction* txn) {
+  std::vector<Entry> result;
+  auto ePos = first(txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return std::move(result);
+  } else if (!ePos.ok()) {
+    return ePos.status();
+  }
+  while (true) {
+    result.push_back(get(ePos.value()));
+    auto eNext = next(&ePos.value(), txn);
+    if (!eNext.ok()) {
+      return eNext.status();
+    }
+    if (!eNext.value()) {
+      return std::move(result);
+    }
+  }
+}
+
+Status CountedTree::setCount(const Pos& pos,
+                             uint64_t count,
+                             Transaction* txn) {
+  auto& entry = _nodes.at(pos.path.back().first)
+                  .entries[pos.path.back().second];
+  if (entry.count == count) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  entry.count = count;
+  return update(pos.path, txn);
+}
+
+Status CountedTree::insert(const Pos& pos,
+                           bool after,
+                           Entry e,
+                           Transaction* txn) {
+  auto& entries = _nodes.at(pos.path.back().first).entries;
+  size_t i = pos.path.back().second + (after ? 1 : 0);
+  entries.insert(entries.begin() + i, std::move(e));
+  return update(pos.path, txn);
+}
+
+Status CountedTree::pushFront(Entry e, Transaction* txn) {
+  auto ePos = first(txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    _nodes[ROOT_ID].entries.emplace_back(std::move(e));
+    return update({{ROOT_ID, 0}}, txn);
+  }
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  return insert(ePos.value(), false, std::move(e), txn);
+}
+
+Status CountedTree::pushBack(Entry e, Transaction* txn) {
+  auto ePos = last(txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    _nodes[ROOT_ID].entries.emplace_back(std::move(e));
+    return update({{ROOT_ID, 0}}, txn);
+  }
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  return insert(ePos.value(), true, std::move(e), txn);
+}
+
+Status CountedTree::erase(const Pos& pos, Transaction* txn) {
+  auto& entries = _nodes.at(pos.path.back().first).entries;
+  entries.erase(entries.begin() + pos.path.back().second);
+  return update(pos.path, txn);
+}
+
+Expected<uint64_t> CountedTree::newNode(Node node, Transaction* txn) {
+  auto id = allocId(txn);
+  if (!id.ok()) {
+    return id.status();
+  }
+  node.nextId = 0;
+  _nodes[id.value()] = std::move(node);
+  _dirty.insert(id.value());
+  return id;
+}
+
+void CountedTree::freeNode(uint64_t id) {
+  _nodes.erase(id);
+  _dirty.erase(id);
+  _freed.insert(id);
+}
+
+Status CountedTree::update(const Path& path, Transaction* txn) {
+  auto sum = [](const std::vector<Entry>& entries) {
+    uint64_t count = 0;
+    for (const auto& e : entries) {
+      count += e.count;
+    }
+    return count;
+  };
+  for (size_t l = path.size() - 1; l > 0; --l) {
+    uint64_t id = path[l].first;
+    _dirty.insert(id);
+    auto& parent = _nodes.at(path[l - 1].first).entries;
+    size_t pi = path[l - 1].second;
+    auto& node = _nodes.at(id);
+    if (node.entries.empty()) {
+      parent.erase(parent.begin() + pi);
+      freeNode(id);
+      continue;
+    }
+    if (node.entries.size() > _fanout) {
+      Node right;
+      right.level = node.level;
+      size_t half = node.entries.size() / 2;
+      right.entries.assign(std::make_move_iterator(node.entries.begin() + half),
+                           std::make_move_iterator(node.entries.end()));
+      node.entries.resize(half);
+      Entry e{right.entries[0].key, 0, sum(right.entries)};
+      auto rid = newNode(std::move(right), txn);
+      if (!rid.ok()) {
+        return rid.status();
+      }
+      e.id = rid.value();
+      parent[pi].count = sum(node.entries);
+      parent[pi].key = node.entries[0].key;
+      parent.insert(parent.begin() + pi + 1, std::move(e));
+      continue;
+    }
+    parent[pi].count = sum(node.entries);
+    parent[pi].key = node.entries[0].key;
+  }
+
+  _dirty.insert(ROOT_ID);
+  auto* root = &_nodes.at(ROOT_ID);
+  if (root->entries.size() > _fanout) {
+    // the root keeps its id, its halves move down
+    size_t half = root->entries.size() / 2;
+    Node left, right;
+    left.level = right.level = root->level;
+    left.entries.assign(std::make_move_iterator(root->entries.begin()),
+                        std::make_move_iterator(root->entries.begin() + half));
+    right.entries.assign(std::make_move_iterator(root->entries.begin() + half),
+                         std::make_move_iterator(root->entries.end()));
+    Entry le{left.entries[0].key, 0, sum(left.entries)};
+    Entry re{right.entries[0].key, 0, sum(right.entries)};
+    auto lid = newNode(std::move(left), txn);
+    if (!lid.ok()) {
+      return lid.status();
+    }
+    auto rid = newNode(std::move(right), txn);
+    if (!rid.ok()) {
+      return rid.status();
+    }
+    le.id = lid.value();
+    re.id = rid.value();
+    root->level++;
+    root->entries = {std::move(le), std::move(re)};
+  }
+  while (root->level > 0 && root->entries.size() == 1) {
+    uint64_t child = root->entries[0].id;
+    auto eChild = load(child, txn);
+    if (!eChild.ok()) {
+      return eChild.status();
+    }
+    root->level = eChild.value()->level;
+    root->entries = std::move(eChild.value()->entries);
+    freeNode(child);
+  }
+  if (root->entries.empty()) {
+    root->level = 0;
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status CountedTree::save(Transaction* txn) {
+  for (auto id : _freed) {
+    auto s = _store->delKV(nodeKey(id), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _freed.clear();
+  for (auto id : _dirty) {
+    const auto& node = _nodes.at(id);
+    Status s;
+    if (id == ROOT_ID && node.entries.empty()) {
+      s = _store->delKV(nodeKey(id), txn);
+    } else {
+      RecordValue rv(encodeNode(node), _type, -1);
+      s = _store->setKV(nodeKey(id), rv, txn);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _dirty.clear();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,121 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_COUNTEDTREE_H_
+#define SRC_TENDISPLUS_STORAGE_COUNTEDTREE_H_
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+
+namespace tendisplus {
+
+// CountedTree is a B+ tree of the entries of a collection, each with a key,
+// an id and a count, as the segments of a list or the score blocks of a
+// zset. A node is a record of the collection, so an entry is found by the
+// counts or by the keys reading the nodes on one path, and an update
+// rewrites them only. The root is node 0 and holds the next id to give
+// out, an empty tree has no record.
+// The nodes read are cached till save(), which writes the ones changed. A
+// Pos is invalid once the tree is changed.
+class CountedTree {
+ public:
+  struct Entry {
+    std::string key;
+    uint64_t id;
+    uint64_t count;
+  };
+  // the nodes from the root down to an entry of level 0 with its index in
+  // each of them, and the count of the entries before the entry
+  struct Pos {
+    std::vector<std::pair<uint64_t, size_t>> path;
+    uint64_t before = 0;
+  };
+
+  static constexpr size_t DEFAULT_FANOUT = 128;
+  // the sub keys of the nodes, a list has decimal sub keys and a score key
+  // never starts with it, see zslScoreKeyPrefix()
+  static const char NODE_KEY_PREFIX[];
+  static bool isNodeKey(const std::string& sk);
+
+  CountedTree(uint32_t chunkId,
+              uint32_t dbId,
+              RecordType type,
+              const std::string& pk,
+              PStore store,
+              size_t fanout = DEFAULT_FANOUT);
+  CountedTree(CountedTree&&) = default;
+
+  Expected<bool> empty(Transaction* txn);
+  // the counts of all the entries
+  Expected<uint64_t> total(Transaction* txn);
+  // an id never given out by the tree, from 1
+  Expected<uint64_t> allocId(Transaction* txn);
+
+  // the entry of the n-th counted item, the ones with 0 count are skipped
+  Expected<Pos> seekCount(uint64_t n, Transaction* txn);
+  // the last entry with a key not after key, or the first one
+  Expected<Pos> seekKey(const std::string& key, Transaction* txn);
+  Expected<Pos> first(Transaction* txn);
+  Expected<Pos> last(Transaction* txn);
+  // move to the next or the previous entry, false at the end
+  Expected<bool> next(Pos* pos, Transaction* txn);
+  Expected<bool> prev(Pos* pos, Transaction* txn);
+  const Entry& get(const Pos& pos) const;
+  // all the entries in order, reading all the nodes
+  Expected<std::vector<Entry>> entries(Transaction* txn);
+
+  Status setCount(const Pos& pos, uint64_t count, Transaction* txn);
+  // insert the entry after or before pos
+  Status insert(const Pos& pos, bool after, Entry e, Transaction* txn);
+  Status pushFront(Entry e, Transaction* txn);
+  Status pushBack(Entry e, Transaction* txn);
+  Status erase(const Pos& pos, Transaction* txn);
+
+  // write the nodes changed
+  Status save(Transaction* txn);
+
+ private:
+  struct Node {
+    // 0 for the nodes of the entries, n for the nodes of the level n - 1
+    uint32_t level = 0;
+    // only for the root
+    uint64_t nextId = 1;
+    std::vector<Entry> entries;
+  };
+  static constexpr uint64_t ROOT_ID = 0;
+  using Path = std::vector<std::pair<uint64_t, size_t>>;
+
+  static std::string encodeNode(const Node& node);
+  static Expected<Node> decodeNode(const std::string& val);
+  RecordKey nodeKey(uint64_t id) const;
+  Expected<Node*> load(uint64_t id, Transaction* txn);
+  // descend from the node at the end of pos->path to an entry of level 0,
+  // by the first or the last entries, pos->before is not counted
+  Status descend(Pos* pos, bool back, Transaction* txn);
+  uint64_t countBefore(const Path& path) const;
+  // fix the counts and the keys from the node at the end of path up to the
+  // root, splitting the full nodes and dropping the empty ones
+  Status update(const Path& path, Transaction* txn);
+  Expected<uint64_t> newNode(Node node, Transaction* txn);
+  void freeNode(uint64_t id);
+
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  RecordType _type;
+  std::string _pk;
+  PStore _store;
+  size_t _fanout;
+  std::unordered_map<uint64_t, Node> _nodes;
+  std::set<uint64_t> _dirty;
+  std::set<uint64_t> _freed;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_COUNTEDTREE_H_
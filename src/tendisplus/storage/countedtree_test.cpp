@@ -0,0 +1,246 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "tendisplus/utils/status.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/storage/countedtree.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/server/server_params.h"
+
+namespace tendisplus {
+
+std::shared_ptr<ServerParams> genParams() {
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 4096\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+using Entries = std::vector<CountedTree::Entry>;
+
+uint64_t countBefore(const Entries& entries, size_t idx) {
+  uint64_t before = 0;
+  for (size_t i = 0; i < idx; ++i) {
+    before += entries[i].count;
+  }
+  return before;
+}
+
+// compare the tree with the entries it should have, by all the ways to
+// reach them
+void checkTree(CountedTree* tree, const Entries& entries, Transaction* txn) {
+  uint64_t total = countBefore(entries, entries.size());
+  EXPECT_EQ(tree->total(txn).value(), total);
+  EXPECT_EQ(tree->empty(txn).value(), entries.empty());
+  auto eAll = tree->entries(txn);
+  ASSERT_TRUE(eAll.ok());
+  ASSERT_EQ(eAll.value().size(), entries.size());
+  if (entries.empty()) {
+    EXPECT_EQ(tree->first(txn).status().code(), ErrorCodes::ERR_NOTFOUND);
+    return;
+  }
+
+  auto ePos = tree->first(txn);
+  ASSERT_TRUE(ePos.ok());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto& e = tree->get(ePos.value());
+    EXPECT_EQ(e.id, entries[i].id);
+    EXPECT_EQ(e.count, entries[i].count);
+    EXPECT_EQ(e.key, entries[i].key);
+    EXPECT_EQ(eAll.value()[i].id, entries[i].id);
+    EXPECT_EQ(ePos.value().before, countBefore(entries, i));
+    auto eNext = tree->next(&ePos.value(), txn);
+    ASSERT_TRUE(eNext.ok());
+    EXPECT_EQ(eNext.value(), i + 1 < entries.size());
+  }
+
+  ePos = tree->last(txn);
+  ASSERT_TRUE(ePos.ok());
+  for (size_t i = entries.size(); i-- > 0;) {
+    EXPECT_EQ(tree->get(ePos.value()).id, entries[i].id);
+    EXPECT_EQ(ePos.value().before, countBefore(entries, i));
+    auto ePrev = tree->prev(&ePos.value(), txn);
+    ASSERT_TRUE(ePrev.ok());
+    EXPECT_EQ(ePrev.value(), i > 0);
+  }
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    uint64_t before = countBefore(entries, i);
+    for (uint64_t n = 0; n < entries[i].count; ++n) {
+      auto eSeek = tree->seekCount(before + n, txn);
+      ASSERT_TRUE(eSeek.ok());
+      EXPECT_EQ(tree->get(eSeek.value()).id, entries[i].id);
+      EXPECT_EQ(eSeek.value().before, before);
+    }
+  }
+  EXPECT_EQ(tree->seekCount(total, txn).status().code(),
+            ErrorCodes::ERR_NOTFOUND);
+}
+
+void testRandomOps(std::shared_ptr<KVStore> store, size_t fanout) {
+  std::mt19937 rng(fanout);
+  Entries entries;
+  auto eTxn = store->createTransaction(nullptr);
+  ASSERT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  auto tree = std::make_unique<CountedTree>(
+    0, 0, RecordType::RT_LIST_ELE, "tree", store, fanout);
+  // save the tree and read it again from the store in a new txn
+  auto reload = [&]() {
+    EXPECT_TRUE(tree->save(txn.get()).ok());
+    EXPECT_TRUE(txn->commit().ok());
+    eTxn = store->createTransaction(nullptr);
+    ASSERT_TRUE(eTxn.ok());
+    txn = std::move(eTxn.value());
+    tree = std::make_unique<CountedTree>(
+      0, 0, RecordType::RT_LIST_ELE, "tree", store, fanout);
+  };
+
+  for (uint32_t step = 0; step < 2000; ++step) {
+    uint32_t op = rng() % 10;
+    size_t idx = entries.empty() ? 0 : rng() % entries.size();
+    uint64_t count = 1 + rng() % 5;
+    if (entries.empty() || op < 2) {
+      CountedTree::Entry e{"", tree->allocId(txn.get()).value(), count};
+      if (rng() % 2) {
+        EXPECT_TRUE(tree->pushFront(e, txn.get()).ok());
+        entries.insert(entries.begin(), e);
+      } else {
+        EXPECT_TRUE(tree->pushBack(e, txn.get()).ok());
+        entries.push_back(e);
+      }
+    } else if (op < 5) {
+      CountedTree::Entry e{"", tree->allocId(txn.get()).value(), count};
+      bool after = rng() % 2;
+      auto ePos = tree->seekCount(countBefore(entries, idx), txn.get());
+      ASSERT_TRUE(ePos.ok());
+      EXPECT_TRUE(tree->insert(ePos.value(), after, e, txn.get()).ok());
+      entries.insert(entries.begin() + idx + after, e);
+    } else if (op < 8) {
+      auto ePos = tree->seekCount(countBefore(entries, idx), txn.get());
+      ASSERT_TRUE(ePos.ok());
+      EXPECT_TRUE(tree->erase(ePos.value(), txn.get()).ok());
+      entries.erase(entries.begin() + idx);
+    } else {
+      auto ePos = tree->seekCount(countBefore(entries, idx), txn.get());
+      ASSERT_TRUE(ePos.ok());
+      EXPECT_TRUE(tree->setCount(ePos.value(), count, txn.get()).ok());
+      entries[idx].count = count;
+    }
+    if (step % 7 == 0) {
+      reload();
+    }
+    checkTree(tree.get(), entries, txn.get());
+  }
+
+  while (!entries.empty()) {
+    auto ePos = tree->first(txn.get());
+    ASSERT_TRUE(ePos.ok());
+    EXPECT_TRUE(tree->erase(ePos.value(), txn.get()).ok());
+    entries.erase(entries.begin());
+    if (entries.size() % 5 == 0) {
+      reload();
+    }
+    checkTree(tree.get(), entries, txn.get());
+  }
+
+  // an empty tree leaves no record
+  RecordKey rk(0, 0, RecordType::RT_LIST_ELE, "tree", "");
+  auto cursor = txn->createDataCursor();
+  cursor->seek(rk.prefixPk());
+  auto eRcd = cursor->next();
+  if (eRcd.ok()) {
+    EXPECT_NE(eRcd.value().getRecordKey().prefixPk(), rk.prefixPk());
+  }
+}
+
+TEST(CountedTree, RandomOps) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  // the small fanouts make the trees deep
+  for (size_t fanout : {2, 3, 4, 16}) {
+    testRandomOps(store, fanout);
+  }
+}
+
+TEST(CountedTree, SeekKey) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto eTxn = store->createTransaction(nullptr);
+  ASSERT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  std::mt19937 rng(0);
+  CountedTree tree(0, 0, RecordType::RT_ZSET_S_ELE, "tree", store, 4);
+  Entries entries = {{"", 0, 0}};
+  EXPECT_TRUE(tree.pushBack(entries[0], txn).ok());
+  // count the keys in the entry of the greatest key not after them, as a
+  // zset counts its members in the blocks of scores
+  for (uint32_t i = 0; i < 2000; ++i) {
+    std::string key = std::to_string(rng() % 100000);
+    auto ePos = tree.seekKey(key, txn);
+    ASSERT_TRUE(ePos.ok());
+    auto it = std::upper_bound(
+      entries.begin(),
+      entries.end(),
+      key,
+      [](const std::string& k, const CountedTree::Entry& e) {
+        return k < e.key;
+      });
+    size_t idx = it - entries.begin() - 1;
+    EXPECT_EQ(tree.get(ePos.value()).key, entries[idx].key);
+    EXPECT_EQ(ePos.value().before, countBefore(entries, idx));
+    if (entries[idx].key == key) {
+      entries[idx].count++;
+      EXPECT_TRUE(
+        tree.setCount(ePos.value(), entries[idx].count, txn).ok());
+    } else {
+      entries.insert(entries.begin() + idx + 1, {key, 0, 1});
+      EXPECT_TRUE(tree.insert(ePos.value(), true, {key, 0, 1}, txn).ok());
+    }
+  }
+  checkTree(&tree, entries, txn);
+  EXPECT_TRUE(CountedTree::isNodeKey(std::string("\xff\xff") + "1"));
+  EXPECT_FALSE(CountedTree::isNodeKey("1"));
+}
+
+}  // namespace tendisplus
@@ -464,6 +464,17 @@ Expected<Record> SlotsCursor::next() {
   }
 }
 
+Status SlotsCursor::nextRaw(std::string* key, std::string* value) {
+  auto s = _baseCursor->nextRaw(key, value);
+  if (!s.ok()) {
+    return s;
+  }
+  if (RecordKey::decodeChunkId(*key) > _endSlot - 1) {
+    return {ErrorCodes::ERR_EXHAUST, "no more primary key"};
+  }
+  return s;
+}
+
 
 KVStore::KVStore(const std::string& id, const std::string& path)
   : _id(id), _dbPath(path), _backupDir(path + "/" + id + "_bak") {
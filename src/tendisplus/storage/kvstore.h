@@ -61,6 +61,9 @@ class Cursor {
   // seek to last of the collection, Not the prefix
   virtual void seekToLast() = 0;
   virtual Expected<Record> next() = 0;
+  // the encoded key and value of next(), without decoding them. The buffers
+  // given are reused, so no allocation is needed after the first records
+  virtual Status nextRaw(std::string* key, std::string* value) = 0;
   virtual Status prev() = 0;
   virtual Expected<std::string> key() = 0;
 };
@@ -185,6 +188,7 @@ class SlotsCursor {
   SlotsCursor(std::unique_ptr<Cursor> cursor, uint32_t start, uint32_t end);
   ~SlotsCursor() = default;
   Expected<Record> next();
+  Status nextRaw(std::string* key, std::string* value);
 
  private:
   const uint32_t _startSlot;
@@ -231,16 +235,31 @@ class Transaction {
                                                          uint32_t end) = 0;
   virtual std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() = 0;
   virtual std::unique_ptr<BasicDataCursor> createDataCursor() = 0;
+  // a cursor only for the sub keys of prefix, which is a prefixPk(). It may
+  // skip the sst files by prefix blooms, so it must seek to the prefix or
+  // an encoded key with the prefix, and stops at the end of the prefix.
+  virtual std::unique_ptr<BasicDataCursor> createPrefixDataCursor(
+    const std::string& prefix) = 0;
   virtual std::unique_ptr<AllDataCursor> createAllDataCursor() = 0;
   virtual std::unique_ptr<BinlogCursor> createBinlogCursor() = 0;
 
   virtual Expected<std::string> getKV(const std::string& key) = 0;
+  // batched getKV, results are in the same order as keys
+  virtual std::vector<Expected<std::string>> getKVs(
+    const std::vector<std::string>& keys) = 0;
   virtual Status setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts = 0) = 0;
   virtual Status delKV(const std::string& key, const uint64_t ts = 0) = 0;
   virtual Status addDeleteRangeBinlog(const std::string& begin,
                                       const std::string& end) = 0;
+  // delete the data keys in [begin, end) atomically with the other writes
+  // of the txn, it is replicated as one REPL_OP_DEL_RANGE of chunkId.
+  // NOTE: the deleted keys are still visible to reads in this txn, and the
+  // range delete is not undone by a rollback to a savepoint.
+  virtual Status deleteRange(const std::string& begin,
+                             const std::string& end,
+                             uint32_t chunkId) = 0;
   virtual uint64_t getBinlogTime() = 0;
   virtual void setBinlogTime(uint64_t timestamp) = 0;
   virtual bool isReplOnly() const = 0;
@@ -292,15 +311,41 @@ class BinlogObserver {
   virtual ~BinlogObserver() = default;
 };
 
+// SstFileBuilder writes the records of the data column family into an sst
+// file, in the order of their keys, which can be ingested by another store
+// with KVStore::ingestExternalFiles()
+class SstFileBuilder {
+ public:
+  virtual ~SstFileBuilder() = default;
+  virtual Status open(const std::string& file) = 0;
+  virtual Status put(const std::string& key, const std::string& value) = 0;
+  // the size of the file written so far
+  virtual uint64_t fileSize() = 0;
+  virtual Status finish() = 0;
+};
+
 struct KVStoreStat {
   std::atomic<uint64_t> compactFilterCount;
   std::atomic<uint64_t> compactKvExpiredCount;
+  // expired collections, sub keys and ttl indexes, see compactExpiredSubKeys
+  std::atomic<uint64_t> compactSubKeyExpiredCount;
   // number of request when store is paused
   std::atomic<uint64_t> pausedErrorCount;
   // number of request when store is destroyed
   std::atomic<uint64_t> destroyedErrorCount;
 };
 
+// statistics of RecordValueCache
+struct ValueCacheStat {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t inserts;
+  uint64_t rejects;
+  uint64_t evicts;
+  uint64_t entries;
+  uint64_t usage;
+};
+
 #define BINLOG_HEADER_V2 "BINLOG_V2\r\n"
 #define BINLOG_HEADER_V2_LEN (strlen(BINLOG_HEADER_V2) + sizeof(uint32_t))
 
@@ -341,6 +386,8 @@ class KVStore {
   virtual Expected<RecordValue> getKV(const RecordKey& key,
                                       Transaction* txn,
                                       RecordType valueType) = 0;
+  virtual std::vector<Expected<RecordValue>> getKVs(
+    const std::vector<RecordKey>& keys, Transaction* txn) = 0;
   virtual Status setKV(const RecordKey&, const RecordValue&, Transaction*) = 0;
   virtual Status setKV(const Record& kv, Transaction* txn) = 0;
   // TODO(eliotwang) deprecate this member function
@@ -373,12 +420,19 @@ class KVStore {
                               const std::string* begin,
                               const std::string* end) = 0;
   virtual Status fullCompact() = 0;
+  virtual std::unique_ptr<SstFileBuilder> createSstFileBuilder() = 0;
+  // move the sst files into the data column family, no binlog is written,
+  // so the keys of them are not replicated to the slaves
+  virtual Status ingestExternalFiles(const std::vector<std::string>& files) = 0;
 
   // remove all data in db
   virtual Status clear() = 0;
 
   virtual bool isRunning() const = 0;
   virtual bool isOpen() const = 0;
+  // a txn reads at the snapshot of its creation, and fails to commit if a
+  // key it writes is committed by others after that
+  virtual bool isOptimisticTxn() const = 0;
   virtual bool isEmpty(bool ignoreBinlog = false) const = 0;
   virtual bool isPaused() const = 0;
   virtual Status stop() = 0;
@@ -394,6 +448,8 @@ class KVStore {
   virtual std::string getBgError() const = 0;
   virtual Status recoveryFromBgError() = 0;
   virtual void resetStatistics() = 0;
+  // return false if the value cache is disabled
+  virtual bool getValueCacheStat(ValueCacheStat* stat) const = 0;
 
   virtual Expected<VersionMeta> getVersionMeta() = 0;
   virtual Expected<VersionMeta> getVersionMeta(const std::string& name) = 0;
@@ -0,0 +1,210 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include "tendisplus/storage/packedzset.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+PackedZset::PackedZset(uint32_t chunkId,
+                       uint32_t dbId,
+                       const std::string& pk,
+                       const ZSlMetaValue& meta,
+                       PStore store)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _pk(pk),
+    _store(store),
+    _entries(meta.getEntries()) {
+  INVARIANT_D(meta.isPacked());
+}
+
+Expected<std::vector<PackedZset::Member>> PackedZset::sorted() const {
+  std::vector<Member> result;
+  result.reserve(_entries.size());
+  for (const auto& entry : _entries.getEntries()) {
+    auto eScore = doubleDecode(entry.second);
+    if (!eScore.ok()) {
+      return eScore.status();
+    }
+    result.emplace_back(eScore.value(), entry.first);
+  }
+  std::sort(result.begin(), result.end());
+  return std::move(result);
+}
+
+Expected<ZsetIndex::Members> PackedZset::scanIf(const Filter& filter,
+                                                uint64_t offset,
+                                                uint64_t limit,
+                                                bool rev) {
+  auto eSorted = sorted();
+  if (!eSorted.ok()) {
+    return eSorted.status();
+  }
+  auto& members = eSorted.value();
+  if (rev) {
+    std::reverse(members.begin(), members.end());
+  }
+  Members result;
+  for (auto& member : members) {
+    if (limit == 0) {
+      break;
+    }
+    if (!filter(member)) {
+      continue;
+    }
+    if (offset > 0) {
+      --offset;
+      continue;
+    }
+    --limit;
+    result.push_back(std::move(member));
+  }
+  return std::move(result);
+}
+
+Expected<ZsetIndex::Members> PackedZset::removeAll(
+  const Expected<Members>& members) {
+  if (!members.ok()) {
+    return members.status();
+  }
+  for (const auto& member : members.value()) {
+    _entries.erase(member.second);
+  }
+  return members;
+}
+
+Status PackedZset::insert(double score,
+                          const std::string& subkey,
+                          Transaction* txn) {
+  auto value = doubleEncode(score);
+  _entries.set(subkey, std::string(value.begin(), value.end()));
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status PackedZset::remove(double score,
+                          const std::string& subkey,
+                          Transaction* txn) {
+  if (!_entries.erase(subkey)) {
+    return {ErrorCodes::ERR_NOTFOUND, "zset member not found"};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<uint32_t> PackedZset::rank(double score,
+                                    const std::string& subkey,
+                                    Transaction* txn) {
+  auto eSorted = sorted();
+  if (!eSorted.ok()) {
+    return eSorted.status();
+  }
+  const auto& members = eSorted.value();
+  auto it = std::lower_bound(
+    members.begin(), members.end(), Member(score, subkey));
+  if (it == members.end() || it->second != subkey) {
+    return {ErrorCodes::ERR_NOTFOUND, "zset member not found"};
+  }
+  return static_cast<uint32_t>(it - members.begin() + 1);
+}
+
+Expected<ZsetIndex::Members> PackedZset::scanByScore(const Zrangespec& range,
+                                                     uint64_t offset,
+                                                     uint64_t limit,
+                                                     bool rev,
+                                                     Transaction* txn) {
+  return scanIf(
+    [&range](const Member& m) {
+      return zslValueGteMin(m.first, range) && zslValueLteMax(m.first, range);
+    },
+    offset,
+    limit,
+    rev);
+}
+
+// the members should have the same score, they are compared by the members
+// only
+Expected<ZsetIndex::Members> PackedZset::scanByLex(const Zlexrangespec& range,
+                                                   uint64_t offset,
+                                                   uint64_t limit,
+                                                   bool rev,
+                                                   Transaction* txn) {
+  return scanIf(
+    [&range](const Member& m) {
+      return zslLexValueGteMin(m.second, range) &&
+        zslLexValueLteMax(m.second, range);
+    },
+    offset,
+    limit,
+    rev);
+}
+
+Expected<ZsetIndex::Members> PackedZset::scanByRank(int64_t start,
+                                                    int64_t len,
+                                                    bool rev,
+                                                    Transaction* txn) {
+  if (start < 0 || len <= 0) {
+    return Members();
+  }
+  return scanIf([](const Member&) { return true; }, start, len, rev);
+}
+
+Expected<uint64_t> PackedZset::countInRange(const Zrangespec& range,
+                                            Transaction* txn) {
+  auto members = scanByScore(
+    range, 0, std::numeric_limits<uint64_t>::max(), false, txn);
+  if (!members.ok()) {
+    return members.status();
+  }
+  return members.value().size();
+}
+
+Expected<uint64_t> PackedZset::countInLexRange(const Zlexrangespec& range,
+                                               Transaction* txn) {
+  auto members =
+    scanByLex(range, 0, std::numeric_limits<uint64_t>::max(), false, txn);
+  if (!members.ok()) {
+    return members.status();
+  }
+  return members.value().size();
+}
+
+Expected<ZsetIndex::Members> PackedZset::removeRangeByScore(
+  const Zrangespec& range, Transaction* txn) {
+  return removeAll(scanByScore(
+    range, 0, std::numeric_limits<uint64_t>::max(), false, txn));
+}
+
+Expected<ZsetIndex::Members> PackedZset::removeRangeByLex(
+  const Zlexrangespec& range, Transaction* txn) {
+  return removeAll(
+    scanByLex(range, 0, std::numeric_limits<uint64_t>::max(), false, txn));
+}
+
+Expected<ZsetIndex::Members> PackedZset::removeRangeByRank(uint32_t start,
+                                                           uint32_t end,
+                                                           Transaction* txn) {
+  if (start == 0 || end < start) {
+    return Members();
+  }
+  return removeAll(scanByRank(start - 1, end - start + 1, false, txn));
+}
+
+Status PackedZset::save(Transaction* txn,
+                        const Expected<RecordValue>& oldValue,
+                        uint64_t versionEP) {
+  RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
+  ZSlMetaValue mv(0, getCount(), 0);
+  mv.setPacked(true);
+  *mv.getMutableEntries() = _entries;
+  uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
+  RecordValue rv(
+    mv.encode(), RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
+  return _store->setKV(rk, rv, txn);
+}
+
+}  // namespace tendisplus
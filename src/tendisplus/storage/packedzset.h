@@ -0,0 +1,98 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_PACKEDZSET_H_
+#define SRC_TENDISPLUS_STORAGE_PACKEDZSET_H_
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/zsetindex.h"
+
+namespace tendisplus {
+
+// PackedZset keeps the members of a small zset packed in its meta, see
+// ZSlMetaValue. The members are sorted by (score, member) for each read,
+// as there are only a few of them, and nothing is written before save().
+class PackedZset : public ZsetIndex {
+ public:
+  PackedZset(uint32_t chunkId,
+             uint32_t dbId,
+             const std::string& pk,
+             const ZSlMetaValue& meta,
+             PStore store);
+
+  Status insert(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
+  Status remove(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
+  Expected<uint32_t> rank(double score,
+                          const std::string& subkey,
+                          Transaction* txn) override;
+
+  Expected<Members> scanByScore(const Zrangespec& range,
+                                uint64_t offset,
+                                uint64_t limit,
+                                bool rev,
+                                Transaction* txn) override;
+  Expected<Members> scanByLex(const Zlexrangespec& range,
+                              uint64_t offset,
+                              uint64_t limit,
+                              bool rev,
+                              Transaction* txn) override;
+  Expected<Members> scanByRank(int64_t start,
+                               int64_t len,
+                               bool rev,
+                               Transaction* txn) override;
+  Expected<uint64_t> countInRange(const Zrangespec& range,
+                                  Transaction* txn) override;
+  Expected<uint64_t> countInLexRange(const Zlexrangespec& range,
+                                     Transaction* txn) override;
+
+  Expected<Members> removeRangeByScore(const Zrangespec& range,
+                                       Transaction* txn) override;
+  Expected<Members> removeRangeByLex(const Zlexrangespec& range,
+                                     Transaction* txn) override;
+  Expected<Members> removeRangeByRank(uint32_t start,
+                                      uint32_t end,
+                                      Transaction* txn) override;
+
+  Status save(Transaction* txn,
+              const Expected<RecordValue>& oldValue,
+              uint64_t versionEP) override;
+  uint32_t getCount() const override {
+    return _entries.size() + 1;
+  }
+  const PackedEntries* getPacked() const override {
+    return &_entries;
+  }
+
+ private:
+  using Member = std::pair<double, std::string>;
+  using Filter = std::function<bool(const Member&)>;
+
+  // the members in (score, member) order
+  Expected<std::vector<Member>> sorted() const;
+  // the members passing the filter, in order or backward if rev
+  Expected<Members> scanIf(const Filter& filter,
+                           uint64_t offset,
+                           uint64_t limit,
+                           bool rev);
+  Expected<Members> removeAll(const Expected<Members>& members);
+
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  std::string _pk;
+  PStore _store;
+  PackedEntries _entries;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_PACKEDZSET_H_
@@ -2,7 +2,9 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <cstring>
 #include <type_traits>
+#include <algorithm>
 #include <utility>
 #include <memory>
 #include <vector>
@@ -485,6 +487,33 @@ Expected<RecordKey> RecordKey::decode(const std::string& key) {
   return RecordKey(chunkid, dbid, type, std::move(pk), std::move(sk), version);
 }
 
+size_t RecordKey::decodePrefixPkSize(const char* key, size_t size) {
+  constexpr size_t rsvd = sizeof(TRSV);
+  const size_t offset = getHdrSize();
+  const uint8_t* keyCstr = reinterpret_cast<const uint8_t*>(key);
+
+  // pk, the padding 0 and the version 0
+  if (size < offset + 3 || keyCstr[offset] == 0) {
+    return 0;
+  }
+  // the last byte of len(PK) is never 0 for a non-empty pk, while a
+  // prefixPk() ends with the padding 0 and the version 0
+  if (keyCstr[size - rsvd - 1] == 0) {
+    return keyCstr[size - 1] == 0 ? size : 0;
+  }
+
+  auto expt = varintDecodeRvs(keyCstr + size - rsvd - 1, size - rsvd - offset);
+  if (!expt.ok()) {
+    return 0;
+  }
+  size_t pkLen = expt.value().first;
+  if (size < offset + pkLen + 2 + expt.value().second + rsvd ||
+      keyCstr[offset + pkLen] != 0 || keyCstr[offset + pkLen + 1] != 0) {
+    return 0;
+  }
+  return offset + pkLen + 2;
+}
+
 size_t RecordKey::minSize() {
   // min key len = 13, 3 is the min size of \0|version|pklen
   return getHdrSize() + sizeof(TRSV) + 3;
@@ -1090,12 +1119,102 @@ std::string Record::toString() const {
   return ss.str();
 }
 
+Expected<PackedEntries> PackedEntries::decode(const uint8_t* data,
+                                              size_t len) {
+  PackedEntries result;
+  size_t offset = 0;
+  while (offset < len) {
+    std::string kv[2];
+    for (auto& str : kv) {
+      auto expt = varintDecodeFwd(data + offset, len - offset);
+      if (!expt.ok()) {
+        return expt.status();
+      }
+      offset += expt.value().second;
+      if (expt.value().first > len - offset) {
+        return {ErrorCodes::ERR_DECODE, "invalid packed entries"};
+      }
+      str.assign(reinterpret_cast<const char*>(data + offset),
+                 expt.value().first);
+      offset += expt.value().first;
+    }
+    if (!result._entries.empty() && result._entries.back().first >= kv[0]) {
+      return {ErrorCodes::ERR_DECODE, "unordered packed entries"};
+    }
+    result._entries.emplace_back(std::move(kv[0]), std::move(kv[1]));
+  }
+  return std::move(result);
+}
+
+void PackedEntries::encode(std::vector<uint8_t>* buf) const {
+  for (const auto& entry : _entries) {
+    for (const auto* str : {&entry.first, &entry.second}) {
+      auto lenBytes = varintEncode(str->size());
+      buf->insert(buf->end(), lenBytes.begin(), lenBytes.end());
+      buf->insert(buf->end(), str->begin(), str->end());
+    }
+  }
+}
+
+std::vector<PackedEntries::Entry>::const_iterator PackedEntries::lowerBound(
+  const std::string& field) const {
+  return std::lower_bound(_entries.begin(),
+                          _entries.end(),
+                          field,
+                          [](const Entry& e, const std::string& f) {
+                            return e.first < f;
+                          });
+}
+
+const std::string* PackedEntries::get(const std::string& field) const {
+  auto it = lowerBound(field);
+  if (it == _entries.end() || it->first != field) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool PackedEntries::set(const std::string& field, const std::string& value) {
+  auto it = _entries.begin() + (lowerBound(field) - _entries.begin());
+  if (it != _entries.end() && it->first == field) {
+    it->second = value;
+    return false;
+  }
+  _entries.emplace(it, field, value);
+  return true;
+}
+
+bool PackedEntries::erase(const std::string& field) {
+  auto it = lowerBound(field);
+  if (it == _entries.end() || it->first != field) {
+    return false;
+  }
+  _entries.erase(it);
+  return true;
+}
+
+bool PackedEntries::fits(uint64_t maxEntries, uint64_t maxValueLen) const {
+  if (_entries.size() > maxEntries) {
+    return false;
+  }
+  for (const auto& entry : _entries) {
+    if (entry.first.size() > maxValueLen ||
+        entry.second.size() > maxValueLen) {
+      return false;
+    }
+  }
+  return true;
+}
+
 HashMetaValue::HashMetaValue() : HashMetaValue(0) {}
 
-HashMetaValue::HashMetaValue(uint64_t count) : _count(count) {}
+HashMetaValue::HashMetaValue(uint64_t count) : _count(count), _packed(false) {}
 
-HashMetaValue::HashMetaValue(HashMetaValue&& o) : _count(o._count) {
+HashMetaValue::HashMetaValue(HashMetaValue&& o)
+  : _count(o._count), _packed(o._packed), _entries(std::move(o._entries)) {
   o._count = 0;
+  o._packed = false;
+  o._entries.clear();
 }
 
 std::string HashMetaValue::encode() const {
@@ -1103,6 +1222,11 @@ std::string HashMetaValue::encode() const {
   value.reserve(128);
   auto countBytes = varintEncode(_count);
   value.insert(value.end(), countBytes.begin(), countBytes.end());
+  if (_packed) {
+    INVARIANT_D(_count == _entries.size());
+    value.push_back(PACKED_TAG);
+    _entries.encode(&value);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1117,7 +1241,24 @@ Expected<HashMetaValue> HashMetaValue::decode(const std::string& val) {
   offset += expt.value().second;
   count = expt.value().first;
 
-  return HashMetaValue(count);
+  HashMetaValue result(count);
+  if (offset < val.size()) {
+    if (valCstr[offset] != PACKED_TAG) {
+      return {ErrorCodes::ERR_DECODE, "invalid hash meta"};
+    }
+    offset++;
+    auto eEntries =
+      PackedEntries::decode(valCstr + offset, val.size() - offset);
+    if (!eEntries.ok()) {
+      return eEntries.status();
+    }
+    if (eEntries.value().size() != count) {
+      return {ErrorCodes::ERR_DECODE, "invalid packed hash count"};
+    }
+    result._packed = true;
+    result._entries = std::move(eEntries.value());
+  }
+  return std::move(result);
 }
 
 HashMetaValue& HashMetaValue::operator=(HashMetaValue&& o) {
@@ -1125,7 +1266,11 @@ HashMetaValue& HashMetaValue::operator=(HashMetaValue&& o) {
     return *this;
   }
   _count = o._count;
+  _packed = o._packed;
+  _entries = std::move(o._entries);
   o._count = 0;
+  o._packed = false;
+  o._entries.clear();
   return *this;
 }
 
@@ -1137,13 +1282,21 @@ uint64_t HashMetaValue::getCount() const {
   return _count;
 }
 
+void HashMetaValue::setPacked(bool packed) {
+  _packed = packed;
+  if (!packed) {
+    _entries.clear();
+  }
+}
+
 ListMetaValue::ListMetaValue(uint64_t head, uint64_t tail)
-  : _head(head), _tail(tail) {}
+  : _head(head), _tail(tail), _segmented(false) {}
 
 ListMetaValue::ListMetaValue(ListMetaValue&& v)
-  : _head(v._head), _tail(v._tail) {
+  : _head(v._head), _tail(v._tail), _segmented(v._segmented) {
   v._head = 0;
   v._tail = 0;
+  v._segmented = false;
 }
 
 std::string ListMetaValue::encode() const {
@@ -1153,6 +1306,9 @@ std::string ListMetaValue::encode() const {
   value.insert(value.end(), headBytes.begin(), headBytes.end());
   auto tailBytes = varintEncode(_tail);
   value.insert(value.end(), tailBytes.begin(), tailBytes.end());
+  if (_segmented) {
+    value.push_back(SEGMENTED_TAG);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1174,7 +1330,15 @@ Expected<ListMetaValue> ListMetaValue::decode(const std::string& val) {
   }
   offset += expt.value().second;
   tail = expt.value().first;
-  return ListMetaValue(head, tail);
+
+  ListMetaValue result(head, tail);
+  if (offset < val.size()) {
+    if (valCstr[offset] != SEGMENTED_TAG || offset + 1 != val.size()) {
+      return {ErrorCodes::ERR_DECODE, "invalid list meta"};
+    }
+    result._segmented = true;
+  }
+  return std::move(result);
 }
 
 ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
@@ -1183,8 +1347,10 @@ ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
   }
   _head = o._head;
   _tail = o._tail;
+  _segmented = o._segmented;
   o._head = 0;
   o._tail = 0;
+  o._segmented = false;
   return *this;
 }
 
@@ -1204,9 +1370,47 @@ uint64_t ListMetaValue::getTail() const {
   return _tail;
 }
 
-SetMetaValue::SetMetaValue() : _count(0) {}
+void ListMetaValue::setSegmented(bool segmented) {
+  _segmented = segmented;
+  if (segmented) {
+    _tail = _head;
+  }
+}
+
+Expected<ListSegment> ListSegment::decode(const std::string& val) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(val.data());
+  size_t len = val.size();
+  size_t offset = 0;
+  ListSegment result;
+  while (offset < len) {
+    auto expt = varintDecodeFwd(data + offset, len - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    if (expt.value().first > len - offset) {
+      return {ErrorCodes::ERR_DECODE, "invalid list segment"};
+    }
+    result._elements.emplace_back(val.data() + offset, expt.value().first);
+    offset += expt.value().first;
+  }
+  return std::move(result);
+}
+
+std::string ListSegment::encode() const {
+  std::string value;
+  for (const auto& ele : _elements) {
+    auto lenBytes = varintEncode(ele.size());
+    value.append(reinterpret_cast<const char*>(lenBytes.data()),
+                 lenBytes.size());
+    value.append(ele);
+  }
+  return value;
+}
 
-SetMetaValue::SetMetaValue(uint64_t count) : _count(count) {}
+SetMetaValue::SetMetaValue() : SetMetaValue(0) {}
+
+SetMetaValue::SetMetaValue(uint64_t count) : _count(count), _packed(false) {}
 
 Expected<SetMetaValue> SetMetaValue::decode(const std::string& val) {
   const uint8_t* valCstr = reinterpret_cast<const uint8_t*>(val.c_str());
@@ -1217,14 +1421,37 @@ Expected<SetMetaValue> SetMetaValue::decode(const std::string& val) {
   }
   offset += expt.value().second;
   uint64_t count = expt.value().first;
-  return SetMetaValue(count);
+
+  SetMetaValue result(count);
+  if (offset < val.size()) {
+    if (valCstr[offset] != PACKED_TAG) {
+      return {ErrorCodes::ERR_DECODE, "invalid set meta"};
+    }
+    offset++;
+    auto eEntries =
+      PackedEntries::decode(valCstr + offset, val.size() - offset);
+    if (!eEntries.ok()) {
+      return eEntries.status();
+    }
+    if (eEntries.value().size() != count) {
+      return {ErrorCodes::ERR_DECODE, "invalid packed set count"};
+    }
+    result._packed = true;
+    result._entries = std::move(eEntries.value());
+  }
+  return result;
 }
 
 std::string SetMetaValue::encode() const {
   std::vector<uint8_t> value;
-  value.reserve(8);
+  value.reserve(_packed ? 128 : 8);
   auto countBytes = varintEncode(_count);
   value.insert(value.end(), countBytes.begin(), countBytes.end());
+  if (_packed) {
+    INVARIANT_D(_count == _entries.size());
+    value.push_back(PACKED_TAG);
+    _entries.encode(&value);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1236,6 +1463,13 @@ uint64_t SetMetaValue::getCount() const {
   return _count;
 }
 
+void SetMetaValue::setPacked(bool packed) {
+  _packed = packed;
+  if (!packed) {
+    _entries.clear();
+  }
+}
+
 uint32_t ZSlMetaValue::HEAD_ID = 1;
 
 ZSlMetaValue::ZSlMetaValue() : ZSlMetaValue(0, 0, 0) {}
@@ -1245,7 +1479,9 @@ ZSlMetaValue::ZSlMetaValue(uint8_t lvl, uint32_t count, uint64_t tail)
     _maxLevel(MAX_LAYER),
     _count(count),
     _tail(tail),
-    _posAlloc(ZSlMetaValue::MIN_POS) {
+    _posAlloc(ZSlMetaValue::MIN_POS),
+    _blockEntries(0),
+    _packed(false) {
   // NOTE(vinchen): _maxLevel can't change. If you want to
   // change it, the constructor of ZSlEleValue should add new
   // parameter of it.
@@ -1279,6 +1515,16 @@ std::string ZSlMetaValue::encode() const {
   bytes = varintEncode(_posAlloc);
   value.insert(value.end(), bytes.begin(), bytes.end());
 
+  if (isScoreKeys()) {
+    value.push_back(SCORE_KEY_TAG);
+    bytes = varintEncode(_blockEntries);
+    value.insert(value.end(), bytes.begin(), bytes.end());
+  } else if (_packed) {
+    INVARIANT_D(_count == _entries.size() + 1);
+    value.push_back(PACKED_TAG);
+    _entries.encode(&value);
+  }
+
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1328,9 +1574,132 @@ Expected<ZSlMetaValue> ZSlMetaValue::decode(const std::string& val) {
   offset += expt.value().second;
   result._posAlloc = expt.value().first;
 
+  if (offset < val.size() && keyCstr[offset] == PACKED_TAG) {
+    offset++;
+    auto eEntries =
+      PackedEntries::decode(keyCstr + offset, val.size() - offset);
+    if (!eEntries.ok()) {
+      return eEntries.status();
+    }
+    if (eEntries.value().size() + 1 != result._count) {
+      return {ErrorCodes::ERR_DECODE, "invalid packed zset count"};
+    }
+    result._packed = true;
+    result._entries = std::move(eEntries.value());
+  } else if (offset < val.size()) {
+    if (keyCstr[offset] != SCORE_KEY_TAG) {
+      return {ErrorCodes::ERR_DECODE, "invalid zset meta"};
+    }
+    offset++;
+    expt = varintDecodeFwd(keyCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    result._blockEntries = expt.value().first;
+    if (result._blockEntries == 0 || offset != val.size()) {
+      return {ErrorCodes::ERR_DECODE, "invalid zset meta with score keys"};
+    }
+  }
+
+  return result;
+}
+
+void ZSlMetaValue::setScoreKeys(uint32_t blockEntries) {
+  _blockEntries = blockEntries;
+  if (blockEntries > 0) {
+    _level = 0;
+    _tail = 0;
+    setPacked(false);
+  }
+}
+
+void ZSlMetaValue::setPacked(bool packed) {
+  _packed = packed;
+  if (packed) {
+    _level = 0;
+    _tail = 0;
+    _blockEntries = 0;
+  } else {
+    _entries.clear();
+  }
+}
+
+std::string zslScoreKeyPrefix(double score, bool after) {
+  // -0.0 and 0.0 are the same score
+  if (score == 0) {
+    score = 0;
+  }
+  uint64_t bits = 0;
+  static_assert(sizeof(bits) == sizeof(score), "invalid double size");
+  memcpy(&bits, &score, sizeof(bits));
+  // the negatives are reversed, and all put before the positives
+  if (bits >> 63) {
+    bits = ~bits;
+  } else {
+    bits |= 1ULL << 63;
+  }
+  // NaN is never a score, so it never overflows
+  if (after) {
+    bits++;
+  }
+  std::string result(sizeof(bits), '\0');
+  for (size_t i = 0; i < sizeof(bits); ++i) {
+    result[i] =
+      static_cast<char>((bits >> ((sizeof(bits) - 1 - i) * 8)) & 0xff);
+  }
+  return result;
+}
+
+std::string zslScoreKeyEncode(double score, const std::string& member) {
+  std::string result = zslScoreKeyPrefix(score);
+  result.reserve(result.size() + member.size() + 2);
+  // "\0" is escaped as "\0\xff", and "\0\0" ends the member
+  for (char c : member) {
+    result.push_back(c);
+    if (c == '\0') {
+      result.push_back('\xff');
+    }
+  }
+  result.append(2, '\0');
   return result;
 }
 
+Expected<std::pair<double, std::string>> zslScoreKeyDecode(
+  const std::string& sk) {
+  constexpr size_t scoreSize = sizeof(uint64_t);
+  if (sk.size() < scoreSize + 2) {
+    return {ErrorCodes::ERR_DECODE, "invalid zset score key"};
+  }
+  uint64_t bits = 0;
+  for (size_t i = 0; i < scoreSize; ++i) {
+    bits = (bits << 8) | static_cast<uint8_t>(sk[i]);
+  }
+  if (bits >> 63) {
+    bits &= ~(1ULL << 63);
+  } else {
+    bits = ~bits;
+  }
+  double score = 0;
+  memcpy(&score, &bits, sizeof(score));
+
+  std::string member;
+  member.reserve(sk.size() - scoreSize - 2);
+  for (size_t i = scoreSize; i + 1 < sk.size(); ++i) {
+    if (sk[i] != '\0') {
+      member.push_back(sk[i]);
+    } else if (sk[i + 1] == '\xff') {
+      member.push_back('\0');
+      ++i;
+    } else if (sk[i + 1] == '\0' && i + 2 == sk.size()) {
+      return std::make_pair(score, std::move(member));
+    } else {
+      break;
+    }
+  }
+  return {ErrorCodes::ERR_DECODE, "invalid zset score key"};
+}
+
 uint8_t ZSlMetaValue::getMaxLevel() const {
   return _maxLevel;
 }
@@ -140,6 +140,10 @@ class RecordKey {
   static RecordType decodeType(const std::string& key);
   static Expected<RecordKey> decode(const std::string& key);
   static RecordType decodeType(const char* key, size_t size);
+  // the size of prefixPk() of an encoded key, the key itself can also be
+  // a prefixPk(). Return 0 if the pk is empty or begins with 0, since
+  // such a prefixPk() can not be told from an encoded key.
+  static size_t decodePrefixPkSize(const char* key, size_t size);
   static Expected<bool> validate(const std::string& key,
                                  RecordType type = RecordType::RT_INVALID);
   static size_t minSize();
@@ -579,8 +583,19 @@ class BinlogReader {
   mystring_view _val;
 };
 
+/*
+ * HEAD|TAIL[|SEGMENTED_TAG]
+ * A segmented list keeps its elements in RT_LIST_ELE records of at most
+ * list-max-segment-entries elements each, the sub key is the segment id
+ * and the value a ListSegment. The segments are the entries of a
+ * CountedTree of the list, in list order, so the meta keeps its size and
+ * TAIL - HEAD is still the length of the list. Metas written before the
+ * segmented encoding have nothing after TAIL.
+ */
 class ListMetaValue {
  public:
+  static constexpr uint8_t SEGMENTED_TAG = 1;
+
   ListMetaValue(uint64_t head, uint64_t tail);
   ListMetaValue(ListMetaValue&&);
   static Expected<ListMetaValue> decode(const std::string&);
@@ -591,13 +606,92 @@ class ListMetaValue {
   void setTail(uint64_t tail);
   uint64_t getTail() const;
 
+  bool isSegmented() const {
+    return _segmented;
+  }
+  // an empty segmented list, or a plain one with the segments dropped
+  void setSegmented(bool segmented);
+
  private:
   uint64_t _head;
   uint64_t _tail;
+  bool _segmented;
+};
+
+// ListSegment keeps consecutive elements of a segmented list in one
+// RT_LIST_ELE record, each encoded as varint(len(element))|element
+class ListSegment {
+ public:
+  ListSegment() = default;
+  ListSegment(ListSegment&&) = default;
+  ListSegment& operator=(ListSegment&&) = default;
+  static Expected<ListSegment> decode(const std::string& val);
+  std::string encode() const;
+  const std::vector<std::string>& getElements() const {
+    return _elements;
+  }
+  std::vector<std::string>* getMutableElements() {
+    return &_elements;
+  }
+  size_t size() const {
+    return _elements.size();
+  }
+
+ private:
+  std::vector<std::string> _elements;
+};
+
+// PackedEntries keeps the elements of a small collection in one value,
+// sorted by field, so the order is the same as the sub keys in rocksdb.
+// Each entry is encoded as varint(len(field))|field|varint(len(value))|value
+// The members of a set have empty values, the ones of a zset have their
+// scores as doubleEncode().
+class PackedEntries {
+ public:
+  using Entry = std::pair<std::string, std::string>;
+
+  PackedEntries() = default;
+  PackedEntries(const PackedEntries&) = default;
+  PackedEntries(PackedEntries&&) = default;
+  PackedEntries& operator=(const PackedEntries&) = default;
+  PackedEntries& operator=(PackedEntries&&) = default;
+  static Expected<PackedEntries> decode(const uint8_t* data, size_t len);
+  void encode(std::vector<uint8_t>* buf) const;
+  // return nullptr if the field does not exist
+  const std::string* get(const std::string& field) const;
+  // return true if the field is newly added
+  bool set(const std::string& field, const std::string& value);
+  // return true if the field existed
+  bool erase(const std::string& field);
+  // whether there are no more than maxEntries entries, and no field or
+  // value is longer than maxValueLen
+  bool fits(uint64_t maxEntries, uint64_t maxValueLen) const;
+  const std::vector<Entry>& getEntries() const {
+    return _entries;
+  }
+  size_t size() const {
+    return _entries.size();
+  }
+  void clear() {
+    _entries.clear();
+  }
+
+ private:
+  std::vector<Entry>::const_iterator lowerBound(
+    const std::string& field) const;
+  std::vector<Entry> _entries;
 };
 
+/*
+ * COUNT[|PACKED_TAG|PackedEntries]
+ * A small hash can be packed into its meta instead of one RT_HASH_ELE
+ * record per field, see hash-max-packed-entries. Metas written before
+ * the packed encoding have nothing after COUNT.
+ */
 class HashMetaValue {
  public:
+  static constexpr uint8_t PACKED_TAG = 1;
+
   HashMetaValue();
   explicit HashMetaValue(uint64_t count);
   HashMetaValue(HashMetaValue&&);
@@ -608,22 +702,56 @@ class HashMetaValue {
   // void setCas(int64_t cas);
   uint64_t getCount() const;
   // uint64_t getCas() const;
+  bool isPacked() const {
+    return _packed;
+  }
+  // the entries are dropped when the hash is unpacked
+  void setPacked(bool packed);
+  const PackedEntries& getEntries() const {
+    return _entries;
+  }
+  PackedEntries* getMutableEntries() {
+    return &_entries;
+  }
 
  private:
   uint64_t _count;
+  bool _packed;
+  PackedEntries _entries;
 };
 
+/*
+ * COUNT[|PACKED_TAG|PackedEntries]
+ * A small set can be packed into its meta instead of one RT_SET_ELE
+ * record per member, see set-max-packed-entries. The members are the
+ * fields of the entries, with empty values.
+ */
 class SetMetaValue {
  public:
+  static constexpr uint8_t PACKED_TAG = 1;
+
   SetMetaValue();
   explicit SetMetaValue(uint64_t count);
   static Expected<SetMetaValue> decode(const std::string&);
   std::string encode() const;
   void setCount(uint64_t count);
   uint64_t getCount() const;
+  bool isPacked() const {
+    return _packed;
+  }
+  // the members are dropped when the set is unpacked
+  void setPacked(bool packed);
+  const PackedEntries& getEntries() const {
+    return _entries;
+  }
+  PackedEntries* getMutableEntries() {
+    return &_entries;
+  }
 
  private:
   uint64_t _count;
+  bool _packed;
+  PackedEntries _entries;
 };
 
 
@@ -632,6 +760,11 @@ class SetMetaValue {
 META: *1
 CHUNK|DBID|ZSET_META|KEY|
 LEVEL|MAX_LEVEL|COUNT+1|TAIL|POSALLOC|
+[SCORE_KEY_TAG|BLOCK_ENTRIES] or [PACKED_TAG|PackedEntries]
+
+A small zset can be packed into its meta, see zset-max-packed-entries, it
+has no S_ELE and no H_ELE records then. The entries are the members with
+their scores as doubleEncode(), COUNT is still the members plus one.
 
 S_ELE: *(COUNT+1)
 CHUNK|DBID|S_ELE|KEY|POS|  -- HEAD_ID(first element)
@@ -641,8 +774,30 @@ H_ELE: *(COUNT)
 CHUNK|DBID|H_ELE|KEY|SUBKEY|
 score
 
+A zset with score keys keeps no skiplist. Each member has an S_ELE record
+with an empty value and zslScoreKeyEncode(score, member) as the sub key,
+so the S_ELE records are in (score, member) order. The members are
+counted in blocks of sub keys for the ranks, the blocks are the entries
+of a CountedTree keyed by the first sub keys, the first block starts from
+"". The nodes of the tree are S_ELE records too, after all the members.
+
+S_ELE: *(COUNT)
+CHUNK|DBID|S_ELE|KEY|SCORE|MEMBER|
+
+S_ELE: *(NODES)
+CHUNK|DBID|S_ELE|KEY|NODE_KEY_PREFIX|NODE_ID|
+
 */
 
+// the sub key of a member of a zset with score keys, the score is kept in
+// 8 bytes ordered as the doubles, and the member is escaped to keep the
+// bytes order with the suffix of the encoded RecordKey after it
+std::string zslScoreKeyEncode(double score, const std::string& member);
+Expected<std::pair<double, std::string>> zslScoreKeyDecode(
+  const std::string& sk);
+// the smallest sub key with score, or the first one after the score
+std::string zslScoreKeyPrefix(double score, bool after = false);
+
 // ZsetSkipListMetaValue
 class ZSlMetaValue {
  public:
@@ -656,6 +811,30 @@ class ZSlMetaValue {
   uint32_t getCount() const;
   uint64_t getTail() const;
   uint64_t getPosAlloc() const;
+
+  static constexpr uint8_t SCORE_KEY_TAG = 1;
+  static constexpr uint8_t PACKED_TAG = 2;
+  bool isScoreKeys() const {
+    return _blockEntries > 0;
+  }
+  bool isPacked() const {
+    return _packed;
+  }
+  // a packed zset has no skiplist, the members are dropped when it is
+  // unpacked
+  void setPacked(bool packed);
+  const PackedEntries& getEntries() const {
+    return _entries;
+  }
+  PackedEntries* getMutableEntries() {
+    return &_entries;
+  }
+  uint32_t getBlockEntries() const {
+    return _blockEntries;
+  }
+  // a zset with score keys, a block is split beyond twice blockEntries
+  // members, 0 for a skiplist
+  void setScoreKeys(uint32_t blockEntries);
   // can not dynamicly change
   static constexpr int8_t MAX_LAYER = ZSKIPLIST_MAXLEVEL;
   static constexpr uint32_t MAX_NUM = (1 << 31);
@@ -671,6 +850,9 @@ class ZSlMetaValue {
   uint32_t _count;
   uint64_t _tail;
   uint64_t _posAlloc;
+  uint32_t _blockEntries;
+  bool _packed;
+  PackedEntries _entries;
 };
 
 class ZSlEleValue {
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <limits>
 #include "tendisplus/storage/record.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/value_cache.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/test_util.h"
@@ -126,6 +128,34 @@ TEST(Record, MinRec) {
   EXPECT_TRUE(minSize == RecordValue::minSize());
 }
 
+TEST(Record, PrefixPkSize) {
+  for (size_t pkLen : {1, 5, 127, 128, 200, 20000}) {
+    std::string pk(pkLen, 'a');
+    for (const auto& sk : {std::string(), std::string(1, '\0'),
+                           std::string("\x01\0", 2), randomStr(20, false)}) {
+      RecordKey rk(genRand(), genRand(), RecordType::RT_HASH_ELE, pk, sk);
+      auto prefix = rk.prefixPk();
+      auto key = rk.encode();
+      EXPECT_EQ(RecordKey::decodePrefixPkSize(key.c_str(), key.size()),
+                prefix.size());
+      EXPECT_EQ(RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()),
+                prefix.size());
+    }
+  }
+
+  // can not be told from a prefixPk() by the tail
+  for (const auto& pk : {std::string(), std::string("\0a", 2)}) {
+    RecordKey rk(0, 0, RecordType::RT_SET_ELE, pk, "b");
+    auto key = rk.encode();
+    EXPECT_EQ(RecordKey::decodePrefixPkSize(key.c_str(), key.size()), 0U);
+    auto prefix = rk.prefixPk();
+    EXPECT_EQ(RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()),
+              0U);
+  }
+  auto hdr = RecordKey(0, 0, RecordType::RT_KV, "", "").prefixChunkid();
+  EXPECT_EQ(RecordKey::decodePrefixPkSize(hdr.c_str(), hdr.size()), 0U);
+}
+
 TEST(Record, Common) {
   srand((unsigned int)time(NULL));
 #ifdef _WIN32
@@ -415,4 +445,256 @@ TEST(VersionMeta, Compare) {
   EXPECT_LT(meta1, meta4);
 }
 
+TEST(HashMetaValue, Packed) {
+  // metas written before the packed encoding
+  HashMetaValue plain(3);
+  auto expPlain = HashMetaValue::decode(plain.encode());
+  EXPECT_TRUE(expPlain.ok());
+  EXPECT_FALSE(expPlain.value().isPacked());
+  EXPECT_EQ(expPlain.value().getCount(), 3u);
+
+  HashMetaValue meta;
+  meta.setPacked(true);
+  auto entries = meta.getMutableEntries();
+  EXPECT_TRUE(entries->set("b", "2"));
+  EXPECT_TRUE(entries->set("a", "1"));
+  EXPECT_TRUE(entries->set("c", ""));
+  EXPECT_FALSE(entries->set("a", "11"));
+  EXPECT_TRUE(entries->set(std::string("\0\xff", 2), std::string(300, 'v')));
+  EXPECT_TRUE(entries->erase("c"));
+  EXPECT_FALSE(entries->erase("c"));
+  meta.setCount(entries->size());
+
+  auto expMeta = HashMetaValue::decode(meta.encode());
+  EXPECT_TRUE(expMeta.ok());
+  const auto& decoded = expMeta.value();
+  EXPECT_TRUE(decoded.isPacked());
+  EXPECT_EQ(decoded.getCount(), 3u);
+  EXPECT_EQ(*decoded.getEntries().get("a"), "11");
+  EXPECT_EQ(*decoded.getEntries().get("b"), "2");
+  EXPECT_EQ(decoded.getEntries().get("c"), nullptr);
+  const auto& vec = decoded.getEntries().getEntries();
+  EXPECT_TRUE(std::is_sorted(vec.begin(), vec.end()));
+  EXPECT_EQ(vec[0].first, std::string("\0\xff", 2));
+  EXPECT_EQ(vec[0].second, std::string(300, 'v'));
+
+  EXPECT_TRUE(decoded.getEntries().fits(3, 300));
+  EXPECT_FALSE(decoded.getEntries().fits(2, 300));
+  EXPECT_FALSE(decoded.getEntries().fits(3, 299));
+
+  // truncated
+  std::string encoded = meta.encode();
+  EXPECT_FALSE(
+    HashMetaValue::decode(encoded.substr(0, encoded.size() - 1)).ok());
+  // count mismatch
+  HashMetaValue bad;
+  bad.setPacked(true);
+  bad.getMutableEntries()->set("a", "1");
+  bad.setCount(1);
+  encoded = bad.encode();
+  encoded[0] = 2;
+  EXPECT_FALSE(HashMetaValue::decode(encoded).ok());
+
+  meta.setPacked(false);
+  EXPECT_EQ(meta.getEntries().size(), 0u);
+  EXPECT_FALSE(HashMetaValue::decode(meta.encode()).value().isPacked());
+}
+
+TEST(SetMetaValue, Packed) {
+  SetMetaValue plain(3);
+  auto expPlain = SetMetaValue::decode(plain.encode());
+  EXPECT_TRUE(expPlain.ok());
+  EXPECT_FALSE(expPlain.value().isPacked());
+  EXPECT_EQ(expPlain.value().getCount(), 3u);
+
+  SetMetaValue meta;
+  meta.setPacked(true);
+  EXPECT_TRUE(meta.getMutableEntries()->set("b", ""));
+  EXPECT_TRUE(meta.getMutableEntries()->set("a", ""));
+  EXPECT_FALSE(meta.getMutableEntries()->set("a", ""));
+  meta.setCount(meta.getEntries().size());
+  auto expMeta = SetMetaValue::decode(meta.encode());
+  EXPECT_TRUE(expMeta.ok());
+  EXPECT_TRUE(expMeta.value().isPacked());
+  EXPECT_EQ(expMeta.value().getCount(), 2u);
+  EXPECT_EQ(expMeta.value().getEntries().getEntries()[0].first, "a");
+  EXPECT_NE(expMeta.value().getEntries().get("b"), nullptr);
+
+  std::string encoded = meta.encode();
+  encoded[0] = 3;
+  EXPECT_FALSE(SetMetaValue::decode(encoded).ok());
+  EXPECT_FALSE(SetMetaValue::decode(plain.encode() + "\x02").ok());
+
+  meta.setPacked(false);
+  EXPECT_EQ(meta.getEntries().size(), 0u);
+  EXPECT_FALSE(SetMetaValue::decode(meta.encode()).value().isPacked());
+}
+
+TEST(ZSlMetaValue, Packed) {
+  ZSlMetaValue mv(0, 2, 0);
+  mv.setPacked(true);
+  auto score = doubleEncode(1.5);
+  EXPECT_TRUE(mv.getMutableEntries()->set(
+    "a", std::string(score.begin(), score.end())));
+
+  auto eMeta = ZSlMetaValue::decode(mv.encode());
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_TRUE(eMeta.value().isPacked());
+  EXPECT_FALSE(eMeta.value().isScoreKeys());
+  EXPECT_EQ(eMeta.value().getCount(), 2u);
+  EXPECT_EQ(eMeta.value().getLevel(), 0u);
+  EXPECT_EQ(doubleDecode(*eMeta.value().getEntries().get("a")).value(), 1.5);
+
+  // the count has the head, as a skiplist
+  std::string encoded = mv.encode();
+  encoded[2] = 1;
+  EXPECT_FALSE(ZSlMetaValue::decode(encoded).ok());
+
+  // unpacked into score keys
+  mv.setScoreKeys(4);
+  EXPECT_FALSE(mv.isPacked());
+  EXPECT_EQ(mv.getEntries().size(), 0u);
+  eMeta = ZSlMetaValue::decode(mv.encode());
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_FALSE(eMeta.value().isPacked());
+  EXPECT_TRUE(eMeta.value().isScoreKeys());
+}
+
+TEST(ZSl, ScoreKeys) {
+  std::vector<double> scores = {-std::numeric_limits<double>::infinity(),
+                                -1e300,
+                                -2.5,
+                                -1,
+                                -1e-300,
+                                0,
+                                1e-300,
+                                1,
+                                2.5,
+                                1e300,
+                                std::numeric_limits<double>::infinity()};
+  std::vector<std::string> members = {
+    "", std::string("\0", 1), std::string("\0\0", 2), "a",
+    std::string("a\0", 2), std::string("a\0\xff", 3), "ab", "\xff"};
+  // the sub keys are in (score, member) order
+  std::string prev;
+  for (double score : scores) {
+    EXPECT_LT(prev, zslScoreKeyPrefix(score));
+    for (const auto& member : members) {
+      std::string sk = zslScoreKeyEncode(score, member);
+      EXPECT_LT(prev, sk);
+      EXPECT_EQ(sk.compare(0, 8, zslScoreKeyPrefix(score)), 0);
+      EXPECT_LT(sk, zslScoreKeyPrefix(score, true));
+      auto eMember = zslScoreKeyDecode(sk);
+      EXPECT_TRUE(eMember.ok());
+      EXPECT_EQ(eMember.value().first, score);
+      EXPECT_EQ(eMember.value().second, member);
+      prev = sk;
+    }
+  }
+  EXPECT_EQ(zslScoreKeyPrefix(-0.0), zslScoreKeyPrefix(0));
+  EXPECT_FALSE(zslScoreKeyDecode("short").ok());
+  std::string sk = zslScoreKeyEncode(1, "a");
+  EXPECT_FALSE(zslScoreKeyDecode(sk.substr(0, sk.size() - 1)).ok());
+
+  // the skiplist metas have no tag
+  ZSlMetaValue plain(1, 1, 0);
+  auto ePlain = ZSlMetaValue::decode(plain.encode());
+  EXPECT_TRUE(ePlain.ok());
+  EXPECT_FALSE(ePlain.value().isScoreKeys());
+
+  ZSlMetaValue meta(0, 6, 0);
+  meta.setScoreKeys(4);
+  auto eMeta = ZSlMetaValue::decode(meta.encode());
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_TRUE(eMeta.value().isScoreKeys());
+  EXPECT_EQ(eMeta.value().getBlockEntries(), 4u);
+  EXPECT_EQ(eMeta.value().getCount(), 6u);
+  // the blocks are not in the meta, it keeps its size
+  EXPECT_LE(meta.encode().size(), plain.encode().size() + 2);
+  EXPECT_FALSE(ZSlMetaValue::decode(meta.encode() + "\x01").ok());
+
+  // the nodes of the tree of the blocks are after all the score keys, see
+  // CountedTree::NODE_KEY_PREFIX
+  EXPECT_LT(zslScoreKeyEncode(std::numeric_limits<double>::infinity(),
+                              "\xff\xff"),
+            "\xff\xff");
+}
+
+TEST(Record, SegmentedList) {
+  // the metas written before the segmented encoding
+  ListMetaValue plain(10, 13);
+  auto ePlain = ListMetaValue::decode(plain.encode());
+  EXPECT_TRUE(ePlain.ok());
+  EXPECT_FALSE(ePlain.value().isSegmented());
+  EXPECT_EQ(ePlain.value().getTail() - ePlain.value().getHead(), 3u);
+
+  ListMetaValue meta(10, 13);
+  meta.setSegmented(true);
+  EXPECT_EQ(meta.getTail(), meta.getHead());
+  meta.setTail(16);
+  auto eMeta = ListMetaValue::decode(meta.encode());
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_TRUE(eMeta.value().isSegmented());
+  EXPECT_EQ(eMeta.value().getTail() - eMeta.value().getHead(), 6u);
+  // the meta keeps its size however long the list is
+  EXPECT_EQ(meta.encode().size(), plain.encode().size() + 1);
+  EXPECT_FALSE(ListMetaValue::decode(meta.encode() + "\x01").ok());
+
+  ListSegment segment;
+  segment.getMutableElements()->push_back(std::string(300, 'v'));
+  segment.getMutableElements()->push_back("");
+  segment.getMutableElements()->push_back(std::string("\0\xff", 2));
+  auto eSegment = ListSegment::decode(segment.encode());
+  EXPECT_TRUE(eSegment.ok());
+  EXPECT_EQ(eSegment.value().getElements(), segment.getElements());
+  std::string encoded = segment.encode();
+  EXPECT_FALSE(
+    ListSegment::decode(encoded.substr(0, encoded.size() - 1)).ok());
+}
+
+TEST(RecordValueCache, Common) {
+  RecordValueCache cache(1024 * 1024, 4);
+  RecordValue rv("v1", RecordType::RT_KV, -1);
+  RecordValue out(RecordType::RT_INVALID);
+
+  // admitted on the second miss
+  auto gen = cache.getGeneration("k1");
+  EXPECT_FALSE(cache.put("k1", rv, gen));
+  EXPECT_FALSE(cache.get("k1", &out));
+  EXPECT_TRUE(cache.put("k1", rv, gen));
+  EXPECT_TRUE(cache.get("k1", &out));
+  EXPECT_EQ(out, rv);
+
+  // put() after invalidate() is ignored
+  gen = cache.getGeneration("k1");
+  cache.invalidate("k1");
+  EXPECT_FALSE(cache.get("k1", &out));
+  EXPECT_FALSE(cache.put("k1", rv, gen));
+  EXPECT_FALSE(cache.get("k1", &out));
+
+  // too big for a shard
+  RecordValue big(std::string(64 * 1024, 'a'), RecordType::RT_KV, -1);
+  gen = cache.getGeneration("k2");
+  EXPECT_FALSE(cache.put("k2", big, gen));
+  EXPECT_FALSE(cache.put("k2", big, gen));
+
+  // bounded by capacity
+  for (int i = 0; i < 100000; ++i) {
+    std::string key = "key_" + std::to_string(i);
+    gen = cache.getGeneration(key);
+    cache.put(key, rv, gen);
+    cache.put(key, rv, gen);
+  }
+  auto stat = cache.getStat();
+  EXPECT_LE(stat.usage, cache.getCapacity());
+  EXPECT_GT(stat.entries, 0u);
+  EXPECT_GT(stat.evicts, 0u);
+  EXPECT_EQ(stat.hits, 1u);
+
+  cache.clear();
+  stat = cache.getStat();
+  EXPECT_EQ(stat.entries, 0u);
+  EXPECT_EQ(stat.usage, 0u);
+}
+
 }  // namespace tendisplus
@@ -0,0 +1,112 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <thread>  // NOLINT
+#include "tendisplus/storage/rocks/rocks_commit_tracker.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+namespace {
+uint64_t roundUpPowerOf2(uint64_t n) {
+  uint64_t r = 1;
+  while (r < n) {
+    r <<= 1;
+  }
+  return r;
+}
+}  // namespace
+
+BinlogCommitTracker::BinlogCommitTracker(size_t capacity)
+  : _mask(roundUpPowerOf2(std::max(capacity, size_t(2))) - 1),
+    _slots(new std::atomic<uint64_t>[_mask + 1]),
+    _binlogIds(new std::atomic<uint64_t>[_mask + 1]),
+    _next(1),
+    _offset(0),
+    _lowest(1),
+    _highestVisible(0) {
+  for (uint64_t i = 0; i <= _mask; ++i) {
+    _slots[i].store(slotValue(0, FREE), std::memory_order_relaxed);
+    _binlogIds[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void BinlogCommitTracker::reset(uint64_t nextBinlogId,
+                                uint64_t highestVisible) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  INVARIANT_D(_lowest.load() == _next.load());
+  INVARIANT_D(highestVisible < nextBinlogId);
+  // the tickets go on, only the binlogIds are moved
+  _offset.store(nextBinlogId - _next.load());
+  _highestVisible.store(highestVisible);
+}
+
+void BinlogCommitTracker::waitForRoom(uint64_t ticket) {
+  // the slot is still taken by ticket - capacity
+  while (ticket - _lowest.load() > _mask) {
+    std::this_thread::yield();
+  }
+}
+
+void BinlogCommitTracker::take(uint64_t ticket, uint64_t binlogId) {
+  waitForRoom(ticket);
+  _binlogIds[ticket & _mask].store(binlogId);
+  _slots[ticket & _mask].store(slotValue(ticket, IN_FLIGHT));
+}
+
+uint64_t BinlogCommitTracker::assignBinlogId(uint64_t* binlogId) {
+  uint64_t ticket = _next.fetch_add(1);
+  *binlogId = ticket + _offset.load();
+  take(ticket, *binlogId);
+  return ticket;
+}
+
+uint64_t BinlogCommitTracker::setBinlogId(uint64_t binlogId) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  uint64_t ticket = _next.load();
+  // the binlogIds failed on the master are skipped, or it goes back to
+  // apply again after the binlogs from binlogId are rolled back
+  _offset.store(binlogId - ticket);
+  take(ticket, binlogId);
+  _next.store(ticket + 1);
+  return ticket;
+}
+
+void BinlogCommitTracker::finish(uint64_t ticket, bool committed) {
+  auto& slot = _slots[ticket & _mask];
+  INVARIANT_D(slot.load() == slotValue(ticket, IN_FLIGHT));
+  slot.store(slotValue(ticket, committed ? COMMITTED : ROLLED_BACK));
+  advance();
+}
+
+void BinlogCommitTracker::advance() {
+  uint64_t lowest = _lowest.load();
+  while (true) {
+    uint64_t value = _slots[lowest & _mask].load();
+    if ((value >> 2) != lowest) {
+      // not assigned yet
+      return;
+    }
+    uint64_t state = value & 3;
+    if (state != COMMITTED && state != ROLLED_BACK) {
+      return;
+    }
+    // the slot may be taken again once _lowest moves on
+    uint64_t binlogId = _binlogIds[lowest & _mask].load();
+    // the lowest is moved by someone else if failed, and reloaded
+    if (!_lowest.compare_exchange_weak(lowest, lowest + 1)) {
+      continue;
+    }
+    if (state == COMMITTED) {
+      uint64_t visible = _highestVisible.load();
+      while (visible < binlogId &&
+             !_highestVisible.compare_exchange_weak(visible, binlogId)) {
+      }
+    }
+    ++lowest;
+  }
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,95 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_COMMIT_TRACKER_H_
+#define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_COMMIT_TRACKER_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
+
+namespace tendisplus {
+
+// BinlogCommitTracker gives out the binlogIds of a store and keeps the
+// highest visible one, which is the largest committed binlogId with all
+// the binlogIds before it committed or rolled back.
+//
+// Each binlogId given out gets a ticket, the tickets are consecutive and
+// start from 1, binlogId = ticket + offset. The tickets in flight are
+// kept in a ring, each slot holds (ticket << 2 | state).
+// assignBinlogId(), finish() and the getters take no lock. The committer
+// which finishes the lowest ticket in flight moves _lowest forward over
+// all the finished ones following it. At most capacity tickets can be in
+// flight, a txn assigning one beyond waits for the lowest one to finish.
+//
+// The binlogIds of a slave are decided by its master, they may skip the
+// ones failed on the master, or go back after a failed apply.
+// setBinlogId() changes the offset with a mutex, so the gaps take no
+// slot. Assigning and setting binlogIds on one store at the same time is
+// not expected.
+class BinlogCommitTracker {
+ public:
+  static constexpr size_t DEFAULT_CAPACITY = 4096;
+  // a txn without binlog
+  static constexpr uint64_t TICKET_NONE = 0;
+
+  explicit BinlogCommitTracker(size_t capacity = DEFAULT_CAPACITY);
+  BinlogCommitTracker(const BinlogCommitTracker&) = delete;
+  BinlogCommitTracker(BinlogCommitTracker&&) = delete;
+
+  // no binlog should be in flight
+  void reset(uint64_t nextBinlogId, uint64_t highestVisible);
+  // return the ticket, which is passed to finish()
+  uint64_t assignBinlogId(uint64_t* binlogId);
+  uint64_t setBinlogId(uint64_t binlogId);
+  // committed is false if the txn is rolled back
+  void finish(uint64_t ticket, bool committed);
+
+  uint64_t getHighestVisible() const {
+    return _highestVisible.load(std::memory_order_acquire);
+  }
+  uint64_t getNextBinlogId() const {
+    return _next.load(std::memory_order_acquire) +
+      _offset.load(std::memory_order_acquire);
+  }
+  // the number of binlogs not finished
+  uint64_t getInFlight() const {
+    return _next.load(std::memory_order_acquire) -
+      _lowest.load(std::memory_order_acquire);
+  }
+  size_t getCapacity() const {
+    return _mask + 1;
+  }
+
+ private:
+  enum State : uint64_t {
+    FREE = 0,
+    IN_FLIGHT = 1,
+    COMMITTED = 2,
+    ROLLED_BACK = 3,
+  };
+  static uint64_t slotValue(uint64_t ticket, State state) {
+    return (ticket << 2) | state;
+  }
+  void waitForRoom(uint64_t ticket);
+  void take(uint64_t ticket, uint64_t binlogId);
+  void advance();
+
+  const uint64_t _mask;
+  std::unique_ptr<std::atomic<uint64_t>[]> _slots;
+  // the binlogIds of the tickets in flight
+  std::unique_ptr<std::atomic<uint64_t>[]> _binlogIds;
+  std::mutex _mutex;
+  // the next ticket
+  std::atomic<uint64_t> _next;
+  // binlogId - ticket, may wrap around
+  std::atomic<uint64_t> _offset;
+  // the lowest ticket not finished
+  std::atomic<uint64_t> _lowest;
+  std::atomic<uint64_t> _highestVisible;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_COMMIT_TRACKER_H_
@@ -25,17 +25,21 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/backupable_db.h"
 #include "rocksdb/utilities/checkpoint.h"
+#include "rocksdb/utilities/write_batch_with_index.h"
 #include "rocksdb/options.h"
 #include "rocksdb/iostats_context.h"
 #include "rocksdb/perf_context.h"
+#include "rocksdb/sst_file_writer.h"
 
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
 #include "tendisplus/storage/rocks/rocks_kvttlcompactfilter.h"
+#include "tendisplus/storage/rocks/rocks_prefix_extractor.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/string.h"
+#include "tendisplus/utils/latency_stats.h"
 #include "tendisplus/server/session.h"
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/storage/varint.h"
@@ -62,14 +66,17 @@ RocksKVCursor::RocksKVCursor(std::unique_ptr<rocksdb::Iterator> it)
 }
 
 void RocksKVCursor::seek(const std::string& prefix) {
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   _it->Seek(rocksdb::Slice(prefix.c_str(), prefix.size()));
 }
 
 void RocksKVCursor::seekToLast() {
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   _it->SeekToLast();
 }
 
 Expected<Record> RocksKVCursor::next() {
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   if (!_it->status().ok()) {
     return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
   }
@@ -88,6 +95,20 @@ Expected<Record> RocksKVCursor::next() {
   return result.status();
 }
 
+Status RocksKVCursor::nextRaw(std::string* key, std::string* value) {
+  LatencyStageTimer timer(LatencyStage::STORAGE);
+  if (!_it->status().ok()) {
+    return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
+  }
+  if (!_it->Valid()) {
+    return {ErrorCodes::ERR_EXHAUST, "no more data"};
+  }
+  key->assign(_it->key().data(), _it->key().size());
+  value->assign(_it->value().data(), _it->value().size());
+  _it->Next();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status RocksKVCursor::prev() {
   if (!_it->status().ok()) {
     return {ErrorCodes::ERR_INTERNAL, _it->status().ToString()};
@@ -123,6 +144,7 @@ RocksTxn::RocksTxn(RocksKVStore* store,
                    uint32_t chunkId)
   : _txnId(txnId),
     _binlogId(binlogId),
+    _binlogTicket(BinlogCommitTracker::TICKET_NONE),
     _chunkId(chunkId),
     _txn(nullptr),
     _store(store),
@@ -196,6 +218,22 @@ std::unique_ptr<BasicDataCursor> RocksTxn::createDataCursor() {
   return std::make_unique<BasicDataCursor>(std::move(cursor));
 }
 
+std::unique_ptr<BasicDataCursor> RocksTxn::createPrefixDataCursor(
+  const std::string& prefix) {
+  if (!_store->isPrefixBloomEnabled() ||
+      RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()) !=
+        prefix.size()) {
+    return createDataCursor();
+  }
+  rocksdb::ReadOptions readOpts;
+  RESET_PERFCONTEXT();
+  readOpts.snapshot = _txn->GetSnapshot();
+  readOpts.prefix_same_as_start = true;
+  auto iter = _txn->GetIterator(readOpts);
+  return std::make_unique<BasicDataCursor>(std::unique_ptr<Cursor>(
+    new RocksKVCursor(std::unique_ptr<rocksdb::Iterator>(iter))));
+}
+
 std::unique_ptr<AllDataCursor> RocksTxn::createAllDataCursor() {
   auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default);
   return std::make_unique<AllDataCursor>(std::move(cursor));
@@ -217,6 +255,8 @@ std::unique_ptr<Cursor> RocksTxn::createCursor(
     readOpts.iterate_upper_bound = &_upperBound;
   }
   readOpts.snapshot = _txn->GetSnapshot();
+  // a prefix bloom may skip the sst files with keys after the target
+  readOpts.total_order_seek = true;
   // create iterator corresponding to chosen column family
   rocksdb::Iterator* iter;
   if (column_family_num == ColumnFamilyNumber::ColumnFamily_Default) {
@@ -234,16 +274,27 @@ std::unique_ptr<Cursor> RocksTxn::createCursor(
 Expected<uint64_t> RocksTxn::commit() {
   INVARIANT_D(!_done);
   _done = true;
+  LatencyStageTimer timer(LatencyStage::STORAGE);
 
   uint64_t binlogTxnId = Transaction::TXNID_UNINITED;
   const auto guard = MakeGuard([this, &binlogTxnId] {
     _txn.reset();
+    auto cache = _store->getValueCache();
+    if (cache) {
+      // readers may have cached the old values before committed
+      for (const auto& key : _cacheDirtyKeys) {
+        cache->invalidate(key);
+      }
+      if (_cacheRangeDirty) {
+        cache->clear();
+      }
+    }
     // for non-replonly mode, we should have binlogTxnId == _txnId
     if (!_replOnly) {
       INVARIANT_D(binlogTxnId == _txnId ||
                   binlogTxnId == Transaction::TXNID_UNINITED);
     }
-    _store->markCommitted(_txnId, binlogTxnId);
+    _store->markCommitted(_txnId, _binlogTicket, binlogTxnId);
   });
 
   if (_txn == nullptr) {
@@ -326,7 +377,8 @@ Status RocksTxn::rollback() {
 
   const auto guard = MakeGuard([this] {
     _txn.reset();
-    _store->markCommitted(_txnId, Transaction::TXNID_UNINITED);
+    _store->markCommitted(
+      _txnId, _binlogTicket, Transaction::TXNID_UNINITED);
   });
 
   if (_txn == nullptr) {
@@ -344,6 +396,197 @@ uint64_t RocksTxn::getTxnId() const {
   return _txnId;
 }
 
+size_t RocksTxn::setSavePoint() {
+  INVARIANT_D(!_done);
+  ensureTxn();
+  _txn->SetSavePoint();
+  _savePoints.emplace_back(_replLogValues.size(), _chunkId);
+  return _savePoints.size() - 1;
+}
+
+Status RocksTxn::rollbackToSavePoint(size_t n) {
+  while (_savePoints.size() > n) {
+    auto s = _txn->RollbackToSavePoint();
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+    _replLogValues.erase(_replLogValues.begin() + _savePoints.back().first,
+                         _replLogValues.end());
+    _chunkId = _savePoints.back().second;
+    _savePoints.pop_back();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+RocksSharedTxn::RocksSharedTxn(RocksTxn* txn)
+  : _txn(txn), _savePoint(txn->setSavePoint()), _done(false) {}
+
+RocksTxn* RocksSharedTxn::baseTxn(Transaction* txn) {
+  auto shared = dynamic_cast<RocksSharedTxn*>(txn);
+  return shared ? shared->_txn : static_cast<RocksTxn*>(txn);
+}
+
+RocksSharedTxn::~RocksSharedTxn() {
+  if (!_done) {
+    rollback();
+  }
+}
+
+Expected<uint64_t> RocksSharedTxn::commit() {
+  INVARIANT_D(!_done);
+  _done = true;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksSharedTxn::rollback() {
+  INVARIANT_D(!_done);
+  _done = true;
+  return _txn->rollbackToSavePoint(_savePoint);
+}
+
+std::unique_ptr<Cursor> RocksSharedTxn::createCursor(
+  ColumnFamilyNumber cf, const std::string* iterate_upper_bound) {
+  return _txn->createCursor(cf, iterate_upper_bound);
+}
+
+Status RocksSharedTxn::flushall() {
+  return _txn->flushall();
+}
+
+Status RocksSharedTxn::migrate(const std::string& logKey,
+                               const std::string& logValue) {
+  return _txn->migrate(logKey, logValue);
+}
+
+std::unique_ptr<RepllogCursorV2> RocksSharedTxn::createRepllogCursorV2(
+  uint64_t begin, bool ignoreReadBarrier) {
+  return _txn->createRepllogCursorV2(begin, ignoreReadBarrier);
+}
+
+Status RocksSharedTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
+  return _txn->applyBinlog(logEntry);
+}
+
+Status RocksSharedTxn::setBinlogKV(uint64_t binlogId,
+                                   const std::string& logKey,
+                                   const std::string& logValue) {
+  return _txn->setBinlogKV(binlogId, logKey, logValue);
+}
+
+Status RocksSharedTxn::setBinlogKV(const std::string& logKey,
+                                   const std::string& logValue) {
+  return _txn->setBinlogKV(logKey, logValue);
+}
+
+Status RocksSharedTxn::delBinlog(const ReplLogRawV2& log) {
+  return _txn->delBinlog(log);
+}
+
+uint64_t RocksSharedTxn::getBinlogId() const {
+  return _txn->getBinlogId();
+}
+
+void RocksSharedTxn::setBinlogId(uint64_t binlogId) {
+  _txn->setBinlogId(binlogId);
+}
+
+uint32_t RocksSharedTxn::getChunkId() const {
+  return _txn->getChunkId();
+}
+
+std::string RocksSharedTxn::getKVStoreId() const {
+  return _txn->getKVStoreId();
+}
+
+void RocksSharedTxn::setChunkId(uint32_t chunkId) {
+  _txn->setChunkId(chunkId);
+}
+
+void RocksSharedTxn::SetSnapshot() {
+  _txn->SetSnapshot();
+}
+
+std::unique_ptr<TTLIndexCursor> RocksSharedTxn::createTTLIndexCursor(
+  uint64_t until) {
+  return _txn->createTTLIndexCursor(until);
+}
+
+std::unique_ptr<SlotCursor> RocksSharedTxn::createSlotCursor(uint32_t slot) {
+  return _txn->createSlotCursor(slot);
+}
+
+std::unique_ptr<SlotsCursor> RocksSharedTxn::createSlotsCursor(
+  uint32_t start, uint32_t end) {
+  return _txn->createSlotsCursor(start, end);
+}
+
+std::unique_ptr<VersionMetaCursor> RocksSharedTxn::createVersionMetaCursor() {
+  return _txn->createVersionMetaCursor();
+}
+
+std::unique_ptr<BasicDataCursor> RocksSharedTxn::createDataCursor() {
+  return _txn->createDataCursor();
+}
+
+std::unique_ptr<BasicDataCursor> RocksSharedTxn::createPrefixDataCursor(
+  const std::string& prefix) {
+  return _txn->createPrefixDataCursor(prefix);
+}
+
+std::unique_ptr<AllDataCursor> RocksSharedTxn::createAllDataCursor() {
+  return _txn->createAllDataCursor();
+}
+
+std::unique_ptr<BinlogCursor> RocksSharedTxn::createBinlogCursor() {
+  return _txn->createBinlogCursor();
+}
+
+Expected<std::string> RocksSharedTxn::getKV(const std::string& key) {
+  return _txn->getKV(key);
+}
+
+std::vector<Expected<std::string>> RocksSharedTxn::getKVs(
+  const std::vector<std::string>& keys) {
+  return _txn->getKVs(keys);
+}
+
+Status RocksSharedTxn::setKV(const std::string& key,
+                             const std::string& val,
+                             const uint64_t ts) {
+  return _txn->setKV(key, val, ts);
+}
+
+Status RocksSharedTxn::delKV(const std::string& key, const uint64_t ts) {
+  return _txn->delKV(key, ts);
+}
+
+Status RocksSharedTxn::addDeleteRangeBinlog(const std::string& begin,
+                                            const std::string& end) {
+  return _txn->addDeleteRangeBinlog(begin, end);
+}
+
+Status RocksSharedTxn::deleteRange(const std::string& begin,
+                                   const std::string& end,
+                                   uint32_t chunkId) {
+  return {ErrorCodes::ERR_INTERNAL, "deleteRange in a shared txn"};
+}
+
+uint64_t RocksSharedTxn::getBinlogTime() {
+  return _txn->getBinlogTime();
+}
+
+void RocksSharedTxn::setBinlogTime(uint64_t timestamp) {
+  _txn->setBinlogTime(timestamp);
+}
+
+bool RocksSharedTxn::isReplOnly() const {
+  return _txn->isReplOnly();
+}
+
+uint64_t RocksSharedTxn::getTxnId() const {
+  return _txn->getTxnId();
+}
+
 std::string RocksTxn::getKVStoreId() const {
   return _store->dbId();
 }
@@ -363,6 +606,7 @@ Expected<std::string> RocksTxn::getKV(const std::string& key) {
   rocksdb::ReadOptions readOpts;
   std::string value;
 
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   RESET_PERFCONTEXT();
   rocksdb::Status s;
   if (RecordKey::decodeType(key) == RecordType::RT_BINLOG) {
@@ -380,6 +624,68 @@ Expected<std::string> RocksTxn::getKV(const std::string& key) {
   return {ErrorCodes::ERR_INTERNAL, s.ToString()};
 }
 
+bool RocksTxn::canReadValueCache() const {
+  return _cacheDirtyKeys.empty() && !_cacheRangeDirty &&
+    (_txn == nullptr || _txn->GetSnapshot() == nullptr);
+}
+
+void RocksTxn::invalidateValueCache(const std::string& key) {
+  auto cache = _store->getValueCache();
+  if (cache == nullptr ||
+      RecordKey::decodeType(key) != RecordType::RT_DATA_META) {
+    return;
+  }
+  cache->invalidate(key);
+  _cacheDirtyKeys.push_back(key);
+}
+
+std::vector<Expected<std::string>> RocksTxn::getKVs(
+  const std::vector<std::string>& keys) {
+  // MultiGet does better on sorted keys, it shares the memtable and
+  // block cache lookups between the neighbour keys.
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+    return keys[a] < keys[b];
+  });
+
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs;
+  std::vector<rocksdb::Slice> sortedKeys;
+  cfs.reserve(keys.size());
+  sortedKeys.reserve(keys.size());
+  for (auto i : order) {
+    const std::string& key = keys[i];
+    if (RecordKey::decodeType(key) == RecordType::RT_BINLOG) {
+      cfs.push_back(_store->getBinlogColumnFamilyHandle());
+    } else {
+      cfs.push_back(_store->getDataColumnFamilyHandle());
+    }
+    sortedKeys.emplace_back(key);
+  }
+
+  rocksdb::ReadOptions readOpts;
+  std::vector<std::string> values;
+  LatencyStageTimer timer(LatencyStage::STORAGE);
+  RESET_PERFCONTEXT();
+  auto ss = _txn->MultiGet(readOpts, cfs, sortedKeys, &values);
+
+  std::vector<Expected<std::string>> result(
+    keys.size(), {ErrorCodes::ERR_NOTFOUND, ""});
+  for (size_t j = 0; j < order.size(); ++j) {
+    auto& s = ss[j];
+    if (s.ok()) {
+      result[order[j]] = std::move(values[j]);
+    } else if (s.IsNotFound()) {
+      result[order[j]] = {ErrorCodes::ERR_NOTFOUND, s.ToString()};
+    } else {
+      result[order[j]] = {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+  }
+  return result;
+}
+
 Status RocksTxn::setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts) {
@@ -387,12 +693,14 @@ Status RocksTxn::setKV(const std::string& key,
     return {ErrorCodes::ERR_INTERNAL, "txn is replOnly"};
   }
 
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   RESET_PERFCONTEXT();
   // put data into default column family
   auto s = _txn->Put(key, val);
   if (!s.ok()) {
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  invalidateValueCache(key);
 
   if (_store->enableRepllog()) {
     INVARIANT_D(_store->dbId() != CATALOG_NAME);
@@ -421,12 +729,14 @@ Status RocksTxn::delKV(const std::string& key, const uint64_t ts) {
   if (_replOnly) {
     return {ErrorCodes::ERR_INTERNAL, "txn is replOnly"};
   }
+  LatencyStageTimer timer(LatencyStage::STORAGE);
   RESET_PERFCONTEXT();
   rocksdb::Status s;
   if (RecordKey::decodeType(key) == RecordType::RT_BINLOG) {
     s = _txn->Delete(_store->getBinlogColumnFamilyHandle(), key);
   } else {
     s = _txn->Delete(key);
+    invalidateValueCache(key);
   }
 
   if (!s.ok()) {
@@ -476,6 +786,49 @@ Status RocksTxn::addDeleteRangeBinlog(const std::string& begin,
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Status RocksTxn::deleteRange(const std::string& begin,
+                             const std::string& end,
+                             uint32_t chunkId) {
+  if (_replOnly) {
+    return {ErrorCodes::ERR_INTERNAL, "txn is replOnly"};
+  }
+  RESET_PERFCONTEXT();
+  auto s = putDeleteRange(begin, end);
+  if (!s.ok()) {
+    return s;
+  }
+
+  if (_store->enableRepllog()) {
+    INVARIANT_D(_store->dbId() != CATALOG_NAME);
+    setChunkId(chunkId);
+    ReplLogValueEntryV2 logVal(
+      ReplOp::REPL_OP_DEL_RANGE, msSinceEpoch(), begin, end);
+    _replLogValues.emplace_back(std::move(logVal));
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksTxn::putDeleteRange(const std::string& begin,
+                                const std::string& end) {
+  // rocksdb::Transaction has no DeleteRange, the range tombstone is put
+  // into the underlying batch, so it is committed together with the txn,
+  // but not indexed: the reads of the txn still see the deleted keys, and
+  // a rollback to a savepoint can't drop it.
+  auto s = _txn->GetWriteBatch()->GetWriteBatch()->DeleteRange(
+    _store->getDataColumnFamilyHandle(), begin, end);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  // the range may cover meta keys, the whole cache is dropped both now
+  // and after committed, as invalidateValueCache() does for one key
+  auto cache = _store->getValueCache();
+  if (cache) {
+    cache->clear();
+    _cacheRangeDirty = true;
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status RocksTxn::flushall() {
   if (_replOnly) {
     return {ErrorCodes::ERR_INTERNAL, "txn is replOnly"};
@@ -532,6 +885,7 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      invalidateValueCache(logEntry.getOpKey());
       break;
     }
     case ReplOp::REPL_OP_DEL: {
@@ -539,6 +893,7 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      invalidateValueCache(logEntry.getOpKey());
       break;
     }
     case ReplOp::REPL_OP_STMT: {
@@ -548,12 +903,11 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
       INVARIANT_D(0);
     }
     case ReplOp::REPL_OP_DEL_RANGE: {
-      auto s =
-        _store->deleteRangeWithoutBinlog(_store->getDataColumnFamilyHandle(),
-                                         logEntry.getOpKey(),
-                                         logEntry.getOpValue());
+      // in the same batch as the other entries and the binlog, as the
+      // master does, so the slave commits them together too
+      auto s = putDeleteRange(logEntry.getOpKey(), logEntry.getOpValue());
       if (!s.ok()) {
-        return {ErrorCodes::ERR_INTERNAL, s.toString()};
+        return s;
       }
       break;
     }
@@ -573,7 +927,7 @@ Status RocksTxn::setBinlogKV(uint64_t binlogId,
   }
 
   // NOTE(vinchen): Because the (logKey, logValue) from the master store in
-  // slave's rocksdb directly, we should change the _nextBinlogSeq.
+  // slave's rocksdb directly, we should change the next binlogId.
   // BTW, the txnid of logValue is different from _txnId. But it's ok.
   _store->setNextBinlogSeq(binlogId, this);
   INVARIANT_D(_binlogId != Transaction::TXNID_UNINITED);
@@ -649,7 +1003,8 @@ RocksTxn::~RocksTxn() {
 
   // _txn.get()->ClearSnapshot();
   _txn.reset();
-  _store->markCommitted(_txnId, Transaction::TXNID_UNINITED);
+  _store->markCommitted(
+      _txnId, _binlogTicket, Transaction::TXNID_UNINITED);
 }
 
 RocksOptTxn::RocksOptTxn(RocksKVStore* store,
@@ -659,12 +1014,12 @@ RocksOptTxn::RocksOptTxn(RocksKVStore* store,
                          Session* sess)
   : RocksTxn(store, txnId, replOnly, ob, sess) {
   // NOTE(deyukong): the rocks-layer's snapshot should be opened in
-  // RocksKVStore::createTransaction, with the guard of RocksKVStore::_mutex,
-  // or, we are not able to guarantee the oplog order is the same as the
-  // local commit,
-  // In other words, to the same key, a txn with greater id can be committed
-  // before a txn with smaller id, and they have no conflicts, it's wrong.
-  // so ensureTxn() should be done in RocksOptTxn's constructor
+  // RocksKVStore::createTransaction, so ensureTxn() should be done in
+  // RocksOptTxn's constructor.
+  // It needs no RocksKVStore::_mutex, the binlogId is assigned when
+  // committing, and two txns changing the same key conflict (optimistic)
+  // or wait for the key locks (pessimistic), so the binlog order of a key
+  // is always the same as the local commit.
   ensureTxn();
 }
 
@@ -711,12 +1066,12 @@ RocksPesTxn::RocksPesTxn(RocksKVStore* store,
                          Session* sess)
   : RocksTxn(store, txnId, replOnly, ob, sess) {
   // NOTE(deyukong): the rocks-layer's snapshot should be opened in
-  // RocksKVStore::createTransaction, with the guard of RocksKVStore::_mutex,
-  // or, we are not able to guarantee the oplog order is the same as the
-  // local commit,
-  // In other words, to the same key, a txn with greater id can be committed
-  // before a txn with smaller id, and they have no conflicts, it's wrong.
-  // so ensureTxn() should be done in RocksOptTxn's constructor
+  // RocksKVStore::createTransaction, so ensureTxn() should be done in
+  // RocksOptTxn's constructor.
+  // It needs no RocksKVStore::_mutex, the binlogId is assigned when
+  // committing, and two txns changing the same key conflict (optimistic)
+  // or wait for the key locks (pessimistic), so the binlog order of a key
+  // is always the same as the local commit.
   ensureTxn();
 }
 
@@ -1034,6 +1389,7 @@ rocksdb::Options RocksKVStore::options() {
   rocksdb::Options options;
   rocksdb::BlockBasedTableOptions table_options;
   table_options.block_cache = _blockCache;
+  // with prefix extractor, the filters have both whole keys and prefixes
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
   table_options.block_size = 16 * 1024;  // 16KB
   table_options.format_version = 2;
@@ -1095,6 +1451,12 @@ rocksdb::Options RocksKVStore::options() {
   options.table_factory.reset(
     rocksdb::NewBlockBasedTableFactory(table_options));
 
+  if (_enablePrefixBloom) {
+    // the old sst files are not filtered by prefix, as the name of
+    // extractor recorded in them does not match
+    options.prefix_extractor.reset(new RecordKeyPrefixExtractor());
+  }
+
   if (_enableFilter && dbId() != CATALOG_NAME) {
     // setup the ttlcompactionfilter expect "catalog" db
     options.compaction_filter_factory.reset(
@@ -1109,7 +1471,6 @@ rocksdb::Options RocksKVStore::options() {
 }
 
 bool RocksKVStore::isRunning() const {
-  std::lock_guard<std::mutex> lk(_mutex);
   return _isRunning;
 }
 
@@ -1154,7 +1515,7 @@ bool RocksKVStore::isEmpty(bool ignoreBinlog) const {
 
 Status RocksKVStore::pause() {
   std::lock_guard<std::mutex> lk(_mutex);
-  if (_aliveTxns.size() != 0) {
+  if (_aliveTxnCnt.load() != 0) {
     return {ErrorCodes::ERR_INTERNAL,
             "it's upperlayer's duty to guarantee no pinning txns alive"};
   }
@@ -1165,7 +1526,7 @@ Status RocksKVStore::pause() {
 
 Status RocksKVStore::resume() {
   std::lock_guard<std::mutex> lk(_mutex);
-  if (_aliveTxns.size() != 0) {
+  if (_aliveTxnCnt.load() != 0) {
     return {ErrorCodes::ERR_INTERNAL,
             "it's upperlayer's duty to guarantee no pinning txns alive"};
   }
@@ -1176,11 +1537,22 @@ Status RocksKVStore::resume() {
 
 Status RocksKVStore::stop() {
   std::lock_guard<std::mutex> lk(_mutex);
-  if (_aliveTxns.size() != 0) {
+  // createTransaction() counts the txn before checking _isStopping, and
+  // stop() sets _isStopping before checking the count, so a txn either
+  // fails or is counted here. _isRunning is only cleared when no txn is
+  // alive, a live store is never seen as stopped.
+  _isStopping = true;
+  if (_aliveTxnCnt.load() != 0) {
+    _isStopping = false;
     return {ErrorCodes::ERR_INTERNAL,
             "it's upperlayer's duty to guarantee no pinning txns alive"};
   }
   _isRunning = false;
+  _isStopping = false;
+  if (_valueCache) {
+    // the data may be replaced by flush or restore
+    _valueCache->clear();
+  }
 
   for (auto* h : _cfHandles) {
     delete h;
@@ -1208,14 +1580,14 @@ Status RocksKVStore::destroy() {
 
 Status RocksKVStore::setMode(StoreMode mode) {
   std::lock_guard<std::mutex> lk(_mutex);
-  if (_aliveTxns.size() != 0) {
+  if (_aliveTxnCnt.load() != 0) {
     return {ErrorCodes::ERR_INTERNAL,
             "it's upperlayer's duty to guarantee no pinning txns alive"};
   }
   if (_mode == mode) {
     return {ErrorCodes::ERR_OK, ""};
   }
-  uint64_t oldSeq = _nextTxnSeq;
+  uint64_t oldSeq = _nextTxnSeq.load();
   switch (mode) {
     case KVStore::StoreMode::READ_WRITE:
       INVARIANT_D(_mode == KVStore::StoreMode::REPLICATE_ONLY);
@@ -1223,8 +1595,8 @@ Status RocksKVStore::setMode(StoreMode mode) {
       // in REPLICATE_ONLY mode, the binlog is same as the sync-source's
       // when changing from REPLICATE_ONLY to READ_WRITE mode, we shrink
       // _nextTxnSeq so that binlog's wont' be duplicated.
-      if (_nextTxnSeq <= _highestVisible) {
-        _nextTxnSeq = _highestVisible + 1;
+      if (_nextTxnSeq.load() <= _binlogTracker.getHighestVisible()) {
+        _nextTxnSeq = _binlogTracker.getHighestVisible() + 1;
       }
       break;
 
@@ -1238,7 +1610,8 @@ Status RocksKVStore::setMode(StoreMode mode) {
 
   LOG(INFO) << "store:" << dbId() << ",mode:" << static_cast<uint32_t>(_mode)
             << ",changes to:" << static_cast<uint32_t>(mode)
-            << ",_nextTxnSeq:" << oldSeq << ",changes to:" << _nextTxnSeq;
+            << ",_nextTxnSeq:" << oldSeq
+            << ",changes to:" << _nextTxnSeq.load();
   _mode = mode;
   return {ErrorCodes::ERR_OK, ""};
 }
@@ -1519,6 +1892,67 @@ Status RocksKVStore::fullCompact() {
   return s;
 }
 
+class RocksSstFileBuilder : public SstFileBuilder {
+ public:
+  explicit RocksSstFileBuilder(const rocksdb::Options& options)
+    : _options(options), _writer(rocksdb::EnvOptions(), _options) {}
+
+  Status open(const std::string& file) final {
+    auto s = _writer.Open(file);
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  Status put(const std::string& key, const std::string& value) final {
+    auto s = _writer.Put(key, value);
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  uint64_t fileSize() final {
+    return _writer.FileSize();
+  }
+
+  Status finish() final {
+    auto s = _writer.Finish();
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+ private:
+  // the writer keeps pointers to the options
+  const rocksdb::Options _options;
+  rocksdb::SstFileWriter _writer;
+};
+
+std::unique_ptr<SstFileBuilder> RocksKVStore::createSstFileBuilder() {
+  // the same table options as the store, so the filters and the name of
+  // prefix extractor recorded in the files are the ones of the stores
+  return std::make_unique<RocksSstFileBuilder>(options());
+}
+
+Status RocksKVStore::ingestExternalFiles(
+  const std::vector<std::string>& files) {
+  rocksdb::IngestExternalFileOptions opts;
+  opts.move_files = true;
+  auto s =
+    getBaseDB()->IngestExternalFile(getDataColumnFamilyHandle(), files, opts);
+  if (!s.ok()) {
+    LOG(ERROR) << "ingest external files failed:" << s.ToString();
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  if (_valueCache) {
+    _valueCache->clear();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status RocksKVStore::clear() {
   std::lock_guard<std::mutex> lk(_mutex);
   if (_isRunning) {
@@ -1637,8 +2071,11 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
     column_families.push_back(rocksdb::ColumnFamilyDescriptor(
       rocksdb::kDefaultColumnFamilyName, columOpts));
     if (!_cfg->binlogUsingDefaultCF) {
+      // binlogs are only scanned in order
+      rocksdb::Options binlogOpts = columOpts;
+      binlogOpts.prefix_extractor.reset();
       column_families.push_back(
-        rocksdb::ColumnFamilyDescriptor("binlog_cf", columOpts));
+        rocksdb::ColumnFamilyDescriptor("binlog_cf", binlogOpts));
     }
     if (_txnMode == TxnMode::TXN_OPT) {
       rocksdb::OptimisticTransactionDB* tmpDb = nullptr;
@@ -1657,6 +2094,7 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
         return {ErrorCodes::ERR_INTERNAL, status.ToString()};
       }
       rocksdb::ReadOptions readOpts;
+      readOpts.total_order_seek = true;
       iter.reset(
         tmpDb->GetBaseDB()->NewIterator(readOpts, getDataColumnFamilyHandle()));
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
@@ -1685,6 +2123,7 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
       }
       LOG(INFO) << "rocksdb Open sucess,id:" << dbId() << " dbname:" << dbname;
       rocksdb::ReadOptions readOpts;
+      readOpts.total_order_seek = true;
       iter.reset(
         tmpDb->GetBaseDB()->NewIterator(readOpts, getDataColumnFamilyHandle()));
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
@@ -1712,22 +2151,19 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
           } else {
             auto binlogId = explk.value().getBinlogId();
             LOG(INFO) << "store:" << dbId()
-                      << " nextSeq change from:" << _nextTxnSeq
+                      << " nextSeq change from:" << _nextTxnSeq.load()
                       << " to:" << binlogId + 1;
             maxCommitId = binlogId;
             _nextTxnSeq = maxCommitId + 1;
-            _nextBinlogSeq = _nextTxnSeq;
-            _highestVisible = maxCommitId;
+            _binlogTracker.reset(maxCommitId + 1, maxCommitId);
             needDeleteBinlog = true;
           }
         }
       } else if (binlog_expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
         _nextTxnSeq = nextBinlogSeq;
-        _nextBinlogSeq = _nextTxnSeq;
         LOG(INFO) << "store:" << dbId() << " have no binlog, set nextSeq to "
-                  << _nextTxnSeq;
-        _highestVisible = _nextBinlogSeq - 1;
-        INVARIANT_D(_highestVisible < _nextBinlogSeq);
+                  << nextBinlogSeq;
+        _binlogTracker.reset(nextBinlogSeq, nextBinlogSeq - 1);
       } else {
         return binlog_expRcd.status();
       }
@@ -1749,12 +2185,11 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
           } else {
             auto binlogId = explk.value().getBinlogId();
             LOG(INFO) << "store(upgrade binlogVersion from 1 to 2):" << dbId()
-                      << " nextSeq change from:" << _nextTxnSeq
+                      << " nextSeq change from:" << _nextTxnSeq.load()
                       << " to:" << binlogId + 1;
             maxCommitId = binlogId;
             _nextTxnSeq = maxCommitId + 1;
-            _nextBinlogSeq = _nextTxnSeq;
-            _highestVisible = maxCommitId;
+            _binlogTracker.reset(maxCommitId + 1, maxCommitId);
             needDeleteBinlog = true;
           }
         } else {
@@ -1780,15 +2215,15 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
           return ret.status();
         }
       }
-      LOG(INFO) << "store:" << dbId() << " nextSeq change from:" << _nextTxnSeq
+      LOG(INFO) << "store:" << dbId()
+                << " nextSeq change from:" << _nextTxnSeq.load()
                 << " to:" << highestVisible + 1
                 << " needDeleteBinlog:" << needDeleteBinlog;
       maxCommitId = highestVisible;
 
       std::lock_guard<std::mutex> lk(_mutex);
       _nextTxnSeq = maxCommitId + 1;
-      _nextBinlogSeq = _nextTxnSeq;
-      _highestVisible = maxCommitId;
+      _binlogTracker.reset(maxCommitId + 1, maxCommitId);
     }
   }
   return maxCommitId;
@@ -1804,10 +2239,12 @@ RocksKVStore::RocksKVStore(const std::string& id,
   : KVStore(id, cfg->dbPath),
     _cfg(cfg),
     _isRunning(false),
+    _isStopping(false),
     _isPaused(false),
     _hasBackup(false),
     _enableFilter(true),
     _enableRepllog(enableRepllog),
+    _enablePrefixBloom(cfg->rocksPrefixBloom && id != CATALOG_NAME),
     _mode(mode),
     _txnMode(txnMode),
     _optdb(nullptr),
@@ -1815,12 +2252,17 @@ RocksKVStore::RocksKVStore(const std::string& id,
     _stats(rocksdb::CreateDBStatistics()),
     _blockCache(blockCache),
     _nextTxnSeq(0),
-    _highestVisible(Transaction::TXNID_UNINITED),
+    _aliveTxnCnt(0),
     _logOb(nullptr),
     _env(std::make_shared<RocksdbEnv>()) {
   if (_cfg->noexpire) {
     _enableFilter = false;
   }
+  if (_cfg->kvstoreValueCacheMB > 0 && _enableRepllog) {
+    _valueCache = std::make_unique<RecordValueCache>(
+      _cfg->kvstoreValueCacheMB * 1024 * 1024LL /
+      std::max(_cfg->kvStoreCount, 1U));
+  }
 
   Expected<uint64_t> s =
     restart(false, Transaction::MIN_VALID_TXNID, UINT64_MAX, flag);
@@ -2119,11 +2561,30 @@ Expected<std::string> RocksKVStore::copyCkpt(const std::string& dir) {
 
 Expected<std::unique_ptr<Transaction>> RocksKVStore::createTransaction(
   Session* sess) {
-  std::lock_guard<std::mutex> lk(_mutex);
-  if (!_isRunning) {
-    return {ErrorCodes::ERR_INTERNAL, "db stopped!"};
+  if (sess == nullptr || !sess->getCtx()->isTxnShared()) {
+    return createRocksTxn(sess);
+  }
+  auto ctx = sess->getCtx();
+  auto txn = ctx->getSharedTxn(dbId());
+  if (txn == nullptr) {
+    auto ptxn = createRocksTxn(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    txn = ptxn.value().get();
+    ctx->addSharedTxn(dbId(), std::move(ptxn.value()));
+  }
+  return std::unique_ptr<Transaction>(
+    new RocksSharedTxn(static_cast<RocksTxn*>(txn)));
+}
+
+Expected<std::unique_ptr<Transaction>> RocksKVStore::createRocksTxn(
+  Session* sess) {
+  uint64_t txnId = _nextTxnSeq.fetch_add(1);
+  auto s = addUnCommitedTxn(txnId);
+  if (!s.ok()) {
+    return s;
   }
-  uint64_t txnId = _nextTxnSeq++;
   bool replOnly = (_mode == KVStore::StoreMode::REPLICATE_ONLY);
 #ifndef NO_VERSIONEP
   if (sess) {
@@ -2134,47 +2595,32 @@ Expected<std::unique_ptr<Transaction>> RocksKVStore::createTransaction(
 #endif
   std::unique_ptr<Transaction> ret = nullptr;
 
-  // TODO(vinchen): should new RocksTxn out of mutex?
   if (_txnMode == TxnMode::TXN_OPT) {
     ret.reset(new RocksOptTxn(this, txnId, replOnly, _logOb, sess));
   } else {
     ret.reset(new RocksPesTxn(this, txnId, replOnly, _logOb, sess));
   }
-  addUnCommitedTxnInLock(txnId);
   return std::move(ret);
 }
 
 Status RocksKVStore::assignBinlogIdIfNeeded(Transaction* txn) {
   if (txn->getBinlogId() == Transaction::TXNID_UNINITED) {
-    std::lock_guard<std::mutex> lk(_mutex);
-    uint64_t binlogId = _nextBinlogSeq++;
-
+    uint64_t binlogId = 0;
+    uint64_t ticket = _binlogTracker.assignBinlogId(&binlogId);
+    static_cast<RocksTxn*>(txn)->setBinlogTicket(ticket);
     txn->setBinlogId(binlogId);
-    INVARIANT_D(_aliveBinlogs.find(binlogId) == _aliveBinlogs.end());
-    _aliveBinlogs.insert({binlogId, {false, txn->getTxnId()}});
-
-    auto it = _aliveTxns.find(txn->getTxnId());
-    INVARIANT_D(it != _aliveTxns.end() && !it->second.first);
-
-    it->second.second = binlogId;
   }
 
   return {ErrorCodes::ERR_OK, ""};
 }
 
 void RocksKVStore::setNextBinlogSeq(uint64_t binlogId, Transaction* txn) {
-  std::lock_guard<std::mutex> lk(_mutex);
   INVARIANT_D(txn->isReplOnly());
+  INVARIANT_D(txn->getBinlogId() == Transaction::TXNID_UNINITED);
 
-  _nextBinlogSeq = binlogId + 1;
-
+  uint64_t ticket = _binlogTracker.setBinlogId(binlogId);
+  static_cast<RocksTxn*>(txn)->setBinlogTicket(ticket);
   txn->setBinlogId(binlogId);
-  INVARIANT_D(_aliveBinlogs.find(binlogId) == _aliveBinlogs.end());
-  _aliveBinlogs.insert({binlogId, {false, txn->getTxnId()}});
-  auto it = _aliveTxns.find(txn->getTxnId());
-  INVARIANT_D(it != _aliveTxns.end() && !it->second.first);
-
-  it->second.second = binlogId;
 }
 
 rocksdb::OptimisticTransactionDB* RocksKVStore::getUnderlayerOptDB() {
@@ -2186,87 +2632,115 @@ rocksdb::TransactionDB* RocksKVStore::getUnderlayerPesDB() {
 }
 
 uint64_t RocksKVStore::getHighestBinlogId() const {
-  std::lock_guard<std::mutex> lk(_mutex);
-  return _highestVisible;
+  return _binlogTracker.getHighestVisible();
 }
 
 uint64_t RocksKVStore::getNextBinlogSeq() const {
-  std::lock_guard<std::mutex> lk(_mutex);
-  return _nextBinlogSeq;
+  return _binlogTracker.getNextBinlogId();
 }
 
 rocksdb::DB* RocksKVStore::getBaseDB() const {
   return _optdb.get() ? _optdb->GetBaseDB() : _pesdb->GetBaseDB();
 }
 
-void RocksKVStore::addUnCommitedTxnInLock(uint64_t txnId) {
-  if (_aliveTxns.find(txnId) != _aliveTxns.end()) {
-    LOG(FATAL) << "BUG: txnid:" << txnId << " double add uncommitted";
+Expected<std::string> RocksKVStore::getLatestValue(
+  const std::string& key) const {
+  rocksdb::ReadOptions readOpts;
+  // the metas of the expired keys are not worth caching
+  readOpts.fill_cache = false;
+  std::string value;
+  auto s = getBaseDB()->Get(readOpts, _cfHandles[0], key, &value);
+  if (s.IsNotFound()) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
   }
-  _aliveTxns.insert({txnId, {false, Transaction::TXNID_UNINITED}});
-}
-
-void RocksKVStore::markCommitted(uint64_t txnId, uint64_t binlogTxnId) {
-  std::lock_guard<std::mutex> lk(_mutex);
-  markCommittedInLock(txnId, binlogTxnId);
-}
-
-std::set<uint64_t> RocksKVStore::getUncommittedTxns() const {
-  std::lock_guard<std::mutex> lk(_mutex);
-  std::set<uint64_t> result;
-  for (auto& kv : _aliveTxns) {
-    if (!kv.second.first) {
-      result.insert(kv.first);
-    }
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
-  return result;
+  return value;
 }
 
-void RocksKVStore::markCommittedInLock(uint64_t txnId, uint64_t binlogTxnId) {
+Status RocksKVStore::addUnCommitedTxn(uint64_t txnId) {
+  // NOTE: count it before checking _isStopping, see stop()
+  _aliveTxnCnt.fetch_add(1);
   if (!_isRunning) {
-    LOG(FATAL) << "BUG: _uncommittedTxns not empty after stopped";
+    _aliveTxnCnt.fetch_sub(1);
+    return {ErrorCodes::ERR_INTERNAL, "db stopped!"};
   }
+  if (_isStopping) {
+    _aliveTxnCnt.fetch_sub(1);
+    return {ErrorCodes::ERR_INTERNAL, "db is stopping"};
+  }
+  auto& shard = _aliveTxns[txnId % ALIVE_TXN_SHARD_NUM];
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  if (!shard.txns.insert(txnId).second) {
+    LOG(FATAL) << "BUG: txnid:" << txnId << " double add uncommitted";
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
 
-  auto it = _aliveTxns.find(txnId);
-  INVARIANT_D(it != _aliveTxns.end());
-  INVARIANT_D(!it->second.first);
-
-  it->second.first = true;
-  auto binlogId = it->second.second;
-  _aliveTxns.erase(it);
+void RocksKVStore::markCommitted(uint64_t txnId,
+                                 uint64_t binlogTicket,
+                                 uint64_t binlogTxnId) {
+  // stop() fails while the txn is counted, it can't be stopped here
+  INVARIANT_D(_isRunning);
 
-  if (binlogId != Transaction::TXNID_UNINITED) {
-    auto i = _aliveBinlogs.find(binlogId);
-    INVARIANT_D(i != _aliveBinlogs.end());
-    INVARIANT_D(i->second.second == txnId ||
-                i->second.second == Transaction::TXNID_UNINITED);  // rollback
+  {
+    auto& shard = _aliveTxns[txnId % ALIVE_TXN_SHARD_NUM];
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto n = shard.txns.erase(txnId);
+    INVARIANT_D(n == 1);
+  }
 
-    i->second.first = true;
-    i->second.second = binlogTxnId;
-    if (i == _aliveBinlogs.begin()) {
-      while (i != _aliveBinlogs.end()) {
-        if (!i->second.first) {
-          break;
-        }
+  if (binlogTicket != BinlogCommitTracker::TICKET_NONE) {
+    // the binlogIds from _binlogTracker are visible after all the binlogIds
+    // before them are committed or rolled back
+    _binlogTracker.finish(binlogTicket,
+                          binlogTxnId != Transaction::TXNID_UNINITED);
+  }
+  _aliveTxnCnt.fetch_sub(1);
+}
 
-        if (i->second.second != Transaction::TXNID_UNINITED) {
-          _highestVisible = i->first;
-          INVARIANT_D(_highestVisible <= _nextBinlogSeq);
-        }
-        i = _aliveBinlogs.erase(i);
-      }
-    }
+std::set<uint64_t> RocksKVStore::getUncommittedTxns() const {
+  std::set<uint64_t> result;
+  for (auto& shard : _aliveTxns) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    result.insert(shard.txns.begin(), shard.txns.end());
   }
+  return result;
 }
 
 Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
                                           Transaction* txn) {
   INVARIANT_D(txn->getKVStoreId() == dbId());
-  Expected<std::string> s = txn->getKV(key.encode());
+  std::string encoded = key.encode();
+  if (!useValueCache(key, txn)) {
+    Expected<std::string> s = txn->getKV(encoded);
+    if (!s.ok()) {
+      return s.status();
+    }
+    return RecordValue::decode(s.value());
+  }
+
+  RecordValue rv(RecordType::RT_INVALID);
+  if (_valueCache->get(encoded, &rv)) {
+    return std::move(rv);
+  }
+  uint64_t gen = _valueCache->getGeneration(encoded);
+  Expected<std::string> s = txn->getKV(encoded);
   if (!s.ok()) {
     return s.status();
   }
-  return RecordValue::decode(s.value());
+  auto eValue = RecordValue::decode(s.value());
+  if (eValue.ok()) {
+    _valueCache->put(encoded, eValue.value(), gen);
+  }
+  return eValue;
+}
+
+bool RocksKVStore::useValueCache(const RecordKey& key, Transaction* txn) {
+  return _valueCache != nullptr &&
+    key.getRecordType() == RecordType::RT_DATA_META &&
+    RocksSharedTxn::baseTxn(txn)->canReadValueCache();
 }
 
 Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
@@ -2283,6 +2757,51 @@ Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
   return eValue;
 }
 
+std::vector<Expected<RecordValue>> RocksKVStore::getKVs(
+  const std::vector<RecordKey>& keys, Transaction* txn) {
+  INVARIANT_D(txn->getKVStoreId() == dbId());
+  std::vector<Expected<RecordValue>> result(keys.size(),
+                                            {ErrorCodes::ERR_NOTFOUND, ""});
+  // keys not served by the value cache
+  std::vector<size_t> index;
+  std::vector<std::string> encoded;
+  std::vector<uint64_t> gens;
+  index.reserve(keys.size());
+  encoded.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    std::string ek = keys[i].encode();
+    if (useValueCache(keys[i], txn)) {
+      RecordValue rv(RecordType::RT_INVALID);
+      if (_valueCache->get(ek, &rv)) {
+        result[i] = std::move(rv);
+        continue;
+      }
+      gens.push_back(_valueCache->getGeneration(ek));
+    } else {
+      gens.push_back(0);
+    }
+    index.push_back(i);
+    encoded.emplace_back(std::move(ek));
+  }
+  if (index.empty()) {
+    return result;
+  }
+
+  auto values = txn->getKVs(encoded);
+  for (size_t j = 0; j < values.size(); ++j) {
+    size_t i = index[j];
+    if (!values[j].ok()) {
+      result[i] = values[j].status();
+      continue;
+    }
+    result[i] = RecordValue::decode(values[j].value());
+    if (result[i].ok() && useValueCache(keys[i], txn)) {
+      _valueCache->put(encoded[j], result[i].value(), gens[j]);
+    }
+  }
+  return result;
+}
+
 Status RocksKVStore::setKV(const RecordKey& key,
                            const RecordValue& value,
                            Transaction* txn) {
@@ -2350,6 +2869,9 @@ Status RocksKVStore::deleteRangeWithoutBinlog(
     LOG(ERROR) << "deleteRange failed:" << s.ToString();
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  if (_valueCache && column_family == getDataColumnFamilyHandle()) {
+    _valueCache->clear();
+  }
   return {ErrorCodes::ERR_OK, ""};
 }
 
@@ -2510,6 +3032,17 @@ Status RocksKVStore::recoveryFromBgError() {
 
 void RocksKVStore::resetStatistics() {
   _stats->Reset();
+  if (_valueCache) {
+    _valueCache->resetStat();
+  }
+}
+
+bool RocksKVStore::getValueCacheStat(ValueCacheStat* stat) const {
+  if (!_valueCache) {
+    return false;
+  }
+  *stat = _valueCache->getStat();
+  return true;
 }
 
 Expected<VersionMeta> RocksKVStore::getVersionMeta() {
@@ -2597,31 +3130,57 @@ void RocksKVStore::appendJSONStat(
   w.Key("has_backup");
   w.Uint64(_hasBackup);
   w.Key("next_txn_seq");
-  w.Uint64(_nextTxnSeq);
-  w.Key("next_binlog_seq");
-  w.Uint64(_nextBinlogSeq);
+  w.Uint64(_nextTxnSeq.load());
   {
-    std::lock_guard<std::mutex> lk(_mutex);
+    uint64_t next = _binlogTracker.getNextBinlogId();
+    // exact on master, the binlogIds of a slave may have gaps
+    uint64_t lowest = next - _binlogTracker.getInFlight();
+    w.Key("next_binlog_seq");
+    w.Uint64(next);
     w.Key("alive_txns");
-    w.Uint64(_aliveTxns.size());
+    w.Uint64(_aliveTxnCnt.load());
     w.Key("alive_binlogs");
-    w.Uint64(_aliveBinlogs.size());
+    w.Uint64(next - lowest);
     w.Key("min_alive_binlog");
-    w.Uint64(_aliveBinlogs.size() ? _aliveBinlogs.begin()->first : 0);
+    w.Uint64(next > lowest ? lowest : 0);
     w.Key("max_alive_binlog");
-    w.Uint64(_aliveBinlogs.size() ? _aliveBinlogs.rbegin()->first : 0);
+    w.Uint64(next > lowest ? next - 1 : 0);
     w.Key("high_visible");
-    w.Uint64(_highestVisible);
+    w.Uint64(_binlogTracker.getHighestVisible());
   }
 
   w.Key("compact_filter_count");
   w.Uint64(stat.compactFilterCount.load(std::memory_order_relaxed));
   w.Key("compact_kvexpired_count");
   w.Uint64(stat.compactKvExpiredCount.load(std::memory_order_relaxed));
+  w.Key("compact_subkey_expired_count");
+  w.Uint64(stat.compactSubKeyExpiredCount.load(std::memory_order_relaxed));
   w.Key("paused_error_count");
   w.Uint64(stat.pausedErrorCount.load(std::memory_order_relaxed));
   w.Key("destroyed_error_count");
   w.Uint64(stat.destroyedErrorCount.load(std::memory_order_relaxed));
+  if (_valueCache) {
+    auto cacheStat = _valueCache->getStat();
+    w.Key("value_cache");
+    w.StartObject();
+    w.Key("capacity");
+    w.Uint64(_valueCache->getCapacity());
+    w.Key("usage");
+    w.Uint64(cacheStat.usage);
+    w.Key("entries");
+    w.Uint64(cacheStat.entries);
+    w.Key("hits");
+    w.Uint64(cacheStat.hits);
+    w.Key("misses");
+    w.Uint64(cacheStat.misses);
+    w.Key("inserts");
+    w.Uint64(cacheStat.inserts);
+    w.Key("rejects");
+    w.Uint64(cacheStat.rejects);
+    w.Key("evicts");
+    w.Uint64(cacheStat.evicts);
+    w.EndObject();
+  }
 
   w.Key("rocksdb");
   w.StartObject();
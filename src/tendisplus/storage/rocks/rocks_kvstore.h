@@ -12,9 +12,12 @@
 #include <mutex>  // NOLINT
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 #include <list>
+#include <array>
+#include <atomic>
 
 #include "rocksdb/db.h"
 #include "rocksdb/utilities/transaction.h"
@@ -22,7 +25,9 @@
 #include "rocksdb/utilities/transaction_db.h"
 
 #include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/value_cache.h"
 #include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/rocks/rocks_commit_tracker.h"
 
 namespace tendisplus {
 
@@ -57,6 +62,8 @@ class RocksTxn : public Transaction {
                                                  uint32_t end) final;
   std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() final;
   std::unique_ptr<BasicDataCursor> createDataCursor() final;
+  std::unique_ptr<BasicDataCursor> createPrefixDataCursor(
+    const std::string& prefix) final;
   std::unique_ptr<AllDataCursor> createAllDataCursor() final;
   std::unique_ptr<BinlogCursor> createBinlogCursor() final;
 
@@ -64,12 +71,18 @@ class RocksTxn : public Transaction {
   Status rollback() final;
   // getKV: get data from chosen column family
   Expected<std::string> getKV(const std::string& key) final;
+  // getKVs: keys are sorted and looked up by one MultiGet
+  std::vector<Expected<std::string>> getKVs(
+    const std::vector<std::string>& keys) final;
   Status setKV(const std::string& key,
                const std::string& val,
                const uint64_t ts = 0) final;
   Status delKV(const std::string& key, const uint64_t ts = 0) final;
   Status addDeleteRangeBinlog(const std::string& begin,
                               const std::string& end) final;
+  Status deleteRange(const std::string& begin,
+                     const std::string& end,
+                     uint32_t chunkId) final;
 #ifdef BINLOG_V1
   Status applyBinlog(const std::list<ReplLog>& txnLog) final;
   Status truncateBinlog(const std::list<ReplLog>& txnLog) final;
@@ -103,12 +116,28 @@ class RocksTxn : public Transaction {
   const std::unique_ptr<rocksdb::Transaction>& getRocksdbTxn() const {
     return _txn;
   }
+  // a txn which has written meta keys or reads from a snapshot must not
+  // read from the value cache
+  bool canReadValueCache() const;
+  // the ticket of _binlogId in the BinlogCommitTracker of _store
+  void setBinlogTicket(uint64_t ticket) {
+    _binlogTicket = ticket;
+  }
+  // set a savepoint and return the number of the ones before it, see
+  // RocksSharedTxn
+  size_t setSavePoint();
+  // roll back to the savepoint set when there were n ones
+  Status rollbackToSavePoint(size_t n);
 
  protected:
   virtual void ensureTxn() {}
+  void invalidateValueCache(const std::string& key);
+  // put a range tombstone of the data into the batch of the txn
+  Status putDeleteRange(const std::string& begin, const std::string& end);
 
   uint64_t _txnId;
   uint64_t _binlogId;
+  uint64_t _binlogTicket;
   uint32_t _chunkId;
   // NOTE(deyukong): I believe rocksdb does clean job in txn's destructor
   std::unique_ptr<rocksdb::Transaction> _txn;
@@ -133,6 +162,14 @@ class RocksTxn : public Transaction {
   std::shared_ptr<BinlogObserver> _logOb;
   Session* _session;
 
+  // meta keys written by this txn, they are invalidated from the value
+  // cache both when written and after committed.
+  std::vector<std::string> _cacheDirtyKeys;
+  // a range of the data is deleted by this txn, see putDeleteRange()
+  bool _cacheRangeDirty = false;
+  // the binlog entries and the chunkId at each savepoint
+  std::vector<std::pair<size_t, uint32_t>> _savePoints;
+
  private:
   // 0 for master, otherwise it's the latest commit binlog timestamp
   uint64_t _binlogTimeSpov = 0;
@@ -175,6 +212,74 @@ class RocksPesTxn : public RocksTxn {
   void SetSnapshot() final;
 };
 
+// RocksSharedTxn is the txn of a command run by a script. All the commands
+// of the script share one RocksTxn of the store, so their writes are
+// committed and replicated together, see SessionCtx::beginSharedTxns().
+// commit() commits nothing, and rollback() only drops the writes done since
+// it is created. No range can be deleted, a rocksdb savepoint can't roll it
+// back.
+class RocksSharedTxn : public Transaction {
+ public:
+  explicit RocksSharedTxn(RocksTxn* txn);
+  RocksSharedTxn(const RocksSharedTxn&) = delete;
+  RocksSharedTxn(RocksSharedTxn&&) = delete;
+  virtual ~RocksSharedTxn();
+  Expected<uint64_t> commit() final;
+  Status rollback() final;
+  std::unique_ptr<Cursor> createCursor(
+    ColumnFamilyNumber cf, const std::string* iterate_upper_bound = NULL) final;
+  Status flushall() final;
+  Status migrate(const std::string& logKey, const std::string& logValue) final;
+  std::unique_ptr<RepllogCursorV2> createRepllogCursorV2(
+    uint64_t begin, bool ignoreReadBarrier = false) final;
+  Status applyBinlog(const ReplLogValueEntryV2& logEntry) final;
+  Status setBinlogKV(uint64_t binlogId,
+                     const std::string& logKey,
+                     const std::string& logValue) final;
+  Status setBinlogKV(const std::string& logKey,
+                     const std::string& logValue) final;
+  Status delBinlog(const ReplLogRawV2& log) final;
+  uint64_t getBinlogId() const final;
+  void setBinlogId(uint64_t binlogId) final;
+  uint32_t getChunkId() const final;
+  std::string getKVStoreId() const final;
+  void setChunkId(uint32_t chunkId) final;
+  void SetSnapshot() final;
+  std::unique_ptr<TTLIndexCursor> createTTLIndexCursor(uint64_t until) final;
+  std::unique_ptr<SlotCursor> createSlotCursor(uint32_t slot) final;
+  std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
+                                                 uint32_t end) final;
+  std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() final;
+  std::unique_ptr<BasicDataCursor> createDataCursor() final;
+  std::unique_ptr<BasicDataCursor> createPrefixDataCursor(
+    const std::string& prefix) final;
+  std::unique_ptr<AllDataCursor> createAllDataCursor() final;
+  std::unique_ptr<BinlogCursor> createBinlogCursor() final;
+  Expected<std::string> getKV(const std::string& key) final;
+  std::vector<Expected<std::string>> getKVs(
+    const std::vector<std::string>& keys) final;
+  Status setKV(const std::string& key,
+               const std::string& val,
+               const uint64_t ts = 0) final;
+  Status delKV(const std::string& key, const uint64_t ts = 0) final;
+  Status addDeleteRangeBinlog(const std::string& begin,
+                              const std::string& end) final;
+  Status deleteRange(const std::string& begin,
+                     const std::string& end,
+                     uint32_t chunkId) final;
+  uint64_t getBinlogTime() final;
+  void setBinlogTime(uint64_t timestamp) final;
+  bool isReplOnly() const final;
+  uint64_t getTxnId() const final;
+  // the RocksTxn under txn, a RocksTxn or a RocksSharedTxn
+  static RocksTxn* baseTxn(Transaction* txn);
+
+ private:
+  RocksTxn* _txn;
+  size_t _savePoint;
+  bool _done;
+};
+
 class RocksKVCursor : public Cursor {
  public:
   explicit RocksKVCursor(std::unique_ptr<rocksdb::Iterator>);
@@ -182,6 +287,7 @@ class RocksKVCursor : public Cursor {
   void seek(const std::string& prefix) final;
   void seekToLast() final;
   Expected<Record> next() final;
+  Status nextRaw(std::string* key, std::string* value) final;
   Status prev() final;
   Expected<std::string> key() final;
 
@@ -215,11 +321,14 @@ class RocksKVStore : public KVStore {
   virtual ~RocksKVStore() {
     stop();
   }
+  // a RocksSharedTxn if the txns of the session are shared
   Expected<std::unique_ptr<Transaction>> createTransaction(Session* sess) final;
   Expected<RecordValue> getKV(const RecordKey& key, Transaction* txn) final;
   Expected<RecordValue> getKV(const RecordKey& key,
                               Transaction* txn,
                               RecordType valueType) final;
+  std::vector<Expected<RecordValue>> getKVs(const std::vector<RecordKey>& keys,
+                                            Transaction* txn) final;
   Status setKV(const Record& kv, Transaction* txn) final;
   Status setKV(const RecordKey& key,
                const RecordValue& val,
@@ -260,6 +369,8 @@ class RocksKVStore : public KVStore {
                       const std::string* begin,
                       const std::string* end) final;
   Status fullCompact() final;
+  std::unique_ptr<SstFileBuilder> createSstFileBuilder() final;
+  Status ingestExternalFiles(const std::vector<std::string>& files) final;
   Status clear() final;
   bool isRunning() const final;
   Status stop() final;
@@ -286,6 +397,9 @@ class RocksKVStore : public KVStore {
   Status destroy() final;
 
   TxnMode getTxnMode() const;
+  bool isOptimisticTxn() const final {
+    return _txnMode == TxnMode::TXN_OPT;
+  }
 
   Expected<uint64_t> restart(
     bool restore = false,
@@ -306,7 +420,9 @@ class RocksKVStore : public KVStore {
     rapidjson::PrettyWriter<rapidjson::StringBuffer>&) const final;
 
   // if binlogTxnId == Transaction::TXNID_UNINITED, it mean rollback
-  void markCommitted(uint64_t txnId, uint64_t binlogTxnId);
+  void markCommitted(uint64_t txnId,
+                     uint64_t binlogTicket,
+                     uint64_t binlogTxnId);
   rocksdb::OptimisticTransactionDB* getUnderlayerOptDB();
   rocksdb::TransactionDB* getUnderlayerPesDB();
 
@@ -318,6 +434,9 @@ class RocksKVStore : public KVStore {
   const std::shared_ptr<ServerParams>& getCfg() const {
     return _cfg;
   }
+  // the latest value of a key in the data column family out of any txn,
+  // for the compaction filter to look up the metas
+  Expected<std::string> getLatestValue(const std::string& key) const;
 
   bool getIntProperty(const std::string& property, uint64_t* value) const;
   bool getProperty(const std::string& property, std::string* value) const;
@@ -326,12 +445,19 @@ class RocksKVStore : public KVStore {
   std::string getBgError() const override;
   Status recoveryFromBgError() override;
   void resetStatistics();
+  bool getValueCacheStat(ValueCacheStat* stat) const final;
 
   Expected<VersionMeta> getVersionMeta() override;
   Expected<VersionMeta> getVersionMeta(const std::string& name) override;
   Status setVersionMeta(const std::string& name,
                         uint64_t ts,
                         uint64_t version) override;
+  RecordValueCache* getValueCache() const {
+    return _valueCache.get();
+  }
+  bool isPrefixBloomEnabled() const {
+    return _enablePrefixBloom;
+  }
   rocksdb::ColumnFamilyHandle* getDataColumnFamilyHandle() {
     return _cfHandles[0];
   }
@@ -345,11 +471,13 @@ class RocksKVStore : public KVStore {
 
  private:
   rocksdb::DB* getBaseDB() const;
-  void addUnCommitedTxnInLock(uint64_t txnId);
-  void markCommittedInLock(uint64_t txnId, uint64_t binlogTxnId);
+  // fails if the store is stopped or stopping
+  Status addUnCommitedTxn(uint64_t txnId);
+  Expected<std::unique_ptr<Transaction>> createRocksTxn(Session* sess);
   rocksdb::Options options();
   Expected<bool> deleteBinlog(uint64_t start);
   void initRocksProperties();
+  bool useValueCache(const RecordKey& key, Transaction* txn);
   Expected<std::string> saveBackupMeta(const std::string& dir,
                                        BackupInfo* result);
   Expected<std::string> loadCopy(const std::string& dir);
@@ -359,7 +487,11 @@ class RocksKVStore : public KVStore {
   mutable std::mutex _mutex;
 
   const std::shared_ptr<ServerParams> _cfg;
-  bool _isRunning;
+  // read without _mutex by createTransaction()
+  std::atomic<bool> _isRunning;
+  // set by stop() while it checks the txns alive, createTransaction()
+  // fails meanwhile, see stop()
+  std::atomic<bool> _isStopping;
   // _isPaused = true, it means that the rocksdb can't do any
   // get/set operations. But the rocksdb is running. It can be
   // reopen again.
@@ -367,6 +499,8 @@ class RocksKVStore : public KVStore {
   bool _hasBackup;
   bool _enableFilter;
   bool _enableRepllog;
+  // the data cf has a RecordKeyPrefixExtractor and prefix blooms
+  const bool _enablePrefixBloom;
 
   KVStore::StoreMode _mode;
 
@@ -378,7 +512,7 @@ class RocksKVStore : public KVStore {
   std::shared_ptr<rocksdb::Statistics> _stats;
   std::shared_ptr<rocksdb::Cache> _blockCache;
 
-  uint64_t _nextTxnSeq;
+  std::atomic<uint64_t> _nextTxnSeq;
 #ifdef BINLOG_V1
   // NOTE(deyukong): sorted data-structure is required here.
   // we rely on the data order to maintain active txns' watermark.
@@ -392,29 +526,33 @@ class RocksKVStore : public KVStore {
   // remove all the continous committed txnIds follows it, and
   // push _highestVisible forward.
   std::map<uint64_t, std::pair<bool, uint64_t>> _aliveTxns;
-#else
-  uint64_t _nextBinlogSeq;  // high water level for binlog id
-  // <txnId, <commit_or_not, binlogId>>
-  std::unordered_map<uint64_t, std::pair<bool, uint64_t>> _aliveTxns;
-
-  // As things run parallel, there will be false-holes in _aliveBinlogs.
-  // Fortunely, when _aliveBinlogs.begin() changes from uncommitted to
-  // committed, we have a chance to remove all the continuous committed
-  // binlogIds follows it, and push _highestVisible forward.
-  // <binlogId, <commit_or_not, txnId>>
-  std::map<uint64_t, std::pair<bool, uint64_t>> _aliveBinlogs;
-#endif
 
   // NOTE(deyukong): _highestVisible is the largest committed binlog
   // before _aliveTxns.begin()
-  // TOD0(vinchen) : make it actomic?
   uint64_t _highestVisible;  // low water level for binlog id
+#else
+  // the uncommitted txns, sharded by txnId so that creating and
+  // committing txns do not contend on _mutex
+  struct AliveTxnShard {
+    mutable std::mutex mutex;
+    std::unordered_set<uint64_t> txns;
+  };
+  static constexpr size_t ALIVE_TXN_SHARD_NUM = 16;
+  std::array<AliveTxnShard, ALIVE_TXN_SHARD_NUM> _aliveTxns;
+  std::atomic<uint64_t> _aliveTxnCnt;
+
+  // binlogIds in flight, the next binlogId (high water level) and the
+  // highest visible binlogId (low water level)
+  BinlogCommitTracker _binlogTracker;
+#endif
 
   std::shared_ptr<BinlogObserver> _logOb;
   std::shared_ptr<RocksdbEnv> _env;
   std::map<std::string, std::string> _rocksIntProperties;
   std::map<std::string, std::string> _rocksStringProperties;
   std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;
+  // nullptr if kvstore-value-cache-mb is 0
+  std::unique_ptr<RecordValueCache> _valueCache;
 };
 
 class RocksdbEnv {
@@ -6,6 +6,8 @@
 #include <utility>
 #include <limits>
 #include <thread>  // NOLINT
+#include <vector>
+#include <atomic>
 
 #include "glog/logging.h"
 #include "gtest/gtest.h"
@@ -15,6 +17,7 @@
 #include "rocksdb/utilities/backupable_db.h"
 #include "rocksdb/utilities/checkpoint.h"
 #include "rocksdb/options.h"
+#include "rocksdb/perf_context.h"
 
 #include "tendisplus/utils/status.h"
 #include "tendisplus/utils/scopeguard.h"
@@ -25,6 +28,7 @@
 #include "tendisplus/server/server_params.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/time.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/network/session_ctx.h"
 
 namespace tendisplus {
@@ -640,6 +644,237 @@ TEST(RocksKVStore, CursorUpperBound) {
   EXPECT_EQ(cnt, 20000);
 }
 
+void setHashes(RocksKVStore* kvstore,
+               const string& prefix,
+               uint32_t num,
+               uint32_t fields) {
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (uint32_t i = 0; i < num; i++) {
+    for (uint32_t j = 0; j < fields; j++) {
+      Status s = kvstore->setKV(
+        Record(RecordKey(0,
+                         0,
+                         RecordType::RT_HASH_ELE,
+                         prefix + to_string(i),
+                         to_string(j)),
+               RecordValue("12345abcdefghijklmn", RecordType::RT_HASH_ELE, -1)),
+        txn.get());
+      EXPECT_TRUE(s.ok());
+    }
+  }
+  EXPECT_TRUE(txn->commit().ok());
+}
+
+// scan the fields of a hash, and count the blocks touched
+size_t scanHash(RocksKVStore* kvstore,
+                const string& pk,
+                bool usePrefix,
+                uint64_t* blocks) {
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  RecordKey rk(0, 0, RecordType::RT_HASH_ELE, pk, "");
+  std::string prefix = rk.prefixPk();
+  auto cursor = usePrefix ? txn->createPrefixDataCursor(prefix)
+                          : txn->createDataCursor();
+  auto perf = rocksdb::get_perf_context();
+  perf->Reset();
+  cursor->seek(prefix);
+  size_t cnt = 0;
+  while (true) {
+    Expected<Record> v = cursor->next();
+    if (!v.ok()) {
+      EXPECT_EQ(v.status().code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    if (v.value().getRecordKey().prefixPk() != prefix) {
+      break;
+    }
+    cnt++;
+  }
+  *blocks += perf->block_read_count + perf->block_cache_hit_count;
+  return cnt;
+}
+
+TEST(RocksKVStore, PrefixBloom) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+
+  // the sst files written without prefix blooms are still readable
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  EXPECT_FALSE(kvstore->isPrefixBloomEnabled());
+  setHashes(kvstore.get(), "old", 100, 10);
+  EXPECT_TRUE(kvstore
+                ->compactRange(
+                  ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr)
+                .ok());
+  EXPECT_TRUE(kvstore->stop().ok());
+  kvstore.reset();
+
+  cfg->rocksPrefixBloom = true;
+  kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  EXPECT_TRUE(kvstore->isPrefixBloomEnabled());
+  setHashes(kvstore.get(), "new", 1000, 10);
+  // leave the old sst file alone
+  std::string begin =
+    RecordKey(0, 0, RecordType::RT_HASH_ELE, "new", "").prefixPk();
+  std::string end =
+    RecordKey(0, 0, RecordType::RT_HASH_ELE, "new~", "").prefixPk();
+  EXPECT_TRUE(kvstore
+                ->compactRange(
+                  ColumnFamilyNumber::ColumnFamily_Default, &begin, &end)
+                .ok());
+  setHashes(kvstore.get(), "mem", 10, 10);
+
+  uint64_t blocks = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_EQ(scanHash(kvstore.get(), "old" + to_string(i), true, &blocks),
+              10U);
+  }
+  for (uint32_t i = 0; i < 1000; i++) {
+    EXPECT_EQ(scanHash(kvstore.get(), "new" + to_string(i), true, &blocks),
+              10U);
+  }
+  for (uint32_t i = 0; i < 10; i++) {
+    EXPECT_EQ(scanHash(kvstore.get(), "mem" + to_string(i), true, &blocks),
+              10U);
+  }
+
+  // seeking the absent keys
+  const uint32_t seeks = 10000;
+  uint64_t totalOrderBlocks = 0;
+  uint64_t prefixBlocks = 0;
+  for (uint32_t i = 0; i < seeks; i++) {
+    std::string pk = "new" + to_string(i) + "x";
+    EXPECT_EQ(scanHash(kvstore.get(), pk, false, &totalOrderBlocks), 0U);
+    EXPECT_EQ(scanHash(kvstore.get(), pk, true, &prefixBlocks), 0U);
+  }
+  LOG(INFO) << "blocks per seek, total order:"
+            << static_cast<double>(totalOrderBlocks) / seeks
+            << " prefix bloom:" << static_cast<double>(prefixBlocks) / seeks;
+  EXPECT_GE(totalOrderBlocks, seeks);
+  EXPECT_LT(prefixBlocks * 10, totalOrderBlocks);
+}
+
+TEST(RocksKVStore, SlotsCursorRaw) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (uint32_t chunk = 0; chunk < 4; chunk++) {
+    for (uint32_t i = 0; i < 100; i++) {
+      RecordKey rk(chunk, 0, RecordType::RT_KV, to_string(i), "");
+      RecordValue rv(to_string(chunk * 100 + i), RecordType::RT_KV, -1);
+      EXPECT_TRUE(kvstore->setKV(rk, rv, txn.get()).ok());
+    }
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  // the raw records are the encoded ones of next()
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = std::move(eTxn.value());
+  auto cursor = txn->createSlotsCursor(1, 3);
+  auto rawCursor = txn->createSlotsCursor(1, 3);
+  std::string key;
+  std::string value;
+  uint32_t cnt = 0;
+  while (true) {
+    Expected<Record> v = cursor->next();
+    auto s = rawCursor->nextRaw(&key, &value);
+    if (!v.ok()) {
+      EXPECT_EQ(v.status().code(), ErrorCodes::ERR_EXHAUST);
+      EXPECT_EQ(s.code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    EXPECT_TRUE(s.ok());
+    EXPECT_EQ(key, v.value().getRecordKey().encode());
+    EXPECT_EQ(value, v.value().getRecordValue().encode());
+    EXPECT_EQ(RecordKey::decodeChunkId(key), 1 + cnt / 100);
+    cnt++;
+  }
+  EXPECT_EQ(cnt, 200U);
+}
+
+TEST(RocksKVStore, IngestExternalFiles) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto src = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto dst = std::make_unique<RocksKVStore>("1", cfg, blockCache);
+  setHashes(src.get(), "src", 100, 10);
+  setHashes(dst.get(), "dst", 10, 10);
+  uint64_t binlogId = dst->getHighestBinlogId();
+
+  // several files of the keys in order, as the migration sends
+  EXPECT_TRUE(filesystem::create_directory("db/ingest"));
+  std::vector<std::string> files;
+  auto builder = src->createSstFileBuilder();
+  auto eTxn = src->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto cursor = eTxn.value()->createDataCursor();
+  uint32_t keys = 0;
+  while (true) {
+    Expected<Record> v = cursor->next();
+    if (!v.ok()) {
+      EXPECT_EQ(v.status().code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    if (keys % 300 == 0) {
+      if (!files.empty()) {
+        EXPECT_TRUE(builder->finish().ok());
+      }
+      files.push_back("db/ingest/" + to_string(files.size()) + ".sst");
+      EXPECT_TRUE(builder->open(files.back()).ok());
+    }
+    auto kv = v.value().encode();
+    EXPECT_TRUE(builder->put(kv.first, kv.second).ok());
+    keys++;
+  }
+  EXPECT_GT(builder->fileSize(), 0U);
+  EXPECT_TRUE(builder->finish().ok());
+  EXPECT_EQ(keys, 1000U);
+  EXPECT_EQ(files.size(), 4U);
+
+  EXPECT_TRUE(dst->ingestExternalFiles(files).ok());
+  uint64_t blocks = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_EQ(scanHash(dst.get(), "src" + to_string(i), false, &blocks), 10U);
+  }
+  for (uint32_t i = 0; i < 10; i++) {
+    EXPECT_EQ(scanHash(dst.get(), "dst" + to_string(i), false, &blocks), 10U);
+  }
+  // the files are moved, and no binlog is written
+  EXPECT_FALSE(filesystem::exists(files[0]));
+  EXPECT_EQ(dst->getHighestBinlogId(), binlogId);
+}
+
 TEST(RocksKVStore, BackupCkptInter) {
   auto cfg = genParams();
   EXPECT_TRUE(filesystem::create_directory("db"));
@@ -942,6 +1177,107 @@ void commonRoutine(RocksKVStore* kvstore) {
   }
 }
 
+TEST(RocksKVStore, ValueCache) {
+  auto cfg = genParams();
+  cfg->kvstoreValueCacheMB = 16;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  ValueCacheStat stat;
+  EXPECT_TRUE(kvstore->getValueCacheStat(&stat));
+
+  LocalSessionGuard sg(nullptr);
+  RecordKey rk(0, 0, RecordType::RT_KV, "a", "");
+  RecordValue rv1("v1", RecordType::RT_KV, -1);
+  RecordValue rv2("v2", RecordType::RT_KV, -1);
+  auto setValue = [&](const RecordValue& rv) {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    EXPECT_TRUE(kvstore->setKV(rk, rv, eTxn.value().get()).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  auto getValue = [&]() {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    return kvstore->getKV(rk, eTxn.value().get());
+  };
+
+  setValue(rv1);
+  for (int i = 0; i < 5; ++i) {
+    auto eValue = getValue();
+    EXPECT_TRUE(eValue.ok());
+    EXPECT_EQ(eValue.value(), rv1);
+  }
+  EXPECT_TRUE(kvstore->getValueCacheStat(&stat));
+  EXPECT_EQ(stat.entries, 1u);
+  EXPECT_EQ(stat.hits, 3u);
+
+  // the cached value is invalidated by write
+  setValue(rv2);
+  EXPECT_TRUE(kvstore->getValueCacheStat(&stat));
+  EXPECT_EQ(stat.entries, 0u);
+  auto eValue = getValue();
+  EXPECT_TRUE(eValue.ok());
+  EXPECT_EQ(eValue.value(), rv2);
+
+  // a txn reads its own write rather than the cache
+  getValue();
+  EXPECT_EQ(getValue().value(), rv2);
+  {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    auto txn = std::move(eTxn.value());
+    EXPECT_TRUE(kvstore->setKV(rk, rv1, txn.get()).ok());
+    EXPECT_EQ(kvstore->getKV(rk, txn.get()).value(), rv1);
+    EXPECT_EQ(getValue().value(), rv2);
+    EXPECT_TRUE(txn->commit().ok());
+  }
+  EXPECT_EQ(getValue().value(), rv1);
+
+  // deleted
+  {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    EXPECT_TRUE(kvstore->delKV(rk, eTxn.value().get()).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  }
+  EXPECT_EQ(getValue().status().code(), ErrorCodes::ERR_NOTFOUND);
+
+  // batched reads share the cache
+  setValue(rv1);
+  for (int i = 0; i < 3; ++i) {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    RecordKey rk2(0, 0, RecordType::RT_KV, "nokey", "");
+    auto values = kvstore->getKVs({rk, rk2}, eTxn.value().get());
+    EXPECT_EQ(values.size(), 2u);
+    EXPECT_EQ(values[0].value(), rv1);
+    EXPECT_EQ(values[1].status().code(), ErrorCodes::ERR_NOTFOUND);
+  }
+  EXPECT_TRUE(kvstore->getValueCacheStat(&stat));
+  EXPECT_EQ(stat.entries, 1u);
+
+  // deleted by a range in the batch of the txn
+  {
+    auto eTxn = kvstore->createTransaction(sg.getSession());
+    EXPECT_TRUE(eTxn.ok());
+    std::string begin = rk.encode();
+    std::string end = begin;
+    end.push_back('\0');
+    EXPECT_TRUE(eTxn.value()->deleteRange(begin, end, 0).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  }
+  EXPECT_TRUE(kvstore->getValueCacheStat(&stat));
+  EXPECT_EQ(stat.entries, 0u);
+  EXPECT_EQ(getValue().status().code(), ErrorCodes::ERR_NOTFOUND);
+}
+
 TEST(RocksKVStore, OptCommon) {
   auto cfg = genParams();
   EXPECT_TRUE(filesystem::create_directory("db"));
@@ -1289,4 +1625,243 @@ TEST(RocksKVStore, Compaction) {
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, CompactionSubKeys) {
+  auto cfg = genParams();
+  cfg->compactExpiredSubKeys = true;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+    SyncPoint::GetInstance()->DisableProcessing();
+    SyncPoint::GetInstance()->ClearAllCallBacks();
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0",
+                                                cfg,
+                                                blockCache,
+                                                true,
+                                                KVStore::StoreMode::READ_WRITE,
+                                                RocksKVStore::TxnMode::TXN_PES);
+
+  SyncPoint::GetInstance()->EnableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  uint64_t totalExpired = 0;
+  SyncPoint::GetInstance()->SetCallBack(
+    "InspectKvTtlSubKeyExpiredCount", [&](void* arg) mutable {
+      totalExpired = *reinterpret_cast<uint64_t*>(arg);
+    });
+
+  const uint32_t dbId = 0;
+  const uint32_t fields = 10;
+  uint64_t aliveTtl = msSinceEpoch() + 3600 * 1000;
+  auto metaKey = [&](const std::string& pk) {
+    uint32_t chunkId = redis_port::keyHashSlot(pk.c_str(), pk.size());
+    return RecordKey(chunkId, dbId, RecordType::RT_DATA_META, pk, "");
+  };
+  auto eleKey = [&](const std::string& pk, uint32_t i) {
+    uint32_t chunkId = redis_port::keyHashSlot(pk.c_str(), pk.size());
+    return RecordKey(
+      chunkId, dbId, RecordType::RT_HASH_ELE, pk, std::to_string(i));
+  };
+  auto put = [&](const std::string& key, const RecordValue& rv) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    EXPECT_TRUE(eTxn.value()->setKV(key, rv.encode()).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  auto putHash = [&](const std::string& pk, bool withMeta, uint64_t ttl) {
+    if (withMeta) {
+      put(metaKey(pk).encode(),
+          RecordValue("", RecordType::RT_HASH_META, -1, ttl));
+    }
+    for (uint32_t i = 0; i < fields; i++) {
+      put(eleKey(pk, i).encode(),
+          RecordValue("v", RecordType::RT_HASH_ELE, -1));
+    }
+    put(TTLIndex(pk, RecordType::RT_HASH_META, dbId, ttl).encode(),
+        RecordValue("", RecordType::RT_TTL_INDEX, -1));
+  };
+  putHash("expired", true, 1);
+  putHash("alive", true, aliveTtl);
+  // a stale ttl index of "alive"
+  put(TTLIndex("alive", RecordType::RT_HASH_META, dbId, 1).encode(),
+      RecordValue("", RecordType::RT_TTL_INDEX, -1));
+  putHash("deleted", false, 1);
+
+  auto status = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr);
+  EXPECT_TRUE(status.ok());
+  // the sub keys of "expired" and "deleted", the ttl index of "deleted"
+  // and the stale one of "alive"
+  EXPECT_EQ(totalExpired, fields * 2 + 2);
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto txn = std::move(eTxn.value());
+  auto exists = [&](const std::string& key) {
+    return txn->getKV(key).ok();
+  };
+  // the expired meta and its ttl index are left to the foreground
+  EXPECT_TRUE(exists(metaKey("expired").encode()));
+  EXPECT_TRUE(exists(
+    TTLIndex("expired", RecordType::RT_HASH_META, dbId, 1).encode()));
+  EXPECT_TRUE(exists(metaKey("alive").encode()));
+  EXPECT_TRUE(exists(
+    TTLIndex("alive", RecordType::RT_HASH_META, dbId, aliveTtl).encode()));
+  EXPECT_FALSE(exists(
+    TTLIndex("alive", RecordType::RT_HASH_META, dbId, 1).encode()));
+  EXPECT_FALSE(exists(
+    TTLIndex("deleted", RecordType::RT_HASH_META, dbId, 1).encode()));
+  for (uint32_t i = 0; i < fields; i++) {
+    EXPECT_FALSE(exists(eleKey("expired", i).encode()));
+    EXPECT_TRUE(exists(eleKey("alive", i).encode()));
+    EXPECT_FALSE(exists(eleKey("deleted", i).encode()));
+  }
+}
+
+TEST(RocksKVStore, BinlogCommitTracker) {
+  BinlogCommitTracker tracker(8);
+  EXPECT_EQ(tracker.getCapacity(), 8U);
+  tracker.reset(10, 9);
+
+  // visible only after all the binlogIds before are finished
+  uint64_t id = 0;
+  uint64_t t1 = tracker.assignBinlogId(&id);
+  EXPECT_EQ(id, 10U);
+  uint64_t t2 = tracker.assignBinlogId(&id);
+  uint64_t t3 = tracker.assignBinlogId(&id);
+  EXPECT_EQ(id, 12U);
+  EXPECT_EQ(tracker.getNextBinlogId(), 13U);
+  EXPECT_EQ(tracker.getInFlight(), 3U);
+  tracker.finish(t3, true);
+  tracker.finish(t2, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 9U);
+  tracker.finish(t1, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 12U);
+
+  // rolled back ones are skipped
+  t1 = tracker.assignBinlogId(&id);
+  t2 = tracker.assignBinlogId(&id);
+  tracker.finish(t2, false);
+  tracker.finish(t1, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 13U);
+  t1 = tracker.assignBinlogId(&id);
+  tracker.finish(t1, false);
+  EXPECT_EQ(tracker.getHighestVisible(), 13U);
+  EXPECT_EQ(tracker.getInFlight(), 0U);
+
+  // a slave skips the binlogIds failed on its master, the gaps can be
+  // larger than the capacity
+  t1 = tracker.setBinlogId(20);
+  t2 = tracker.setBinlogId(22);
+  t3 = tracker.setBinlogId(40);
+  EXPECT_EQ(tracker.getNextBinlogId(), 41U);
+  tracker.finish(t2, true);
+  tracker.finish(t3, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 13U);
+  tracker.finish(t1, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 40U);
+
+  // and applies them again after rolled back
+  t1 = tracker.setBinlogId(41);
+  t2 = tracker.setBinlogId(42);
+  tracker.finish(t2, false);
+  tracker.finish(t1, false);
+  EXPECT_EQ(tracker.getHighestVisible(), 40U);
+  t1 = tracker.setBinlogId(41);
+  tracker.finish(t1, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 41U);
+  t1 = tracker.setBinlogId(42);
+  tracker.finish(t1, true);
+  EXPECT_EQ(tracker.getHighestVisible(), 42U);
+  EXPECT_EQ(tracker.getNextBinlogId(), 43U);
+
+  // more binlogIds in flight than the capacity
+  std::vector<std::thread> threads;
+  std::atomic<uint64_t> maxCommitted(0);
+  for (size_t i = 0; i < 16; ++i) {
+    threads.emplace_back([&tracker, &maxCommitted, i]() {
+      for (size_t j = 0; j < 10000; ++j) {
+        uint64_t id = 0;
+        uint64_t ticket = tracker.assignBinlogId(&id);
+        bool committed = (i + j) % 7 != 0;
+        if (committed) {
+          uint64_t v = maxCommitted.load();
+          while (v < id && !maxCommitted.compare_exchange_weak(v, id)) {
+          }
+        }
+        tracker.finish(ticket, committed);
+        EXPECT_LE(tracker.getHighestVisible(), tracker.getNextBinlogId());
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(tracker.getNextBinlogId(), 43U + 16 * 10000);
+  EXPECT_EQ(tracker.getInFlight(), 0U);
+  EXPECT_EQ(tracker.getHighestVisible(), maxCommitted.load());
+}
+
+// a multi-threaded set/get harness, one txn per operation
+TEST(RocksKVStore, TxnThroughput) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  for (size_t threadNum : {8, 32, 64}) {
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> sets(0);
+    std::atomic<uint64_t> gets(0);
+    uint64_t binlogStart = kvstore->getNextBinlogSeq();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadNum; ++i) {
+      threads.emplace_back([&, i]() {
+        uint64_t n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          RecordKey rk(0,
+                       0,
+                       RecordType::RT_KV,
+                       std::to_string(i) + "_" + std::to_string(n % 1000),
+                       "");
+          auto eTxn = kvstore->createTransaction(nullptr);
+          EXPECT_TRUE(eTxn.ok());
+          if (n % 4 == 0) {
+            RecordValue rv(std::to_string(n), RecordType::RT_KV, -1);
+            EXPECT_TRUE(kvstore->setKV(rk, rv, eTxn.value().get()).ok());
+            EXPECT_TRUE(eTxn.value()->commit().ok());
+            sets.fetch_add(1, std::memory_order_relaxed);
+          } else {
+            kvstore->getKV(rk, eTxn.value().get());
+            gets.fetch_add(1, std::memory_order_relaxed);
+          }
+          n++;
+        }
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    stop = true;
+    for (auto& t : threads) {
+      t.join();
+    }
+    LOG(INFO) << "threads:" << threadNum
+              << " sets/s:" << sets.load() / 2
+              << " gets/s:" << gets.load() / 2;
+
+    // every set commits one binlog, all visible
+    EXPECT_EQ(kvstore->getNextBinlogSeq() - binlogStart, sets.load());
+    EXPECT_EQ(kvstore->getHighestBinlogId() + 1, kvstore->getNextBinlogSeq());
+    EXPECT_TRUE(kvstore->getUncommittedTxns().empty());
+  }
+}
+
 }  // namespace tendisplus
@@ -5,9 +5,12 @@
 #include <string>
 #include <memory>
 #include <limits>
+#include <unordered_map>
 #include "rocksdb/compaction_filter.h"
 #include "tendisplus/storage/rocks/rocks_kvttlcompactfilter.h"
 #include "tendisplus/storage/record.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/sync_point.h"
@@ -16,18 +19,24 @@
 namespace tendisplus {
 class KVTtlCompactionFilter : public CompactionFilter {
  public:
-  explicit KVTtlCompactionFilter(KVStore* store, uint64_t current_time)
-    : _store(store), _currentTime(current_time) {}
+  KVTtlCompactionFilter(RocksKVStore* store,
+                        uint64_t current_time,
+                        bool sub_keys)
+    : _store(store), _currentTime(current_time), _subKeys(sub_keys) {}
 
   ~KVTtlCompactionFilter() override {
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlExpiredCount", &_expiredCount);
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlFilterCount", &_filterCount);
+    TEST_SYNC_POINT_CALLBACK("InspectKvTtlSubKeyExpiredCount",
+                             &_subKeyExpiredCount);
 
     // do something statistics here
     _store->stat.compactFilterCount.fetch_add(_filterCount,
                                               std::memory_order_relaxed);
     _store->stat.compactKvExpiredCount.fetch_add(_expiredCount,
                                                  std::memory_order_relaxed);
+    _store->stat.compactSubKeyExpiredCount.fetch_add(
+      _subKeyExpiredCount, std::memory_order_relaxed);
   }
 
   const char* Name() const override {
@@ -59,6 +68,22 @@ class KVTtlCompactionFilter : public CompactionFilter {
           }
         }
         break;
+      case RecordType::RT_LIST_ELE:
+      case RecordType::RT_HASH_ELE:
+      case RecordType::RT_SET_ELE:
+      case RecordType::RT_ZSET_S_ELE:
+      case RecordType::RT_ZSET_H_ELE:
+        if (_subKeys && isSubKeyExpired(key)) {
+          _subKeyExpiredCount++;
+          return true;
+        }
+        break;
+      case RecordType::RT_TTL_INDEX:
+        if (_subKeys && isTTLIndexStale(key)) {
+          _subKeyExpiredCount++;
+          return true;
+        }
+        break;
       case RecordType::RT_INVALID:
         // TODO(vinchen): make sure
         INVARIANT_D(0);
@@ -70,15 +95,118 @@ class KVTtlCompactionFilter : public CompactionFilter {
   }
 
  private:
-  KVStore* _store;
+  // the ttl of a meta, or the meta is gone
+  struct MetaState {
+    bool exists;
+    uint64_t ttl;
+  };
+
+  // NOTE: a collection meta is never dropped here even if it is expired,
+  // otherwise a new key with the same name would see the sub keys left
+  // in the lower levels. The expiring of the meta is still up to the
+  // foreground, while its sub keys are reclaimed here.
+  bool isSubKeyExpired(const rocksdb::Slice& key) const {
+    auto metaKey = metaKeyOf(key);
+    if (metaKey.empty()) {
+      return false;
+    }
+    auto state = lookupMeta(metaKey);
+    if (!state.ok()) {
+      return false;
+    }
+    // a sub key is never written without its meta, so the ones of a
+    // deleted key are garbage
+    return !state.value().exists ||
+      (state.value().ttl > 0 && state.value().ttl < _currentTime);
+  }
+
+  // the ttl index of a deleted key, or of a ttl changed since
+  bool isTTLIndexStale(const rocksdb::Slice& key) const {
+    auto rk = RecordKey::decode(key.ToString());
+    if (!rk.ok()) {
+      return false;
+    }
+    auto index = TTLIndex::decode(rk.value());
+    if (!index.ok()) {
+      return false;
+    }
+    const auto& pk = index.value().getPriKey();
+    uint32_t chunkId = redis_port::keyHashSlot(pk.c_str(), pk.size());
+    RecordKey metaRk(
+      chunkId, index.value().getDbId(), RecordType::RT_DATA_META, pk, "");
+    auto state = lookupMeta(metaRk.encode());
+    if (!state.ok()) {
+      return false;
+    }
+    return !state.value().exists ||
+      state.value().ttl != index.value().getTTL();
+  }
+
+  // the key of the meta a sub key belongs to, empty if it can't be decoded
+  static std::string metaKeyOf(const rocksdb::Slice& key) {
+    size_t prefixSize = RecordKey::decodePrefixPkSize(key.data(), key.size());
+    if (prefixSize == 0) {
+      auto rk = RecordKey::decode(key.ToString());
+      if (!rk.ok()) {
+        return "";
+      }
+      return RecordKey(rk.value().getChunkId(),
+                       rk.value().getDbId(),
+                       RecordType::RT_DATA_META,
+                       rk.value().getPrimaryKey(),
+                       "")
+        .encode();
+    }
+    // the prefixPk() with the type of meta, then len(PK) and the reserved
+    // byte copied from the end of the sub key
+    size_t pkLen = prefixSize - RecordKey::getHdrSize() - 2;
+    size_t tailSize = varintEncode(pkLen).size() + sizeof(RecordKey::TRSV);
+    std::string metaKey(key.data(), prefixSize);
+    metaKey[RecordKey::TYPE_OFFSET] = rt2Char(RecordType::RT_DATA_META);
+    metaKey.append(key.data() + key.size() - tailSize, tailSize);
+    return metaKey;
+  }
+
+  // the sub keys of a collection are next to each other, so a small cache
+  // saves most of the lookups. All the records compacted are written
+  // before the compaction begins, so a state looked up after that is never
+  // too old for them.
+  Expected<MetaState> lookupMeta(const std::string& metaKey) const {
+    auto it = _metaCache.find(metaKey);
+    if (it != _metaCache.end()) {
+      return it->second;
+    }
+    MetaState state{false, 0};
+    auto eValue = _store->getLatestValue(metaKey);
+    if (eValue.ok()) {
+      const auto& v = eValue.value();
+      state.exists = true;
+      state.ttl = RecordValue::decodeTtl(v.data(), v.size());
+    } else if (eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return eValue.status();
+    }
+    if (_metaCache.size() >= META_CACHE_SIZE) {
+      _metaCache.clear();
+    }
+    _metaCache.emplace(metaKey, state);
+    return state;
+  }
+
+  static constexpr size_t META_CACHE_SIZE = 4096;
+
+  RocksKVStore* _store;
   // millisecond, same as ttl in the record
   const uint64_t _currentTime;
+  // reclaim the sub keys and ttl indexes, see compactExpiredSubKeys
+  const bool _subKeys;
+  mutable std::unordered_map<std::string, MetaState> _metaCache;
   // It is safe to not using std::atomic since the compaction filter,
   // created from a compaction filter factory, will not be called
   // from multiple threads.
   mutable uint64_t _expiredCount = 0;
   mutable uint64_t _expiredSize = 0;
   mutable uint64_t _filterCount = 0;
+  mutable uint64_t _subKeyExpiredCount = 0;
 };
 
 std::unique_ptr<CompactionFilter>
@@ -95,8 +223,8 @@ KVTtlCompactionFilterFactory::CreateCompactionFilter(
     currentTs = std::numeric_limits<uint64_t>::max();
   }
 
-  return std::unique_ptr<CompactionFilter>(
-    new KVTtlCompactionFilter(_store, currentTs));
+  return std::unique_ptr<CompactionFilter>(new KVTtlCompactionFilter(
+    _store, currentTs, _store->getCfg()->compactExpiredSubKeys));
 }
 
 }  // namespace tendisplus
@@ -0,0 +1,25 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include "tendisplus/storage/rocks/rocks_prefix_extractor.h"
+#include "tendisplus/storage/record.h"
+
+namespace tendisplus {
+
+rocksdb::Slice RecordKeyPrefixExtractor::Transform(
+  const rocksdb::Slice& key) const {
+  size_t size = RecordKey::decodePrefixPkSize(key.data(), key.size());
+  // the iterators with prefix_same_as_start transform the keys out of
+  // domain too, the whole key never equals to a prefix of others
+  if (size == 0) {
+    return key;
+  }
+  return rocksdb::Slice(key.data(), size);
+}
+
+bool RecordKeyPrefixExtractor::InDomain(const rocksdb::Slice& key) const {
+  return RecordKey::decodePrefixPkSize(key.data(), key.size()) != 0;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,31 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_EXTRACTOR_H_
+#define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_EXTRACTOR_H_
+
+#include "rocksdb/slice.h"
+#include "rocksdb/slice_transform.h"
+
+namespace tendisplus {
+
+// RecordKeyPrefixExtractor maps an encoded RecordKey to its prefixPk(),
+// so that the prefix blooms can skip the sst files without the sub keys
+// of a collection. The pk length is read from the tail of the key, and a
+// seek target which is a prefixPk() maps to itself.
+//
+// Keys with an empty pk or a pk beginning with 0 are out of domain, they
+// are never skipped, and seeking them should use a total order cursor.
+class RecordKeyPrefixExtractor : public rocksdb::SliceTransform {
+ public:
+  const char* Name() const override {
+    return "tendis.RecordKeyPrefixExtractor";
+  }
+  rocksdb::Slice Transform(const rocksdb::Slice& key) const override;
+  bool InDomain(const rocksdb::Slice& key) const override;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_EXTRACTOR_H_
@@ -0,0 +1,592 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <utility>
+#include "tendisplus/storage/packedzset.h"
+#include "tendisplus/storage/scoreindex.h"
+#include "tendisplus/storage/skiplist.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+std::unique_ptr<ZsetIndex> makeZsetIndex(uint32_t chunkId,
+                                         uint32_t dbId,
+                                         const std::string& pk,
+                                         const ZSlMetaValue& meta,
+                                         PStore store) {
+  if (meta.isScoreKeys()) {
+    return std::make_unique<ScoreIndex>(chunkId, dbId, pk, meta, store);
+  }
+  if (meta.isPacked()) {
+    return std::make_unique<PackedZset>(chunkId, dbId, pk, meta, store);
+  }
+  return std::make_unique<SkipList>(chunkId, dbId, pk, meta, store);
+}
+
+ScoreIndex::ScoreIndex(uint32_t chunkId,
+                       uint32_t dbId,
+                       const std::string& pk,
+                       const ZSlMetaValue& meta,
+                       PStore store)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _pk(pk),
+    _store(store),
+    _count(meta.getCount()),
+    _blockEntries(meta.getBlockEntries()),
+    _tree(chunkId, dbId, RecordType::RT_ZSET_S_ELE, pk, store) {
+  INVARIANT_D(meta.isScoreKeys());
+}
+
+RecordKey ScoreIndex::subRecordKey(const std::string& sk) const {
+  return RecordKey(_chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, sk);
+}
+
+Status ScoreIndex::forEach(const std::string& from,
+                           Transaction* txn,
+                           Visitor fn) {
+  std::string prefix = subRecordKey("").prefixPk();
+  auto cursor = txn->createPrefixDataCursor(prefix);
+  cursor->seek(prefix + from);
+  while (true) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!exptRcd.ok()) {
+      return exptRcd.status();
+    }
+    const RecordKey& rk = exptRcd.value().getRecordKey();
+    if (rk.prefixPk() != prefix) {
+      break;
+    }
+    // the nodes of the tree of the blocks are after all the members
+    const std::string& sk = rk.getSecondaryKey();
+    if (CountedTree::isNodeKey(sk)) {
+      break;
+    }
+    auto eMember = zslScoreKeyDecode(sk);
+    if (!eMember.ok()) {
+      return eMember.status();
+    }
+    if (!fn(eMember.value().first, eMember.value().second, sk)) {
+      break;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status ScoreIndex::forEachRev(const std::string& to,
+                              Transaction* txn,
+                              Visitor fn) {
+  struct Entry {
+    double score;
+    std::string member;
+    std::string sk;
+  };
+  auto ePos = _tree.seekKey(to, txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return {ErrorCodes::ERR_OK, ""};
+  } else if (!ePos.ok()) {
+    return ePos.status();
+  }
+  CountedTree::Pos pos = std::move(ePos.value());
+  // the blocks are read forward one by one from the last, and given out
+  // backward, so at most a block more is read
+  std::string end = to;
+  while (true) {
+    std::string first = _tree.get(pos).key;
+    std::vector<Entry> entries;
+    auto s = forEach(
+      first,
+      txn,
+      [&](double score, const std::string& member, const std::string& sk) {
+        if (sk >= end) {
+          return false;
+        }
+        entries.push_back({score, member, sk});
+        return true;
+      });
+    if (!s.ok()) {
+      return s;
+    }
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+      if (!fn(it->score, it->member, it->sk)) {
+        return {ErrorCodes::ERR_OK, ""};
+      }
+    }
+    auto ePrev = _tree.prev(&pos, txn);
+    if (!ePrev.ok()) {
+      return ePrev.status();
+    }
+    if (!ePrev.value()) {
+      break;
+    }
+    end = std::move(first);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<CountedTree::Pos> ScoreIndex::findBlock(const std::string& sk,
+                                                 Transaction* txn) {
+  auto ePos = _tree.seekKey(sk, txn);
+  if (ePos.status().code() != ErrorCodes::ERR_NOTFOUND) {
+    return ePos;
+  }
+  // the first block starts from ""
+  auto s = _tree.pushBack({"", 0, 0}, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return _tree.seekKey(sk, txn);
+}
+
+Expected<uint64_t> ScoreIndex::countLess(const std::string& sk,
+                                         Transaction* txn) {
+  auto ePos = _tree.seekKey(sk, txn);
+  if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return 0;
+  } else if (!ePos.ok()) {
+    return ePos.status();
+  }
+  uint64_t count = ePos.value().before;
+  auto s = forEach(
+    _tree.get(ePos.value()).key,
+    txn,
+    [&](double, const std::string&, const std::string& cur) {
+      if (cur >= sk) {
+        return false;
+      }
+      count++;
+      return true;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  return count;
+}
+
+Status ScoreIndex::splitBlock(const std::string& first, Transaction* txn) {
+  auto ePos = _tree.seekKey(first, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  uint64_t count = _tree.get(ePos.value()).count;
+  uint64_t half = count / 2;
+  uint64_t n = 0;
+  std::string prev;
+  std::string mid;
+  auto s = forEach(
+    first, txn, [&](double, const std::string&, const std::string& sk) {
+      if (n++ == half) {
+        mid = sk;
+        return false;
+      }
+      prev = sk;
+      return true;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  if (mid.empty() || prev.empty()) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid zset score block"};
+  }
+  // the shortest prefix of mid after prev, the sub keys are prefix free
+  size_t i = 0;
+  while (i < prev.size() && i < mid.size() && prev[i] == mid[i]) {
+    ++i;
+  }
+  INVARIANT_D(i < mid.size() && prev < mid);
+  s = _tree.setCount(ePos.value(), half, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  ePos = _tree.seekKey(first, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  return _tree.insert(
+    ePos.value(), true, {mid.substr(0, i + 1), 0, count - half}, txn);
+}
+
+Status ScoreIndex::mergeBlock(const std::string& first, Transaction* txn) {
+  auto ePos = _tree.seekKey(first, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  uint64_t count = _tree.get(ePos.value()).count;
+  // merge with the next or the previous one, if they fit in one
+  for (bool forward : {true, false}) {
+    CountedTree::Pos other = ePos.value();
+    auto eMoved = forward ? _tree.next(&other, txn) : _tree.prev(&other, txn);
+    if (!eMoved.ok()) {
+      return eMoved.status();
+    }
+    const auto& entry = _tree.get(other);
+    if (!eMoved.value() || count + entry.count > _blockEntries) {
+      continue;
+    }
+    // the later one is dropped, the first block is never
+    std::string kept = forward ? first : entry.key;
+    uint64_t merged = count + entry.count;
+    auto s = _tree.erase(forward ? other : ePos.value(), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    auto eKept = _tree.seekKey(kept, txn);
+    if (!eKept.ok()) {
+      return eKept.status();
+    }
+    return _tree.setCount(eKept.value(), merged, txn);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status ScoreIndex::clearBlocks(Transaction* txn) {
+  while (true) {
+    auto ePos = _tree.first(txn);
+    if (ePos.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      break;
+    } else if (!ePos.ok()) {
+      return ePos.status();
+    }
+    auto s = _tree.erase(ePos.value(), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return _tree.save(txn);
+}
+
+Status ScoreIndex::insert(double score,
+                          const std::string& subkey,
+                          Transaction* txn) {
+  if (_count >= std::numeric_limits<int32_t>::max() / 2) {
+    return {ErrorCodes::ERR_INTERNAL, "zset count reach limit"};
+  }
+  std::string sk = zslScoreKeyEncode(score, subkey);
+  RecordValue rv("", RecordType::RT_ZSET_S_ELE, -1);
+  auto s = _store->setKV(subRecordKey(sk), rv, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  auto ePos = findBlock(sk, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  std::string first = _tree.get(ePos.value()).key;
+  uint64_t count = _tree.get(ePos.value()).count + 1;
+  s = _tree.setCount(ePos.value(), count, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  ++_count;
+  if (count > 2 * static_cast<uint64_t>(_blockEntries)) {
+    return splitBlock(first, txn);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// The caller shoule guarantee the (score, subkey) exists
+Status ScoreIndex::remove(double score,
+                          const std::string& subkey,
+                          Transaction* txn) {
+  std::string sk = zslScoreKeyEncode(score, subkey);
+  auto s = _store->delKV(subRecordKey(sk), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  auto ePos = _tree.seekKey(sk, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  std::string first = _tree.get(ePos.value()).key;
+  uint64_t count = _tree.get(ePos.value()).count;
+  INVARIANT_D(count > 0 && _count > 1);
+  if (count == 0 || _count <= 1) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid zset score block"};
+  }
+  s = _tree.setCount(ePos.value(), count - 1, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  --_count;
+  if (_count == 1) {
+    return clearBlocks(txn);
+  }
+  return mergeBlock(first, txn);
+}
+
+Expected<uint32_t> ScoreIndex::rank(double score,
+                                    const std::string& subkey,
+                                    Transaction* txn) {
+  auto count = countLess(zslScoreKeyEncode(score, subkey), txn);
+  if (!count.ok()) {
+    return count.status();
+  }
+  return count.value() + 1;
+}
+
+bool ScoreIndex::scoreBounds(const Zrangespec& range,
+                             std::string* lower,
+                             std::string* upper) const {
+  if (range.min > range.max ||
+      (range.min == range.max && (range.minex || range.maxex))) {
+    return false;
+  }
+  *lower = zslScoreKeyPrefix(range.min, range.minex);
+  *upper = zslScoreKeyPrefix(range.max, !range.maxex);
+  return *lower < *upper;
+}
+
+Expected<bool> ScoreIndex::lexBounds(const Zlexrangespec& range,
+                                     Transaction* txn,
+                                     std::string* lower,
+                                     std::string* upper) {
+  if (compareStringObjectsForLexRange(range.min, range.max) > 0 ||
+      (range.min == range.max && (range.minex || range.maxex)) ||
+      range.min == ZLEXMAX || range.max == ZLEXMIN || _count <= 1) {
+    return false;
+  }
+  // the members should have the same score, which is the first one's
+  double score = 0;
+  auto s = forEach(
+    "", txn, [&](double first, const std::string&, const std::string&) {
+      score = first;
+      return false;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  // the sub keys after sk are after sk + "\0" too
+  if (range.min == ZLEXMIN) {
+    *lower = zslScoreKeyPrefix(score);
+  } else {
+    *lower = zslScoreKeyEncode(score, range.min);
+    if (range.minex) {
+      lower->push_back('\0');
+    }
+  }
+  if (range.max == ZLEXMAX) {
+    *upper = zslScoreKeyPrefix(score, true);
+  } else {
+    *upper = zslScoreKeyEncode(score, range.max);
+    if (!range.maxex) {
+      upper->push_back('\0');
+    }
+  }
+  return *lower < *upper;
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::scanBetween(
+  const std::string& lower,
+  const std::string& upper,
+  uint64_t offset,
+  uint64_t limit,
+  bool rev,
+  Transaction* txn) {
+  Members result;
+  auto visit = [&](double score,
+                   const std::string& member,
+                   const std::string& sk) {
+    if (rev ? sk < lower : sk >= upper) {
+      return false;
+    }
+    if (offset > 0) {
+      --offset;
+      return true;
+    }
+    if (limit == 0) {
+      return false;
+    }
+    --limit;
+    result.push_back({score, member});
+    return true;
+  };
+  auto s = rev ? forEachRev(upper, txn, visit) : forEach(lower, txn, visit);
+  if (!s.ok()) {
+    return s;
+  }
+  return std::move(result);
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::scanByScore(const Zrangespec& range,
+                                                     uint64_t offset,
+                                                     uint64_t limit,
+                                                     bool rev,
+                                                     Transaction* txn) {
+  std::string lower, upper;
+  if (!scoreBounds(range, &lower, &upper)) {
+    return Members();
+  }
+  return scanBetween(lower, upper, offset, limit, rev, txn);
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::scanByLex(const Zlexrangespec& range,
+                                                   uint64_t offset,
+                                                   uint64_t limit,
+                                                   bool rev,
+                                                   Transaction* txn) {
+  std::string lower, upper;
+  auto inRange = lexBounds(range, txn, &lower, &upper);
+  if (!inRange.ok()) {
+    return inRange.status();
+  }
+  if (!inRange.value()) {
+    return Members();
+  }
+  return scanBetween(lower, upper, offset, limit, rev, txn);
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::scanByRank(int64_t start,
+                                                    int64_t len,
+                                                    bool rev,
+                                                    Transaction* txn) {
+  Members result;
+  int64_t members = _count - 1;
+  if (start < 0 || len <= 0 || start >= members) {
+    return std::move(result);
+  }
+  len = std::min(len, members - start);
+  // the reversed ranks are read forward from the lowest one
+  int64_t from = rev ? members - start - len : start;
+  auto ePos = _tree.seekCount(from, txn);
+  if (!ePos.ok()) {
+    return ePos.status();
+  }
+  from -= ePos.value().before;
+  auto s = forEach(
+    _tree.get(ePos.value()).key,
+    txn,
+    [&](double score, const std::string& member, const std::string&) {
+      if (from > 0) {
+        --from;
+        return true;
+      }
+      if (rev) {
+        result.push_front({score, member});
+      } else {
+        result.push_back({score, member});
+      }
+      return --len > 0;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  return std::move(result);
+}
+
+Expected<uint64_t> ScoreIndex::countInRange(const Zrangespec& range,
+                                            Transaction* txn) {
+  std::string lower, upper;
+  if (!scoreBounds(range, &lower, &upper)) {
+    return 0;
+  }
+  auto eLower = countLess(lower, txn);
+  if (!eLower.ok()) {
+    return eLower.status();
+  }
+  auto eUpper = countLess(upper, txn);
+  if (!eUpper.ok()) {
+    return eUpper.status();
+  }
+  return eUpper.value() - eLower.value();
+}
+
+Expected<uint64_t> ScoreIndex::countInLexRange(const Zlexrangespec& range,
+                                               Transaction* txn) {
+  std::string lower, upper;
+  auto inRange = lexBounds(range, txn, &lower, &upper);
+  if (!inRange.ok()) {
+    return inRange.status();
+  }
+  if (!inRange.value()) {
+    return 0;
+  }
+  auto eLower = countLess(lower, txn);
+  if (!eLower.ok()) {
+    return eLower.status();
+  }
+  auto eUpper = countLess(upper, txn);
+  if (!eUpper.ok()) {
+    return eUpper.status();
+  }
+  return eUpper.value() - eLower.value();
+}
+
+Status ScoreIndex::removeAll(const Members& members, Transaction* txn) {
+  for (const auto& member : members) {
+    auto s = remove(member.first, member.second, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::removeRangeByScore(
+  const Zrangespec& range, Transaction* txn) {
+  auto members = scanByScore(
+    range, 0, std::numeric_limits<uint64_t>::max(), false, txn);
+  if (!members.ok()) {
+    return members.status();
+  }
+  auto s = removeAll(members.value(), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return members;
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::removeRangeByLex(
+  const Zlexrangespec& range, Transaction* txn) {
+  auto members =
+    scanByLex(range, 0, std::numeric_limits<uint64_t>::max(), false, txn);
+  if (!members.ok()) {
+    return members.status();
+  }
+  auto s = removeAll(members.value(), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return members;
+}
+
+Expected<ZsetIndex::Members> ScoreIndex::removeRangeByRank(uint32_t start,
+                                                           uint32_t end,
+                                                           Transaction* txn) {
+  if (start == 0 || end < start) {
+    return Members();
+  }
+  auto members = scanByRank(start - 1, end - start + 1, false, txn);
+  if (!members.ok()) {
+    return members.status();
+  }
+  auto s = removeAll(members.value(), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return members;
+}
+
+Status ScoreIndex::save(Transaction* txn,
+                        const Expected<RecordValue>& oldValue,
+                        uint64_t versionEP) {
+  auto s = _tree.save(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
+  ZSlMetaValue mv(0, _count, 0);
+  mv.setScoreKeys(_blockEntries);
+  uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
+  RecordValue rv(
+    mv.encode(), RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
+  return _store->setKV(rk, rv, txn);
+}
+
+}  // namespace tendisplus
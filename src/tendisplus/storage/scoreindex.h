@@ -0,0 +1,127 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_SCOREINDEX_H_
+#define SRC_TENDISPLUS_STORAGE_SCOREINDEX_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/countedtree.h"
+#include "tendisplus/storage/zsetindex.h"
+
+namespace tendisplus {
+
+// ScoreIndex keeps the members of a zset with score keys, see ZSlMetaValue.
+// The ranges by score or lex are read by one iterator over the sub keys,
+// and a rank is the counts of the blocks before its block, summed by the
+// tree of the blocks, plus a scan in the block, which has at most twice
+// blockEntries members. An update rewrites the nodes on the path to its
+// block only.
+class ScoreIndex : public ZsetIndex {
+ public:
+  ScoreIndex(uint32_t chunkId,
+             uint32_t dbId,
+             const std::string& pk,
+             const ZSlMetaValue& meta,
+             PStore store);
+
+  Status insert(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
+  Status remove(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
+  Expected<uint32_t> rank(double score,
+                          const std::string& subkey,
+                          Transaction* txn) override;
+
+  Expected<Members> scanByScore(const Zrangespec& range,
+                                uint64_t offset,
+                                uint64_t limit,
+                                bool rev,
+                                Transaction* txn) override;
+  Expected<Members> scanByLex(const Zlexrangespec& range,
+                              uint64_t offset,
+                              uint64_t limit,
+                              bool rev,
+                              Transaction* txn) override;
+  Expected<Members> scanByRank(int64_t start,
+                               int64_t len,
+                               bool rev,
+                               Transaction* txn) override;
+  Expected<uint64_t> countInRange(const Zrangespec& range,
+                                  Transaction* txn) override;
+  Expected<uint64_t> countInLexRange(const Zlexrangespec& range,
+                                     Transaction* txn) override;
+
+  Expected<Members> removeRangeByScore(const Zrangespec& range,
+                                       Transaction* txn) override;
+  Expected<Members> removeRangeByLex(const Zlexrangespec& range,
+                                     Transaction* txn) override;
+  Expected<Members> removeRangeByRank(uint32_t start,
+                                      uint32_t end,
+                                      Transaction* txn) override;
+
+  Status save(Transaction* txn,
+              const Expected<RecordValue>& oldValue,
+              uint64_t versionEP) override;
+  uint32_t getCount() const override {
+    return _count;
+  }
+  // the first sub keys and the counts of the blocks, in order
+  Expected<std::vector<CountedTree::Entry>> getBlocks(Transaction* txn) {
+    return _tree.entries(txn);
+  }
+
+ private:
+  // score, member and sub key of each member in order, return false to stop
+  using Visitor =
+    std::function<bool(double, const std::string&, const std::string&)>;
+
+  RecordKey subRecordKey(const std::string& sk) const;
+  Status forEach(const std::string& from, Transaction* txn, Visitor fn);
+  // the members before to, from the last one backward
+  Status forEachRev(const std::string& to, Transaction* txn, Visitor fn);
+  // the block sk is in, the first one is added to an empty tree
+  Expected<CountedTree::Pos> findBlock(const std::string& sk,
+                                       Transaction* txn);
+  // the number of members with sub keys less than sk
+  Expected<uint64_t> countLess(const std::string& sk, Transaction* txn);
+  // the blocks are found again by their first sub keys, as any change of
+  // the tree invalidates the positions in it
+  Status splitBlock(const std::string& first, Transaction* txn);
+  Status mergeBlock(const std::string& first, Transaction* txn);
+  // remove all the blocks of an empty zset, which is deleted without save()
+  Status clearBlocks(Transaction* txn);
+  // the sub keys in [lower, upper) of the range, false if it is empty
+  bool scoreBounds(const Zrangespec& range,
+                   std::string* lower,
+                   std::string* upper) const;
+  Expected<bool> lexBounds(const Zlexrangespec& range,
+                           Transaction* txn,
+                           std::string* lower,
+                           std::string* upper);
+  Expected<Members> scanBetween(const std::string& lower,
+                                const std::string& upper,
+                                uint64_t offset,
+                                uint64_t limit,
+                                bool rev,
+                                Transaction* txn);
+  Status removeAll(const Members& members, Transaction* txn);
+
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  std::string _pk;
+  PStore _store;
+  uint32_t _count;
+  uint32_t _blockEntries;
+  CountedTree _tree;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_SCOREINDEX_H_
@@ -716,6 +716,69 @@ Expected<uint64_t> SkipList::lastInLexRange(const Zlexrangespec& range,
   return pos;
 }
 
+Expected<uint64_t> SkipList::countInRange(const Zrangespec& range,
+                                          Transaction* txn) {
+  auto f = firstInRange(range, txn);
+  if (!f.ok()) {
+    return f.status();
+  }
+  if (f.value() == SKIPLIST_INVALID_POS) {
+    return 0;
+  }
+  auto first = getCacheNode(f.value());
+  Expected<uint32_t> rank = this->rank(first->getScore(),
+                                       first->getSubKey(), txn);
+  if (!rank.ok()) {
+    return rank.status();
+  }
+  // _count - 1 : total skiplist nodes exclude head
+  uint32_t count = (_count - 1 - (rank.value() - 1));
+  auto l = lastInRange(range, txn);
+  if (!l.ok()) {
+    return l.status();
+  }
+  if (l.value() == SKIPLIST_INVALID_POS) {
+    return count;
+  }
+  auto last = getCacheNode(l.value());
+  rank = this->rank(last->getScore(), last->getSubKey(), txn);
+  if (!rank.ok()) {
+    return rank.status();
+  }
+  return count - (_count - 1 - rank.value());
+}
+
+Expected<uint64_t> SkipList::countInLexRange(const Zlexrangespec& range,
+                                             Transaction* txn) {
+  auto f = firstInLexRange(range, txn);
+  if (!f.ok()) {
+    return f.status();
+  }
+  if (f.value() == SKIPLIST_INVALID_POS) {
+    return 0;
+  }
+  auto first = getCacheNode(f.value());
+  Expected<uint32_t> rank = this->rank(first->getScore(),
+                                       first->getSubKey(), txn);
+  if (!rank.ok()) {
+    return rank.status();
+  }
+  uint32_t count = (_count - 1 - (rank.value() - 1));
+  auto l = lastInLexRange(range, txn);
+  if (!l.ok()) {
+    return l.status();
+  }
+  if (l.value() == SKIPLIST_INVALID_POS) {
+    return count;
+  }
+  auto last = getCacheNode(l.value());
+  rank = this->rank(last->getScore(), last->getSubKey(), txn);
+  if (!rank.ok()) {
+    return rank.status();
+  }
+  return count - (_count - 1 - rank.value());
+}
+
 Expected<std::list<std::pair<double, std::string>>> SkipList::scanByScore(
   const Zrangespec& range,
   uint64_t offset,
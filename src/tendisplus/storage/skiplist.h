@@ -15,14 +15,13 @@
 #include <utility>
 #include "tendisplus/storage/record.h"
 #include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/zsetindex.h"
 #include "tendisplus/utils/redis_port.h"
 
 namespace tendisplus {
 
-using Zrangespec = redis_port::Zrangespec;
-using Zlexrangespec = redis_port::Zlexrangespec;
 const uint64_t SKIPLIST_INVALID_POS = (uint64_t)-1;
-class SkipList {
+class SkipList : public ZsetIndex {
  public:
   using PSE = std::unique_ptr<ZSlEleValue>;
   using PSE_MAP = std::map<uint64_t, SkipList::PSE>;
@@ -31,11 +30,15 @@ class SkipList {
            const std::string& pk,
            const ZSlMetaValue& meta,
            PStore store);
-  Status insert(double score, const std::string& subkey, Transaction* txn);
-  Status remove(double score, const std::string& subkey, Transaction* txn);
+  Status insert(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
+  Status remove(double score,
+                const std::string& subkey,
+                Transaction* txn) override;
   Expected<uint32_t> rank(double score,
                           const std::string& subkey,
-                          Transaction* txn);
+                          Transaction* txn) override;
 
   Expected<bool> isInRange(const Zrangespec& spec, Transaction* txn);
   Expected<bool> isInLexRange(const Zlexrangespec& spec, Transaction* txn);
@@ -53,33 +56,38 @@ class SkipList {
     uint64_t offset,
     uint64_t limit,
     bool rev,
-    Transaction* txn);
+    Transaction* txn) override;
   Expected<std::list<std::pair<double, std::string>>> scanByRank(
-    int64_t start, int64_t len, bool rev, Transaction* txn);
+    int64_t start, int64_t len, bool rev, Transaction* txn) override;
 
   Expected<std::list<std::pair<double, std::string>>> scanByScore(
     const Zrangespec& range,
     uint64_t offset,
     uint64_t limit,
     bool rev,
-    Transaction* txn);
+    Transaction* txn) override;
+
+  Expected<uint64_t> countInRange(const Zrangespec& range,
+                                  Transaction* txn) override;
+  Expected<uint64_t> countInLexRange(const Zlexrangespec& range,
+                                     Transaction* txn) override;
 
   Expected<std::list<std::pair<double, std::string>>> removeRangeByScore(
-    const Zrangespec& range, Transaction* txn);
+    const Zrangespec& range, Transaction* txn) override;
 
   Expected<std::list<std::pair<double, std::string>>> removeRangeByLex(
-    const Zlexrangespec& range, Transaction* txn);
+    const Zlexrangespec& range, Transaction* txn) override;
 
   // 1-based index
   Expected<std::list<std::pair<double, std::string>>> removeRangeByRank(
-    uint32_t start, uint32_t end, Transaction* txn);
+    uint32_t start, uint32_t end, Transaction* txn) override;
 
 
   Status save(Transaction* txn,
               const Expected<RecordValue>& oldValue,
-              uint64_t versionEP);
+              uint64_t versionEP) override;
   Status traverse(std::stringstream& ss, Transaction* txn);
-  uint32_t getCount() const;
+  uint32_t getCount() const override;
   uint64_t getAlloc() const;
   uint64_t getTail() const;
   uint8_t getLevel() const;
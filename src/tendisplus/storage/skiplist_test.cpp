@@ -2,6 +2,8 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <chrono>  // NOLINT
+#include <cstdlib>
 #include <fstream>
 #include <utility>
 #include <algorithm>
@@ -11,6 +13,8 @@
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/portable.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/scoreindex.h"
+#include "tendisplus/storage/packedzset.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
 #include "tendisplus/server/server_params.h"
@@ -449,4 +453,503 @@ TEST(SkipList, Common) {
   LOG(INFO) << "skiplist level:" << static_cast<uint32_t>(sl.getLevel());
 }
 
+// a zset of each kind, the skiplist with its head
+void initZsets(PStore store, ZSlMetaValue* slMeta, ZSlMetaValue* siMeta) {
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  *slMeta = ZSlMetaValue(1, 1, 0);
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "sl",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  Status s = store->setKV(head, subRv, eTxn.value().get());
+  EXPECT_TRUE(s.ok());
+
+  *siMeta = ZSlMetaValue(1, 1, 0);
+  siMeta->setScoreKeys(8);
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+}
+
+void expectSameMembers(const Expected<ZsetIndex::Members>& a,
+                       const Expected<ZsetIndex::Members>& b) {
+  ASSERT_TRUE(a.ok()) << a.status().toString();
+  ASSERT_TRUE(b.ok()) << b.status().toString();
+  EXPECT_EQ(a.value(), b.value());
+}
+
+TEST(ScoreIndex, SameAsSkipList) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  ZSlMetaValue slMeta, siMeta;
+  initZsets(store, &slMeta, &siMeta);
+  SkipList sl(0, 0, "sl", slMeta, store);
+  ScoreIndex si(0, 0, "si", siMeta, store);
+
+  constexpr uint32_t CNT = 3000;
+  std::vector<std::pair<double, std::string>> members;
+  for (uint32_t i = 0; i < CNT; ++i) {
+    // repeated and negative scores
+    members.push_back({static_cast<double>(rand() % 200) - 100 + 0.5,
+                       std::to_string(rand()) + "_" + std::to_string(i)});
+  }
+  auto timed = [](const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+  };
+  auto insertAll = [&](ZsetIndex* index) {
+    for (uint32_t i = 0; i < CNT; i += 100) {
+      auto eTxn = store->createTransaction(nullptr);
+      EXPECT_TRUE(eTxn.ok());
+      for (uint32_t j = i; j < i + 100; ++j) {
+        Status s = index->insert(
+          members[j].first, members[j].second, eTxn.value().get());
+        EXPECT_TRUE(s.ok()) << s.toString();
+      }
+      Status s =
+        index->save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+      EXPECT_TRUE(s.ok());
+      EXPECT_TRUE(eTxn.value()->commit().ok());
+    }
+  };
+  LOG(INFO) << "insert " << CNT << " skiplist:" << timed([&] {
+    insertAll(&sl);
+  }) << "us scorekeys:" << timed([&] { insertAll(&si); }) << "us";
+  EXPECT_EQ(sl.getCount(), CNT + 1);
+  EXPECT_EQ(si.getCount(), CNT + 1);
+
+  // remove a third
+  std::random_shuffle(members.begin(), members.end());
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  for (uint32_t i = 0; i < CNT / 3; ++i) {
+    EXPECT_TRUE(sl.remove(members.back().first, members.back().second, txn)
+                  .ok());
+    EXPECT_TRUE(si.remove(members.back().first, members.back().second, txn)
+                  .ok());
+    members.pop_back();
+  }
+  EXPECT_EQ(sl.getCount(), si.getCount());
+  uint64_t total = 0;
+  auto eBlocks = si.getBlocks(txn);
+  ASSERT_TRUE(eBlocks.ok());
+  EXPECT_GT(eBlocks.value().size(), 1u);
+  for (const auto& block : eBlocks.value()) {
+    EXPECT_LE(block.count, 16u);
+    total += block.count;
+  }
+  EXPECT_EQ(total + 1, si.getCount());
+
+  for (const auto& member : members) {
+    auto slRank = sl.rank(member.first, member.second, txn);
+    auto siRank = si.rank(member.first, member.second, txn);
+    EXPECT_TRUE(slRank.ok() && siRank.ok());
+    EXPECT_EQ(slRank.value(), siRank.value());
+  }
+
+  int64_t len = sl.getCount() - 1;
+  for (bool rev : {false, true}) {
+    expectSameMembers(sl.scanByRank(0, len, rev, txn),
+                      si.scanByRank(0, len, rev, txn));
+    for (uint32_t i = 0; i < 50; ++i) {
+      int64_t start = rand() % len;
+      int64_t rangeLen = 1 + rand() % (len - start);
+      expectSameMembers(sl.scanByRank(start, rangeLen, rev, txn),
+                        si.scanByRank(start, rangeLen, rev, txn));
+    }
+  }
+
+  for (uint32_t i = 0; i < 200; ++i) {
+    Zrangespec range;
+    range.min = rand() % 220 - 110 + (rand() % 2 ? 0.5 : 0);
+    range.max = range.min + rand() % 60 - 5;
+    range.minex = rand() % 2;
+    range.maxex = rand() % 2;
+    uint64_t offset = rand() % 3 ? 0 : rand() % 20;
+    uint64_t limit = rand() % 2 ? -1 : rand() % 50;
+    bool rev = rand() % 2;
+    expectSameMembers(sl.scanByScore(range, offset, limit, rev, txn),
+                      si.scanByScore(range, offset, limit, rev, txn));
+    auto slCount = sl.countInRange(range, txn);
+    auto siCount = si.countInRange(range, txn);
+    EXPECT_TRUE(slCount.ok() && siCount.ok());
+    EXPECT_EQ(slCount.value(), siCount.value());
+  }
+
+  uint32_t ROUND = 100;
+  LOG(INFO) << "zrangebyscore " << ROUND << " times skiplist:" << timed([&] {
+    Zrangespec range{-50, 50, 0, 0};
+    for (uint32_t i = 0; i < ROUND; ++i) {
+      sl.scanByScore(range, 0, 10, false, txn);
+    }
+  }) << "us scorekeys:" << timed([&] {
+    Zrangespec range{-50, 50, 0, 0};
+    for (uint32_t i = 0; i < ROUND; ++i) {
+      si.scanByScore(range, 0, 10, false, txn);
+    }
+  }) << "us";
+
+  Zrangespec range{-20, 20, 1, 0};
+  expectSameMembers(sl.removeRangeByScore(range, txn),
+                    si.removeRangeByScore(range, txn));
+  expectSameMembers(sl.removeRangeByRank(3, 30, txn),
+                    si.removeRangeByRank(3, 30, txn));
+  EXPECT_EQ(sl.getCount(), si.getCount());
+  expectSameMembers(sl.scanByRank(0, sl.getCount() - 1, false, txn),
+                    si.scanByRank(0, si.getCount() - 1, false, txn));
+
+  // reload from the meta saved
+  Status s = si.save(txn, {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+  EXPECT_TRUE(s.ok());
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "si", "");
+  auto eMeta = store->getKV(mk, txn);
+  EXPECT_TRUE(eMeta.ok());
+  auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+  EXPECT_TRUE(eMetaContent.ok());
+  auto reload = makeZsetIndex(0, 0, "si", eMetaContent.value(), store);
+  EXPECT_EQ(reload->getCount(), si.getCount());
+  expectSameMembers(reload->scanByRank(0, si.getCount() - 1, true, txn),
+                    sl.scanByRank(0, sl.getCount() - 1, true, txn));
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+}
+
+TEST(ScoreIndex, Lex) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  ZSlMetaValue slMeta, siMeta;
+  initZsets(store, &slMeta, &siMeta);
+  SkipList sl(0, 0, "sl", slMeta, store);
+  ScoreIndex si(0, 0, "si", siMeta, store);
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  // the members with the same score are in binary order
+  std::vector<std::string> members = {"a",
+                                      std::string("a\0", 2),
+                                      std::string("a\0b", 3),
+                                      "ab",
+                                      "b",
+                                      "\xff"};
+  for (uint32_t i = 0; i < 300; ++i) {
+    members.push_back(std::to_string(rand() % 100000) + "_" +
+                      std::to_string(i));
+  }
+  for (const auto& member : members) {
+    EXPECT_TRUE(sl.insert(-3, member, txn).ok());
+    EXPECT_TRUE(si.insert(-3, member, txn).ok());
+  }
+  std::sort(members.begin(), members.end());
+
+  std::vector<std::pair<std::string, std::string>> borders = {
+    {"-", "+"}, {"[a", "[ab"}, {"(a", "(ab"}, {"[a", "(a"}, {"(5", "+"},
+    {"-", "[3"}, {"[b", "[a"}, {"+", "-"}, {"(0", "(\xff"}};
+  for (uint32_t i = 0; i < 100; ++i) {
+    std::string min = members[rand() % members.size()];
+    std::string max = members[rand() % members.size()];
+    borders.push_back({(rand() % 2 ? "[" : "(") + min,
+                       (rand() % 2 ? "[" : "(") + max});
+  }
+  for (const auto& border : borders) {
+    // the binary borders can not be parsed from c strings
+    Zlexrangespec range;
+    range.minex = border.first[0] == '(';
+    range.maxex = border.second[0] == '(';
+    range.min = border.first == "-"
+      ? ZLEXMIN
+      : border.first == "+" ? ZLEXMAX : border.first.substr(1);
+    range.max = border.second == "-"
+      ? ZLEXMIN
+      : border.second == "+" ? ZLEXMAX : border.second.substr(1);
+    for (bool rev : {false, true}) {
+      expectSameMembers(sl.scanByLex(range, 0, -1, rev, txn),
+                        si.scanByLex(range, 0, -1, rev, txn));
+      expectSameMembers(sl.scanByLex(range, 2, 5, rev, txn),
+                        si.scanByLex(range, 2, 5, rev, txn));
+    }
+    auto slCount = sl.countInLexRange(range, txn);
+    auto siCount = si.countInLexRange(range, txn);
+    EXPECT_TRUE(slCount.ok() && siCount.ok());
+    EXPECT_EQ(slCount.value(), siCount.value());
+  }
+
+  Zlexrangespec range;
+  range.min = "a";
+  range.minex = false;
+  range.max = "b";
+  range.maxex = true;
+  expectSameMembers(sl.removeRangeByLex(range, txn),
+                    si.removeRangeByLex(range, txn));
+  expectSameMembers(sl.scanByRank(0, sl.getCount() - 1, false, txn),
+                    si.scanByRank(0, si.getCount() - 1, false, txn));
+}
+
+TEST(PackedZset, SameAsSkipList) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  ZSlMetaValue slMeta, siMeta;
+  initZsets(store, &slMeta, &siMeta);
+  SkipList sl(0, 0, "sl", slMeta, store);
+  ZSlMetaValue pzMeta(1, 1, 0);
+  pzMeta.setPacked(true);
+  PackedZset pz(0, 0, "pz", pzMeta, store);
+  EXPECT_NE(pz.getPacked(), nullptr);
+  EXPECT_EQ(sl.getPacked(), nullptr);
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  std::vector<std::pair<double, std::string>> members;
+  for (uint32_t i = 0; i < 100; ++i) {
+    members.push_back({static_cast<double>(rand() % 20) - 10,
+                       std::to_string(rand()) + "_" + std::to_string(i)});
+    EXPECT_TRUE(
+      sl.insert(members.back().first, members.back().second, txn).ok());
+    EXPECT_TRUE(
+      pz.insert(members.back().first, members.back().second, txn).ok());
+  }
+  EXPECT_EQ(sl.getCount(), pz.getCount());
+  for (const auto& member : members) {
+    auto slRank = sl.rank(member.first, member.second, txn);
+    auto pzRank = pz.rank(member.first, member.second, txn);
+    EXPECT_TRUE(slRank.ok() && pzRank.ok());
+    EXPECT_EQ(slRank.value(), pzRank.value());
+  }
+  EXPECT_FALSE(pz.remove(0, "none", txn).ok());
+
+  for (bool rev : {false, true}) {
+    expectSameMembers(sl.scanByRank(0, 100, rev, txn),
+                      pz.scanByRank(0, 100, rev, txn));
+    expectSameMembers(sl.scanByRank(10, 30, rev, txn),
+                      pz.scanByRank(10, 30, rev, txn));
+  }
+  for (uint32_t i = 0; i < 100; ++i) {
+    Zrangespec range;
+    range.min = rand() % 24 - 12 + (rand() % 2 ? 0.5 : 0);
+    range.max = range.min + rand() % 10 - 2;
+    range.minex = rand() % 2;
+    range.maxex = rand() % 2;
+    uint64_t offset = rand() % 3 ? 0 : rand() % 20;
+    uint64_t limit = rand() % 2 ? -1 : rand() % 50;
+    bool rev = rand() % 2;
+    expectSameMembers(sl.scanByScore(range, offset, limit, rev, txn),
+                      pz.scanByScore(range, offset, limit, rev, txn));
+    EXPECT_EQ(sl.countInRange(range, txn).value(),
+              pz.countInRange(range, txn).value());
+  }
+
+  Zrangespec range{-5, 5, 1, 0};
+  expectSameMembers(sl.removeRangeByScore(range, txn),
+                    pz.removeRangeByScore(range, txn));
+  expectSameMembers(sl.removeRangeByRank(3, 10, txn),
+                    pz.removeRangeByRank(3, 10, txn));
+  EXPECT_EQ(sl.getCount(), pz.getCount());
+
+  // reload from the meta saved, nothing but the meta is written
+  Status s = pz.save(txn, {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+  EXPECT_TRUE(s.ok());
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "pz", "");
+  auto eMeta = store->getKV(mk, txn);
+  EXPECT_TRUE(eMeta.ok());
+  auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+  EXPECT_TRUE(eMetaContent.ok());
+  EXPECT_TRUE(eMetaContent.value().isPacked());
+  auto reload = makeZsetIndex(0, 0, "pz", eMetaContent.value(), store);
+  EXPECT_NE(reload->getPacked(), nullptr);
+  expectSameMembers(reload->scanByRank(0, 100, true, txn),
+                    sl.scanByRank(0, 100, true, txn));
+  RecordKey sub(0, 0, RecordType::RT_ZSET_S_ELE, "pz", "");
+  auto cursor = txn->createPrefixDataCursor(sub.prefixPk());
+  cursor->seek(sub.prefixPk());
+  EXPECT_EQ(cursor->next().status().code(), ErrorCodes::ERR_EXHAUST);
+
+  // the lex ranges of the members with the same score
+  PackedZset lex(0, 0, "lex", pzMeta, store);
+  for (const auto& member : {"a", "ab", "b", "c"}) {
+    EXPECT_TRUE(lex.insert(1, member, txn).ok());
+  }
+  Zlexrangespec lexRange;
+  lexRange.min = "a";
+  lexRange.minex = true;
+  lexRange.max = "c";
+  lexRange.maxex = false;
+  auto eLex = lex.scanByLex(lexRange, 0, -1, true, txn);
+  ASSERT_TRUE(eLex.ok());
+  ZsetIndex::Members expected = {{1, "c"}, {1, "b"}, {1, "ab"}};
+  EXPECT_EQ(eLex.value(), expected);
+  EXPECT_EQ(lex.countInLexRange(lexRange, txn).value(), 3u);
+}
+
+
+TEST(ScoreIndex, RemoveAll) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  ZSlMetaValue slMeta, siMeta;
+  initZsets(store, &slMeta, &siMeta);
+  ScoreIndex si(0, 0, "si", siMeta, store);
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  for (uint32_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(si.insert(i % 7, std::to_string(i), txn).ok());
+  }
+  EXPECT_TRUE(si.save(txn, {ErrorCodes::ERR_NOTFOUND, ""}, -1).ok());
+  auto eBlocks = si.getBlocks(txn);
+  EXPECT_TRUE(eBlocks.ok() && eBlocks.value().size() > 1);
+  for (uint32_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(si.remove(i % 7, std::to_string(i), txn).ok());
+  }
+  EXPECT_EQ(si.getCount(), 1u);
+
+  // an empty zset is deleted without save(), no sub key is left
+  RecordKey rk(0, 0, RecordType::RT_ZSET_S_ELE, "si", "");
+  auto cursor = txn->createDataCursor();
+  cursor->seek(rk.prefixPk());
+  auto eRcd = cursor->next();
+  if (eRcd.ok()) {
+    EXPECT_NE(eRcd.value().getRecordKey().prefixPk(), rk.prefixPk());
+  }
+}
+
+// rank and update a zset of TENDIS_ZSET_BENCH_MEMBERS members, 10M for the
+// benchmark, a few by default. The ranks read the nodes of the tree of the
+// blocks on one path and a block of members, and an update writes them.
+TEST(ScoreIndex, RankBench) {
+  uint64_t cnt = 200000;
+  const char* members = getenv("TENDIS_ZSET_BENCH_MEMBERS");
+  if (members) {
+    cnt = std::strtoull(members, nullptr, 10);
+  }
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  ZSlMetaValue slMeta, siMeta;
+  initZsets(store, &slMeta, &siMeta);
+  siMeta.setScoreKeys(128);
+  ScoreIndex si(0, 0, "si", siMeta, store);
+  // the score of a member is known from its index, many are repeated
+  auto score = [](uint64_t i) {
+    return static_cast<double>(i * 2654435761ULL % 1000003);
+  };
+  auto timed = [](const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+  };
+
+  constexpr uint64_t BATCH = 10000;
+  LOG(INFO) << "insert " << cnt << " members:" << timed([&] {
+    for (uint64_t i = 0; i < cnt; i += BATCH) {
+      auto eTxn = store->createTransaction(nullptr);
+      EXPECT_TRUE(eTxn.ok());
+      for (uint64_t j = i; j < std::min(i + BATCH, cnt); ++j) {
+        Status s = si.insert(score(j), std::to_string(j), eTxn.value().get());
+        EXPECT_TRUE(s.ok()) << s.toString();
+      }
+      Status s =
+        si.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+      EXPECT_TRUE(s.ok());
+      EXPECT_TRUE(eTxn.value()->commit().ok());
+    }
+  }) << "us";
+  EXPECT_EQ(si.getCount(), cnt + 1);
+
+  // a new index reads the tree from the store as a command does
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "si", "");
+  auto eMeta = store->getKV(mk, txn);
+  EXPECT_TRUE(eMeta.ok());
+  auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+  EXPECT_TRUE(eMetaContent.ok());
+  // the meta keeps its size however many members there are
+  EXPECT_LT(eMeta.value().getValue().size(), 32u);
+
+  constexpr uint32_t ROUND = 1000;
+  std::vector<uint64_t> picked;
+  for (uint32_t i = 0; i < ROUND; ++i) {
+    picked.push_back((static_cast<uint64_t>(rand()) << 16 ^ rand()) % cnt);
+  }
+  // a member moved by the updates below is picked once
+  std::sort(picked.begin(), picked.end());
+  picked.erase(std::unique(picked.begin(), picked.end()), picked.end());
+  uint64_t sum = 0;
+  LOG(INFO) << "zrank " << ROUND << " times:" << timed([&] {
+    for (uint64_t i : picked) {
+      auto reload = makeZsetIndex(0, 0, "si", eMetaContent.value(), store);
+      auto eRank = reload->rank(score(i), std::to_string(i), txn);
+      EXPECT_TRUE(eRank.ok());
+      sum += eRank.value();
+    }
+  }) << "us";
+  EXPECT_GT(sum, 0u);
+  LOG(INFO) << "zrange by rank " << ROUND << " times:" << timed([&] {
+    for (uint64_t i : picked) {
+      auto reload = makeZsetIndex(0, 0, "si", eMetaContent.value(), store);
+      auto eMembers = reload->scanByRank(i, 10, false, txn);
+      EXPECT_TRUE(eMembers.ok());
+    }
+  }) << "us";
+  LOG(INFO) << "zadd and zrem " << ROUND << " times:" << timed([&] {
+    for (uint64_t i : picked) {
+      auto reload = makeZsetIndex(0, 0, "si", eMetaContent.value(), store);
+      std::string member = std::to_string(i);
+      EXPECT_TRUE(reload->remove(score(i), member, txn).ok());
+      EXPECT_TRUE(reload->insert(score(i) + 0.5, member, txn).ok());
+      Status s = reload->save(txn, eMeta, -1);
+      EXPECT_TRUE(s.ok());
+    }
+  }) << "us";
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+}
+
 }  // namespace tendisplus
@@ -0,0 +1,150 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <utility>
+#include <algorithm>
+#include "tendisplus/storage/value_cache.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+RecordValueCache::RecordValueCache(size_t capacity, uint32_t shardNum)
+  : _capacity(capacity),
+    _shardCapacity(capacity / std::max(shardNum, 1U)),
+    // about as many missing keys as the entries a shard can hold
+    _maxDoorkeeperSize(std::max(_shardCapacity / 64, size_t(1024))),
+    _hits(0),
+    _misses(0),
+    _inserts(0),
+    _rejects(0),
+    _evicts(0) {
+  INVARIANT(shardNum > 0);
+  for (uint32_t i = 0; i < shardNum; ++i) {
+    _shards.emplace_back(std::make_unique<Shard>());
+  }
+}
+
+size_t RecordValueCache::charge(const std::string& key,
+                                const RecordValue& value) {
+  // the map node and the list node are counted roughly
+  return key.size() * 2 + value.getValue().size() + sizeof(Entry) + 64;
+}
+
+bool RecordValueCache::get(const std::string& key, RecordValue* value) {
+  auto& shard = getShard(std::hash<std::string>()(key));
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) {
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  *value = RecordValue(it->second->value);
+  _hits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+uint64_t RecordValueCache::getGeneration(const std::string& key) {
+  auto& shard = getShard(std::hash<std::string>()(key));
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  return shard.generation;
+}
+
+bool RecordValueCache::put(const std::string& key,
+                           const RecordValue& value,
+                           uint64_t gen) {
+  size_t hash = std::hash<std::string>()(key);
+  size_t c = charge(key, value);
+  // big values are left to the block cache
+  if (c > _shardCapacity / 16) {
+    _rejects.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  auto& shard = getShard(hash);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  if (shard.generation != gen) {
+    // the key may be changed after the value was read
+    _rejects.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (shard.doorkeeper.erase(hash) == 0) {
+    if (shard.doorkeeper.size() >= _maxDoorkeeperSize) {
+      shard.doorkeeper.clear();
+    }
+    shard.doorkeeper.insert(hash);
+    _rejects.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    shard.usage -= it->second->charge;
+    shard.lru.erase(it->second);
+    shard.map.erase(it);
+  }
+  shard.lru.push_front(Entry{key, value, c});
+  shard.map.emplace(key, shard.lru.begin());
+  shard.usage += c;
+  _inserts.fetch_add(1, std::memory_order_relaxed);
+
+  while (shard.usage > _shardCapacity && !shard.lru.empty()) {
+    auto& victim = shard.lru.back();
+    shard.usage -= victim.charge;
+    shard.map.erase(victim.key);
+    shard.lru.pop_back();
+    _evicts.fetch_add(1, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+void RecordValueCache::invalidate(const std::string& key) {
+  auto& shard = getShard(std::hash<std::string>()(key));
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  ++shard.generation;
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    shard.usage -= it->second->charge;
+    shard.lru.erase(it->second);
+    shard.map.erase(it);
+  }
+}
+
+void RecordValueCache::clear() {
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard->mutex);
+    ++shard->generation;
+    shard->map.clear();
+    shard->lru.clear();
+    shard->doorkeeper.clear();
+    shard->usage = 0;
+  }
+}
+
+ValueCacheStat RecordValueCache::getStat() const {
+  ValueCacheStat stat;
+  stat.hits = _hits.load(std::memory_order_relaxed);
+  stat.misses = _misses.load(std::memory_order_relaxed);
+  stat.inserts = _inserts.load(std::memory_order_relaxed);
+  stat.rejects = _rejects.load(std::memory_order_relaxed);
+  stat.evicts = _evicts.load(std::memory_order_relaxed);
+  stat.entries = 0;
+  stat.usage = 0;
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard->mutex);
+    stat.entries += shard->map.size();
+    stat.usage += shard->usage;
+  }
+  return stat;
+}
+
+void RecordValueCache::resetStat() {
+  _hits = 0;
+  _misses = 0;
+  _inserts = 0;
+  _rejects = 0;
+  _evicts = 0;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,86 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_VALUE_CACHE_H_
+#define SRC_TENDISPLUS_STORAGE_VALUE_CACHE_H_
+
+#include <string>
+#include <list>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>  // NOLINT
+#include <atomic>
+#include "tendisplus/storage/record.h"
+
+namespace tendisplus {
+
+// RecordValueCache keeps decoded RecordValues of hot meta keys, keyed by
+// the encoded RecordKey. It is sharded by key hash, each shard is a LRU
+// list bounded by the charge of its entries.
+//
+// A key is only admitted when it misses twice within a short window, so
+// one-off scans do not wash out the hot keys.
+//
+// To avoid caching a value that is being overwritten, a reader should take
+// the generation of the key before reading the store, and put() is ignored
+// if an invalidate() happens on the same shard in between.
+class RecordValueCache {
+ public:
+  static constexpr uint32_t DEFAULT_SHARD_NUM = 16;
+
+  explicit RecordValueCache(size_t capacity,
+                            uint32_t shardNum = DEFAULT_SHARD_NUM);
+  RecordValueCache(const RecordValueCache&) = delete;
+  RecordValueCache(RecordValueCache&&) = delete;
+
+  bool get(const std::string& key, RecordValue* value);
+  uint64_t getGeneration(const std::string& key);
+  // return true if the value is cached
+  bool put(const std::string& key, const RecordValue& value, uint64_t gen);
+  void invalidate(const std::string& key);
+  void clear();
+  size_t getCapacity() const {
+    return _capacity;
+  }
+  ValueCacheStat getStat() const;
+  void resetStat();
+
+ private:
+  struct Entry {
+    std::string key;
+    RecordValue value;
+    size_t charge;
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> map;
+    // hashes of the keys which missed recently
+    std::unordered_set<size_t> doorkeeper;
+    size_t usage = 0;
+    uint64_t generation = 0;
+  };
+
+  Shard& getShard(size_t hash) {
+    return *_shards[hash % _shards.size()];
+  }
+  static size_t charge(const std::string& key, const RecordValue& value);
+
+  const size_t _capacity;
+  const size_t _shardCapacity;
+  const size_t _maxDoorkeeperSize;
+  std::vector<std::unique_ptr<Shard>> _shards;
+
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+  std::atomic<uint64_t> _inserts;
+  std::atomic<uint64_t> _rejects;
+  std::atomic<uint64_t> _evicts;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_VALUE_CACHE_H_
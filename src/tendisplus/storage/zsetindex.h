@@ -0,0 +1,99 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ZSETINDEX_H_
+#define SRC_TENDISPLUS_STORAGE_ZSETINDEX_H_
+
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/utils/redis_port.h"
+
+namespace tendisplus {
+
+using Zrangespec = redis_port::Zrangespec;
+using Zlexrangespec = redis_port::Zlexrangespec;
+
+// ZsetIndex keeps the members of a zset in (score, member) order, it is a
+// SkipList, a ScoreIndex for the zsets with score keys, or a PackedZset for
+// the zsets packed in their metas. The members are changed in the txn
+// given, and the meta is written by save().
+class ZsetIndex {
+ public:
+  using Members = std::list<std::pair<double, std::string>>;
+
+  virtual ~ZsetIndex() = default;
+  // the caller should check the existence of subkey before
+  virtual Status insert(double score,
+                        const std::string& subkey,
+                        Transaction* txn) = 0;
+  virtual Status remove(double score,
+                        const std::string& subkey,
+                        Transaction* txn) = 0;
+  // 1-based rank
+  virtual Expected<uint32_t> rank(double score,
+                                  const std::string& subkey,
+                                  Transaction* txn) = 0;
+
+  virtual Expected<Members> scanByScore(const Zrangespec& range,
+                                        uint64_t offset,
+                                        uint64_t limit,
+                                        bool rev,
+                                        Transaction* txn) = 0;
+  virtual Expected<Members> scanByLex(const Zlexrangespec& range,
+                                      uint64_t offset,
+                                      uint64_t limit,
+                                      bool rev,
+                                      Transaction* txn) = 0;
+  virtual Expected<Members> scanByRank(int64_t start,
+                                       int64_t len,
+                                       bool rev,
+                                       Transaction* txn) = 0;
+  virtual Expected<uint64_t> countInRange(const Zrangespec& range,
+                                          Transaction* txn) = 0;
+  virtual Expected<uint64_t> countInLexRange(const Zlexrangespec& range,
+                                             Transaction* txn) = 0;
+
+  virtual Expected<Members> removeRangeByScore(const Zrangespec& range,
+                                               Transaction* txn) = 0;
+  virtual Expected<Members> removeRangeByLex(const Zlexrangespec& range,
+                                             Transaction* txn) = 0;
+  // 1-based index
+  virtual Expected<Members> removeRangeByRank(uint32_t start,
+                                              uint32_t end,
+                                              Transaction* txn) = 0;
+
+  virtual Status save(Transaction* txn,
+                      const Expected<RecordValue>& oldValue,
+                      uint64_t versionEP) = 0;
+  // the number of members plus one, the head of the skiplist
+  virtual uint32_t getCount() const = 0;
+  // the members and their scores if the zset is packed, there are no
+  // RT_ZSET_H_ELE records then
+  virtual const PackedEntries* getPacked() const {
+    return nullptr;
+  }
+};
+
+// compare the lex range borders, defined in skiplist.cpp
+int compareStringObjectsForLexRange(const std::string& a,
+                                    const std::string& b);
+bool zslValueGteMin(double value, const Zrangespec& spec);
+bool zslValueLteMax(double value, const Zrangespec& spec);
+bool zslLexValueGteMin(const std::string& value, const Zlexrangespec& spec);
+bool zslLexValueLteMax(const std::string& value, const Zlexrangespec& spec);
+
+// a SkipList, a ScoreIndex or a PackedZset, as the meta is
+std::unique_ptr<ZsetIndex> makeZsetIndex(uint32_t chunkId,
+                                         uint32_t dbId,
+                                         const std::string& pk,
+                                         const ZSlMetaValue& meta,
+                                         PStore store);
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ZSETINDEX_H_
@@ -0,0 +1,227 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <limits>
+
+#include "tendisplus/utils/latency_stats.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+namespace {
+thread_local LatencyStats::Mark tlsStageTimes = {};
+// the nesting of the commands tracked, the inner ones of exec or scripts
+thread_local uint32_t tlsDepth = 0;
+thread_local uint64_t tlsQueueWait = 0;
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : _count(0) {
+  for (auto& b : _buckets) {
+    b.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint32_t LatencyHistogram::bucketOf(uint64_t ns) {
+  if (ns < SUB_BUCKETS) {
+    return ns;
+  }
+  uint32_t bits = 63 - __builtin_clzll(ns);
+  if (bits >= MAX_BITS) {
+    return BUCKETS - 1;
+  }
+  uint32_t sub = (ns >> (bits - SUB_BITS)) & (SUB_BUCKETS - 1);
+  return (bits - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketLower(uint32_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t bits = bucket / SUB_BUCKETS + SUB_BITS - 1;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  return (SUB_BUCKETS + sub) << (bits - SUB_BITS);
+}
+
+uint64_t LatencyHistogram::bucketUpper(uint32_t bucket) {
+  if (bucket + 1 >= BUCKETS) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return bucketLower(bucket + 1) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  auto& b = _buckets[bucketOf(ns)];
+  b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  _count.store(_count.load(std::memory_order_relaxed) + 1,
+               std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    uint64_t n = other.bucketCount(i);
+    _buckets[i].store(bucketCount(i) + n, std::memory_order_relaxed);
+    count += n;
+  }
+  // the buckets may be counted after _count of other is
+  _count.store(_count.load(std::memory_order_relaxed) + count,
+               std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+  for (auto& b : _buckets) {
+    b.store(0, std::memory_order_relaxed);
+  }
+  _count.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    total += bucketCount(i);
+  }
+  if (total == 0) {
+    return 0;
+  }
+  // the rank of the percentile, 1-based
+  uint64_t rank = static_cast<uint64_t>(p / 100 * total + 0.5);
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    seen += bucketCount(i);
+    if (seen >= rank) {
+      return bucketUpper(i);
+    }
+  }
+  return bucketUpper(BUCKETS - 1);
+}
+
+const char* LatencyStats::stageName(LatencyStage stage) {
+  switch (stage) {
+    case LatencyStage::TOTAL:
+      return "total";
+    case LatencyStage::QUEUE:
+      return "queue";
+    case LatencyStage::LOCK:
+      return "lock";
+    case LatencyStage::STORAGE:
+      return "storage";
+    case LatencyStage::REPLY:
+      return "reply";
+    default:
+      INVARIANT_D(0);
+      return "unknown";
+  }
+}
+
+LatencyStats::Shard::Shard() {
+  for (auto& h : ids) {
+    h.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+LatencyStats::Registry* LatencyStats::registry() {
+  static Registry* r = new Registry();
+  return r;
+}
+
+LatencyStats::Shard* LatencyStats::localShard() {
+  thread_local Shard* shard = nullptr;
+  if (shard == nullptr) {
+    auto r = registry();
+    std::lock_guard<std::mutex> lk(r->mutex);
+    r->shards.emplace_back(std::make_unique<Shard>());
+    shard = r->shards.back().get();
+  }
+  return shard;
+}
+
+LatencyStats::Mark LatencyStats::startCommand() {
+  tlsDepth++;
+  return tlsStageTimes;
+}
+
+void LatencyStats::endCommand(uint32_t id,
+                              uint64_t totalNs,
+                              const Mark& start) {
+  INVARIANT_D(tlsDepth > 0);
+  tlsDepth--;
+  record(id, LatencyStage::TOTAL, totalNs);
+  for (auto stage : {LatencyStage::LOCK, LatencyStage::STORAGE}) {
+    auto i = static_cast<uint32_t>(stage);
+    record(id, stage, tlsStageTimes[i] - start[i]);
+  }
+  if (tlsDepth == 0 && tlsQueueWait != 0) {
+    record(id, LatencyStage::QUEUE, tlsQueueWait);
+    tlsQueueWait = 0;
+  }
+}
+
+bool LatencyStats::isTracking() {
+  return tlsDepth > 0;
+}
+
+void LatencyStats::addStageTime(LatencyStage stage, uint64_t ns) {
+  tlsStageTimes[static_cast<uint32_t>(stage)] += ns;
+}
+
+void LatencyStats::setQueueWait(uint64_t ns) {
+  tlsQueueWait = ns;
+}
+
+void LatencyStats::record(uint32_t id, LatencyStage stage, uint64_t ns) {
+  INVARIANT_D(id < MAX_IDS);
+  auto shard = localShard();
+  auto hists = shard->ids[id].load(std::memory_order_relaxed);
+  if (hists == nullptr) {
+    shard->owned.emplace_back(std::make_unique<Histograms>());
+    hists = shard->owned.back().get();
+    // the histograms are read by the other threads after seen here
+    shard->ids[id].store(hists, std::memory_order_release);
+  }
+  (*hists)[static_cast<uint32_t>(stage)].record(ns);
+}
+
+void LatencyStats::merge(uint32_t id,
+                         LatencyStage stage,
+                         LatencyHistogram* out) {
+  INVARIANT_D(id < MAX_IDS);
+  auto r = registry();
+  std::lock_guard<std::mutex> lk(r->mutex);
+  for (const auto& shard : r->shards) {
+    auto hists = shard->ids[id].load(std::memory_order_acquire);
+    if (hists) {
+      out->merge((*hists)[static_cast<uint32_t>(stage)]);
+    }
+  }
+}
+
+void LatencyStats::reset() {
+  auto r = registry();
+  std::lock_guard<std::mutex> lk(r->mutex);
+  for (const auto& shard : r->shards) {
+    for (const auto& h : shard->ids) {
+      auto hists = h.load(std::memory_order_acquire);
+      if (hists == nullptr) {
+        continue;
+      }
+      for (auto& hist : *hists) {
+        hist.reset();
+      }
+    }
+  }
+}
+
+LatencyStageTimer::LatencyStageTimer(LatencyStage stage)
+  : _stage(stage), _start(LatencyStats::isTracking() ? nsSinceEpoch() : 0) {}
+
+LatencyStageTimer::~LatencyStageTimer() {
+  if (_start != 0) {
+    LatencyStats::addStageTime(_stage, nsSinceEpoch() - _start);
+  }
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,130 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_LATENCY_STATS_H_
+#define SRC_TENDISPLUS_UTILS_LATENCY_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+namespace tendisplus {
+
+// LatencyHistogram counts the nanoseconds in log-linear buckets, there are
+// SUB_BUCKETS buckets in each power of two, so a percentile read from it
+// is at most 25% bigger than the real one. It has one writer, which counts
+// without atomic read-modify-writes, and it can be read by other threads.
+class LatencyHistogram {
+ public:
+  static constexpr uint32_t SUB_BITS = 2;
+  static constexpr uint32_t SUB_BUCKETS = 1U << SUB_BITS;
+  // the values from 2^MAX_BITS ns (about 18 minutes) are in the last bucket
+  static constexpr uint32_t MAX_BITS = 40;
+  static constexpr uint32_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram();
+  LatencyHistogram(const LatencyHistogram&) = delete;
+
+  static uint32_t bucketOf(uint64_t ns);
+  static uint64_t bucketLower(uint32_t bucket);
+  static uint64_t bucketUpper(uint32_t bucket);
+
+  // only called by the writer
+  void record(uint64_t ns);
+  // add the counts of other, it is not thread safe for this one
+  void merge(const LatencyHistogram& other);
+  // a record at the same time may be kept
+  void reset();
+
+  uint64_t count() const {
+    return _count.load(std::memory_order_relaxed);
+  }
+  uint64_t bucketCount(uint32_t bucket) const {
+    return _buckets[bucket].load(std::memory_order_relaxed);
+  }
+  // the upper bound of the bucket of the p-th percentile, 0 if empty
+  uint64_t percentile(double p) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, BUCKETS> _buckets;
+  std::atomic<uint64_t> _count;
+};
+
+enum class LatencyStage : uint32_t {
+  // the whole run of the command
+  TOTAL = 0,
+  // waiting in the queue of the work pool
+  QUEUE,
+  // waiting for the key, chunk and store locks
+  LOCK,
+  // in the reads, writes and commits of rocksdb
+  STORAGE,
+  // from the reply queued to it written to the socket
+  REPLY,
+  COUNT,
+};
+
+// LatencyStats keeps a histogram for each stage of each command id in each
+// thread, the histograms are merged when they are read. The stage times of
+// a command are added up in the thread running it, between startCommand()
+// and endCommand().
+class LatencyStats {
+ public:
+  static constexpr uint32_t MAX_IDS = 1024;
+  static constexpr uint32_t STAGES =
+    static_cast<uint32_t>(LatencyStage::COUNT);
+
+  static const char* stageName(LatencyStage stage);
+
+  // the stage times added in this thread, by the command being run
+  using Mark = std::array<uint64_t, STAGES>;
+  static Mark startCommand();
+  // record the total time and the stage times since start for id, the
+  // queue wait is recorded for the first command of a work pool task
+  static void endCommand(uint32_t id, uint64_t totalNs, const Mark& start);
+  static bool isTracking();
+  static void addStageTime(LatencyStage stage, uint64_t ns);
+  // set by the work pool before running a task
+  static void setQueueWait(uint64_t ns);
+
+  static void record(uint32_t id, LatencyStage stage, uint64_t ns);
+  // add the histograms of all the threads to out
+  static void merge(uint32_t id, LatencyStage stage, LatencyHistogram* out);
+  static void reset();
+
+ private:
+  using Histograms = std::array<LatencyHistogram, STAGES>;
+  // the histograms of a thread, created at its first record and never
+  // freed, so the counts of an exited thread are kept.
+  struct Shard {
+    Shard();
+    std::array<std::atomic<Histograms*>, MAX_IDS> ids;
+    std::vector<std::unique_ptr<Histograms>> owned;
+  };
+  struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Shard>> shards;
+  };
+  // never freed, the threads may record till the process exits
+  static Registry* registry();
+  static Shard* localShard();
+};
+
+// add the time of its scope to the stage, if a command is tracked in this
+// thread
+class LatencyStageTimer {
+ public:
+  explicit LatencyStageTimer(LatencyStage stage);
+  ~LatencyStageTimer();
+
+ private:
+  LatencyStage _stage;
+  uint64_t _start;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_LATENCY_STATS_H_
@@ -855,6 +855,75 @@ uint64_t crc64(uint64_t crc, const unsigned char* s, uint64_t l) {
   return crc;
 }
 
+std::string sha1hex(const std::string& s) {
+  uint32_t h[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  auto rol = [](uint32_t v, uint32_t bits) {
+    return (v << bits) | (v >> (32 - bits));
+  };
+  // the message padded with 0x80, zeros and its length in bits
+  std::string msg(s);
+  uint64_t bits = static_cast<uint64_t>(s.size()) * 8;
+  msg.push_back(static_cast<char>(0x80));
+  while (msg.size() % 64 != 56) {
+    msg.push_back(0);
+  }
+  for (int i = 7; i >= 0; i--) {
+    msg.push_back(static_cast<char>((bits >> (i * 8)) & 0xff));
+  }
+
+  uint32_t w[80];
+  for (size_t block = 0; block < msg.size(); block += 64) {
+    const unsigned char* p =
+      reinterpret_cast<const unsigned char*>(msg.data() + block);
+    for (int i = 0; i < 16; i++) {
+      w[i] = (uint32_t(p[i * 4]) << 24) | (uint32_t(p[i * 4 + 1]) << 16) |
+        (uint32_t(p[i * 4 + 2]) << 8) | uint32_t(p[i * 4 + 3]);
+    }
+    for (int i = 16; i < 80; i++) {
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  static const char hex[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(40);
+  for (auto v : h) {
+    for (int i = 28; i >= 0; i -= 4) {
+      out.push_back(hex[(v >> i) & 0xf]);
+    }
+  }
+  return out;
+}
+
 void memrev64(void* p) {
   unsigned char *x = reinterpret_cast<unsigned char*>(p), t;
 
@@ -1025,6 +1094,7 @@ int getCommandFlags(const char* sflags) {
 #define sremCommand NULL
 #define smoveCommand NULL
 #define sismemberCommand NULL
+#define smismemberCommand NULL
 #define scardCommand NULL
 #define spopCommand NULL
 #define srandmemberCommand NULL
@@ -1224,6 +1294,7 @@ struct redisCommand redisCommandTable[] = {
   {"srem", sremCommand, -3, "wF", 0, NULL, 1, 1, 1, 0, 0},
   {"smove", smoveCommand, 4, "wF", 0, NULL, 1, 2, 1, 0, 0},
   {"sismember", sismemberCommand, 3, "rF", 0, NULL, 1, 1, 1, 0, 0},
+  {"smismember", smismemberCommand, -3, "rF", 0, NULL, 1, 1, 1, 0, 0},
   {"scard", scardCommand, 2, "rF", 0, NULL, 1, 1, 1, 0, 0},
   {"spop", spopCommand, -2, "wRF", 0, NULL, 1, 1, 1, 0, 0},
   {"srandmember", srandmemberCommand, -2, "rR", 0, NULL, 1, 1, 1, 0, 0},
@@ -109,6 +109,8 @@ struct redisCommand {
 uint64_t htonll(uint64_t v);
 uint64_t ntohll(uint64_t v);
 uint64_t crc64(uint64_t crc, const unsigned char* s, uint64_t l);
+// the sha1 digest in 40 lowercase hex chars, as redis names the scripts
+std::string sha1hex(const std::string& s);
 int random();
 
 /* Input flags. */
@@ -0,0 +1,206 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string.h>
+#include <utility>
+#include <algorithm>
+#include "tendisplus/utils/resp_writer.h"
+
+namespace tendisplus {
+
+ReplyChunkPool* ReplyChunkPool::getInstance() {
+  static ReplyChunkPool pool;
+  return &pool;
+}
+
+std::string ReplyChunkPool::get() {
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (!_free.empty()) {
+      std::string chunk = std::move(_free.back());
+      _free.pop_back();
+      ++_reused;
+      return chunk;
+    }
+  }
+  ++_allocated;
+  std::string chunk;
+  chunk.reserve(CHUNK_SIZE);
+  return chunk;
+}
+
+void ReplyChunkPool::put(std::string&& chunk) {
+  if (chunk.capacity() < CHUNK_SIZE || chunk.capacity() > 2 * CHUNK_SIZE) {
+    return;
+  }
+  chunk.clear();
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_free.size() < MAX_FREE_CHUNKS) {
+    _free.emplace_back(std::move(chunk));
+  }
+}
+
+RespWriter::RespWriter() : _tailPooled(false), _size(0), _bytesCopied(0) {}
+
+RespWriter::RespWriter(RespWriter&& o)
+  : _chunks(std::move(o._chunks)),
+    _tailPooled(o._tailPooled),
+    _size(o._size),
+    _bytesCopied(o._bytesCopied) {
+  o._chunks.clear();
+  o._tailPooled = false;
+  o._size = 0;
+  o._bytesCopied = 0;
+}
+
+RespWriter& RespWriter::operator=(RespWriter&& o) {
+  if (this != &o) {
+    clear();
+    _chunks = std::move(o._chunks);
+    _tailPooled = o._tailPooled;
+    _size = o._size;
+    _bytesCopied = o._bytesCopied;
+    o._chunks.clear();
+    o._tailPooled = false;
+    o._size = 0;
+    o._bytesCopied = 0;
+  }
+  return *this;
+}
+
+RespWriter::~RespWriter() {
+  clear();
+}
+
+void RespWriter::clear() {
+  auto pool = ReplyChunkPool::getInstance();
+  for (auto& chunk : _chunks) {
+    pool->put(std::move(chunk));
+  }
+  _chunks.clear();
+  _tailPooled = false;
+  _size = 0;
+}
+
+void RespWriter::write(const char* data, size_t len) {
+  _size += len;
+  _bytesCopied += len;
+  while (len > 0) {
+    if (!_tailPooled ||
+        _chunks.back().size() == _chunks.back().capacity()) {
+      _chunks.emplace_back(ReplyChunkPool::getInstance()->get());
+      _tailPooled = true;
+    }
+    std::string& tail = _chunks.back();
+    size_t n = std::min(len, tail.capacity() - tail.size());
+    tail.append(data, n);
+    data += n;
+    len -= n;
+  }
+}
+
+void RespWriter::adopt(std::string&& s) {
+  _size += s.size();
+  _chunks.emplace_back(std::move(s));
+  _tailPooled = false;
+}
+
+void RespWriter::writeHeader(char prefix, int64_t v) {
+  // prefix + sign + 20 digits + \r\n
+  char buf[32];
+  char* end = buf + sizeof(buf);
+  char* p = end;
+  *--p = '\n';
+  *--p = '\r';
+  uint64_t uv = v < 0 ? -static_cast<uint64_t>(v) : v;
+  do {
+    *--p = '0' + (uv % 10);
+    uv /= 10;
+  } while (uv);
+  if (v < 0) {
+    *--p = '-';
+  }
+  *--p = prefix;
+  write(p, end - p);
+}
+
+RespWriter& RespWriter::appendMultiBulkLen(uint64_t len) {
+  writeHeader('*', len);
+  return *this;
+}
+
+RespWriter& RespWriter::appendBulk(const char* data, size_t len) {
+  writeHeader('$', len);
+  write(data, len);
+  write("\r\n", 2);
+  return *this;
+}
+
+RespWriter& RespWriter::appendBulk(const std::string& s) {
+  return appendBulk(s.data(), s.size());
+}
+
+RespWriter& RespWriter::appendBulk(std::string&& s) {
+  if (s.size() < ZERO_COPY_THRESHOLD) {
+    return appendBulk(s.data(), s.size());
+  }
+  writeHeader('$', s.size());
+  adopt(std::move(s));
+  write("\r\n", 2);
+  return *this;
+}
+
+RespWriter& RespWriter::appendStatus(const std::string& s) {
+  write("+", 1);
+  write(s.data(), s.size());
+  write("\r\n", 2);
+  return *this;
+}
+
+RespWriter& RespWriter::appendLongLong(int64_t v) {
+  writeHeader(':', v);
+  return *this;
+}
+
+RespWriter& RespWriter::appendNull() {
+  write("$-1\r\n", 5);
+  return *this;
+}
+
+RespWriter& RespWriter::appendRaw(const std::string& s) {
+  write(s.data(), s.size());
+  return *this;
+}
+
+RespWriter& RespWriter::appendRaw(std::string&& s) {
+  if (!s.empty()) {
+    adopt(std::move(s));
+  }
+  return *this;
+}
+
+std::vector<std::string> RespWriter::releaseChunks() {
+  std::vector<std::string> chunks = std::move(_chunks);
+  _chunks.clear();
+  _tailPooled = false;
+  _size = 0;
+  return chunks;
+}
+
+std::string RespWriter::str() {
+  if (_chunks.size() == 1) {
+    auto chunks = releaseChunks();
+    return std::move(chunks[0]);
+  }
+  std::string result;
+  result.reserve(_size);
+  for (const auto& chunk : _chunks) {
+    result.append(chunk);
+  }
+  _bytesCopied += result.size();
+  clear();
+  return result;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,104 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_RESP_WRITER_H_
+#define SRC_TENDISPLUS_UTILS_RESP_WRITER_H_
+
+#include <string>
+#include <vector>
+#include <mutex>  // NOLINT
+#include <atomic>
+
+namespace tendisplus {
+
+// a process-wide free list of reply chunks, chunks are taken by RespWriter
+// in the executor threads and given back by the network threads after the
+// data has been written to the socket.
+class ReplyChunkPool {
+ public:
+  static constexpr size_t CHUNK_SIZE = 16 * 1024;
+  static constexpr size_t MAX_FREE_CHUNKS = 4096;
+
+  static ReplyChunkPool* getInstance();
+  // return an empty string with at least CHUNK_SIZE capacity
+  std::string get();
+  // chunks with unexpected capacity are simply freed
+  void put(std::string&& chunk);
+  uint64_t getAllocated() const {
+    return _allocated.load(std::memory_order_relaxed);
+  }
+  uint64_t getReused() const {
+    return _reused.load(std::memory_order_relaxed);
+  }
+
+ private:
+  ReplyChunkPool() = default;
+  std::mutex _mutex;
+  std::vector<std::string> _free;
+  std::atomic<uint64_t> _allocated{0};
+  std::atomic<uint64_t> _reused{0};
+};
+
+// RespWriter builds a RESP reply as a list of chunks. Small pieces are
+// appended into pooled chunks, big bulk values which are moved in are kept
+// as their own chunk, so the reply can be handed to the network layer and
+// written with a single vectored write without being flattened.
+class RespWriter {
+ public:
+  // moved-in bulk values not smaller than this are not copied
+  static constexpr size_t ZERO_COPY_THRESHOLD = 4096;
+
+  RespWriter();
+  RespWriter(const RespWriter&) = delete;
+  RespWriter(RespWriter&&);
+  RespWriter& operator=(RespWriter&&);
+  ~RespWriter();
+
+  RespWriter& appendMultiBulkLen(uint64_t len);
+  RespWriter& appendBulk(const std::string& s);
+  RespWriter& appendBulk(std::string&& s);
+  RespWriter& appendBulk(const char* data, size_t len);
+  RespWriter& appendStatus(const std::string& s);
+  RespWriter& appendLongLong(int64_t v);
+  RespWriter& appendNull();
+  // append an already formatted reply
+  RespWriter& appendRaw(const std::string& s);
+  RespWriter& appendRaw(std::string&& s);
+
+  size_t size() const {
+    return _size;
+  }
+  bool empty() const {
+    return _size == 0;
+  }
+  // bytes memcpy-ed into the reply since constructed, for statistics
+  size_t bytesCopied() const {
+    return _bytesCopied;
+  }
+  const std::vector<std::string>& chunks() const {
+    return _chunks;
+  }
+  // take the chunks away, the caller should give them back to
+  // ReplyChunkPool after use.
+  std::vector<std::string> releaseChunks();
+  // flatten the reply into one string, it is a move rather than
+  // a copy if there is only one chunk.
+  std::string str();
+  void clear();
+
+ private:
+  void write(const char* data, size_t len);
+  void writeHeader(char prefix, int64_t v);
+  void adopt(std::string&& s);
+
+  std::vector<std::string> _chunks;
+  // whether the last chunk comes from ReplyChunkPool and can be appended
+  bool _tailPooled;
+  size_t _size;
+  size_t _bytesCopied;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_RESP_WRITER_H_
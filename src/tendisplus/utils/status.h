@@ -40,6 +40,8 @@ enum class ErrorCodes {
   ERR_UNKNOWN,
   ERR_CLUSTER,
   ERR_CONNECT_TRY,
+  // the session yields the thread to wait a lock, see Session::yieldOnLock
+  ERR_LOCK_YIELD,
 
   // error from redis
   ERR_AUTH = 100,
@@ -18,6 +18,9 @@
 #include <random>
 #include <limits>
 #include <thread>  // NOLINT
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "tendisplus/utils/status.h"
 #include "tendisplus/utils/string.h"
@@ -351,6 +354,24 @@ std::vector<std::string> stringSplit(const std::string& s,
   return elems;
 }
 
+const char* findChar(const char* begin, const char* end, char c) {
+  const char* p = begin;
+#ifdef __SSE2__
+  const __m128i target = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, target));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  if (p >= end) {
+    return nullptr;
+  }
+  return static_cast<const char*>(memchr(p, c, end - p));
+}
+
 unsigned char random_char() {
   std::random_device rd;
   std::mt19937 gen(rd());
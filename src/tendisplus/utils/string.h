@@ -56,6 +56,10 @@ std::vector<std::string> stringSplit(const std::string& s,
 
 std::string trim(const std::string& str);
 
+// the first c in [begin, end), or nullptr. It compares 16 bytes a time with
+// SSE2, and the bytes after end are never read.
+const char* findChar(const char* begin, const char* end, char c);
+
 #define strDelete(str, c) \
   (str).erase(std::remove((str).begin(), (str).end(), (c)), (str).end())
 
@@ -1623,6 +1623,157 @@ void testSet(std::shared_ptr<ServerEntry> svr) {
   expect = Command::runSessionCmd(&sess);
   EXPECT_TRUE(expect.ok());
   EXPECT_EQ(expect.value(), ss1.str());
+
+  // smismember
+  sess.setArgs({"smismember", "myset", "a", "c", "b", "a"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  ss1.str("");
+  Command::fmtMultiBulkLen(ss1, 4);
+  Command::fmtLongLong(ss1, 1);
+  Command::fmtLongLong(ss1, 0);
+  Command::fmtLongLong(ss1, 1);
+  Command::fmtLongLong(ss1, 1);
+  EXPECT_EQ(expect.value(), ss1.str());
+
+  sess.setArgs({"smismember", "nosuchset", "a", "b"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  ss1.str("");
+  Command::fmtMultiBulkLen(ss1, 2);
+  Command::fmtLongLong(ss1, 0);
+  Command::fmtLongLong(ss1, 0);
+  EXPECT_EQ(expect.value(), ss1.str());
+
+  sess.setArgs({"smismember", "myset3", "a"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_FALSE(expect.ok());
+
+  // sinter checks the members of the smallest set in batch
+  std::vector<std::string> big = {"sadd", "sinter_big"};
+  std::vector<std::string> small = {"sadd", "sinter_small"};
+  for (int i = 0; i < 300; ++i) {
+    big.push_back(std::to_string(i * 2));
+    small.push_back(std::to_string(i * 3));
+  }
+  sess.setArgs(big);
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  sess.setArgs(small);
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  sess.setArgs({"sinter", "sinter_big", "sinter_small"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  std::set<std::string> inter;
+  for (int i = 0; i < 600; i += 6) {
+    inter.insert(std::to_string(i));
+  }
+  ss1.str("");
+  Command::fmtMultiBulkLen(ss1, inter.size());
+  for (auto& v : inter) {
+    Command::fmtBulk(ss1, v);
+  }
+  EXPECT_EQ(expect.value(), ss1.str());
+}
+
+// the sets are keyed by names of different lengths, so their members are in
+// different orders, and some are merged and some are probed
+void testSetAlgebra(std::shared_ptr<ServerEntry> svr) {
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(svr, std::move(socket), 1, false, nullptr, nullptr);
+
+  auto replyMembers = [](const std::string& reply) {
+    std::set<std::string> result;
+    size_t pos = reply.find("\r\n") + 2;
+    while (pos < reply.size()) {
+      size_t end = reply.find("\r\n", pos);
+      size_t len = std::stoul(reply.substr(pos + 1, end - pos - 1));
+      result.insert(reply.substr(end + 2, len));
+      pos = end + 2 + len + 2;
+    }
+    return result;
+  };
+  auto run = [&sess](const std::vector<std::string>& args) {
+    sess.setArgs(args);
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok()) << expect.status().toString();
+    return expect.value();
+  };
+
+  std::vector<std::string> keys = {
+    "sa1", "sa2", std::string(40, 'b'), std::string(60, 'c')};
+  std::vector<std::set<std::string>> sets(keys.size());
+  // "m1" and "m12" are in different orders in the set of "sa1" and the one
+  // of the 60 bytes key
+  for (uint32_t i = 0; i < 1000; i++) {
+    for (size_t j = 0; j < keys.size(); j++) {
+      if (i % (j + 2) == 0 || (j == 1 && i < 900)) {
+        sets[j].insert("m" + std::to_string(i));
+      }
+    }
+  }
+  for (size_t j = 0; j < keys.size(); j++) {
+    std::vector<std::string> args = {"sadd", keys[j]};
+    args.insert(args.end(), sets[j].begin(), sets[j].end());
+    EXPECT_EQ(run(args), Command::fmtLongLong(sets[j].size()));
+  }
+
+  std::vector<std::vector<size_t>> cases = {
+    {0, 1}, {1, 0}, {0, 2}, {2, 3}, {0, 1, 2}, {3, 1, 0, 2}};
+  for (const auto& c : cases) {
+    std::set<std::string> inter = sets[c[0]], uni, diff = sets[c[0]];
+    for (auto j : c) {
+      std::set<std::string> tmp;
+      for (const auto& m : inter) {
+        if (sets[j].count(m)) {
+          tmp.insert(m);
+        }
+      }
+      inter.swap(tmp);
+      uni.insert(sets[j].begin(), sets[j].end());
+      if (j != c[0]) {
+        for (const auto& m : sets[j]) {
+          diff.erase(m);
+        }
+      }
+    }
+    std::vector<std::pair<std::string, std::set<std::string>*>> ops = {
+      {"sinter", &inter}, {"sunion", &uni}, {"sdiff", &diff}};
+    for (const auto& op : ops) {
+      std::vector<std::string> args = {op.first};
+      std::vector<std::string> storeArgs = {op.first + "store", "sadest"};
+      for (auto j : c) {
+        args.push_back(keys[j]);
+        storeArgs.push_back(keys[j]);
+      }
+      auto reply = run(args);
+      EXPECT_EQ(replyMembers(reply), *op.second) << op.first;
+      EXPECT_EQ(reply.substr(0, reply.find("\r\n")),
+                "*" + std::to_string(op.second->size()));
+
+      EXPECT_EQ(run(storeArgs), Command::fmtLongLong(op.second->size()));
+      EXPECT_EQ(run({"scard", "sadest"}),
+                Command::fmtLongLong(op.second->size()));
+      EXPECT_EQ(replyMembers(run({"smembers", "sadest"})), *op.second);
+    }
+  }
+
+  // the key stored is also read
+  std::set<std::string> uni = sets[0];
+  uni.insert(sets[2].begin(), sets[2].end());
+  EXPECT_EQ(run({"sunionstore", "sa1", "sa1", keys[2]}),
+            Command::fmtLongLong(uni.size()));
+  EXPECT_EQ(replyMembers(run({"smembers", "sa1"})), uni);
+
+  // a set not existing makes the intersection empty
+  EXPECT_EQ(run({"sinter", "sa2", "sanotexist"}), Command::fmtNull());
+  EXPECT_EQ(run({"sinterstore", "sadest", "sa2", "sanotexist"}),
+            Command::fmtZero());
+  EXPECT_EQ(run({"exists", "sadest"}), Command::fmtZero());
+  EXPECT_EQ(run({"sdiff", "sanotexist", "sa2"}), Command::fmtZeroBulkLen());
+  EXPECT_EQ(replyMembers(run({"sunion", "sanotexist", "sa2"})), sets[1]);
 }
 
 void testZset(std::shared_ptr<ServerEntry> svr) {
@@ -2124,6 +2275,43 @@ void testMset(std::shared_ptr<ServerEntry> svr) {
   Command::fmtBulk(ss, "1");
   Command::fmtBulk(ss, "2");
   EXPECT_EQ(ss.str(), expect.value());
+
+  // keys spread over all the kvstores, with missing keys, duplicated
+  // keys and wrong type keys
+  sess.setArgs({"hset", "mget_hash", "f", "v"});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  std::vector<std::string> mgetArgs = {"mget"};
+  std::vector<std::string> existsArgs = {"exists"};
+  ss.str("");
+  Command::fmtMultiBulkLen(ss, 202);
+  for (int i = 0; i < 200; ++i) {
+    std::string key = "mget_key_" + std::to_string(i);
+    if (i % 3 == 0) {
+      sess.setArgs({"set", key, std::to_string(i)});
+      expect = Command::runSessionCmd(&sess);
+      EXPECT_TRUE(expect.ok());
+      Command::fmtBulk(ss, std::to_string(i));
+    } else {
+      Command::fmtNull(ss);
+    }
+    mgetArgs.push_back(key);
+    existsArgs.push_back(key);
+  }
+  mgetArgs.push_back("mget_key_0");
+  Command::fmtBulk(ss, "0");
+  mgetArgs.push_back("mget_hash");
+  Command::fmtNull(ss);
+  sess.setArgs(mgetArgs);
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(ss.str(), expect.value());
+
+  existsArgs.push_back("mget_hash");
+  sess.setArgs(existsArgs);
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(Command::fmtLongLong(68), expect.value());
 }
 
 void testKV(std::shared_ptr<ServerEntry> svr) {
@@ -73,6 +73,7 @@ void testType(std::shared_ptr<ServerEntry> svr);
 void testPf(std::shared_ptr<ServerEntry> svr);
 void testZset(std::shared_ptr<ServerEntry> svr);
 void testSet(std::shared_ptr<ServerEntry> svr);
+void testSetAlgebra(std::shared_ptr<ServerEntry> svr);
 void testZset3(std::shared_ptr<ServerEntry> svr);
 void testZset4(std::shared_ptr<ServerEntry> svr);
 void testZset2(std::shared_ptr<ServerEntry> svr);
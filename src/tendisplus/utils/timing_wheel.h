@@ -0,0 +1,180 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_TIMING_WHEEL_H_
+#define SRC_TENDISPLUS_UTILS_TIMING_WHEEL_H_
+
+#include <algorithm>
+#include <limits>
+#include <list>
+#include <utility>
+#include <vector>
+
+namespace tendisplus {
+
+// TimingWheel is a hierarchical timing wheel of LEVELS levels with SLOTS
+// slots each, a slot of level n spans SLOTS^n ticks. An entry is put in the
+// level of the highest digit its tick differs from the current one, and it
+// is moved down when the current tick reaches its slot. The ticks beyond the
+// top level wait in the overflow until the top level turns round. The ticks
+// of the empty lower levels are skipped, so an advance costs about the
+// entries moved, not the ticks passed.
+// It is not thread safe.
+template <typename T>
+class TimingWheel {
+ public:
+  static constexpr uint32_t SLOT_BITS = 8;
+  static constexpr uint64_t SLOTS = 1ULL << SLOT_BITS;
+  static constexpr uint32_t LEVELS = 4;
+
+  TimingWheel(uint64_t tickMs, uint64_t nowMs)
+    : _tickMs(std::max(tickMs, uint64_t(1))),
+      _current(nowMs / _tickMs + 1),
+      _size(0),
+      _slots(LEVELS, std::vector<std::list<Entry>>(SLOTS)),
+      _counts(LEVELS + 1, 0) {}
+
+  // the entries expired already are due at the next advance()
+  void add(uint64_t expireMs, T value) {
+    _size++;
+    place({expireMs, std::move(value)});
+  }
+
+  // move at most limit entries expired at nowMs to the back of *due, in
+  // the order of their ticks. The rest of them are kept, they are due at
+  // the next advance(). It returns the number of entries moved.
+  size_t advance(uint64_t nowMs,
+                 std::list<std::pair<uint64_t, T>>* due,
+                 size_t limit = std::numeric_limits<size_t>::max()) {
+    size_t moved = 0;
+    auto take = [&]() {
+      while (moved < limit && !_ready.empty()) {
+        auto& e = _ready.front();
+        due->emplace_back(e.expireMs, std::move(e.value));
+        _ready.pop_front();
+        moved++;
+      }
+    };
+    take();
+    // a tick is due when all the time in it has passed
+    uint64_t target = nowMs / _tickMs;
+    while (moved < limit && _current <= target) {
+      cascade();
+      auto& slot = _slots[0][_current & (SLOTS - 1)];
+      _counts[0] -= slot.size();
+      _ready.splice(_ready.end(), slot);
+      _current = std::min(nextBusyTick(), target + 1);
+      take();
+    }
+    _size -= moved;
+    return moved;
+  }
+
+  size_t size() const {
+    return _size;
+  }
+
+  uint64_t getTickMs() const {
+    return _tickMs;
+  }
+
+  void clear() {
+    for (auto& level : _slots) {
+      for (auto& slot : level) {
+        slot.clear();
+      }
+    }
+    _ready.clear();
+    _overflow.clear();
+    _size = 0;
+    std::fill(_counts.begin(), _counts.end(), 0);
+  }
+
+ private:
+  struct Entry {
+    uint64_t expireMs;
+    T value;
+  };
+
+  static uint64_t digit(uint64_t tick, uint32_t level) {
+    return (tick >> (level * SLOT_BITS)) & (SLOTS - 1);
+  }
+
+  void place(Entry&& e) {
+    // the first tick not before expireMs
+    uint64_t tick = (e.expireMs + _tickMs - 1) / _tickMs;
+    if (tick < _current) {
+      _ready.push_back(std::move(e));
+      return;
+    }
+    uint32_t level = 0;
+    uint64_t diff = tick ^ _current;
+    while (level < LEVELS && (diff >> ((level + 1) * SLOT_BITS)) != 0) {
+      level++;
+    }
+    _counts[level]++;
+    if (level == LEVELS) {
+      _overflow.push_back(std::move(e));
+    } else {
+      _slots[level][digit(tick, level)].push_back(std::move(e));
+    }
+  }
+
+  void moveDown(uint32_t level, std::list<Entry>* slot) {
+    std::list<Entry> entries;
+    entries.swap(*slot);
+    _counts[level] -= entries.size();
+    for (auto& e : entries) {
+      place(std::move(e));
+    }
+  }
+
+  // the tick after _current where a slot may turn, the lower levels without
+  // entries have nothing to do till the level above turns
+  uint64_t nextBusyTick() const {
+    uint32_t level = 0;
+    while (level <= LEVELS && _counts[level] == 0) {
+      level++;
+    }
+    if (level == 0) {
+      return _current + 1;
+    }
+    if (level > LEVELS) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+    uint32_t bits = level * SLOT_BITS;
+    if (bits >= 64) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+    return ((_current >> bits) + 1) << bits;
+  }
+
+  // the slots of the upper levels turn when the lower digits become 0
+  void cascade() {
+    for (uint32_t level = 1; level < LEVELS; ++level) {
+      if (digit(_current, level - 1) != 0) {
+        return;
+      }
+      moveDown(level, &_slots[level][digit(_current, level)]);
+    }
+    if (digit(_current, LEVELS - 1) == 0) {
+      moveDown(LEVELS, &_overflow);
+    }
+  }
+
+  uint64_t _tickMs;
+  // the next tick to advance
+  uint64_t _current;
+  size_t _size;
+  std::vector<std::vector<std::list<Entry>>> _slots;
+  // the entries of each level and the overflow
+  std::vector<size_t> _counts;
+  // the entries due already, in the order of their ticks
+  std::list<Entry> _ready;
+  std::list<Entry> _overflow;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_TIMING_WHEEL_H_
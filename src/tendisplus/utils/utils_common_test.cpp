@@ -13,12 +13,16 @@
 #include <algorithm>
 #include <bitset>
 #include <random>
+#include <thread>  // NOLINT
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/time.h"
 #include "tendisplus/utils/param_manager.h"
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/utils/base64.h"
+#include "tendisplus/utils/resp_writer.h"
+#include "tendisplus/utils/timing_wheel.h"
+#include "tendisplus/utils/latency_stats.h"
 #include "gtest/gtest.h"
 #include "glog/logging.h"
 
@@ -129,6 +133,22 @@ TEST(String, Split) {
   }
 }
 
+TEST(String, FindChar) {
+  std::string s(100, 'a');
+  for (size_t i = 0; i < s.size(); i++) {
+    s[i] = '\r';
+    for (size_t begin = 0; begin <= i; begin += 7) {
+      EXPECT_EQ(findChar(s.data() + begin, s.data() + s.size(), '\r'),
+                s.data() + i);
+      // the bytes after end are not searched
+      EXPECT_EQ(findChar(s.data() + begin, s.data() + i, '\r'), nullptr);
+    }
+    s[i] = 'a';
+  }
+  EXPECT_EQ(findChar(s.data(), s.data() + s.size(), '\r'), nullptr);
+  EXPECT_EQ(findChar(s.data(), s.data(), 'a'), nullptr);
+}
+
 TEST(Base64, common) {
   std::string data = "aa";
   std::string encode =
@@ -211,5 +231,249 @@ TEST(ParamManager, common) {
   EXPECT_EQ(pm.getUint64("ikey3", 1), 1);
 }
 
+TEST(RespWriter, common) {
+  RespWriter w;
+  w.appendMultiBulkLen(4)
+    .appendBulk("abc")
+    .appendNull()
+    .appendLongLong(-12345)
+    .appendStatus("OK");
+  EXPECT_EQ(w.str(), "*4\r\n$3\r\nabc\r\n$-1\r\n:-12345\r\n+OK\r\n");
+  EXPECT_TRUE(w.empty());
+
+  // values cross the chunk boundary
+  std::string expect;
+  std::string small(100, 'x');
+  std::string big(RespWriter::ZERO_COPY_THRESHOLD * 2, 'y');
+  uint64_t n = ReplyChunkPool::CHUNK_SIZE / small.size() * 3;
+  w.appendMultiBulkLen(n + 1);
+  expect.append("*" + std::to_string(n + 1) + "\r\n");
+  for (uint64_t i = 0; i < n; i++) {
+    w.appendBulk(small);
+    expect.append("$100\r\n" + small + "\r\n");
+  }
+  size_t copied = w.bytesCopied();
+  w.appendBulk(std::string(big));
+  expect.append("$" + std::to_string(big.size()) + "\r\n" + big + "\r\n");
+  // the moved-in big value is not copied
+  EXPECT_LT(w.bytesCopied() - copied, size_t(32));
+  EXPECT_GT(w.chunks().size(), size_t(3));
+  EXPECT_EQ(w.size(), expect.size());
+  EXPECT_EQ(w.str(), expect);
+
+  // a single adopted string is moved out without copy
+  RespWriter w2;
+  std::string raw = "+PONG\r\n";
+  w2.appendRaw(std::string(raw));
+  EXPECT_EQ(w2.str(), raw);
+  EXPECT_EQ(w2.bytesCopied(), size_t(0));
+}
+
+// compare the cost of a HGETALL-like reply between the stringstream
+// formatting and RespWriter
+TEST(RespWriter, bytesCopiedBench) {
+  const uint32_t fields = 10000;
+  const uint32_t rounds = 20;
+  std::string value(64, 'v');
+
+  uint64_t ssSize = 0;
+  auto start = nsSinceEpoch();
+  for (uint32_t r = 0; r < rounds; r++) {
+    std::stringstream ss;
+    ss << "*" << fields * 2 << "\r\n";
+    for (uint32_t i = 0; i < fields; i++) {
+      std::string field = "field_" + std::to_string(i);
+      ss << "$" << field.size() << "\r\n" << field << "\r\n";
+      ss << "$" << value.size() << "\r\n" << value << "\r\n";
+    }
+    // ss.str() and copied into the send buffer
+    std::string reply = ss.str();
+    std::vector<char> sendBuf(reply.begin(), reply.end());
+    ssSize += sendBuf.size();
+  }
+  auto ssCost = nsSinceEpoch() - start;
+
+  uint64_t writerCopied = 0;
+  uint64_t size = 0;
+  start = nsSinceEpoch();
+  for (uint32_t r = 0; r < rounds; r++) {
+    RespWriter w;
+    w.appendMultiBulkLen(fields * 2);
+    for (uint32_t i = 0; i < fields; i++) {
+      w.appendBulk("field_" + std::to_string(i));
+      w.appendBulk(value);
+    }
+    // the chunks are handed to the send buffer as they are
+    auto chunks = w.releaseChunks();
+    writerCopied += w.bytesCopied();
+    for (auto& chunk : chunks) {
+      size += chunk.size();
+      ReplyChunkPool::getInstance()->put(std::move(chunk));
+    }
+  }
+  auto writerCost = nsSinceEpoch() - start;
+
+  EXPECT_EQ(size, ssSize);
+  LOG(INFO) << "reply size:" << size / rounds
+            << " stringstream cost:" << ssCost / rounds << "ns"
+            << " RespWriter bytes copied per reply:" << writerCopied / rounds
+            << " cost:" << writerCost / rounds << "ns"
+            << " pool allocated:"
+            << ReplyChunkPool::getInstance()->getAllocated()
+            << " reused:" << ReplyChunkPool::getInstance()->getReused();
+}
+
+
+TEST(TimingWheel, common) {
+  uint64_t now = 1000000;
+  TimingWheel<uint64_t> wheel(10, now);
+  std::mt19937_64 gen(now);
+  std::vector<uint64_t> expires;
+  // due at once, in each level and in the overflow
+  expires.push_back(now - 100);
+  expires.push_back(now);
+  for (uint64_t span : {100ULL, 100000ULL, 10000000ULL, 1000000000ULL}) {
+    for (uint32_t i = 0; i < 200; ++i) {
+      expires.push_back(now + 1 + gen() % span);
+    }
+  }
+  expires.push_back(now + (10ULL << 40));
+  for (auto expire : expires) {
+    wheel.add(expire, expire);
+  }
+  EXPECT_EQ(wheel.size(), expires.size());
+
+  std::list<std::pair<uint64_t, uint64_t>> due;
+  EXPECT_EQ(wheel.advance(now, &due), 2u);
+  std::sort(expires.begin(), expires.end());
+  size_t checked = 2;
+  // an entry is due when the tick of its expire time has passed
+  auto dueAt = [](uint64_t expire) { return (expire + 9) / 10 * 10; };
+  for (size_t step = 0; checked < expires.size(); ++step) {
+    // jump over the empty ticks
+    now = std::max(now + 7, dueAt(expires[checked]) + step % 3);
+    due.clear();
+    wheel.advance(now, &due);
+    uint64_t prev = 0;
+    for (const auto& e : due) {
+      EXPECT_EQ(e.first, e.second);
+      EXPECT_LE(e.first, now);
+      // in the order of ticks
+      EXPECT_LE(dueAt(prev), dueAt(e.first));
+      prev = e.first;
+    }
+    while (checked < expires.size() && dueAt(expires[checked]) <= now) {
+      checked++;
+    }
+    EXPECT_EQ(wheel.size(), expires.size() - checked);
+  }
+  EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimingWheel, limit) {
+  uint64_t now = 1000000;
+  TimingWheel<uint64_t> wheel(10, now);
+  for (uint64_t i = 0; i < 100; ++i) {
+    wheel.add(now + 1 + i, i);
+  }
+  now += 1000;
+  std::list<std::pair<uint64_t, uint64_t>> due;
+  // the entries over the limit are kept, in the order of their ticks
+  uint64_t next = 0;
+  while (wheel.size()) {
+    due.clear();
+    size_t expected = std::min(wheel.size(), size_t(30));
+    EXPECT_EQ(wheel.advance(now, &due, 30), expected);
+    for (const auto& e : due) {
+      EXPECT_EQ(e.second, next++);
+    }
+  }
+  EXPECT_EQ(next, 100u);
+  due.clear();
+  EXPECT_EQ(wheel.advance(now, &due, 30), 0u);
+}
+
+TEST(LatencyHistogram, common) {
+  for (uint32_t b = 0; b < LatencyHistogram::BUCKETS; b++) {
+    EXPECT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::bucketLower(b)), b);
+    EXPECT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::bucketUpper(b)), b);
+    if (b + 1 < LatencyHistogram::BUCKETS) {
+      EXPECT_EQ(LatencyHistogram::bucketUpper(b) + 1,
+                LatencyHistogram::bucketLower(b + 1));
+    }
+  }
+  LatencyHistogram h;
+  EXPECT_EQ(h.percentile(50), 0u);
+  for (uint64_t v = 1; v <= 10000; v++) {
+    h.record(v * 1000);
+  }
+  EXPECT_EQ(h.count(), 10000u);
+  // the upper bound of the bucket, at most 25% bigger
+  for (double p : {50.0, 99.0, 99.9}) {
+    uint64_t real = static_cast<uint64_t>(p * 100) * 1000;
+    EXPECT_GE(h.percentile(p), real);
+    EXPECT_LE(h.percentile(p), real + real / 4);
+  }
+  EXPECT_EQ(h.percentile(100), LatencyHistogram::bucketUpper(
+                                 LatencyHistogram::bucketOf(10000000)));
+  h.reset();
+  EXPECT_EQ(h.count(), 0u);
+}
+
+TEST(LatencyStats, common) {
+  const uint32_t id = LatencyStats::MAX_IDS - 1;
+  LatencyStats::reset();
+  // the histograms of the threads are merged
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < 4; i++) {
+    threads.emplace_back([]() {
+      for (uint32_t j = 0; j < 1000; j++) {
+        LatencyStats::record(id, LatencyStage::TOTAL, 1000);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  LatencyHistogram total;
+  LatencyStats::merge(id, LatencyStage::TOTAL, &total);
+  EXPECT_EQ(total.count(), 4000u);
+
+  // the stage times are counted only while a command is tracked
+  {
+    LatencyStageTimer timer(LatencyStage::LOCK);
+  }
+  LatencyStats::setQueueWait(5000);
+  auto outer = LatencyStats::startCommand();
+  {
+    LatencyStageTimer timer(LatencyStage::LOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  auto inner = LatencyStats::startCommand();
+  LatencyStats::addStageTime(LatencyStage::STORAGE, 3000000);
+  LatencyStats::endCommand(id - 1, 3000000, inner);
+  LatencyStats::endCommand(id, 6000000, outer);
+  EXPECT_FALSE(LatencyStats::isTracking());
+
+  LatencyHistogram lock;
+  LatencyStats::merge(id, LatencyStage::LOCK, &lock);
+  EXPECT_EQ(lock.count(), 1u);
+  EXPECT_GE(lock.percentile(50), 2000000u);
+  LatencyHistogram storage;
+  LatencyStats::merge(id, LatencyStage::STORAGE, &storage);
+  EXPECT_GE(storage.percentile(50), 3000000u);
+  // the queue wait is of the outer command only
+  LatencyHistogram queue;
+  LatencyStats::merge(id, LatencyStage::QUEUE, &queue);
+  EXPECT_EQ(queue.count(), 1u);
+  LatencyHistogram innerQueue;
+  LatencyStats::merge(id - 1, LatencyStage::QUEUE, &innerQueue);
+  EXPECT_EQ(innerQueue.count(), 0u);
+
+  LatencyStats::reset();
+  LatencyHistogram empty;
+  LatencyStats::merge(id, LatencyStage::TOTAL, &empty);
+  EXPECT_EQ(empty.count(), 0u);
+}
 
 }  // namespace tendisplus